@@ -556,6 +556,144 @@ void linebuffer(stream<AxiPackedStencil<T, IN_EXTENT_0, IN_EXTENT_1, IN_EXTENT_2
 }
 
 
+/** Pads a sub-image streamed in from memory to an image size [IMG_EXTENT_0,
+ * IMG_EXTENT_1, IMG_EXTENT_2, IMG_EXTENT_3], implementing repeat_edge and
+ * constant_exterior boundary conditions in the hardware.
+ * Only the region [lo_0, lo_0 + valid_0) x [lo_1, lo_1 + valid_1) of each
+ * plane is read from the input. The rest of the image repeats the nearest
+ * pixel of that region, or is filled with value if CONSTANT is set.
+ * Dimension 2 and 3 are not padded, and the input and output stencils
+ * step one pixel at a time in dimension 0 and 1.
+ */
+template <bool CONSTANT, size_t IMG_EXTENT_0, size_t IMG_EXTENT_1=1, size_t IMG_EXTENT_2=1, size_t IMG_EXTENT_3=1,
+	  size_t EXTENT_2, size_t EXTENT_3, typename T, typename V>
+void border(stream<AxiPackedStencil<T, 1, 1, EXTENT_2, EXTENT_3> > &in_stream,
+	    stream<PackedStencil<T, 1, 1, EXTENT_2, EXTENT_3> > &out_stream,
+	    V value, int lo_0, int valid_0, int lo_1, int valid_1) {
+    static_assert(IMG_EXTENT_3 % EXTENT_3 == 0, "image extent is not divisible by input.");
+    static_assert(IMG_EXTENT_2 % EXTENT_2 == 0, "image extent is not divisible by input.");
+#pragma HLS INLINE off
+    assert(valid_0 > 0 && valid_1 > 0);
+
+    Stencil<T, 1, 1, EXTENT_2, EXTENT_3> fill_stencil;
+    for (size_t idx_3 = 0; idx_3 < EXTENT_3; idx_3++)
+    for (size_t idx_2 = 0; idx_2 < EXTENT_2; idx_2++)
+        fill_stencil(0, 0, idx_2, idx_3) = (T)value;
+    PackedStencil<T, 1, 1, EXTENT_2, EXTENT_3> fill = fill_stencil;
+
+    // the last valid row read in
+    PackedStencil<T, 1, 1, EXTENT_2, EXTENT_3> row[IMG_EXTENT_0];
+
+    for (size_t plane = 0; plane < (IMG_EXTENT_3 / EXTENT_3) * (IMG_EXTENT_2 / EXTENT_2); plane++)
+    for (size_t idx_1 = 0; idx_1 < IMG_EXTENT_1; idx_1++)
+    for (size_t idx_0 = 0; idx_0 < IMG_EXTENT_0; idx_0++) {
+#pragma HLS PIPELINE II=1
+#pragma HLS DEPENDENCE variable=row inter false
+        const int pos_0 = (int)idx_0 - lo_0;
+        const int pos_1 = (int)idx_1 - lo_1;
+        const int col = pos_0 < 0 ? 0 : (pos_0 < valid_0 ? pos_0 : valid_0 - 1);
+
+        // the first pixel, and the pixels after it in the valid region,
+        // are read in; the rest repeat the ones read before
+        const bool read_row = idx_1 == 0 || (pos_1 > 0 && pos_1 < valid_1);
+        const bool read_col = idx_0 == 0 || (pos_0 > 0 && pos_0 < valid_0);
+        if (read_row && read_col) {
+            row[col] = in_stream.read();
+        }
+
+        if (CONSTANT && (pos_0 < 0 || pos_0 >= valid_0 || pos_1 < 0 || pos_1 >= valid_1)) {
+            out_stream.write(fill);
+        } else {
+            out_stream.write(row[col]);
+        }
+    }
+}
+
+
+/** Splits each of num_beats wide beats streamed in from memory into the
+ * stencils it packs. The stencils are adjacent along dimension PACK_DIM
+ * of the beat, whose extent is a multiple of that of the stencil.
+ */
+template <size_t PACK_DIM,
+	  size_t BEAT_EXTENT_0, size_t BEAT_EXTENT_1, size_t BEAT_EXTENT_2, size_t BEAT_EXTENT_3,
+	  size_t EXTENT_0, size_t EXTENT_1, size_t EXTENT_2, size_t EXTENT_3,
+	  typename T>
+void unpack_stream(stream<AxiPackedStencil<T, BEAT_EXTENT_0, BEAT_EXTENT_1, BEAT_EXTENT_2, BEAT_EXTENT_3> > &in_stream,
+		   stream<PackedStencil<T, EXTENT_0, EXTENT_1, EXTENT_2, EXTENT_3> > &out_stream,
+		   size_t num_beats) {
+    const size_t beat_extents[4] = {BEAT_EXTENT_0, BEAT_EXTENT_1, BEAT_EXTENT_2, BEAT_EXTENT_3};
+    const size_t extents[4] = {EXTENT_0, EXTENT_1, EXTENT_2, EXTENT_3};
+    const size_t factor = beat_extents[PACK_DIM] / extents[PACK_DIM];
+    static_assert(PACK_DIM < 4, "invalid packed dimension.");
+#pragma HLS INLINE off
+    assert(factor * extents[PACK_DIM] == beat_extents[PACK_DIM]);
+
+    Stencil<T, BEAT_EXTENT_0, BEAT_EXTENT_1, BEAT_EXTENT_2, BEAT_EXTENT_3> beat;
+#pragma HLS ARRAY_PARTITION variable=beat.value complete dim=0
+    size_t k = 0;
+    for (size_t i = 0; i < num_beats * factor; i++) {
+#pragma HLS PIPELINE II=1
+        if (k == 0) {
+            beat = in_stream.read();
+        }
+        Stencil<T, EXTENT_0, EXTENT_1, EXTENT_2, EXTENT_3> stencil;
+        for (size_t idx_3 = 0; idx_3 < EXTENT_3; idx_3++)
+        for (size_t idx_2 = 0; idx_2 < EXTENT_2; idx_2++)
+        for (size_t idx_1 = 0; idx_1 < EXTENT_1; idx_1++)
+        for (size_t idx_0 = 0; idx_0 < EXTENT_0; idx_0++) {
+            size_t pos[4] = {idx_0, idx_1, idx_2, idx_3};
+            pos[PACK_DIM] += k * extents[PACK_DIM];
+            stencil(idx_0, idx_1, idx_2, idx_3) = beat(pos[0], pos[1], pos[2], pos[3]);
+        }
+        out_stream.write(stencil);
+        k = k == factor - 1 ? 0 : k + 1;
+    }
+}
+
+/** The inverse of unpack_stream: packs the stencils of out_stream into
+ * num_beats wide beats to be streamed out to memory, and asserts TLAST
+ * on the last beat.
+ */
+template <size_t PACK_DIM,
+	  size_t EXTENT_0, size_t EXTENT_1, size_t EXTENT_2, size_t EXTENT_3,
+	  size_t BEAT_EXTENT_0, size_t BEAT_EXTENT_1, size_t BEAT_EXTENT_2, size_t BEAT_EXTENT_3,
+	  typename T>
+void pack_stream(stream<PackedStencil<T, EXTENT_0, EXTENT_1, EXTENT_2, EXTENT_3> > &in_stream,
+		 stream<AxiPackedStencil<T, BEAT_EXTENT_0, BEAT_EXTENT_1, BEAT_EXTENT_2, BEAT_EXTENT_3> > &out_stream,
+		 size_t num_beats) {
+    const size_t beat_extents[4] = {BEAT_EXTENT_0, BEAT_EXTENT_1, BEAT_EXTENT_2, BEAT_EXTENT_3};
+    const size_t extents[4] = {EXTENT_0, EXTENT_1, EXTENT_2, EXTENT_3};
+    const size_t factor = beat_extents[PACK_DIM] / extents[PACK_DIM];
+    static_assert(PACK_DIM < 4, "invalid packed dimension.");
+#pragma HLS INLINE off
+    assert(factor * extents[PACK_DIM] == beat_extents[PACK_DIM]);
+
+    Stencil<T, BEAT_EXTENT_0, BEAT_EXTENT_1, BEAT_EXTENT_2, BEAT_EXTENT_3> beat;
+#pragma HLS ARRAY_PARTITION variable=beat.value complete dim=0
+    size_t k = 0, n = 0;
+    for (size_t i = 0; i < num_beats * factor; i++) {
+#pragma HLS PIPELINE II=1
+        Stencil<T, EXTENT_0, EXTENT_1, EXTENT_2, EXTENT_3> stencil = in_stream.read();
+        for (size_t idx_3 = 0; idx_3 < EXTENT_3; idx_3++)
+        for (size_t idx_2 = 0; idx_2 < EXTENT_2; idx_2++)
+        for (size_t idx_1 = 0; idx_1 < EXTENT_1; idx_1++)
+        for (size_t idx_0 = 0; idx_0 < EXTENT_0; idx_0++) {
+            size_t pos[4] = {idx_0, idx_1, idx_2, idx_3};
+            pos[PACK_DIM] += k * extents[PACK_DIM];
+            beat(pos[0], pos[1], pos[2], pos[3]) = stencil(idx_0, idx_1, idx_2, idx_3);
+        }
+        if (k == factor - 1) {
+            AxiPackedStencil<T, BEAT_EXTENT_0, BEAT_EXTENT_1, BEAT_EXTENT_2, BEAT_EXTENT_3> axi_beat = beat;
+            axi_beat.last = n == num_beats - 1;
+            out_stream.write(axi_beat);
+            k = 0;
+            n++;
+        } else {
+            k++;
+        }
+    }
+}
+
 template <size_t IMG_EXTENT_0, size_t IMG_EXTENT_1=1, size_t IMG_EXTENT_2=1, size_t IMG_EXTENT_3=1,
 	  size_t IN_EXTENT_0, size_t IN_EXTENT_1, size_t IN_EXTENT_2, size_t IN_EXTENT_3,
           size_t OUT_EXTENT_0, size_t OUT_EXTENT_1, size_t OUT_EXTENT_2, size_t OUT_EXTENT_3,
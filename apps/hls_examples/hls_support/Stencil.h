@@ -207,6 +207,8 @@ public:
     }
 };
 
+// hooks for the backpressure-randomized C simulation
+#include "StressTest.h"
 
 #include "HalideRuntime.h"
 
@@ -260,16 +262,19 @@ void subimage_to_stream(const struct halide_buffer_t *buf_noop,
     for(size_t idx_1 = 0; idx_1 < (unsigned)subimage_extent_1; idx_1 += EXTENT_1)
     for(size_t idx_0 = 0; idx_0 < (unsigned)subimage_extent_0; idx_0 += EXTENT_0) {
         Stencil<T, EXTENT_0, EXTENT_1, EXTENT_2, EXTENT_3> stencil;
+        // a stencil (or a beat of several stencils) is read row by row,
+        // which are contiguous if dim 0 is dense
+        const T *origin = (const T *)subimage + idx_0 * stride_0 + idx_1 * stride_1 +
+            idx_2 * stride_2 + idx_3 * stride_3;
         for(size_t st_idx_3 = 0; st_idx_3 < EXTENT_3; st_idx_3++)
         for(size_t st_idx_2 = 0; st_idx_2 < EXTENT_2; st_idx_2++)
-        for(size_t st_idx_1 = 0; st_idx_1 < EXTENT_1; st_idx_1++)
-        for(size_t st_idx_0 = 0; st_idx_0 < EXTENT_0; st_idx_0++) {
-            int offset = (idx_0 + st_idx_0) * stride_0 +
-                (idx_1 + st_idx_1) * stride_1 +
-                (idx_2 + st_idx_2) * stride_2 +
-                (idx_3 + st_idx_3) * stride_3;
-            stencil(st_idx_0, st_idx_1, st_idx_2, st_idx_3) = *((T *)subimage + offset);
+        for(size_t st_idx_1 = 0; st_idx_1 < EXTENT_1; st_idx_1++) {
+            const T *row = origin + st_idx_1 * stride_1 + st_idx_2 * stride_2 + st_idx_3 * stride_3;
+            for(size_t st_idx_0 = 0; st_idx_0 < EXTENT_0; st_idx_0++) {
+                stencil(st_idx_0, st_idx_1, st_idx_2, st_idx_3) = row[st_idx_0 * stride_0];
+            }
         }
+        HLS_STRESS_STARVE();
         stream.write(stencil);
     }
 }
@@ -291,17 +296,18 @@ void stream_to_subimage(const struct halide_buffer_t *buf_noop,
     for(size_t idx_2 = 0; idx_2 < (unsigned)subimage_extent_2; idx_2 += EXTENT_2)
     for(size_t idx_1 = 0; idx_1 < (unsigned)subimage_extent_1; idx_1 += EXTENT_1)
     for(size_t idx_0 = 0; idx_0 < (unsigned)subimage_extent_0; idx_0 += EXTENT_0) {
+        HLS_STRESS_BACKPRESSURE();
         AxiPackedStencil<T, EXTENT_0, EXTENT_1, EXTENT_2, EXTENT_3> axi_stencil = stream.read();
         Stencil<T, EXTENT_0, EXTENT_1, EXTENT_2, EXTENT_3> stencil = axi_stencil;
+        T *origin = (T *)subimage + idx_0 * stride_0 + idx_1 * stride_1 +
+            idx_2 * stride_2 + idx_3 * stride_3;
         for(size_t st_idx_3 = 0; st_idx_3 < EXTENT_3; st_idx_3++)
         for(size_t st_idx_2 = 0; st_idx_2 < EXTENT_2; st_idx_2++)
-        for(size_t st_idx_1 = 0; st_idx_1 < EXTENT_1; st_idx_1++)
-        for(size_t st_idx_0 = 0; st_idx_0 < EXTENT_0; st_idx_0++) {
-            int offset = (idx_0 + st_idx_0) * stride_0 +
-                (idx_1 + st_idx_1) * stride_1 +
-                (idx_2 + st_idx_2) * stride_2 +
-                (idx_3 + st_idx_3) * stride_3;
-            *((T *)subimage + offset) = stencil(st_idx_0, st_idx_1, st_idx_2, st_idx_3);
+        for(size_t st_idx_1 = 0; st_idx_1 < EXTENT_1; st_idx_1++) {
+            T *row = origin + st_idx_1 * stride_1 + st_idx_2 * stride_2 + st_idx_3 * stride_3;
+            for(size_t st_idx_0 = 0; st_idx_0 < EXTENT_0; st_idx_0++) {
+                row[st_idx_0 * stride_0] = stencil(st_idx_0, st_idx_1, st_idx_2, st_idx_3);
+            }
         }
         // check TLAST
         if (idx_3 == subimage_extent_3 - EXTENT_3 &&
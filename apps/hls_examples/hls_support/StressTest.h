@@ -0,0 +1,417 @@
+#ifndef STRESS_TEST_H
+#define STRESS_TEST_H
+
+/** \file
+ * Backpressure-randomized C simulation of the generated accelerators.
+ *
+ * The default C simulation of Vivado HLS runs every DATAFLOW process to
+ * completion, one after another, over unbounded hls::streams. It can
+ * never hang, so FIFOs that are too shallow (or unbalanced fan-outs)
+ * only show up on the board.
+ *
+ * When the testbench is compiled with -DHLS_STRESS_TEST, every dataflow
+ * process marked by the code generator runs in its own thread, every
+ * stream sized by a 'HLS STREAM' pragma blocks when it holds 'depth'
+ * elements, and the DMA helpers in Stencil.h randomly starve the input
+ * streams and stall the output streams. The hardware region is re-run
+ * for several frames. A simulation in which no stream makes progress
+ * for a while is reported as a deadlock, together with the occupancy of
+ * every stream.
+ *
+ * The simulation is controlled by environment variables:
+ *   HLS_STRESS_FRAMES        number of frames per launch (default 8)
+ *   HLS_STRESS_SEED          seed of the random stalls (default 0)
+ *   HLS_STRESS_STARVE        probability of starving an input beat (default 0.1)
+ *   HLS_STRESS_BACKPRESSURE  probability of stalling an output beat (default 0.1)
+ *   HLS_STRESS_MAX_STALL_US  longest random stall in microseconds (default 50)
+ *   HLS_STRESS_AXIS_DEPTH    depth of the AXI streams at the DMA ends (default 16)
+ *   HLS_STRESS_TIMEOUT_MS    time without progress before declaring a deadlock (default 2000)
+ *   HLS_STRESS_MAX_SLOWDOWN  fail if the slowest frame is this many times
+ *                            slower than the fastest one (default: no limit)
+ *
+ * The macros are complete statements and are emitted without a trailing
+ * semicolon. Without HLS_STRESS_TEST they expand to nothing, so the
+ * generated code is unchanged for synthesis and for the default C
+ * simulation.
+ */
+
+#ifndef HLS_STRESS_TEST
+
+#define HLS_DATAFLOW_PROCESS_BEGIN
+#define HLS_DATAFLOW_PROCESS_END
+#define HLS_DATAFLOW_JOIN
+#define HLS_STREAM_DEPTH(stream, depth)
+#define HLS_AXIS_STREAM(stream)
+#define HLS_STRESS_FRAME_BEGIN
+#define HLS_STRESS_FRAME_END
+#define HLS_STRESS_STARVE()
+#define HLS_STRESS_BACKPRESSURE()
+
+#else
+
+#include <hls_stream.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace hls_stress {
+
+typedef std::chrono::steady_clock clock;
+
+struct StreamStats {
+    std::string name;
+    size_t depth;       // 0 means unbounded
+    size_t occupancy;
+    size_t peak;
+    unsigned long full_stalls;
+    unsigned long empty_stalls;
+    bool blocked_on_read, blocked_on_write;
+};
+
+struct Config {
+    int frames;
+    unsigned seed;
+    double starve;
+    double backpressure;
+    int max_stall_us;
+    size_t axis_depth;
+    int timeout_ms;
+    double max_slowdown;
+
+    static double env(const char *name, double def) {
+        const char *v = getenv(name);
+        return v ? atof(v) : def;
+    }
+
+    Config() {
+        frames = std::max(1, (int)env("HLS_STRESS_FRAMES", 8));
+        seed = (unsigned)env("HLS_STRESS_SEED", 0);
+        starve = env("HLS_STRESS_STARVE", 0.1);
+        backpressure = env("HLS_STRESS_BACKPRESSURE", 0.1);
+        max_stall_us = std::max(1, (int)env("HLS_STRESS_MAX_STALL_US", 50));
+        axis_depth = std::max(1, (int)env("HLS_STRESS_AXIS_DEPTH", 16));
+        timeout_ms = std::max(1, (int)env("HLS_STRESS_TIMEOUT_MS", 2000));
+        max_slowdown = env("HLS_STRESS_MAX_SLOWDOWN", 0);
+    }
+};
+
+/** Book-keeping shared by every stream. It is a function-local static so
+ * that this header can be included by several translation units. */
+struct State {
+    Config config;
+    std::mutex lock;
+    std::atomic<unsigned long> progress;  // bumped on every read and write
+    std::vector<StreamStats *> streams;               // live streams
+    std::map<std::string, StreamStats> summary;        // streams that went away
+    std::vector<double> frame_ms;
+    unsigned long next_seed;
+
+    State() : progress(0), next_seed(0) {}
+};
+
+inline State &state() {
+    static State s;
+    return s;
+}
+
+inline const Config &config() {
+    return state().config;
+}
+
+void report_deadlock();
+
+/** Fold the statistics of a stream into a summary keyed by stream name. */
+inline void merge(std::map<std::string, StreamStats> &summary, const StreamStats &stats) {
+    std::map<std::string, StreamStats>::iterator it = summary.find(stats.name);
+    if (it == summary.end()) {
+        summary[stats.name] = stats;
+        return;
+    }
+    StreamStats &s = it->second;
+    s.peak = std::max(s.peak, stats.peak);
+    s.occupancy = stats.occupancy;
+    s.full_stalls += stats.full_stalls;
+    s.empty_stalls += stats.empty_stalls;
+}
+
+/** The seed of the next thread's generator. */
+inline unsigned next_seed() {
+    std::lock_guard<std::mutex> guard(state().lock);
+    return config().seed + (unsigned)(state().next_seed++);
+}
+
+/** Randomly sleep with the given probability. Every thread owns its own
+ * generator, seeded deterministically from HLS_STRESS_SEED. */
+inline void random_stall(double probability) {
+    if (probability <= 0) return;
+    static thread_local std::mt19937 rng(next_seed());
+    std::uniform_real_distribution<double> coin(0.0, 1.0);
+    if (coin(rng) < probability) {
+        std::uniform_int_distribution<int> us(1, config().max_stall_us);
+        std::this_thread::sleep_for(std::chrono::microseconds(us(rng)));
+    }
+}
+
+/** A blocking FIFO with the same interface as hls::stream. Unless a depth
+ * is set, it never blocks on write, which matches the default C
+ * simulation model. */
+template <typename T>
+class bounded_stream {
+    std::deque<T> data;
+    std::mutex mutex;
+    std::condition_variable cond;
+    StreamStats stats;
+
+    // Wait until ready() holds. Gives up the whole simulation if no
+    // stream in the design made progress within the timeout.
+    template <typename Pred>
+    void wait(std::unique_lock<std::mutex> &guard, Pred ready, bool &blocked, unsigned long &stalls) {
+        if (ready()) return;
+        stalls++;
+        blocked = true;
+        const auto timeout = std::chrono::milliseconds(config().timeout_ms);
+        unsigned long last_progress = state().progress;
+        clock::time_point last_change = clock::now();
+        while (!ready()) {
+            cond.wait_for(guard, std::chrono::milliseconds(10));
+            unsigned long p = state().progress;
+            if (p != last_progress) {
+                last_progress = p;
+                last_change = clock::now();
+            } else if (clock::now() - last_change > timeout) {
+                guard.unlock();
+                report_deadlock();
+            }
+        }
+        blocked = false;
+    }
+
+public:
+    bounded_stream() {
+        stats.depth = 0;
+        stats.occupancy = stats.peak = 0;
+        stats.full_stalls = stats.empty_stalls = 0;
+        stats.blocked_on_read = stats.blocked_on_write = false;
+        std::lock_guard<std::mutex> guard(state().lock);
+        stats.name = "stream." + std::to_string(state().streams.size());
+        state().streams.push_back(&stats);
+    }
+
+    bounded_stream(const std::string &name) : bounded_stream() {
+        stats.name = name;
+    }
+
+    ~bounded_stream() {
+        std::lock_guard<std::mutex> guard(state().lock);
+        std::vector<StreamStats *> &s = state().streams;
+        s.erase(std::remove(s.begin(), s.end(), &stats), s.end());
+        merge(state().summary, stats);
+        if (!data.empty()) {
+            printf("WARNING: stream %s contains %zu leftover elements.\n",
+                   stats.name.c_str(), data.size());
+        }
+    }
+
+    void set_depth(size_t depth, const char *name) {
+        std::lock_guard<std::mutex> guard(mutex);
+        stats.depth = depth;
+        stats.name = name;
+    }
+
+    T read() {
+        std::unique_lock<std::mutex> guard(mutex);
+        wait(guard, [this]() { return !data.empty(); },
+             stats.blocked_on_read, stats.empty_stalls);
+        T elem = data.front();
+        data.pop_front();
+        stats.occupancy = data.size();
+        state().progress++;
+        cond.notify_all();
+        return elem;
+    }
+
+    void read(T &head) {
+        head = read();
+    }
+
+    void write(const T &tail) {
+        std::unique_lock<std::mutex> guard(mutex);
+        wait(guard, [this]() { return stats.depth == 0 || data.size() < stats.depth; },
+             stats.blocked_on_write, stats.full_stalls);
+        data.push_back(tail);
+        stats.occupancy = data.size();
+        stats.peak = std::max(stats.peak, stats.occupancy);
+        state().progress++;
+        cond.notify_all();
+    }
+
+    bool read_nb(T &head) {
+        if (empty()) return false;
+        head = read();
+        return true;
+    }
+
+    bool write_nb(const T &tail) {
+        if (full()) return false;
+        write(tail);
+        return true;
+    }
+
+    void operator>>(T &head) { read(head); }
+    void operator<<(const T &tail) { write(tail); }
+
+    bool empty() {
+        std::lock_guard<std::mutex> guard(mutex);
+        return data.empty();
+    }
+
+    bool full() {
+        std::lock_guard<std::mutex> guard(mutex);
+        return stats.depth != 0 && data.size() >= stats.depth;
+    }
+
+    size_t size() {
+        std::lock_guard<std::mutex> guard(mutex);
+        return data.size();
+    }
+
+private:
+    bounded_stream(const bounded_stream &);
+    bounded_stream &operator=(const bounded_stream &);
+};
+
+inline void print_stream(const StreamStats &s) {
+    printf("  %-48s %8zu %8zu %8zu %12lu %12lu%s%s\n",
+           s.name.c_str(), s.depth, s.occupancy, s.peak,
+           s.full_stalls, s.empty_stalls,
+           s.blocked_on_write ? "  <- blocked on write" : "",
+           s.blocked_on_read ? "  <- blocked on read" : "");
+}
+
+inline void print_stream_header() {
+    printf("  %-48s %8s %8s %8s %12s %12s\n",
+           "stream", "depth", "fill", "peak", "full-stalls", "empty-stalls");
+}
+
+inline void report_deadlock() {
+    std::lock_guard<std::mutex> guard(state().lock);
+    printf("HLS stress test: DEADLOCK, no stream made progress for %d ms.\n",
+           config().timeout_ms);
+    print_stream_header();
+    for (const StreamStats *s : state().streams) {
+        print_stream(*s);
+    }
+    fflush(stdout);
+    _Exit(1);
+}
+
+/** Dataflow processes spawned by the current thread. Every process
+ * joins the processes it spawned itself (e.g. those of the kernel
+ * launched by the testbench) before it returns, and the end of a frame
+ * joins the top-level ones, so no process outlives its frame. */
+inline std::vector<std::thread> &children() {
+    static thread_local std::vector<std::thread> c;
+    return c;
+}
+
+inline void spawn(std::function<void()> f) {
+    children().push_back(std::thread(f));
+}
+
+inline void join() {
+    std::vector<std::thread> &c = children();
+    for (std::thread &t : c) {
+        t.join();
+    }
+    c.clear();
+}
+
+inline clock::time_point begin_frame() {
+    return clock::now();
+}
+
+inline void end_frame(clock::time_point start, int frame) {
+    join();
+    double ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+    std::lock_guard<std::mutex> guard(state().lock);
+    std::vector<double> &t = state().frame_ms;
+    t.push_back(ms);
+    if (frame != config().frames - 1) {
+        return;
+    }
+
+    double lo = *std::min_element(t.begin(), t.end());
+    double hi = *std::max_element(t.begin(), t.end());
+    double sum = 0;
+    for (double v : t) sum += v;
+    printf("HLS stress test: %zu frames, frame time min %.3f ms, mean %.3f ms, max %.3f ms "
+           "(slowdown %.2fx)\n", t.size(), lo, sum / t.size(), hi, lo > 0 ? hi / lo : 0.0);
+    std::map<std::string, StreamStats> summary;
+    summary.swap(state().summary);
+    for (const StreamStats *s : state().streams) {
+        merge(summary, *s);
+    }
+    print_stream_header();
+    for (const auto &s : summary) {
+        print_stream(s.second);
+    }
+    if (config().max_slowdown > 0 && lo > 0 && hi / lo > config().max_slowdown) {
+        printf("HLS stress test: FAILED, throughput degraded by %.2fx (limit %.2fx).\n",
+               hi / lo, config().max_slowdown);
+        fflush(stdout);
+        _Exit(1);
+    }
+    t.clear();
+}
+
+}  // namespace hls_stress
+
+// Every stream in the generated code carries (Axi)PackedStencils, so
+// replacing those specializations of hls::stream is enough to make the
+// whole design use bounded, thread-safe FIFOs.
+namespace hls {
+
+template <typename T, size_t EXTENT_0, size_t EXTENT_1, size_t EXTENT_2, size_t EXTENT_3>
+class stream<PackedStencil<T, EXTENT_0, EXTENT_1, EXTENT_2, EXTENT_3> >
+    : public hls_stress::bounded_stream<PackedStencil<T, EXTENT_0, EXTENT_1, EXTENT_2, EXTENT_3> > {
+public:
+    using hls_stress::bounded_stream<PackedStencil<T, EXTENT_0, EXTENT_1, EXTENT_2, EXTENT_3> >::bounded_stream;
+};
+
+template <typename T, size_t EXTENT_0, size_t EXTENT_1, size_t EXTENT_2, size_t EXTENT_3>
+class stream<AxiPackedStencil<T, EXTENT_0, EXTENT_1, EXTENT_2, EXTENT_3> >
+    : public hls_stress::bounded_stream<AxiPackedStencil<T, EXTENT_0, EXTENT_1, EXTENT_2, EXTENT_3> > {
+public:
+    using hls_stress::bounded_stream<AxiPackedStencil<T, EXTENT_0, EXTENT_1, EXTENT_2, EXTENT_3> >::bounded_stream;
+};
+
+}  // namespace hls
+
+#define HLS_DATAFLOW_PROCESS_BEGIN hls_stress::spawn([&]() {
+#define HLS_DATAFLOW_PROCESS_END hls_stress::join(); });
+#define HLS_DATAFLOW_JOIN hls_stress::join();
+#define HLS_STREAM_DEPTH(stream, depth) (stream).set_depth(depth, #stream);
+#define HLS_AXIS_STREAM(stream) (stream).set_depth(hls_stress::config().axis_depth, #stream);
+#define HLS_STRESS_FRAME_BEGIN                                          \
+    for (int hls_stress_frame = 0; hls_stress_frame < hls_stress::config().frames; hls_stress_frame++) { \
+    hls_stress::clock::time_point hls_stress_start = hls_stress::begin_frame();
+#define HLS_STRESS_FRAME_END hls_stress::end_frame(hls_stress_start, hls_stress_frame); }
+#define HLS_STRESS_STARVE() hls_stress::random_stall(hls_stress::config().starve)
+#define HLS_STRESS_BACKPRESSURE() hls_stress::random_stall(hls_stress::config().backpressure)
+
+#endif  // HLS_STRESS_TEST
+
+#endif
@@ -0,0 +1,239 @@
+#include <set>
+
+#include "AsyncProducers.h"
+#include "Debug.h"
+#include "ExprUsesVar.h"
+#include "IRMutator.h"
+#include "IROperator.h"
+#include "IRPrinter.h"
+
+namespace Halide {
+namespace Internal {
+
+using std::map;
+using std::set;
+using std::string;
+
+namespace {
+
+// Check if a statement contains any produce or consume nodes of a func.
+class ContainsPipelineOf : public IRVisitor {
+    const string &func;
+
+    using IRVisitor::visit;
+
+    void visit(const ProducerConsumer *op) {
+        if (op->name == func) {
+            result = true;
+        } else {
+            IRVisitor::visit(op);
+        }
+    }
+
+public:
+    bool result = false;
+    ContainsPipelineOf(const string &f) : func(f) {}
+};
+
+bool contains_pipeline_of(Stmt s, const string &func) {
+    ContainsPipelineOf c(func);
+    s.accept(&c);
+    return c.result;
+}
+
+// Find calls to, or provides of, any of a set of funcs.
+class UsesAnyOf : public IRVisitor {
+    const set<string> &funcs;
+
+    using IRVisitor::visit;
+
+    void visit(const Call *op) {
+        IRVisitor::visit(op);
+        if (funcs.count(op->name)) {
+            result = op->name;
+        }
+    }
+
+    void visit(const Provide *op) {
+        IRVisitor::visit(op);
+        if (funcs.count(op->name)) {
+            result = op->name;
+        }
+    }
+
+public:
+    string result;
+    UsesAnyOf(const set<string> &f) : funcs(f) {}
+};
+
+bool is_semaphore_call(Expr e, const string &fn, const string &sem) {
+    const Call *c = e.as<Call>();
+    if (c && c->name == fn && c->call_type == Call::Extern && !c->args.empty()) {
+        const Variable *v = c->args[0].as<Variable>();
+        return v && v->name == sem;
+    }
+    return false;
+}
+
+// Reduce the realization of an async func to the task that computes
+// it. Each produce node signals the consumer when it's done.
+class GenerateProducerBody : public IRMutator {
+    const string &func;
+
+    using IRMutator::visit;
+
+    void visit(const ProducerConsumer *op) {
+        if (op->name == func) {
+            if (op->is_producer) {
+                stmt = Block::make(op, release_semaphore(func + ".semaphore", 1));
+            } else {
+                stmt = Evaluate::make(0);
+            }
+        } else if (contains_pipeline_of(op->body, func)) {
+            IRMutator::visit(op);
+        } else {
+            // Stages computed outside the consumer of the func are
+            // its inputs, or at least independent of it.
+            stmt = op;
+        }
+    }
+
+    void visit(const Evaluate *op) {
+        // Returning folds to the producer is the consumer's job.
+        if (is_semaphore_call(op->value, "halide_semaphore_release", func + ".folding_semaphore")) {
+            stmt = Evaluate::make(0);
+        } else {
+            stmt = op;
+        }
+    }
+
+public:
+    GenerateProducerBody(const string &f) : func(f) {}
+};
+
+// Reduce the realization of an async func to everything but
+// computing it. The produce nodes become waits on the producer.
+class GenerateConsumerBody : public IRMutator {
+    const string &func;
+
+    using IRMutator::visit;
+
+    void visit(const ProducerConsumer *op) {
+        if (op->name == func) {
+            if (op->is_producer) {
+                stmt = acquire_semaphore(func + ".semaphore", 1);
+            } else {
+                // The consume node and everything it contains only
+                // run in this task.
+                stmt = op;
+            }
+        } else if (contains_pipeline_of(op->body, func)) {
+            IRMutator::visit(op);
+        } else if (op->is_producer) {
+            // Computed by the producer task.
+            skipped.insert(op->name);
+            stmt = Evaluate::make(0);
+        } else {
+            stmt = op;
+        }
+    }
+
+    void visit(const LetStmt *op) {
+        // Taking folds is the producer's job.
+        if (is_semaphore_call(op->value, "halide_semaphore_acquire", func + ".folding_semaphore")) {
+            stmt = Evaluate::make(0);
+        } else {
+            IRMutator::visit(op);
+        }
+    }
+
+public:
+    set<string> skipped;
+    GenerateConsumerBody(const string &f) : func(f) {}
+};
+
+class ForkAsyncProducers : public IRMutator {
+    const map<string, Function> &env;
+
+    using IRMutator::visit;
+
+    void visit(const Realize *op) {
+        // Fork any async funcs realized inside this one first.
+        IRMutator::visit(op);
+
+        auto it = env.find(op->name);
+        if (it == env.end() || !it->second.schedule().async()) {
+            return;
+        }
+        op = stmt.as<Realize>();
+        internal_assert(op);
+        const string &name = op->name;
+
+        Stmt producer = GenerateProducerBody(name).mutate(op->body);
+        GenerateConsumerBody consumer_gen(name);
+        Stmt consumer = consumer_gen.mutate(op->body);
+
+        // The consumer only waits on the async func, so it can't use
+        // anything else the producer task computes.
+        UsesAnyOf uses(consumer_gen.skipped);
+        consumer.accept(&uses);
+        user_assert(uses.result.empty())
+            << "Func " << name << " cannot be scheduled async, because its consumer also uses "
+            << uses.result << ", which is computed alongside " << name
+            << " by the producer task.\n";
+
+        // Each task closes the semaphore the other one waits on when
+        // it exits, so that the other one fails instead of hanging if
+        // it returns an error.
+        string sem_name = name + ".semaphore";
+        string folding_sem_name = name + ".folding_semaphore";
+        Expr sem = Variable::make(Handle(), sem_name);
+        Expr close_sem = Call::make(Int(32), Call::register_destructor,
+                                    {Expr("halide_semaphore_close"), sem}, Call::Intrinsic);
+        producer = Block::make(Evaluate::make(close_sem), producer);
+        if (stmt_uses_var(consumer, folding_sem_name)) {
+            Expr folding_sem = Variable::make(Handle(), folding_sem_name);
+            Expr close_folding_sem = Call::make(Int(32), Call::register_destructor,
+                                                {Expr("halide_semaphore_close"), folding_sem}, Call::Intrinsic);
+            consumer = Block::make(Evaluate::make(close_folding_sem), consumer);
+        }
+
+        string fork_name = name + ".__async_fork";
+        Expr task = Variable::make(Int(32), fork_name);
+        Stmt body = IfThenElse::make(task == 0, producer, consumer);
+        body = For::make(fork_name, 0, 2, ForType::Parallel, DeviceAPI::None, body);
+
+        Expr init = Call::make(Int(32), "halide_semaphore_init", {sem, 0}, Call::Extern);
+        body = Block::make(Evaluate::make(init), body);
+        Expr alloca = Call::make(Handle(), Call::alloca,
+                                 {(int)sizeof(halide_semaphore_t)}, Call::Intrinsic);
+        body = LetStmt::make(sem_name, alloca, body);
+
+        stmt = Realize::make(op->name, op->types, op->bounds, op->condition, body);
+    }
+
+public:
+    ForkAsyncProducers(const map<string, Function> &e) : env(e) {}
+};
+
+}  // namespace
+
+Stmt acquire_semaphore(const string &name, Expr n) {
+    Expr sem = Variable::make(Handle(), name);
+    Expr acquire = Call::make(Int(32), "halide_semaphore_acquire", {sem, n}, Call::Extern);
+    string result_name = unique_name('t');
+    Expr result = Variable::make(Int(32), result_name);
+    return LetStmt::make(result_name, acquire, AssertStmt::make(result == 0, result));
+}
+
+Stmt release_semaphore(const string &name, Expr n) {
+    Expr sem = Variable::make(Handle(), name);
+    return Evaluate::make(Call::make(Int(32), "halide_semaphore_release", {sem, n}, Call::Extern));
+}
+
+Stmt fork_async_producers(Stmt s, const map<string, Function> &env) {
+    return ForkAsyncProducers(env).mutate(s);
+}
+
+}
+}
@@ -0,0 +1,34 @@
+#ifndef HALIDE_ASYNC_PRODUCERS_H
+#define HALIDE_ASYNC_PRODUCERS_H
+
+#include <map>
+
+#include "IR.h"
+
+/** \file
+ * Defines the lowering pass that runs async producers concurrently
+ * with their consumers.
+ */
+
+namespace Halide {
+namespace Internal {
+
+/** Split the realization of each func scheduled async into two tasks
+ * forked off together: one that only computes the func, and one that
+ * runs the rest of the realization, waiting on a semaphore in place
+ * of each produce node of the func. */
+Stmt fork_async_producers(Stmt s, const std::map<std::string, Function> &env);
+
+/** Make a statement that waits until n units of the semaphore with
+ * the given name are available and takes them, failing if the
+ * semaphore gets closed first. */
+Stmt acquire_semaphore(const std::string &name, Expr n);
+
+/** Make a statement that gives n units back to the semaphore with
+ * the given name. */
+Stmt release_semaphore(const std::string &name, Expr n);
+
+}
+}
+
+#endif
@@ -0,0 +1,632 @@
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <set>
+#include <sstream>
+
+#include "AutoSchedule.h"
+#include "Bounds.h"
+#include "FindCalls.h"
+#include "Func.h"
+#include "Function.h"
+#include "IROperator.h"
+#include "IRVisitor.h"
+#include "ParallelRVar.h"
+#include "RealizationOrder.h"
+#include "Simplify.h"
+
+namespace Halide {
+
+std::vector<AutoScheduleParams> AutoScheduleParams::candidates() {
+    std::vector<AutoScheduleParams> result;
+    for (int vector_factor : {1, 2}) {
+        // Every stencil at root, where the tile size doesn't matter.
+        AutoScheduleParams p;
+        p.vector_factor = vector_factor;
+        p.max_recompute = 0;
+        result.push_back(p);
+        for (int tile_width : {32, 64, 128, 256}) {
+            for (int tile_height : {8, 32}) {
+                p = AutoScheduleParams();
+                p.tile_width = tile_width;
+                p.tile_height = tile_height;
+                p.vector_factor = vector_factor;
+                result.push_back(p);
+            }
+        }
+    }
+    return result;
+}
+
+std::string AutoScheduleParams::to_string() const {
+    std::ostringstream s;
+    s << "tile " << tile_width << "x" << tile_height
+      << ", vector factor " << vector_factor
+      << ", max recompute " << max_recompute;
+    return s.str();
+}
+
+namespace Internal {
+
+using std::map;
+using std::ostringstream;
+using std::set;
+using std::string;
+using std::vector;
+
+namespace {
+
+// The fewest iterations worth parallelizing a loop over.
+const int min_parallel_tasks = 4;
+
+// Checks whether all the calls to a function in another are
+// pointwise, i.e. each argument is one of the caller's pure
+// variables, so that inlining it never recomputes anything.
+class IsPointwise : public IRVisitor {
+    const string &func;
+    vector<string> pure_args;
+
+    using IRVisitor::visit;
+
+    void visit(const Call *op) {
+        IRVisitor::visit(op);
+        if (op->call_type == Call::Halide && op->name == func) {
+            for (const Expr &arg : op->args) {
+                const Variable *var = arg.as<Variable>();
+                if (!var || std::find(pure_args.begin(), pure_args.end(), var->name) == pure_args.end()) {
+                    result = false;
+                }
+            }
+        }
+    }
+
+public:
+    bool result = true;
+
+    IsPointwise(const string &func, const vector<string> &pure_args) :
+        func(func), pure_args(pure_args) {}
+};
+
+// The extent of each dimension of a region, or -1 where it isn't a
+// known constant.
+vector<int64_t> region_extents(const Box &box, int dimensions) {
+    vector<int64_t> extents(dimensions, -1);
+    for (int i = 0; i < dimensions && i < (int)box.size(); i++) {
+        if (box[i].is_bounded()) {
+            Expr extent = simplify(box[i].max - box[i].min + 1);
+            if (const int64_t *e = as_const_int(extent)) {
+                extents[i] = *e;
+            }
+        }
+    }
+    return extents;
+}
+
+// Make a name usable as a C++ identifier.
+string identifier(const string &name) {
+    string result = name;
+    for (char &c : result) {
+        if (!isalnum(c) && c != '_') {
+            c = '_';
+        }
+    }
+    if (result.empty() || isdigit(result[0])) {
+        result = "_" + result;
+    }
+    return result;
+}
+
+enum class Placement {
+    Inline,
+    Root,
+    ComputeAt
+};
+
+struct Choice {
+    Placement placement = Placement::Root;
+    // The function a ComputeAt function is computed at the tiles of.
+    string consumer;
+    // Whether the pure stage of the function is tiled, for the
+    // functions computed at it.
+    bool tiled = false;
+    vector<int64_t> extents;
+    int vector_size = 1;
+};
+
+// Applies the scheduling directives chosen for one stage of a
+// function, and writes them out as C++.
+template<typename StageType>
+class StageWriter {
+    StageType stage;
+    ostringstream calls;
+
+public:
+    set<string> vars;
+
+    StageWriter(StageType s) : stage(s) {}
+
+    void tile(const string &x, const string &y, int width, int height) {
+        stage.tile(Var(x), Var(y), Var(x + "_o"), Var(y + "_o"), Var(x + "_i"), Var(y + "_i"), width, height);
+        calls << "\n        .tile(" << identifier(x) << ", " << identifier(y) << ", "
+              << identifier(x + "_o") << ", " << identifier(y + "_o") << ", "
+              << identifier(x + "_i") << ", " << identifier(y + "_i") << ", "
+              << width << ", " << height << ")";
+        vars.insert({x, y, x + "_o", y + "_o", x + "_i", y + "_i"});
+    }
+
+    void vectorize(const string &x, int factor) {
+        stage.vectorize(Var(x), factor);
+        calls << "\n        .vectorize(" << identifier(x) << ", " << factor << ")";
+        vars.insert(x);
+    }
+
+    void parallel(const string &x) {
+        stage.parallel(Var(x));
+        calls << "\n        .parallel(" << identifier(x) << ")";
+        vars.insert(x);
+    }
+
+    void compute_root() {
+        stage.compute_root();
+        calls << "\n        .compute_root()";
+    }
+
+    void compute_at(const Function &consumer, const string &x) {
+        stage.compute_at(Func(consumer), Var(x));
+        calls << "\n        .compute_at(" << identifier(consumer.name()) << ", " << identifier(x) << ")";
+        vars.insert(x);
+    }
+
+    string str() const {
+        return calls.str();
+    }
+};
+
+// Undoes the loop structure chosen for a stage: drops its splits, and
+// restores the default loop order of its definition, innermost first:
+// the reduction variables, then the pure variables, then the dummy
+// outermost loop.
+void reset_stage_schedule(const string &func, const vector<string> &pure_args, Definition def) {
+    StageSchedule &s = def.schedule();
+    s.splits().clear();
+    s.dims().clear();
+    for (const ReductionVariable &rv : s.rvars()) {
+        Dim::Type type = can_parallelize_rvar(rv.var, func, def) ? Dim::Type::PureRVar : Dim::Type::ImpureRVar;
+        s.dims().push_back({rv.var, ForType::Serial, DeviceAPI::None, type});
+    }
+    for (size_t i = 0; i < pure_args.size(); i++) {
+        const Variable *var = def.args()[i].as<Variable>();
+        if (var && !var->param.defined() && !var->reduction_domain.defined() &&
+            var->name == pure_args[i]) {
+            s.dims().push_back({var->name, ForType::Serial, DeviceAPI::None, Dim::Type::PureVar});
+        }
+    }
+    s.dims().push_back({Var::outermost().name(), ForType::Serial, DeviceAPI::None, Dim::Type::PureVar});
+}
+
+// Undoes the schedule a previous call to generate_schedules (or the
+// user) applied to a function, so that the new one starts from the
+// default: inlined, synchronous, stored in the order of its
+// arguments, with no splits, prefetches or races allowed. Anything
+// this can't undo is rejected by check_schedule_replaceable first.
+void reset_schedule(Function f) {
+    f.schedule().compute_level() = LoopLevel::inlined();
+    f.schedule().store_level() = LoopLevel::inlined();
+    f.schedule().async() = false;
+    f.schedule().storage_dims().clear();
+    for (const string &arg : f.args()) {
+        f.schedule().storage_dims().push_back({arg});
+    }
+    vector<Definition> stages = {f.definition()};
+    for (size_t i = 0; i < f.updates().size(); i++) {
+        stages.push_back(f.update(i));
+    }
+    for (Definition &def : stages) {
+        reset_stage_schedule(f.name(), f.args(), def);
+        def.schedule().prefetches().clear();
+        def.schedule().allow_race_conditions() = false;
+        def.schedule().touched() = false;
+    }
+}
+
+// Bounds, memoization, specializations, wrappers and acceleration
+// change what a function computes or how it is called, not just its
+// loop nest, so there is no default to reset them to. Refuse to
+// schedule a pipeline that uses them rather than silently keep them
+// under a schedule that didn't account for them.
+void check_schedule_replaceable(const Function &f) {
+    const FuncSchedule &s = f.schedule();
+    const char *used = nullptr;
+    if (!s.bounds().empty()) {
+        used = "bound or align_bounds";
+    } else if (s.memoized()) {
+        used = "memoize";
+    } else if (!s.wrappers().empty()) {
+        used = "in";
+    } else if (s.is_hw_kernel() || s.is_accelerated() || s.is_linebuffered()) {
+        used = "accelerate or linebuffer";
+    } else {
+        bool specialized = !f.definition().specializations().empty();
+        for (size_t i = 0; i < f.updates().size(); i++) {
+            specialized = specialized || !f.update(i).specializations().empty();
+        }
+        if (specialized) {
+            used = "specialize";
+        }
+    }
+    user_assert(!used)
+        << "auto_schedule can't replace the schedule of " << f.name()
+        << ", which uses " << used << ". Remove it from the schedule, "
+        << "or schedule the pipeline by hand.\n";
+}
+
+}  // namespace
+
+map<string, Box> required_regions(const vector<Function> &outputs,
+                                  const vector<vector<int>> &output_sizes,
+                                  const map<string, Function> &env,
+                                  const vector<string> &order) {
+    map<string, Box> regions;
+    for (size_t i = 0; i < outputs.size(); i++) {
+        Box box;
+        for (int size : output_sizes[i]) {
+            box.push_back(Interval(0, size - 1));
+        }
+        regions[outputs[i].name()] = box;
+    }
+
+    for (auto it = order.rbegin(); it != order.rend(); it++) {
+        const Function &f = env.at(*it);
+        auto region = regions.find(f.name());
+        if (region == regions.end() || f.has_extern_definition()) {
+            continue;
+        }
+
+        Scope<Interval> scope;
+        const vector<string> args = f.args();
+        for (size_t i = 0; i < args.size() && i < region->second.size(); i++) {
+            scope.push(args[i], region->second[i]);
+        }
+
+        vector<Definition> definitions = {f.definition()};
+        definitions.insert(definitions.end(), f.updates().begin(), f.updates().end());
+        for (const Definition &def : definitions) {
+            for (const ReductionVariable &rv : def.schedule().rvars()) {
+                scope.push(rv.var, Interval(rv.min, simplify(rv.min + rv.extent - 1)));
+            }
+            vector<Expr> exprs = def.args();
+            exprs.insert(exprs.end(), def.values().begin(), def.values().end());
+            for (const Expr &e : exprs) {
+                for (const auto &b : boxes_required(e, scope)) {
+                    if (b.first == f.name() || !env.count(b.first)) {
+                        continue;
+                    }
+                    auto existing = regions.find(b.first);
+                    if (existing == regions.end()) {
+                        regions[b.first] = b.second;
+                    } else {
+                        merge_boxes(existing->second, b.second);
+                    }
+                }
+            }
+            for (const ReductionVariable &rv : def.schedule().rvars()) {
+                scope.pop(rv.var);
+            }
+        }
+    }
+    return regions;
+}
+
+string generate_schedules(const vector<Function> &outputs,
+                          const vector<vector<int>> &output_sizes,
+                          const Target &target,
+                          const AutoScheduleParams &params) {
+    user_assert(outputs.size() == output_sizes.size())
+        << "auto_schedule needs a size estimate for each of the " << outputs.size() << " outputs\n";
+    user_assert(params.tile_width > 0 && params.tile_height > 0 && params.vector_factor > 0)
+        << "auto_schedule needs positive tile sizes and vector factor, not " << params.to_string() << "\n";
+    for (size_t i = 0; i < outputs.size(); i++) {
+        user_assert((int)output_sizes[i].size() == outputs[i].dimensions())
+            << "The size estimate for output " << outputs[i].name() << " has "
+            << output_sizes[i].size() << " dimensions instead of " << outputs[i].dimensions() << "\n";
+    }
+
+    const int tile_width = params.tile_width, tile_height = params.tile_height;
+    const double max_recompute = params.max_recompute;
+
+    map<string, Function> env;
+    for (const Function &f : outputs) {
+        map<string, Function> calls = find_transitive_calls(f);
+        env.insert(calls.begin(), calls.end());
+    }
+    for (const auto &it : env) {
+        if (!it.second.has_extern_definition()) {
+            check_schedule_replaceable(it.second);
+        }
+    }
+    vector<string> order = realization_order(outputs, env);
+    map<string, Box> regions = required_regions(outputs, output_sizes, env, order);
+
+    map<string, vector<string>> callers;
+    for (const auto &p : env) {
+        for (const auto &callee : find_direct_calls(p.second)) {
+            if (callee.first != p.first) {
+                callers[callee.first].push_back(p.first);
+            }
+        }
+    }
+
+    set<string> output_names;
+    for (const Function &f : outputs) {
+        output_names.insert(f.name());
+    }
+
+    // Decide where to compute each function, consumers first.
+    map<string, Choice> choices;
+    std::function<vector<string>(const string &)> consumers_of = [&](const string &name) {
+        vector<string> result;
+        for (const string &caller : callers[name]) {
+            vector<string> consumers = {caller};
+            if (choices[caller].placement == Placement::Inline) {
+                consumers = consumers_of(caller);
+            }
+            for (const string &c : consumers) {
+                if (std::find(result.begin(), result.end(), c) == result.end()) {
+                    result.push_back(c);
+                }
+            }
+        }
+        return result;
+    };
+
+    for (auto it = order.rbegin(); it != order.rend(); it++) {
+        const Function &f = env.at(*it);
+        Choice &choice = choices[f.name()];
+        choice.extents = region_extents(regions[f.name()], f.dimensions());
+        choice.vector_size = target.natural_vector_size(f.output_types()[0]) * params.vector_factor;
+
+        if (output_names.count(f.name()) || f.has_extern_definition()) {
+            continue;
+        }
+
+        // Functions that are just a load from an input at their own
+        // coordinates, like the Func of an ImageParam, are always
+        // inlined.
+        bool pointwise = f.can_be_inlined();
+        if (pointwise && !f.has_update_definition() && f.values().size() == 1) {
+            const Call *load = f.values()[0].as<Call>();
+            bool plain_load = load && load->call_type == Call::Image &&
+                              load->args.size() == f.args().size();
+            for (size_t i = 0; plain_load && i < load->args.size(); i++) {
+                const Variable *var = load->args[i].as<Variable>();
+                plain_load = var && var->name == f.args()[i];
+            }
+            if (plain_load) {
+                choice.placement = Placement::Inline;
+                continue;
+            }
+        }
+        for (const string &caller : callers[f.name()]) {
+            IsPointwise check(f.name(), env.at(caller).args());
+            env.at(caller).accept(&check);
+            pointwise = pointwise && check.result;
+        }
+        if (pointwise) {
+            choice.placement = Placement::Inline;
+            continue;
+        }
+
+        vector<string> consumers = consumers_of(f.name());
+        if (consumers.size() == 1) {
+            const Function &g = env.at(consumers[0]);
+            Choice &consumer_choice = choices[g.name()];
+            const vector<int64_t> &g_extents = consumer_choice.extents;
+            if (consumer_choice.placement == Placement::Root &&
+                !g.has_update_definition() && !g.has_extern_definition() &&
+                g.dimensions() >= 2 && f.dimensions() == g.dimensions() &&
+                g_extents[0] >= tile_width && g_extents[1] >= tile_height &&
+                choice.extents[0] >= 0 && choice.extents[1] >= 0) {
+                // Assume the dimensions of the stencil line up with
+                // those of its consumer, and that each tile needs the
+                // same halo the whole consumer does.
+                double halo_x = std::max<int64_t>(0, choice.extents[0] - g_extents[0]);
+                double halo_y = std::max<int64_t>(0, choice.extents[1] - g_extents[1]);
+                double recompute = ((tile_width + halo_x) * (tile_height + halo_y)) / (tile_width * tile_height);
+                if (recompute <= max_recompute) {
+                    choice.placement = Placement::ComputeAt;
+                    choice.consumer = g.name();
+                    consumer_choice.tiled = true;
+                    continue;
+                }
+            }
+        }
+        choice.placement = Placement::Root;
+    }
+
+    // Apply the schedules, and write them out.
+    ostringstream source;
+    source << "// Schedule chosen by auto_schedule for " << target.to_string()
+           << ", with " << params.to_string() << " and estimated output sizes:\n";
+    for (size_t i = 0; i < outputs.size(); i++) {
+        source << "//   " << outputs[i].name() << ":";
+        for (size_t j = 0; j < output_sizes[i].size(); j++) {
+            source << (j == 0 ? " " : " x ") << output_sizes[i][j];
+        }
+        source << "\n";
+    }
+
+    for (auto it = order.rbegin(); it != order.rend(); it++) {
+        Function f = env.at(*it);
+        const Choice &choice = choices[f.name()];
+        if (f.has_extern_definition()) {
+            continue;
+        }
+        reset_schedule(f);
+        if (choice.placement == Placement::Inline) {
+            continue;
+        }
+
+        Func func(f);
+        StageWriter<Func &> pure(func);
+        if (f.dimensions() == 0) {
+            if (!output_names.count(f.name())) {
+                pure.compute_root();
+                source << identifier(f.name()) << pure.str() << ";\n";
+            }
+            continue;
+        }
+
+        const vector<string> args = f.args();
+        const vector<int64_t> &extents = choice.extents;
+        const int vector_size = choice.vector_size;
+        const string &x = args[0];
+        const string &outermost = args.back();
+
+        if (choice.placement == Placement::ComputeAt) {
+            const Function &consumer = env.at(choice.consumer);
+            pure.compute_at(consumer, consumer.args()[0] + "_o");
+            pure.vectorize(x, vector_size);
+        } else {
+            if (!output_names.count(f.name())) {
+                pure.compute_root();
+            }
+            if (choice.tiled) {
+                const string &y = args[1];
+                pure.tile(x, y, tile_width, tile_height);
+                if (tile_width >= vector_size) {
+                    pure.vectorize(x + "_i", vector_size);
+                }
+                if (args.size() > 2) {
+                    pure.parallel(outermost);
+                } else if (extents[1] >= min_parallel_tasks * tile_height) {
+                    pure.parallel(y + "_o");
+                }
+            } else {
+                if (extents[0] < 0 || extents[0] >= vector_size) {
+                    pure.vectorize(x, vector_size);
+                }
+                if (args.size() > 1 &&
+                    (extents.back() < 0 || extents.back() >= min_parallel_tasks)) {
+                    pure.parallel(outermost);
+                }
+            }
+        }
+
+        // Only pure variables of update definitions can be safely
+        // vectorized or parallelized.
+        vector<string> update_calls;
+        set<string> vars = pure.vars;
+        for (size_t i = 0; i < f.updates().size(); i++) {
+            const vector<Expr> &update_args = f.update(i).args();
+            auto is_pure = [&](size_t j) {
+                const Variable *var = update_args[j].as<Variable>();
+                return var && var->name == args[j];
+            };
+            StageWriter<Stage> update(func.update(i));
+            if (is_pure(0) && (extents[0] < 0 || extents[0] >= vector_size)) {
+                update.vectorize(x, vector_size);
+            }
+            if (choice.placement == Placement::Root && args.size() > 1 && is_pure(args.size() - 1) &&
+                (extents.back() < 0 || extents.back() >= min_parallel_tasks)) {
+                update.parallel(outermost);
+            }
+            if (!update.str().empty()) {
+                update_calls.push_back(identifier(f.name()) + ".update(" + std::to_string(i) + ")" + update.str() + ";\n");
+                vars.insert(update.vars.begin(), update.vars.end());
+            }
+        }
+
+        if (pure.str().empty() && update_calls.empty()) {
+            continue;
+        }
+        source << "{\n";
+        if (!vars.empty()) {
+            source << "    Var ";
+            bool first = true;
+            for (const string &v : vars) {
+                source << (first ? "" : ", ") << identifier(v) << "(\"" << v << "\")";
+                first = false;
+            }
+            source << ";\n";
+        }
+        if (!pure.str().empty()) {
+            source << "    " << identifier(f.name()) << pure.str() << ";\n";
+        }
+        for (const string &s : update_calls) {
+            source << "    " << s;
+        }
+        source << "}\n";
+    }
+
+    return source.str();
+}
+
+string tuning_target_key(const Target &target) {
+    return target
+        .without_feature(Target::JIT)
+        .without_feature(Target::UserContext)
+        .without_feature(Target::NoRuntime)
+        .without_feature(Target::Matlab)
+        .without_feature(Target::CPlusPlusMangling)
+        .to_string();
+}
+
+vector<TunedSchedule> pareto_front(const vector<TunedSchedule> &schedules) {
+    vector<TunedSchedule> sorted = schedules;
+    std::stable_sort(sorted.begin(), sorted.end(), [](const TunedSchedule &a, const TunedSchedule &b) {
+        return a.time_ms < b.time_ms || (a.time_ms == b.time_ms && a.peak_memory < b.peak_memory);
+    });
+    // Each schedule after the fastest is only worth keeping if it uses
+    // less memory than every faster one.
+    vector<TunedSchedule> front;
+    for (const TunedSchedule &s : sorted) {
+        if (front.empty() || s.peak_memory < front.back().peak_memory) {
+            front.push_back(s);
+        }
+    }
+    return front;
+}
+
+map<string, vector<TunedSchedule>> load_tuned_schedules(const string &filename) {
+    map<string, vector<TunedSchedule>> result;
+    std::ifstream f(filename);
+    if (!f.is_open()) {
+        return result;
+    }
+    string line;
+    int line_number = 0;
+    while (std::getline(f, line)) {
+        line_number++;
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::istringstream in(line);
+        string key;
+        TunedSchedule s;
+        in >> key >> s.params.tile_width >> s.params.tile_height >> s.params.vector_factor
+           >> s.params.max_recompute >> s.time_ms >> s.peak_memory;
+        user_assert(!in.fail())
+            << filename << ":" << line_number << ": Can't parse tuned schedule \"" << line << "\"\n";
+        result[key].push_back(s);
+    }
+    return result;
+}
+
+void save_tuned_schedules(const string &filename,
+                          const map<string, vector<TunedSchedule>> &schedules) {
+    std::ofstream f(filename);
+    user_assert(f.is_open()) << "Can't open " << filename << " to write tuned schedules\n";
+    f << "# Schedules found by Pipeline::tune_schedule, fastest first for each target.\n"
+      << "# target tile_width tile_height vector_factor max_recompute time_ms peak_memory\n";
+    for (const auto &p : schedules) {
+        for (const TunedSchedule &s : p.second) {
+            f << p.first << " "
+              << s.params.tile_width << " " << s.params.tile_height << " "
+              << s.params.vector_factor << " " << s.params.max_recompute << " "
+              << s.time_ms << " " << s.peak_memory << "\n";
+        }
+    }
+}
+
+}  // namespace Internal
+}  // namespace Halide
@@ -0,0 +1,111 @@
+#ifndef HALIDE_INTERNAL_AUTO_SCHEDULE_H
+#define HALIDE_INTERNAL_AUTO_SCHEDULE_H
+
+/** \file
+ *
+ * Defines a simple automatic scheduler for CPU pipelines.
+ */
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Bounds.h"
+#include "Target.h"
+
+namespace Halide {
+
+/** The knobs of the automatic scheduler. The defaults are reasonable
+ * for most CPU pipelines; Pipeline::tune_schedule searches over
+ * other values by benchmarking. */
+struct AutoScheduleParams {
+    /** The size of the tiles of consumers that have stencils computed
+     * per tile. */
+    int tile_width = 64, tile_height = 32;
+
+    /** Functions are vectorized by this many times the natural vector
+     * size of their type on the target. */
+    int vector_factor = 1;
+
+    /** A stencil is computed at root rather than per tile of its
+     * consumer if that would compute more than this many times as
+     * many points. Set it below 1 to compute every stencil at root. */
+    double max_recompute = 1.5;
+
+    /** A set of parameters worth trying for most pipelines: a few
+     * tile shapes, vector factors, and whether stencils are computed
+     * per tile at all. */
+    EXPORT static std::vector<AutoScheduleParams> candidates();
+
+    /** A short description of the parameters, e.g. "tile 64x32,
+     * vector factor 1, max recompute 1.5". */
+    EXPORT std::string to_string() const;
+};
+
+namespace Internal {
+
+class Function;
+
+/** Choose a schedule for each of the functions the outputs depend
+ * on, given an estimate of the size of each output (one extent per
+ * dimension), and apply it. Functions that are only ever called
+ * pointwise are inlined, stencils whose consumers are tiled are
+ * computed at those tiles when that doesn't recompute too much, and
+ * everything else is computed at root. Functions computed at root are
+ * vectorized across their innermost dimension and parallelized across
+ * their outermost. The loop nest, storage order, compute and store
+ * levels, prefetches and async the functions already had are
+ * replaced. Functions with bounds, memoization, specializations,
+ * wrappers or acceleration are rejected with a user error, since
+ * their schedule can't be reset without changing what they compute.
+ * Returns the schedule as C++ source, written in terms of the names
+ * of the functions and their variables, so it can be checked in. */
+std::string generate_schedules(const std::vector<Function> &outputs,
+                               const std::vector<std::vector<int>> &output_sizes,
+                               const Target &target,
+                               const AutoScheduleParams &params = AutoScheduleParams());
+
+/** Compute the region of each function required to compute the
+ * outputs over the given sizes, working from the outputs back through
+ * their producers in realization order as bounds inference does, but
+ * independently of the schedule. */
+std::map<std::string, Box> required_regions(const std::vector<Function> &outputs,
+                                            const std::vector<std::vector<int>> &output_sizes,
+                                            const std::map<std::string, Function> &env,
+                                            const std::vector<std::string> &order);
+
+/** A schedule measured by Pipeline::tune_schedule. */
+struct TunedSchedule {
+    AutoScheduleParams params;
+    /** The best time of the pipeline over the samples, in
+     * milliseconds. */
+    double time_ms;
+    /** The most heap memory the pipeline had allocated at once, in
+     * bytes. */
+    int64_t peak_memory;
+};
+
+/** The target a tuned schedule is recorded under: the target without
+ * the features that don't affect what code the pipeline runs, such as
+ * JIT, so that schedules tuned with the JIT can be found by Generators
+ * compiling ahead of time for the same machine. */
+std::string tuning_target_key(const Target &target);
+
+/** Keep the schedules that are on the Pareto front of time and peak
+ * memory, i.e. those for which no other schedule is both at least as
+ * fast and uses at most as much memory, sorted fastest first. */
+std::vector<TunedSchedule> pareto_front(const std::vector<TunedSchedule> &schedules);
+
+/** Read and write files of tuned schedules. Each line records one
+ * schedule as the target key it was tuned for, the parameters, the
+ * time and the peak memory; lines starting with # are comments. */
+// @{
+std::map<std::string, std::vector<TunedSchedule>> load_tuned_schedules(const std::string &filename);
+void save_tuned_schedules(const std::string &filename,
+                          const std::map<std::string, std::vector<TunedSchedule>> &schedules);
+// @}
+
+}
+}
+
+#endif
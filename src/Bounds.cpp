@@ -1,4 +1,6 @@
 #include <iostream>
+#include <list>
+#include <mutex>
 
 #include "Bounds.h"
 #include "IRVisitor.h"
@@ -1478,27 +1480,152 @@ Interval compute_pure_function_definition_value_bounds(
     return result;
 }
 
+namespace {
+
+// The value bounds of a pure function depend only on its definition,
+// the value bounds of the functions it calls, and the ranges of the
+// parameters it uses, and not on any schedule. They're cached across
+// calls to compute_function_value_bounds, so that lowering a pipeline
+// again after only its schedule has changed doesn't compute them
+// again. This only saves the simplification of the bounds: the
+// definitions are still walked and compared each time, and the rest
+// of lowering is redone in full.
+struct CachedValueBounds {
+    string name;
+    vector<string> args;
+    vector<Expr> values;
+    map<pair<string, int>, Interval> callee_bounds;
+    // The min and max of each parameter used, either of which may be
+    // undefined.
+    map<string, pair<Expr, Expr>> param_ranges;
+    vector<Interval> result;
+};
+
+// How many function definitions to keep the bounds of, across all
+// pipelines. The most recently used are kept.
+const size_t value_bounds_cache_size = 256;
+
+std::mutex value_bounds_cache_mutex;
+std::list<CachedValueBounds> value_bounds_cache;
+
+// The values of a definition and of all its specializations.
+void gather_values(const Definition &def, vector<Expr> &values) {
+    values.insert(values.end(), def.values().begin(), def.values().end());
+    for (const Specialization &s : def.specializations()) {
+        gather_values(s.definition, values);
+    }
+}
+
+// Find the functions and parameters the bounds of some values depend on.
+class ValueBoundsDependencies : public IRGraphVisitor {
+    const FuncValueBounds &fb;
+
+    using IRGraphVisitor::visit;
+
+    void visit(const Call *op) {
+        IRGraphVisitor::visit(op);
+        if (op->call_type == Call::Halide) {
+            pair<string, int> key = {op->name, op->value_index};
+            auto it = fb.find(key);
+            // Functions without value bounds are unbounded.
+            callee_bounds[key] = it == fb.end() ? Interval::everything() : it->second;
+        }
+    }
+
+    void visit(const Variable *op) {
+        if (op->param.defined() && !op->param.is_buffer()) {
+            param_ranges[op->name] = {op->param.get_min_value(), op->param.get_max_value()};
+        }
+    }
+
+public:
+    map<pair<string, int>, Interval> callee_bounds;
+    map<string, pair<Expr, Expr>> param_ranges;
+
+    ValueBoundsDependencies(const FuncValueBounds &fb) : fb(fb) {}
+};
+
+bool same_range(const Interval &a, const Interval &b) {
+    return equal(a.min, b.min) && equal(a.max, b.max);
+}
+
+bool same_range(const pair<Expr, Expr> &a, const pair<Expr, Expr> &b) {
+    return equal(a.first, b.first) && equal(a.second, b.second);
+}
+
+template<typename K, typename V>
+bool same_ranges(const map<K, V> &a, const map<K, V> &b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (auto i = a.begin(), j = b.begin(); i != a.end(); i++, j++) {
+        if (i->first != j->first || !same_range(i->second, j->second)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool matches(const CachedValueBounds &entry, const CachedValueBounds &key) {
+    if (entry.name != key.name || entry.args != key.args ||
+        entry.values.size() != key.values.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < entry.values.size(); i++) {
+        if (!equal(entry.values[i], key.values[i])) {
+            return false;
+        }
+    }
+    return (same_ranges(entry.callee_bounds, key.callee_bounds) &&
+            same_ranges(entry.param_ranges, key.param_ranges));
+}
+
+}  // namespace
+
 FuncValueBounds compute_function_value_bounds(const vector<string> &order,
                                               const map<string, Function> &env) {
     FuncValueBounds fb;
 
     for (size_t i = 0; i < order.size(); i++) {
         Function f = env.find(order[i])->second;
+        if (!f.is_pure()) {
+            continue;
+        }
         const vector<string> f_args = f.args();
-        for (int j = 0; j < f.outputs(); j++) {
-            pair<string, int> key = { f.name(), j };
 
-            Interval result;
-
-            if (f.is_pure()) {
-
-                // Make a scope that says the args could be anything.
-                Scope<Interval> arg_scope;
-                for (size_t k = 0; k < f.args().size(); k++) {
-                    arg_scope.push(f_args[k], Interval::everything());
+        CachedValueBounds key;
+        key.name = f.name();
+        key.args = f_args;
+        gather_values(f.definition(), key.values);
+        ValueBoundsDependencies deps(fb);
+        for (const Expr &e : key.values) {
+            e.accept(&deps);
+        }
+        key.callee_bounds = std::move(deps.callee_bounds);
+        key.param_ranges = std::move(deps.param_ranges);
+
+        bool cached = false;
+        {
+            std::lock_guard<std::mutex> lock(value_bounds_cache_mutex);
+            for (auto it = value_bounds_cache.begin(); it != value_bounds_cache.end(); it++) {
+                if (matches(*it, key)) {
+                    key.result = it->result;
+                    value_bounds_cache.splice(value_bounds_cache.begin(), value_bounds_cache, it);
+                    cached = true;
+                    break;
                 }
+            }
+        }
+
+        if (!cached) {
+            // Make a scope that says the args could be anything.
+            Scope<Interval> arg_scope;
+            for (size_t k = 0; k < f.args().size(); k++) {
+                arg_scope.push(f_args[k], Interval::everything());
+            }
 
-                result = compute_pure_function_definition_value_bounds(f.definition(), arg_scope, fb, j);
+            for (int j = 0; j < f.outputs(); j++) {
+                Interval result = compute_pure_function_definition_value_bounds(f.definition(), arg_scope, fb, j);
                 // These can expand combinatorially as we go down the
                 // pipeline if we don't run CSE on them.
                 if (result.has_lower_bound()) {
@@ -1508,13 +1635,22 @@ FuncValueBounds compute_function_value_bounds(const vector<string> &order,
                 if (result.has_upper_bound()) {
                     result.max = simplify(common_subexpression_elimination(result.max));
                 }
+                key.result.push_back(result);
+            }
 
-                fb[key] = result;
+            std::lock_guard<std::mutex> lock(value_bounds_cache_mutex);
+            value_bounds_cache.push_front(key);
+            if (value_bounds_cache.size() > value_bounds_cache_size) {
+                value_bounds_cache.pop_back();
             }
+        }
 
+        for (int j = 0; j < f.outputs(); j++) {
+            fb[{ f.name(), j }] = key.result[j];
             debug(2) << "Bounds on value " << j
                      << " for func " << order[i]
-                     << " are: " << result.min << ", " << result.max << "\n";
+                     << " are: " << key.result[j].min << ", " << key.result[j].max
+                     << (cached ? " (cached)" : "") << "\n";
         }
     }
 
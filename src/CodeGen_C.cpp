@@ -2367,7 +2367,12 @@ void CodeGen_C::visit(const ProducerConsumer *op) {
 }
 
 void CodeGen_C::visit(const For *op) {
-    if (op->for_type == ForType::Parallel) {
+    if (op->for_type == ForType::Parallel && ends_with(op->name, ".__async_fork")) {
+        // The producer and consumer tasks of an async fork wait on
+        // each other, so each needs a thread of its own.
+        do_indent();
+        stream << "#pragma omp parallel for num_threads(" << print_expr(op->extent) << ")\n";
+    } else if (op->for_type == ForType::Parallel) {
         do_indent();
         stream << "#pragma omp parallel for\n";
     } else {
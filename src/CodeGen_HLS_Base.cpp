@@ -83,6 +83,26 @@ string CodeGen_HLS_Base::print_stencil_pragma(const string &name) {
     return string();
 }
 
+void CodeGen_HLS_Base::open_dataflow_process() {
+    // Values computed inside a process are not visible outside of it
+    cache.clear();
+    do_indent();
+    stream << "HLS_DATAFLOW_PROCESS_BEGIN\n";
+    indent++;
+}
+
+void CodeGen_HLS_Base::close_dataflow_process() {
+    cache.clear();
+    indent--;
+    do_indent();
+    stream << "HLS_DATAFLOW_PROCESS_END\n";
+}
+
+string CodeGen_HLS_Base::hw_counter_name(const string &kind) {
+    internal_assert(profiled_kernel >= 0);
+    return "_hw_" + kind + "_" + to_string(profiled_kernel);
+}
+
 void CodeGen_HLS_Base::visit(const Call *op) {
     if (op->name == "linebuffer") {
         //IR: linebuffer(buffered.stencil_update.stream, buffered.stencil.stream, extent_0[, extent_1, ...])
@@ -90,14 +110,66 @@ void CodeGen_HLS_Base::visit(const Call *op) {
         internal_assert(op->args.size() >= 3);
         string a0 = print_expr(op->args[0]);
         string a1 = print_expr(op->args[1]);
+        vector<string> extents;
+        for(size_t i = 2; i < op->args.size(); i++) {
+            extents.push_back(print_expr(op->args[i]));
+        }
+        open_dataflow_process();
         do_indent();
         stream << "linebuffer<";
-        for(size_t i = 2; i < op->args.size(); i++) {
-            stream << print_expr(op->args[i]);
-            if (i != op->args.size() -1)
+        for(size_t i = 0; i < extents.size(); i++) {
+            stream << extents[i];
+            if (i != extents.size() -1)
                 stream << ", ";
         }
         stream << ">(" << a0 << ", " << a1 << ");\n";
+        close_dataflow_process();
+        id = "0"; // skip evaluation
+    } else if (op->name == "border") {
+        //IR: border(buffered.border.stream, buffered.stencil_update.stream, mode, value,
+        //           lo_0, valid_0, lo_1, valid_1, extent_0[, extent_1, ...])
+        //C: border<is_constant, extent_0[, extent_1, ...]>(buffered.border.stream, buffered.stencil_update.stream,
+        //                                                   value, lo_0, valid_0, lo_1, valid_1)
+        internal_assert(op->args.size() >= 9);
+        const StringImm *mode = op->args[2].as<StringImm>();
+        internal_assert(mode);
+        vector<string> args;
+        for(size_t i = 0; i < 8; i++) {
+            if (i != 2) {
+                args.push_back(print_expr(op->args[i]));
+            }
+        }
+        vector<string> extents;
+        for(size_t i = 8; i < op->args.size(); i++) {
+            extents.push_back(print_expr(op->args[i]));
+        }
+        open_dataflow_process();
+        do_indent();
+        stream << "border<" << (mode->value == "constant_exterior" ? "true" : "false");
+        for(size_t i = 0; i < extents.size(); i++) {
+            stream << ", " << extents[i];
+        }
+        stream << ">(";
+        for(size_t i = 0; i < args.size(); i++) {
+            stream << args[i];
+            if (i != args.size() -1)
+                stream << ", ";
+        }
+        stream << ");\n";
+        close_dataflow_process();
+        id = "0"; // skip evaluation
+    } else if (op->name == "unpack_stream" || op->name == "pack_stream") {
+        //IR: unpack_stream(func.packed.stream, func.stencil_update.stream, dim, num_beats)
+        //C: unpack_stream<dim>(func.packed.stream, func.stencil_update.stream, num_beats)
+        internal_assert(op->args.size() == 4);
+        string a0 = print_expr(op->args[0]);
+        string a1 = print_expr(op->args[1]);
+        string dim = print_expr(op->args[2]);
+        string num_beats = print_expr(op->args[3]);
+        open_dataflow_process();
+        do_indent();
+        stream << op->name << "<" << dim << ">(" << a0 << ", " << a1 << ", " << num_beats << ");\n";
+        close_dataflow_process();
         id = "0"; // skip evaluation
     } else if (op->name == "write_stream") {
         if (op->args.size() == 2) {
@@ -106,6 +178,10 @@ void CodeGen_HLS_Base::visit(const Call *op) {
             // C: buffered_stencil_update_stream.write(buffered_stencil_update);
             string a0 = print_expr(op->args[0]);
             string a1 = print_expr(op->args[1]);
+            if (profiled_kernel >= 0) {
+                do_indent();
+                stream << "if (" << a0 << ".full()) " << hw_counter_name("stalled_out") << "++;\n";
+            }
             do_indent();
             stream << a0 << ".write(" << a1 << ");\n";
             id = "0"; // skip evaluation
@@ -160,6 +236,11 @@ void CodeGen_HLS_Base::visit(const Call *op) {
             stream << "}\n";
 
             // emit code writing stream
+            if (profiled_kernel >= 0) {
+                do_indent();
+                stream << "if (" << print_name(stream_name) << ".full()) "
+                       << hw_counter_name("stalled_out") << "++;\n";
+            }
             do_indent();
             stream << print_name(stream_name) << ".write("
                    << print_name(packed_stencil_name) << ");\n";
@@ -178,6 +259,11 @@ void CodeGen_HLS_Base::visit(const Call *op) {
             internal_assert(consumer_imm);
             stream_name += ".to." + consumer_imm->value;
         }
+        if (profiled_kernel >= 0) {
+            do_indent();
+            stream << "if (" << print_name(stream_name) << ".empty()) "
+                   << hw_counter_name("stalled_in") << "++;\n";
+        }
         do_indent();
         stream << a1 << " = " << print_name(stream_name) << ".read();\n";
         id = "0"; // skip evaluation
@@ -296,6 +382,7 @@ void CodeGen_HLS_Base::visit(const Call *op) {
         }
 
         // emits for a loop for each dimensions (larger dimension number, outer the loop)
+        open_dataflow_process();
         for (int i = num_of_demensions - 1; i >= 0; i--) {
             string dim_name = "_dim_" + to_string(i);
             do_indent();
@@ -342,6 +429,7 @@ void CodeGen_HLS_Base::visit(const Call *op) {
         }
 
         close_scope("");
+        close_dataflow_process();
 
         id = "0"; // skip evaluation
     } else {
@@ -24,7 +24,7 @@ public:
                      Target target,
                      OutputKind output_kind,
                      const std::string &include_guard = "")
-        : CodeGen_C(dest, target, output_kind, include_guard) {}
+        : CodeGen_C(dest, target, output_kind, include_guard), profiled_kernel(-1) {}
 
     struct Stencil_Type {
         typedef enum {Stencil, Stream, AxiStream} StencilContainerType;
@@ -41,6 +41,24 @@ protected:
     virtual std::string print_name(const std::string &name);
     virtual std::string print_stencil_pragma(const std::string &name);
 
+    /** Mark the code emitted in between as one DATAFLOW process. The
+     * markers expand to nothing unless the testbench is built with
+     * HLS_STRESS_TEST (see StressTest.h), in which case every process
+     * runs in its own thread. */
+    // @{
+    void open_dataflow_process();
+    void close_dataflow_process();
+    // @}
+
+    /** The index of the HW kernel whose cycle counters are updated by
+     * the code being emitted, or -1 if it keeps no counters (see
+     * profiled_hw_kernels in Profiling.h). */
+    int profiled_kernel;
+
+    /** The name of the local counter KIND ("active", "stalled_in" or
+     * "stalled_out") of the profiled kernel. */
+    std::string hw_counter_name(const std::string &kind);
+
     using CodeGen_C::visit;
 
     void visit(const Call *);
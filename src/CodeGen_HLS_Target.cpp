@@ -11,6 +11,7 @@
 #include "Param.h"
 #include "Var.h"
 #include "Lerp.h"
+#include "Profiling.h"
 #include "Simplify.h"
 
 namespace Halide {
@@ -125,8 +126,10 @@ string CodeGen_HLS_Target::CodeGen_HLS_C::print_stencil_pragma(const string &nam
         oss << "#pragma HLS STREAM variable=" << print_name(name) << " depth=" << stype.depth << "\n";
         if (stype.depth <= 100) {
             // use shift register implementation when the FIFO is shallow
-            oss << "#pragma HLS RESOURCE variable=" << print_name(name) << " core=FIFO_SRL\n\n";
+            oss << "#pragma HLS RESOURCE variable=" << print_name(name) << " core=FIFO_SRL\n";
         }
+        // bound the FIFO in the stress-test C simulation
+        oss << string(indent, ' ') << "HLS_STREAM_DEPTH(" << print_name(name) << ", " << stype.depth << ")\n\n";
     } else if (stype.type == Stencil_Type::StencilContainerType::Stencil) {
         oss << "#pragma HLS ARRAY_PARTITION variable=" << print_name(name) << ".value complete dim=0\n\n";
     } else {
@@ -139,6 +142,13 @@ string CodeGen_HLS_Target::CodeGen_HLS_C::print_stencil_pragma(const string &nam
 void CodeGen_HLS_Target::CodeGen_HLS_C::add_kernel(Stmt stmt,
                                                    const string &name,
                                                    const vector<HLS_Argument> &args) {
+    // The profiled kernels count their cycles into output arguments
+    // appended to the prototype, which are read back through AXI-Lite
+    hw_kernels.clear();
+    if (target.has_feature(Target::Profile)) {
+        hw_kernels = profiled_hw_kernels(stmt);
+    }
+
     // Emit the function prototype
     stream << "void " << name << "(\n";
     for (size_t i = 0; i < args.size(); i++) {
@@ -160,6 +170,9 @@ void CodeGen_HLS_Target::CodeGen_HLS_C::add_kernel(Stmt stmt,
 
         if (i < args.size()-1) stream << ",\n";
     }
+    for (size_t i = 0; i < hw_kernels.size() * 3; i++) {
+        stream << ",\nuint64_t &hw_counter_" << i;
+    }
 
     if (is_header()) {
         stream << ");\n";
@@ -193,6 +206,10 @@ void CodeGen_HLS_Target::CodeGen_HLS_C::add_kernel(Stmt stmt,
                        << "port=" << arg_name << " bundle=config\n";
             }
         }
+        for (size_t i = 0; i < hw_kernels.size() * 3; i++) {
+            stream << "#pragma HLS INTERFACE s_axilite "
+                   << "port=hw_counter_" << i << " bundle=config\n";
+        }
         stream << "\n";
 
         // create alias (references) of the arguments using the names in the IR
@@ -215,6 +232,10 @@ void CodeGen_HLS_Target::CodeGen_HLS_C::add_kernel(Stmt stmt,
         // print body
         print(stmt);
 
+        // wait for all the dataflow processes in the stress-test C simulation
+        do_indent();
+        stream << "HLS_DATAFLOW_JOIN\n";
+
         close_scope("kernel hls_target" + print_name(name));
     }
     stream << "\n";
@@ -255,11 +276,54 @@ void CodeGen_HLS_Target::CodeGen_HLS_C::visit(const For *op) {
         //stream << "#pragma HLS DEPENDENCE array inter false\n"
         //       << "#pragma HLS LOOP_FLATTEN off\n";
         stream << "#pragma HLS PIPELINE II=1\n";
+        if (profiled_kernel >= 0) {
+            do_indent();
+            stream << hw_counter_name("active") << "++;\n";
+        }
     }
+    loop_level++;
     op->body.accept(this);
+    loop_level--;
     close_scope("for " + print_name(op->name));
 }
 
+// The loop nest of a producer outside of any loop forms one DATAFLOW process
+void CodeGen_HLS_Target::CodeGen_HLS_C::visit(const ProducerConsumer *op) {
+    if (op->is_producer && loop_level == 0) {
+        do_indent();
+        stream << "// produce " << op->name << '\n';
+        open_dataflow_process();
+
+        // Every iteration of a pipelined loop counts as an active
+        // cycle, every read of an empty stream and write of a full
+        // stream as a stalled one.
+        int old_profiled_kernel = profiled_kernel;
+        vector<string>::iterator it = std::find(hw_kernels.begin(), hw_kernels.end(), op->name);
+        profiled_kernel = it == hw_kernels.end() ? -1 : (int)(it - hw_kernels.begin());
+        if (profiled_kernel >= 0) {
+            do_indent();
+            stream << "uint64_t " << hw_counter_name("active") << " = 0, "
+                   << hw_counter_name("stalled_in") << " = 0, "
+                   << hw_counter_name("stalled_out") << " = 0;\n";
+        }
+
+        print_stmt(op->body);
+
+        if (profiled_kernel >= 0) {
+            const char *kinds[] = {"active", "stalled_in", "stalled_out"};
+            for (int i = 0; i < 3; i++) {
+                do_indent();
+                stream << "hw_counter_" << profiled_kernel * 3 + i << " = "
+                       << hw_counter_name(kinds[i]) << ";\n";
+            }
+        }
+        profiled_kernel = old_profiled_kernel;
+        close_dataflow_process();
+    } else {
+        CodeGen_HLS_Base::visit(op);
+    }
+}
+
 class RenameAllocation : public IRMutator {
     const string &orig_name;
     const string &new_name;
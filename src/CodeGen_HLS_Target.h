@@ -45,7 +45,7 @@ protected:
     class CodeGen_HLS_C : public CodeGen_HLS_Base {
     public:
         CodeGen_HLS_C(std::ostream &s, Target target, OutputKind output_kind)
-            : CodeGen_HLS_Base(s, target, output_kind) {}
+            : CodeGen_HLS_Base(s, target, output_kind), loop_level(0) {}
 
         void add_kernel(Stmt stmt,
                         const std::string &name,
@@ -58,6 +58,14 @@ protected:
 
         void visit(const For *op);
         void visit(const Allocate *op);
+        void visit(const ProducerConsumer *op);
+
+        /** The number of loops enclosing the code being emitted. Producers
+         * at level zero are the DATAFLOW processes of the kernel. */
+        int loop_level;
+
+        /** The kernels that keep cycle counters, when profiling. */
+        std::vector<std::string> hw_kernels;
     };
 
     /** A name for the HLS target */
@@ -8,6 +8,7 @@
 #include "Param.h"
 #include "Var.h"
 #include "Lerp.h"
+#include "Profiling.h"
 #include "Simplify.h"
 
 namespace Halide {
@@ -70,7 +71,9 @@ CodeGen_HLS_Testbench::CodeGen_HLS_Testbench(ostream &tb_stream,
                                              Target target,
                                              OutputKind output_kind)
     : CodeGen_HLS_Base(tb_stream, target, output_kind, ""),
-      cg_target("hls_target", target) {
+      cg_target("hls_target", target),
+      stream_level(0),
+      reporting_hw_counters(false) {
     cg_target.init_module();
 
     stream << hls_headers;
@@ -92,7 +95,16 @@ void CodeGen_HLS_Testbench::visit(const ProducerConsumer *op) {
         string ip_name = unique_name("hls_target");
         cg_target.add_kernel(hw_body, ip_name, args);
 
+        // the kernel cycle counters are passed to the target function
+        // when profiling (see inject_profiling)
+        string counters_name = op->name + ".hw_counters";
+        size_t num_kernels = 0;
+        if (allocations.contains(counters_name)) {
+            num_kernels = profiled_hw_kernels(hw_body).size();
+        }
+
         // emits the target function call
+        open_dataflow_process();
         do_indent();
         stream << ip_name << "("; // avoid starting with '_'
         for(size_t i = 0; i < args.size(); i++) {
@@ -100,7 +112,19 @@ void CodeGen_HLS_Testbench::visit(const ProducerConsumer *op) {
             if(i != args.size() - 1)
                 stream << ", ";
         }
+        for(size_t i = 0; i < num_kernels * 3; i++) {
+            stream << ", " << print_name(counters_name) << "[" << i << "]";
+        }
         stream <<");\n";
+        if (num_kernels > 0) {
+            // the counters are complete once the target function
+            // returns, which is inside this process in the stress-test
+            // C simulation
+            reporting_hw_counters = true;
+            print_stmt(update_hw_counters(op->name, num_kernels));
+            reporting_hw_counters = false;
+        }
+        close_dataflow_process();
     } else {
         CodeGen_HLS_Base::visit(op);
     }
@@ -131,9 +155,21 @@ void CodeGen_HLS_Testbench::visit(const Call *op) {
         }
         rhs <<");\n";
 
+        // the DMA into the accelerator runs concurrently with it
+        // in the stress-test C simulation, the DMA out of it doesn't
+        bool is_input = direction->value == "buffer_to_stream";
+        if (is_input) {
+            open_dataflow_process();
+        }
         do_indent();
         stream << rhs.str();
+        if (is_input) {
+            close_dataflow_process();
+        }
 
+        id = "0"; // skip evaluation
+    } else if (op->name == "halide_profiler_hw_kernels_update" && !reporting_hw_counters) {
+        // already emitted along with the call of the accelerator
         id = "0"; // skip evaluation
     } else if (op->name == "buffer_to_stencil") {
         internal_assert(op->args.size() == 2);
@@ -169,14 +205,32 @@ void CodeGen_HLS_Testbench::visit(const Realize *op) {
                     op->types[0], op->bounds, 1});
         stencils.push(op->name, stream_type);
 
+        if (stream_level == 0) {
+            // The frame is a loop in the stress-test C simulation, so
+            // values computed inside it are not visible after it
+            cache.clear();
+            do_indent();
+            stream << "HLS_STRESS_FRAME_BEGIN\n";
+        }
+        stream_level++;
+
         // emits the declaration for the stream
         do_indent();
         stream << print_stencil_type(stream_type) << ' ' << print_name(op->name) << ";\n";
         stream << print_stencil_pragma(op->name);
+        do_indent();
+        stream << "HLS_AXIS_STREAM(" << print_name(op->name) << ")\n";
 
         // traverse down
         op->body.accept(this);
 
+        stream_level--;
+        if (stream_level == 0) {
+            cache.clear();
+            do_indent();
+            stream << "HLS_STRESS_FRAME_END\n";
+        }
+
         // We didn't generate free stmt inside for stream type
         allocations.pop(op->name);
         stencils.pop(op->name);
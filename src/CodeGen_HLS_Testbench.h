@@ -35,6 +35,15 @@ protected:
 
 private:
     CodeGen_HLS_Target cg_target;
+
+    /** The number of AXI streams in scope. The hardware region is
+     * re-run for several frames in the stress-test C simulation
+     * around the outermost one. */
+    int stream_level;
+
+    /** Set while emitting the report of the kernel cycle counters,
+     * which goes along with the call of the accelerator. */
+    bool reporting_hw_counters;
 };
 
 }
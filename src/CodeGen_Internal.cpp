@@ -156,6 +156,9 @@ bool function_takes_user_context(const std::string &name) {
         "halide_free",
         "halide_malloc",
         "halide_print",
+        "halide_profiler_hw_kernels_update",
+        "halide_profiler_instrument_pipeline_start",
+        "halide_profiler_instrument_run_start",
         "halide_profiler_memory_allocate",
         "halide_profiler_memory_free",
         "halide_profiler_pipeline_start",
@@ -476,5 +479,15 @@ void set_function_attributes_for_target(llvm::Function *fn, Target t) {
     #endif
 }
 
+size_t count_llvm_instructions(const llvm::Module &module) {
+    size_t count = 0;
+    for (const llvm::Function &f : module) {
+        for (const llvm::BasicBlock &b : f) {
+            count += b.size();
+        }
+    }
+    return count;
+}
+
 }
 }
@@ -77,6 +77,9 @@ std::unique_ptr<llvm::TargetMachine> make_target_machine(const llvm::Module &mod
 /** Set the appropriate llvm Function attributes given a Target. */
 void set_function_attributes_for_target(llvm::Function *, Target);
 
+/** The number of instructions in an llvm::Module. */
+size_t count_llvm_instructions(const llvm::Module &module);
+
 }}
 
 #endif
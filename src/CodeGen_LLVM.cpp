@@ -18,6 +18,7 @@
 #include "MatlabWrapper.h"
 #include "IntegerDivisionTable.h"
 #include "CSE.h"
+#include "PassTimer.h"
 
 #include "CodeGen_X86.h"
 #include "CodeGen_GPU_Host.h"
@@ -535,6 +536,15 @@ std::unique_ptr<llvm::Module> CodeGen_LLVM::compile(const Module &input) {
 
     add_external_code(input);
 
+    PassTimer timer("llvm code generation", input.name());
+    if (timer.enabled()) {
+        size_t ir_nodes = 0;
+        for (const auto &f : input.functions()) {
+            ir_nodes += count_ir_nodes(f.body);
+        }
+        timer.pass("Generating llvm bitcode", ir_nodes);
+    }
+
     // Generate the code for this module.
     debug(1) << "Generating llvm bitcode...\n";
     for (const auto &b : input.buffers()) {
@@ -564,7 +574,13 @@ std::unique_ptr<llvm::Module> CodeGen_LLVM::compile(const Module &input) {
     debug(2) << "Done generating llvm bitcode\n";
 
     // Optimize
+    if (timer.enabled()) {
+        timer.pass("Optimizing llvm module", count_llvm_instructions(*module));
+    }
     CodeGen_LLVM::optimize_module();
+    if (timer.enabled()) {
+        timer.done(count_llvm_instructions(*module));
+    }
 
     input_module = nullptr;
 
@@ -3065,10 +3081,14 @@ void CodeGen_LLVM::visit(const For *op) {
         // Return success
         return_with_error_code(ConstantInt::get(i32_t, 0));
 
-        // Move the builder back to the main function and call do_par_for
+        // Move the builder back to the main function and call
+        // do_par_for, or do_async_fork if the iterations are the
+        // tasks of an async producer and its consumer, which must
+        // run concurrently.
         builder->restoreIP(call_site);
-        llvm::Function *do_par_for = module->getFunction("halide_do_par_for");
-        internal_assert(do_par_for) << "Could not find halide_do_par_for in initial module\n";
+        string do_par_for_name = ends_with(op->name, ".__async_fork") ? "halide_do_async_fork" : "halide_do_par_for";
+        llvm::Function *do_par_for = module->getFunction(do_par_for_name);
+        internal_assert(do_par_for) << "Could not find " << do_par_for_name << " in initial module\n";
         #if LLVM_VERSION < 50
         do_par_for->setDoesNotAlias(5);
         #else
@@ -4,6 +4,7 @@
 #include "CodeGen_Zynq_C.h"
 #include "CodeGen_Internal.h"
 #include "IROperator.h"
+#include "Profiling.h"
 #include "Simplify.h"
 
 namespace Halide {
@@ -42,7 +43,8 @@ const string zynq_runtime =
     "int halide_zynq_cma_free(struct buffer_t *buf);\n"
     "int halide_zynq_subimage(const struct buffer_t* image, struct cma_buffer_t* subimage, void *address_of_subimage_origin, int width, int height);\n"
     "int halide_zynq_hwacc_launch(struct cma_buffer_t bufs[]);\n"
-    "int halide_zynq_hwacc_sync(int task_id);\n";
+    "int halide_zynq_hwacc_sync(int task_id);\n"
+    "int halide_zynq_hwacc_counters(int task_id, uint64_t *counters, int num_counters);\n";
 }
 
 CodeGen_Zynq_C::CodeGen_Zynq_C(ostream &dest,
@@ -89,6 +91,15 @@ void CodeGen_Zynq_C::visit(const ProducerConsumer *op) {
         do_indent();
         stream << "halide_zynq_hwacc_sync(_process_id);\n";
 
+        // read back the kernel cycle counters when profiling
+        string counters_name = op->name + ".hw_counters";
+        if (allocations.contains(counters_name)) {
+            size_t num_counters = profiled_hw_kernels(op->body).size() * 3;
+            do_indent();
+            stream << "halide_zynq_hwacc_counters(_process_id, "
+                   << print_name(counters_name) << ", " << num_counters << ");\n";
+        }
+
         buffer_slices.clear();
     } else {
         CodeGen_C::visit(op);
@@ -4,6 +4,7 @@
 #include "CodeGen_Zynq_LLVM.h"
 #include "CodeGen_Internal.h"
 #include "IROperator.h"
+#include "Profiling.h"
 #include <sys/mman.h>
 
 namespace Halide {
@@ -69,6 +70,18 @@ void CodeGen_Zynq_LLVM::visit(const ProducerConsumer *op) {
         internal_assert(pend_fn);
         builder->CreateCall(pend_fn, pend_args);
 
+        // read back the kernel cycle counters when profiling
+        std::string counters_name = op->name + ".hw_counters";
+        if (sym_exists(counters_name)) {
+            int num_counters = (int)profiled_hw_kernels(op->body).size() * 3;
+            Value *counters = sym_get(counters_name);
+            Value *counters_args[] = {process_id, counters,
+                                      llvm::ConstantInt::get(i32_t, num_counters)};
+            llvm::Function *counters_fn = module->getFunction("halide_zynq_hwacc_counters");
+            internal_assert(counters_fn);
+            builder->CreateCall(counters_fn, counters_args);
+        }
+
         buffer_slices.clear();
     } else {
         CodeGen_ARM::visit(op);
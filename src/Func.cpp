@@ -2163,6 +2163,12 @@ Func &Func::memoize() {
     return *this;
 }
 
+Func &Func::async() {
+    invalidate_cache();
+    func.schedule().async() = true;
+    return *this;
+}
+
 Stage Func::specialize(Expr c) {
     invalidate_cache();
     return Stage(func.definition(), name(), args(), func.schedule()).specialize(c);
@@ -2681,6 +2687,14 @@ Func &Func::fifo_depth(Func consumer, int depth) {
     return *this;
 }
 
+Func &Func::stream_beat_width(int bits) {
+    invalidate_cache();
+    user_assert(bits >= 0 && bits % 8 == 0)
+        << "Stream beat width of " << name() << " must be a non-negative multiple of 8 bits.\n";
+    func.schedule().stream_beat_width() = bits;
+    return *this;
+}
+
 Func &Func::compute_inline() {
     return compute_at(LoopLevel::inlined());
 }
@@ -3223,6 +3237,29 @@ void Func::print_loop_nest() {
     pipeline().print_loop_nest();
 }
 
+std::string Func::footprint_report(const std::vector<int> &output_size, const Target &target) {
+    return pipeline().footprint_report({output_size}, target);
+}
+
+std::string Func::auto_schedule(const std::vector<int> &output_size, const Target &target) {
+    return pipeline().auto_schedule({output_size}, target);
+}
+
+std::string Func::auto_schedule(const std::vector<int> &output_size, const AutoScheduleParams &params,
+                                const Target &target) {
+    return pipeline().auto_schedule({output_size}, params, target);
+}
+
+std::string Func::tune_schedule(Realization dst, const std::string &filename,
+                                const std::vector<AutoScheduleParams> &candidates, const Target &target) {
+    return pipeline().tune_schedule(dst, filename, candidates, target);
+}
+
+std::string Func::apply_tuned_schedule(const std::string &filename, const std::vector<int> &output_size,
+                                       const Target &target) {
+    return pipeline().apply_tuned_schedule(filename, {output_size}, target);
+}
+
 void Func::compile_to_file(const string &filename_prefix,
                            const vector<Argument> &args,
                            const std::string &fn_name,
@@ -3307,6 +3344,14 @@ void *Func::compile_jit(const Target &target) {
     return pipeline().compile_jit(target);
 }
 
+void *Func::compile_jit(const std::vector<Target> &targets) {
+    return pipeline().compile_jit(targets);
+}
+
+JITCallable Func::compile_to_callable(const Target &target) {
+    return pipeline().compile_to_callable(target);
+}
+
 EXPORT Var _("_");
 EXPORT Var _0("_0"), _1("_1"), _2("_2"), _3("_3"), _4("_4"),
            _5("_5"), _6("_6"), _7("_7"), _8("_8"), _9("_9");
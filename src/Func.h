@@ -696,6 +696,35 @@ public:
      * doing. */
     EXPORT void print_loop_nest();
 
+    /** Estimate the cost of the schedule of this Func and the Funcs it
+     * uses, given the size of its output. See
+     * Pipeline::footprint_report. */
+    EXPORT std::string footprint_report(const std::vector<int> &output_size,
+                                        const Target &target = get_target_from_environment());
+
+    /** Choose a schedule for this Func and every Func it uses, given
+     * an estimate of the size of its output. See
+     * Pipeline::auto_schedule. */
+    EXPORT std::string auto_schedule(const std::vector<int> &output_size,
+                                     const Target &target = get_target_from_environment());
+    EXPORT std::string auto_schedule(const std::vector<int> &output_size,
+                                     const AutoScheduleParams &params,
+                                     const Target &target = get_target_from_environment());
+
+    /** Search for the auto_schedule parameters that work best for
+     * this Func by benchmarking, record them in a file, and apply the
+     * fastest. See Pipeline::tune_schedule. */
+    EXPORT std::string tune_schedule(Realization dst,
+                                     const std::string &filename,
+                                     const std::vector<AutoScheduleParams> &candidates = AutoScheduleParams::candidates(),
+                                     const Target &target = get_jit_target_from_environment());
+
+    /** Apply the fastest schedule recorded for the target by
+     * tune_schedule. See Pipeline::apply_tuned_schedule. */
+    EXPORT std::string apply_tuned_schedule(const std::string &filename,
+                                            const std::vector<int> &output_size,
+                                            const Target &target = get_target_from_environment());
+
     /** Compile to object file and header pair, with the given
      * arguments. The name defaults to the same name as this halide
      * function.
@@ -747,6 +776,22 @@ public:
      */
     EXPORT void *compile_jit(const Target &target = get_jit_target_from_environment());
 
+    /** Eagerly jit compile the function once for each of a list of
+     * targets, along with a wrapper that picks the first of them
+     * whose features the cpu it's running on has, using
+     * halide_can_use_target_features, just like the code produced by
+     * compile_to_multitarget_static_library. The last target is the
+     * baseline, which is used if none of the others can be. All
+     * targets must have identical arch-os-bits. Subsequent calls to
+     * realize without a target use the result. Returns the raw
+     * function pointer to the wrapper. */
+    EXPORT void *compile_jit(const std::vector<Target> &targets);
+
+    /** JIT-compile the function and bind its inputs once, returning
+     * an object that realizes it into output buffers with little
+     * overhead per call. See Pipeline::compile_to_callable. */
+    EXPORT JITCallable compile_to_callable(const Target &target = get_jit_target_from_environment());
+
     /** Set the error handler function that be called in the case of
      * runtime errors during halide pipelines. If you are compiling
      * statically, you can also just define your own function with
@@ -1823,6 +1868,18 @@ public:
      */
     EXPORT Func &memoize();
 
+    /** Compute this function in a task of its own, concurrently
+     * with the code that consumes it. Each iteration of its produce
+     * node signals a semaphore, which the consumer waits on in place
+     * of computing it. If the storage of the function is folded, the
+     * consumer in turn signals when a fold is free again, so the
+     * producer runs ahead by at most the fold factor. The function
+     * must not be inlined or an output, and the consumer may not use
+     * other functions computed after it at the same loop level. This
+     * is useful to overlap stages that are each hard to parallelize,
+     * e.g. a producer that reads its input serially. */
+    EXPORT Func &async();
+
 
     /** Allocate storage for this function within f's loop over
      * var. Scheduling storage is optional, and can be used to
@@ -1951,6 +2008,19 @@ public:
      */
     EXPORT Func &fifo_depth(Func consumer, int depth);
 
+    /** Pack the stencils streamed between the host and the accelerator
+     * into beats of the given width in bits (e.g. 64 or 128 to match
+     * the HP ports of a Zynq), if this function is an input or the
+     * output of an accelerated pipeline. Consecutive stencils along
+     * the innermost dimension that the stencils are scanned over go
+     * into one beat, so each beat is a contiguous burst when that
+     * dimension is dense in memory. The accelerator splits and merges
+     * the beats. Falls back to one stencil per beat, with a warning,
+     * if the beat width is not a multiple of the stencil size or the
+     * tile doesn't divide into beats.
+     */
+    EXPORT Func &stream_beat_width(int bits);
+
     /** Aggressively inline all uses of this function. This is the
      * default schedule, so you're unlikely to need to call this. For
      * a Func with an update definition, that means it gets computed
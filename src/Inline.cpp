@@ -36,6 +36,11 @@ void validate_schedule_inlined_function(Function f) {
                    << f.name() << " because the function is scheduled inline.\n";
     }
 
+    if (func_s.async()) {
+        user_error << "Cannot compute function "
+                   << f.name() << " asynchronously because the function is scheduled inline.\n";
+    }
+
     for (size_t i = 0; i < stage_s.dims().size(); i++) {
         Dim d = stage_s.dims()[i];
         if (d.is_parallel()) {
@@ -32,6 +32,12 @@ static bool have_symbol(const char *s) {
 }
 #endif
 
+#if defined(__linux__)
+#include <link.h>
+#elif defined(__APPLE__)
+#include <mach-o/loader.h>
+#endif
+
 namespace Halide {
 namespace Internal {
 
@@ -136,6 +142,7 @@ public:
     std::map<std::string, JITModule::Symbol> exports;
     llvm::LLVMContext context;
     ExecutionEngine *execution_engine;
+    std::unique_ptr<llvm::ObjectCache> object_cache;
     std::vector<JITModule> dependencies;
     JITModule::Symbol entrypoint;
     JITModule::Symbol argv_entrypoint;
@@ -167,6 +174,218 @@ JITModule::Symbol compile_and_get_function(ExecutionEngine &ee, const string &na
     return symbol;
 }
 
+// A persistent cache of compiled objects, stored as one file per
+// module in a local directory, named by a hash of the llvm module and
+// everything else that affects the code generated for it.
+class JITObjectCache : public llvm::ObjectCache {
+    std::string path;
+
+public:
+    JITObjectCache(const std::string &dir, const std::string &key)
+        : path(dir + "/" + key + ".o") {}
+
+    void notifyObjectCompiled(const llvm::Module *m, llvm::MemoryBufferRef obj) override {
+        // Write to a unique temporary file and rename it into place,
+        // so that processes racing to fill the same entry never see a
+        // partial object.
+        std::error_code ec = llvm::sys::fs::create_directories(llvm::sys::path::parent_path(path));
+        int fd;
+        llvm::SmallString<128> tmp_path;
+        if (!ec) {
+            ec = llvm::sys::fs::createUniqueFile(path + ".%%%%%%.tmp", fd, tmp_path);
+        }
+        if (ec) {
+            debug(1) << "Couldn't write to the JIT cache: " << ec.message() << "\n";
+            return;
+        }
+        bool ok;
+        {
+            llvm::raw_fd_ostream out(fd, true);
+            out << obj.getBuffer();
+            out.close();
+            ok = !out.has_error();
+            out.clear_error();
+        }
+        if (ok) {
+            ec = llvm::sys::fs::rename(tmp_path, path);
+        }
+        if (!ok || ec) {
+            debug(1) << "Couldn't write " << path << " to the JIT cache\n";
+            llvm::sys::fs::remove(tmp_path);
+            return;
+        }
+        debug(2) << "Saved compiled object to " << path << "\n";
+    }
+
+    std::unique_ptr<llvm::MemoryBuffer> getObject(const llvm::Module *m) override {
+        llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buf = llvm::MemoryBuffer::getFile(path);
+        if (!buf) {
+            debug(2) << "JIT cache miss for " << path << "\n";
+            return nullptr;
+        }
+        debug(1) << "Loading compiled object from " << path << "\n";
+        return std::move(*buf);
+    }
+};
+
+std::string hex_string(const uint8_t *bytes, size_t size) {
+    static const char digits[] = "0123456789abcdef";
+    std::string result;
+    for (size_t i = 0; i < size; i++) {
+        result += digits[bytes[i] >> 4];
+        result += digits[bytes[i] & 0xf];
+    }
+    return result;
+}
+
+#if defined(__linux__)
+struct BuildIdSearch {
+    uintptr_t addr;
+    std::string id;
+};
+
+// Find the loaded object containing an address, and read the build id
+// note the linker gave it (--build-id, on by default in most
+// toolchains) from its PT_NOTE segments.
+int find_build_id(struct dl_phdr_info *info, size_t, void *data) {
+    BuildIdSearch *search = (BuildIdSearch *)data;
+    bool contains = false;
+    for (int i = 0; i < info->dlpi_phnum; i++) {
+        const ElfW(Phdr) &ph = info->dlpi_phdr[i];
+        uintptr_t start = info->dlpi_addr + ph.p_vaddr;
+        if (ph.p_type == PT_LOAD && search->addr >= start && search->addr < start + ph.p_memsz) {
+            contains = true;
+        }
+    }
+    if (!contains) {
+        return 0;
+    }
+    for (int i = 0; i < info->dlpi_phnum; i++) {
+        const ElfW(Phdr) &ph = info->dlpi_phdr[i];
+        if (ph.p_type != PT_NOTE) {
+            continue;
+        }
+        const uint8_t *note = (const uint8_t *)(info->dlpi_addr + ph.p_vaddr);
+        const uint8_t *end = note + ph.p_memsz;
+        while (note + sizeof(ElfW(Nhdr)) <= end) {
+            const ElfW(Nhdr) *header = (const ElfW(Nhdr) *)note;
+            const uint8_t *name = note + sizeof(ElfW(Nhdr));
+            const uint8_t *desc = name + ((header->n_namesz + 3) & ~3);
+            if (header->n_type == NT_GNU_BUILD_ID && header->n_namesz == 4 &&
+                memcmp(name, "GNU", 4) == 0 && desc + header->n_descsz <= end) {
+                search->id = hex_string(desc, header->n_descsz);
+                return 1;
+            }
+            note = desc + ((header->n_descsz + 3) & ~3);
+        }
+    }
+    return 1;
+}
+#endif
+
+// The id the linker stamped on the object containing this code: the
+// GNU build id note on Linux, or the LC_UUID load command on macOS.
+// Empty if there isn't one.
+std::string linker_build_id() {
+#if defined(__linux__)
+    BuildIdSearch search;
+    search.addr = (uintptr_t)&linker_build_id;
+    dl_iterate_phdr(find_build_id, &search);
+    return search.id;
+#elif defined(__APPLE__)
+    Dl_info info;
+    if (!dladdr((void *)&linker_build_id, &info) || !info.dli_fbase) {
+        return std::string();
+    }
+#ifdef __LP64__
+    const mach_header_64 *header = (const mach_header_64 *)info.dli_fbase;
+#else
+    const mach_header *header = (const mach_header *)info.dli_fbase;
+#endif
+    const uint8_t *cmd = (const uint8_t *)(header + 1);
+    for (uint32_t i = 0; i < header->ncmds; i++) {
+        const load_command *lc = (const load_command *)cmd;
+        if (lc->cmd == LC_UUID) {
+            const uuid_command *uuid = (const uuid_command *)lc;
+            return hex_string(uuid->uuid, sizeof(uuid->uuid));
+        }
+        cmd += lc->cmdsize;
+    }
+    return std::string();
+#else
+    return std::string();
+#endif
+}
+
+// An id of this build of libHalide, i.e. of the shared library, or the
+// executable it was linked into. That's the id the linker gave it if
+// it has one, which is cheap to read, as it's already in memory.
+// Otherwise it's the size and modification time of the file it was
+// loaded from, which change whenever it's rebuilt. Empty if neither
+// can be found.
+const std::string &libhalide_build_id() {
+    static const std::string id = []() {
+        std::string id = linker_build_id();
+        if (!id.empty()) {
+            debug(2) << "libHalide build id: " << id << "\n";
+            return id;
+        }
+
+        std::string path;
+#ifdef _WIN32
+        HMODULE module = nullptr;
+        char name[MAX_PATH];
+        if (GetModuleHandleExA(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS |
+                               GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+                               (LPCSTR)&libhalide_build_id, &module) &&
+            GetModuleFileNameA(module, name, sizeof(name))) {
+            path = name;
+        }
+#else
+        Dl_info info;
+        if (dladdr((void *)&libhalide_build_id, &info) && info.dli_fname) {
+            path = info.dli_fname;
+        }
+#endif
+        if (path.empty() || !file_exists(path)) {
+            // dladdr only knows the executable by the name it was run as.
+            path = llvm::sys::fs::getMainExecutable(nullptr, (void *)&libhalide_build_id);
+        }
+        if (path.empty() || !file_exists(path)) {
+            debug(1) << "Couldn't find the file libHalide was loaded from\n";
+            return std::string();
+        }
+        FileStat stat = file_stat(path);
+        id = std::to_string(stat.file_size) + "-" + std::to_string(stat.mod_time);
+        debug(2) << "libHalide build id: " << id << " from " << path << "\n";
+        return id;
+    }();
+    return id;
+}
+
+// Hash the llvm module and the code generation options. The version
+// of llvm and the build of libHalide are included too, as either may
+// change the code generated for the same module.
+std::string jit_object_cache_key(const llvm::Module &m, const std::string &mcpu, const std::string &mattrs) {
+    std::string ir;
+    llvm::raw_string_ostream ir_stream(ir);
+    m.print(ir_stream, nullptr);
+    ir_stream.flush();
+
+    llvm::MD5 hash;
+    hash.update(ir);
+    hash.update(m.getTargetTriple());
+    hash.update(mcpu);
+    hash.update(mattrs);
+    hash.update(std::to_string(LLVM_VERSION));
+    hash.update(libhalide_build_id());
+    llvm::MD5::MD5Result result;
+    hash.final(result);
+    llvm::SmallString<32> key;
+    llvm::MD5::stringifyResult(result, key);
+    return key.str().str();
+}
+
 // Expand LLVM's search for symbols to include code contained in a set of JITModule.
 // TODO: Does this need to be conditionalized to llvm 3.6?
 class HalideJITMemoryManager : public SectionMemoryManager {
@@ -269,6 +488,12 @@ void JITModule::compile_module(std::unique_ptr<llvm::Module> m, const string &fu
     DataLayout initial_module_data_layout = m->getDataLayout();
     string module_name = m->getModuleIdentifier();
 
+    std::unique_ptr<llvm::ObjectCache> object_cache;
+    string cache_dir = get_env_variable("HL_JIT_CACHE_DIR");
+    if (!cache_dir.empty() && !libhalide_build_id().empty()) {
+        object_cache.reset(new JITObjectCache(cache_dir, jit_object_cache_key(*m, mcpu, mattrs)));
+    }
+
     llvm::EngineBuilder engine_builder((std::move(m)));
     engine_builder.setTargetOptions(options);
     engine_builder.setErrorStr(&error_string);
@@ -301,6 +526,10 @@ void JITModule::compile_module(std::unique_ptr<llvm::Module> m, const string &fu
     if (!ee) std::cerr << error_string << "\n";
     internal_assert(ee) << "Couldn't create execution engine\n";
 
+    if (object_cache) {
+        ee->setObjectCache(object_cache.get());
+    }
+
     // Do any target-specific initialization
     std::vector<llvm::JITEventListener *> listeners;
 
@@ -350,6 +579,7 @@ void JITModule::compile_module(std::unique_ptr<llvm::Module> m, const string &fu
     // Stash the various objects that need to stay alive behind a reference-counted pointer.
     jit_module->exports = exports;
     jit_module->execution_engine = ee;
+    jit_module->object_cache = std::move(object_cache);
     jit_module->dependencies = dependencies;
     jit_module->entrypoint = entrypoint;
     jit_module->argv_entrypoint = argv_entrypoint;
@@ -107,7 +107,12 @@ struct JITModule {
     EXPORT Symbol find_symbol_by_name(const std::string &) const;
 
     /** Take an llvm module and compile it. The requested exports will
-        be available via the exports method. */
+        be available via the exports method. If the environment
+        variable HL_JIT_CACHE_DIR names a directory, the compiled
+        object is saved there under a hash of the llvm module and
+        target, and later compilations of an identical module (in this
+        process or another) load it instead of running LLVM's code
+        generator. */
     EXPORT void compile_module(std::unique_ptr<llvm::Module> mod,
                                const std::string &function_name, const Target &target,
                                const std::vector<JITModule> &dependencies = std::vector<JITModule>(),
@@ -4,6 +4,7 @@
 #include "CodeGen_LLVM.h"
 #include "CodeGen_C.h"
 #include "CodeGen_Internal.h"
+#include "PassTimer.h"
 
 #include <iostream>
 #include <fstream>
@@ -64,6 +65,12 @@ void emit_file(llvm::Module &module, Internal::LLVMOStream& out, llvm::TargetMac
     // Ask the target to add backend passes as necessary.
     target_machine->addPassesToEmitFile(pass_manager, out, file_type);
 
+    Internal::PassTimer timer("llvm backend", module.getModuleIdentifier());
+    if (timer.enabled()) {
+        timer.pass(file_type == llvm::TargetMachine::CGFT_ObjectFile ?
+                   "Emitting object file" : "Emitting assembly",
+                   Internal::count_llvm_instructions(module));
+    }
     pass_manager.run(module);
 }
 
@@ -8,6 +8,7 @@
 #include "AddImageChecks.h"
 #include "AddParameterChecks.h"
 #include "AllocationBoundsInference.h"
+#include "AsyncProducers.h"
 #include "Bounds.h"
 #include "BoundsInference.h"
 #include "CSE.h"
@@ -37,6 +38,7 @@
 #include "LoopCarry.h"
 #include "Memoization.h"
 #include "PartitionLoops.h"
+#include "PassTimer.h"
 #include "PerfectNestedLoops.h"
 #include "Prefetch.h"
 #include "Profiling.h"
@@ -47,6 +49,7 @@
 #include "RemoveUndef.h"
 #include "ScheduleFunctions.h"
 #include "SelectGPUAPI.h"
+#include "ShareStencilSums.h"
 #include "SkipStages.h"
 #include "SlidingWindow.h"
 #include "Simplify.h"
@@ -76,13 +79,12 @@ using std::string;
 using std::vector;
 using std::map;
 
-Module lower(const vector<Function> &output_funcs, const string &pipeline_name, const Target &t,
-             const vector<Argument> &args, const Internal::LoweredFunc::LinkageType linkage_type,
-             const vector<IRMutator *> &custom_passes) {
-    std::vector<std::string> namespaces;
-    std::string simple_pipeline_name = extract_namespaces(pipeline_name, namespaces);
+namespace {
 
-    Module result_module(simple_pipeline_name, t);
+// The passes of lower up to stop_after, timed by the given timer.
+PartialLowering lower_until(const vector<Function> &output_funcs, const string &pipeline_name, const Target &t,
+                            LoweringPass stop_after, PassTimer &timer) {
+    timer.pass("Preparing the function graph", Stmt());
 
     // Compute an environment
     map<string, Function> env;
@@ -116,17 +118,26 @@ Module lower(const vector<Function> &output_funcs, const string &pipeline_name,
     simplify_specializations(env);
 
     bool any_memoized = false;
+    auto stop = [&](const Stmt &s) {
+        return PartialLowering{s, outputs, env, order, any_memoized};
+    };
 
     debug(1) << "Creating initial loop nests...\n";
+    timer.pass("Creating initial loop nests", Stmt());
     Stmt s = schedule_functions(outputs, order, env, t, any_memoized);
     debug(2) << "Lowering after creating initial loop nests:\n" << s << '\n';
+    if (stop_after == LoweringPass::InitialLoopNests) {
+        return stop(s);
+    }
 
     debug(1) << "Canonicalizing GPU var names...\n";
+    timer.pass("Canonicalizing GPU var names", s);
     s = canonicalize_gpu_vars(s);
     debug(2) << "Lowering after canonicalizing GPU var names:\n" << s << '\n';
 
     if (any_memoized) {
         debug(1) << "Injecting memoization...\n";
+        timer.pass("Injecting memoization", s);
         s = inject_memoization(s, env, pipeline_name, outputs);
         debug(2) << "Lowering after injecting memoization:\n" << s << '\n';
     } else {
@@ -134,21 +145,25 @@ Module lower(const vector<Function> &output_funcs, const string &pipeline_name,
     }
 
     debug(1) << "Injecting tracing...\n";
+    timer.pass("Injecting tracing", s);
     s = inject_tracing(s, pipeline_name, env, outputs, t);
     debug(2) << "Lowering after injecting tracing:\n" << s << '\n';
 
     debug(1) << "Adding checks for parameters\n";
+    timer.pass("Adding checks for parameters", s);
     s = add_parameter_checks(s, t);
     debug(2) << "Lowering after injecting parameter checks:\n" << s << '\n';
 
     // Compute the maximum and minimum possible value of each
     // function. Used in later bounds inference passes.
     debug(1) << "Computing bounds of each function's value\n";
+    timer.pass("Computing bounds of each function's value", s);
     FuncValueBounds func_bounds = compute_function_value_bounds(order, env);
 
     // The checks will be in terms of the symbols defined by bounds
     // inference.
     debug(1) << "Adding checks for images\n";
+    timer.pass("Adding checks for images", s);
     s = add_image_checks(s, outputs, t, order, env, func_bounds);
     debug(2) << "Lowering after injecting image checks:\n" << s << '\n';
 
@@ -157,18 +172,25 @@ Module lower(const vector<Function> &output_funcs, const string &pipeline_name,
     // can still simplify Exprs).
     vector<BoundsInference_Stage> inlined_stages;
     debug(1) << "Performing computation bounds inference...\n";
+    timer.pass("Performing computation bounds inference", s);
     s = bounds_inference(s, outputs, order, env, func_bounds, inlined_stages, t);
     debug(2) << "Lowering after computation bounds inference:\n" << s << '\n';
+    if (stop_after == LoweringPass::BoundsInference) {
+        return stop(s);
+    }
 
     debug(1) << "Performing sliding window optimization...\n";
+    timer.pass("Performing sliding window optimization", s);
     s = sliding_window(s, env);
     debug(2) << "Lowering after sliding window:\n" << s << '\n';
 
     debug(1) << "Performing allocation bounds inference...\n";
+    timer.pass("Performing allocation bounds inference", s);
     s = allocation_bounds_inference(s, env, func_bounds);
     debug(2) << "Lowering after allocation bounds inference:\n" << s << '\n';
 
     debug(1) << "Removing code that depends on undef values...\n";
+    timer.pass("Removing code that depends on undef values", s);
     s = remove_undef(s);
     debug(2) << "Lowering after removing code that depends on undef values:\n" << s << "\n\n";
 
@@ -176,17 +198,19 @@ Module lower(const vector<Function> &output_funcs, const string &pipeline_name,
     // after this point. This lets later passes assume syntactic
     // equivalence means semantic equivalence.
     debug(1) << "Uniquifying variable names...\n";
+    timer.pass("Uniquifying variable names", s);
     s = uniquify_variable_names(s);
     debug(2) << "Lowering after uniquifying variable names:\n" << s << "\n\n";
 
     {
         // passes specific to HLS backend
         debug(1) << "Performing HLS target optimization..\n";
+        timer.pass("Performing HLS target optimization", s);
         vector<HWKernelDAG> dags;
         s = extract_hw_kernel_dag(s, env, inlined_stages, dags);
 
         for(const HWKernelDAG &dag : dags) {
-            s = stream_opt(s, dag);
+            s = stream_opt(s, dag, t);
             //s = replace_image_param(s, dag);
         }
 
@@ -194,36 +218,75 @@ Module lower(const vector<Function> &output_funcs, const string &pipeline_name,
     }
 
     debug(1) << "Performing storage folding optimization...\n";
+    timer.pass("Performing storage folding optimization", s);
     s = storage_folding(s, env);
     debug(2) << "Lowering after storage folding:\n" << s << '\n';
+    return stop(s);
+}
+
+}  // namespace
+
+PartialLowering lower_until(const vector<Function> &output_funcs, const string &pipeline_name, const Target &t,
+                            LoweringPass stop_after) {
+    PassTimer timer("lowering", pipeline_name);
+    return lower_until(output_funcs, pipeline_name, t, stop_after, timer);
+}
+
+Module lower(const vector<Function> &output_funcs, const string &pipeline_name, const Target &t,
+             const vector<Argument> &args, const Internal::LoweredFunc::LinkageType linkage_type,
+             const vector<IRMutator *> &custom_passes) {
+    std::vector<std::string> namespaces;
+    std::string simple_pipeline_name = extract_namespaces(pipeline_name, namespaces);
+
+    Module result_module(simple_pipeline_name, t);
+
+    PassTimer timer("lowering", pipeline_name);
+    PartialLowering lowered = lower_until(output_funcs, pipeline_name, t, LoweringPass::StorageFolding, timer);
+    Stmt s = lowered.stmt;
+    const vector<Function> &outputs = lowered.outputs;
+    map<string, Function> &env = lowered.env;
+    const vector<string> &order = lowered.order;
+    const bool any_memoized = lowered.any_memoized;
 
     debug(1) << "Injecting debug_to_file calls...\n";
+    timer.pass("Injecting debug_to_file calls", s);
     s = debug_to_file(s, outputs, env);
     debug(2) << "Lowering after injecting debug_to_file calls:\n" << s << '\n';
 
     debug(1) << "Simplifying...\n"; // without removing dead lets, because storage flattening needs the strides
+    timer.pass("First simplification", s);
     s = simplify(s, false);
     debug(2) << "Lowering after first simplification:\n" << s << "\n\n";
 
     debug(1) << "Injecting prefetches...\n";
+    timer.pass("Injecting prefetches", s);
     s = inject_prefetch(s, env);
     debug(2) << "Lowering after injecting prefetches:\n" << s << "\n\n";
 
     debug(1) << "Dynamically skipping stages...\n";
+    timer.pass("Dynamically skipping stages", s);
     s = skip_stages(s, order);
     debug(2) << "Lowering after dynamically skipping stages:\n" << s << "\n\n";
 
+    debug(1) << "Forking asynchronous producers...\n";
+    timer.pass("Forking asynchronous producers", s);
+    s = fork_async_producers(s, env);
+    debug(2) << "Lowering after forking asynchronous producers:\n" << s << "\n\n";
+
     debug(1) << "Destructuring tuple-valued realizations...\n";
+    timer.pass("Destructuring tuple-valued realizations", s);
     s = split_tuples(s, env);
     debug(2) << "Lowering after destructuring tuple-valued realizations:\n" << s << "\n\n";
 
     if (t.has_feature(Target::OpenGL)) {
         debug(1) << "Injecting image intrinsics...\n";
+        timer.pass("Injecting image intrinsics", s);
         s = inject_image_intrinsics(s, env);
         debug(2) << "Lowering after image intrinsics:\n" << s << "\n\n";
     }
 
     debug(1) << "Performing storage flattening...\n";
+    timer.pass("Performing storage flattening", s);
     s = storage_flattening(s, outputs, env, t);
     if (t.has_feature(Target::Zynq)) {
         s = inject_zynq_intrinsics(s, env);
@@ -231,11 +294,13 @@ Module lower(const vector<Function> &output_funcs, const string &pipeline_name,
     debug(2) << "Lowering after storage flattening:\n" << s << "\n\n";
 
     debug(1) << "Unpacking buffer arguments...\n";
+    timer.pass("Unpacking buffer arguments", s);
     s = unpack_buffers(s);
     debug(2) << "Lowering after unpacking buffer arguments...\n";
 
     if (any_memoized) {
         debug(1) << "Rewriting memoized allocations...\n";
+        timer.pass("Rewriting memoized allocations", s);
         s = rewrite_memoized_allocations(s, env);
         debug(2) << "Lowering after rewriting memoized allocations:\n" << s << "\n\n";
     } else {
@@ -247,16 +312,19 @@ Module lower(const vector<Function> &output_funcs, const string &pipeline_name,
         t.has_feature(Target::OpenGL) ||
         (t.arch != Target::Hexagon && (t.features_any_of({Target::HVX_64, Target::HVX_128})))) {
         debug(1) << "Selecting a GPU API for GPU loops...\n";
+        timer.pass("Selecting a GPU API for GPU loops", s);
         s = select_gpu_api(s, t);
         debug(2) << "Lowering after selecting a GPU API:\n" << s << "\n\n";
 
         debug(1) << "Injecting host <-> dev buffer copies...\n";
+        timer.pass("Injecting host <-> dev buffer copies", s);
         s = inject_host_dev_buffer_copies(s, t);
         debug(2) << "Lowering after injecting host <-> dev buffer copies:\n" << s << "\n\n";
     }
 
     if (t.has_feature(Target::OpenGL)) {
         debug(1) << "Injecting OpenGL texture intrinsics...\n";
+        timer.pass("Injecting OpenGL texture intrinsics", s);
         s = inject_opengl_intrinsics(s);
         debug(2) << "Lowering after OpenGL intrinsics:\n" << s << "\n\n";
     }
@@ -264,70 +332,92 @@ Module lower(const vector<Function> &output_funcs, const string &pipeline_name,
     if (t.has_gpu_feature() ||
         t.has_feature(Target::OpenGLCompute)) {
         debug(1) << "Injecting per-block gpu synchronization...\n";
+        timer.pass("Injecting per-block gpu synchronization", s);
         s = fuse_gpu_thread_loops(s);
         debug(2) << "Lowering after injecting per-block gpu synchronization:\n" << s << "\n\n";
     }
 
     debug(1) << "Simplifying...\n";
+    timer.pass("Second simplification", s);
     s = simplify(s);
     s = unify_duplicate_lets(s);
     s = remove_trivial_for_loops(s);
     debug(2) << "Lowering after second simplifcation:\n" << s << "\n\n";
 
     debug(1) << "Reduce prefetch dimension...\n";
+    timer.pass("Reduce prefetch dimension", s);
     s = reduce_prefetch_dimension(s, t);
     debug(2) << "Lowering after reduce prefetch dimension:\n" << s << "\n";
 
     debug(1) << "Unrolling...\n";
+    timer.pass("Unrolling", s);
     s = unroll_loops(s);
     s = simplify(s);
     debug(2) << "Lowering after unrolling:\n" << s << "\n\n";
 
+    {
+        // HLS backend
+        debug(1) << "Sharing column sums of unrolled stencils...\n";
+        timer.pass("Sharing column sums of unrolled stencils", s);
+        s = share_stencil_sums(s);
+        debug(2) << "Lowering after sharing column sums:\n" << s << "\n\n";
+    }
+
     debug(1) << "Vectorizing...\n";
+    timer.pass("Vectorizing", s);
     s = vectorize_loops(s, t);
     s = simplify(s);
     debug(2) << "Lowering after vectorizing:\n" << s << "\n\n";
 
     debug(1) << "Detecting vector interleavings...\n";
+    timer.pass("Detecting vector interleavings", s);
     s = rewrite_interleavings(s);
     s = simplify(s);
     debug(2) << "Lowering after rewriting vector interleavings:\n" << s << "\n\n";
 
     debug(1) << "Partitioning loops to simplify boundary conditions...\n";
+    timer.pass("Partitioning loops to simplify boundary conditions", s);
     s = partition_loops(s);
     s = unify_duplicate_lets(s);  // try this again as all likely() calls are removed
     s = simplify(s);
     debug(2) << "Lowering after partitioning loops:\n" << s << "\n\n";
 
     debug(1) << "Trimming loops to the region over which they do something...\n";
+    timer.pass("Trimming loops to the region over which they do something", s);
     s = trim_no_ops(s);
     debug(2) << "Lowering after loop trimming:\n" << s << "\n\n";
 
     debug(1) << "Injecting early frees...\n";
+    timer.pass("Injecting early frees", s);
     s = inject_early_frees(s);
     debug(2) << "Lowering after injecting early frees:\n" << s << "\n\n";
 
     if (t.has_feature(Target::Profile)) {
         debug(1) << "Injecting profiling...\n";
-        s = inject_profiling(s, pipeline_name);
+        timer.pass("Injecting profiling", s);
+        s = inject_profiling(s, pipeline_name, t);
         debug(2) << "Lowering after injecting profiling:\n" << s << "\n\n";
     }
 
     if (t.has_feature(Target::FuzzFloatStores)) {
         debug(1) << "Fuzzing floating point stores...\n";
+        timer.pass("Fuzzing floating point stores", s);
         s = fuzz_float_stores(s);
         debug(2) << "Lowering after fuzzing floating point stores:\n" << s << "\n\n";
     }
 
     debug(1) << "Simplifying...\n";
+    timer.pass("Common subexpression elimination", s);
     s = common_subexpression_elimination(s);
 
     if (t.has_feature(Target::OpenGL)) {
         debug(1) << "Detecting varying attributes...\n";
+        timer.pass("Detecting varying attributes", s);
         s = find_linear_expressions(s);
         debug(2) << "Lowering after detecting varying attributes:\n" << s << "\n\n";
 
         debug(1) << "Moving varying attribute expressions out of the shader...\n";
+        timer.pass("Moving varying attribute expressions out of the shader", s);
         s = setup_gpu_vertex_buffer(s);
         debug(2) << "Lowering after removing varying attributes:\n" << s << "\n\n";
     }
@@ -335,26 +425,31 @@ Module lower(const vector<Function> &output_funcs, const string &pipeline_name,
     {
         // HLS backend
         debug(1) << "Perfecting nested loops for better inner loop pipelining...\n";
+        timer.pass("Perfecting nested loops for better inner loop pipelining", s);
         s = perfect_nested_loops(s);
         debug(2) << "Lowering after perfecting nested loops:\n" << s << "\n\n";
     }
 
+    timer.pass("Final simplification", s);
     s = remove_dead_allocations(s);
     s = remove_trivial_for_loops(s);
     s = simplify(s);
     debug(1) << "Lowering after final simplification:\n" << s << "\n\n";
 
     debug(1) << "Splitting off Hexagon offload...\n";
+    timer.pass("Splitting off Hexagon offload", s);
     s = inject_hexagon_rpc(s, t, result_module);
     debug(2) << "Lowering after splitting off Hexagon offload:\n" << s << '\n';
 
     if (!custom_passes.empty()) {
         for (size_t i = 0; i < custom_passes.size(); i++) {
             debug(1) << "Running custom lowering pass " << i << "...\n";
+            timer.pass("Custom lowering pass " + std::to_string(i), s);
             s = custom_passes[i]->mutate(s);
             debug(1) << "Lowering after custom pass " << i << ":\n" << s << "\n\n";
         }
     }
+    timer.done(s);
 
     vector<Argument> public_args = args;
     for (const auto &out : outputs) {
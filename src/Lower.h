@@ -8,8 +8,10 @@
  */
 
 #include <iterator>
+#include <map>
 
 #include "Argument.h"
+#include "Function.h"
 #include "IR.h"
 #include "Module.h"
 #include "Target.h"
@@ -38,6 +40,30 @@ EXPORT Module lower(const std::vector<Function> &output_funcs, const std::string
 EXPORT Stmt lower_main_stmt(const std::vector<Function> &output_funcs, const std::string &pipeline_name, const Target &t,
                             const std::vector<IRMutator *> &custom_passes = std::vector<IRMutator *>());
 
+/** The passes of lowering that lower_until can stop after. */
+enum class LoweringPass {
+    InitialLoopNests,
+    BoundsInference,
+    StorageFolding
+};
+
+/** A pipeline lowered part of the way by lower_until: the statement
+ * so far, and the deep copies of the functions it computes. */
+struct PartialLowering {
+    Stmt stmt;
+    std::vector<Function> outputs;
+    std::map<std::string, Function> env;
+    std::vector<std::string> order;
+    bool any_memoized;
+};
+
+/** Run the passes of lower on the given functions, in the same order,
+ * up to and including stop_after. lower itself continues from the
+ * result. Useful for analyses of the loop nest and allocations a
+ * schedule produces, such as footprint_report. */
+EXPORT PartialLowering lower_until(const std::vector<Function> &output_funcs, const std::string &pipeline_name,
+                                   const Target &t, LoweringPass stop_after);
+
 void lower_test();
 
 }
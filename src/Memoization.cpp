@@ -2,12 +2,16 @@
 #include "Error.h"
 #include "IRMutator.h"
 #include "IROperator.h"
+#include "IRPrinter.h"
 #include "Param.h"
+#include "Reduction.h"
 #include "Scope.h"
 #include "Util.h"
 #include "Var.h"
 
 #include <map>
+#include <set>
+#include <sstream>
 
 namespace Halide {
 namespace Internal {
@@ -20,6 +24,10 @@ public:
     ~FindParameterDependencies() { }
 
     void visit_function(const Function &function) {
+        if (described.insert(function.name()).second) {
+            describe(function);
+        }
+
         function.accept(this);
 
         if (function.has_extern_definition()) {
@@ -109,7 +117,15 @@ public:
         info.type = expr.type();
         info.size_expr = info.type.bytes();
         info.value_expr = expr;
-        dependency_info[DependencyKey(info.type.bytes(), unique_name("memoize_tag"))] = info;
+        // Number the tags in the order they are found, rather than
+        // with unique_name, so that the layout of the key doesn't
+        // depend on what else was compiled first.
+        std::ostringstream name;
+        name << "memoize_tag.";
+        name.width(8);
+        name.fill('0');
+        name << num_tags++;
+        dependency_info[DependencyKey(info.type.bytes(), name.str())] = info;
     }
 
     // Used to make sure larger parameters come before smaller ones
@@ -139,15 +155,77 @@ public:
     };
 
     std::map<DependencyKey, DependencyInfo> dependency_info;
+
+    // The definitions of the function and everything it calls, which
+    // together with the parameters determine its result.
+    std::ostringstream definitions;
+
+private:
+    std::set<std::string> described;
+    int num_tags = 0;
+
+    void describe(const Definition &def) {
+        for (const Expr &arg : def.args()) {
+            definitions << arg << ",";
+        }
+        definitions << "=";
+        for (const Expr &value : def.values()) {
+            definitions << value << ",";
+        }
+        definitions << "if " << def.predicate();
+        for (const ReductionVariable &rv : def.schedule().rvars()) {
+            definitions << " " << rv.var << " in [" << rv.min << ", " << rv.extent << "]";
+        }
+        definitions << ";";
+    }
+
+    void describe(const Function &function) {
+        definitions << function.name() << "(";
+        for (const std::string &arg : function.args()) {
+            definitions << arg << ",";
+        }
+        definitions << ")";
+        if (function.has_extern_definition()) {
+            definitions << "extern " << function.extern_function_name() << "(";
+            for (const ExternFuncArgument &arg : function.extern_arguments()) {
+                if (arg.is_func()) {
+                    definitions << Function(arg.func).name();
+                } else if (arg.is_expr()) {
+                    definitions << arg.expr;
+                } else if (arg.is_buffer()) {
+                    definitions << arg.buffer.name();
+                } else if (arg.is_image_param()) {
+                    definitions << arg.image_param.name();
+                }
+                definitions << ",";
+            }
+            definitions << ");";
+        } else {
+            describe(function.definition());
+            for (const Definition &update : function.updates()) {
+                describe(update);
+            }
+        }
+        definitions << "\n";
+    }
 };
 
+// A 64-bit FNV-1a hash, which is the same on every host, so that
+// keys computed from it are too.
+uint64_t fingerprint(const std::string &s) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (char c : s) {
+        h = (h ^ (uint8_t)c) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
 typedef std::pair<FindParameterDependencies::DependencyKey, FindParameterDependencies::DependencyInfo> DependencyKeyInfoPair;
 
 class KeyInfo {
     FindParameterDependencies dependencies;
     Expr key_size_expr;
-    const std::string &top_level_name;
-    const std::string &function_name;
+    uint64_t definition_hash;
 
     size_t parameters_alignment() {
         int32_t max_alignment = 0;
@@ -166,27 +244,27 @@ class KeyInfo {
         return size_t(1) << i;
     }
 
-// TODO: Using the full names in the key results in a (hopefully incredibly
-// slight) performance difference based on how one names filters and
-// functions. It is arguably a little easier to debug if something
-// goes wrong as one doesn't need to destructure the cache key by hand
-// in the debugger. Also, if a pointer is used, a counter must also be
-// put in the cache key to avoid aliasing on reuse of the address in
-// JIT situations where code is regenerated into the same region of
-// memory.
-//
-// There is a plan to change the hash function used in the cache and
-// after that happens, we'll measure performance again and maybe decide
-// to choose one path or the other (see Git history for the implementation.
-// It was deleted as part of the address_of intrinsic cleanup).
-
 public:
-  KeyInfo(const Function &function, const std::string &name)
-        : top_level_name(name), function_name(function.name())
-    {
+    // The key starts with a hash of the names of the pipeline and the
+    // function, the definitions of the function and everything it
+    // calls, and the names and types of the parameters those depend
+    // on. The values of the parameters follow. Unlike the address of
+    // a string, none of this changes between runs of the same
+    // program, so keys can be saved to a backing file and looked up
+    // by later runs. It does change if any of the definitions do.
+    KeyInfo(const Function &function, const std::string &top_level_name) {
         dependencies.visit_function(function);
-        size_t size_so_far = 0;
-        size_so_far += Handle().bytes() + 4;
+
+        std::ostringstream description;
+        description << top_level_name.size() << ":" << top_level_name
+                    << function.name().size() << ":" << function.name() << "\n"
+                    << dependencies.definitions.str();
+        for (const DependencyKeyInfoPair &i : dependencies.dependency_info) {
+            description << i.second.type << " " << i.second.value_expr << "\n";
+        }
+        definition_hash = fingerprint(description.str());
+
+        size_t size_so_far = UInt(64).bytes();
 
         size_t needed_alignment = parameters_alignment();
         if (needed_alignment > 1) {
@@ -210,28 +288,11 @@ public:
         std::vector<Stmt> writes;
         Expr index = Expr(0);
 
-        // Store a pointer to a string identifying the filter and
-        // function. Assume this will be unique due to CSE. This can
-        // break with loading and unloading of code, though the name
-        // mechanism can also break in those conditions. For JIT, a
-        // counter is needed as the address may be reused. This isn't
-        // a problem when using full names as the function names
-        // already are uniquefied by a counter.
-        writes.push_back(Store::make(key_name,
-                                     StringImm::make(std::to_string(top_level_name.size()) + ":" + top_level_name +
-                                                     std::to_string(function_name.size()) + ":" + function_name),
-                                     (index / Handle().bytes()), Parameter(), const_true()));
-        size_t alignment = Handle().bytes();
-        index += Handle().bytes();
-
-        // Halide compilation is not threadsafe anyway...
-        static std::atomic<int> memoize_instance {0};
         writes.push_back(Store::make(key_name,
-                                     memoize_instance++,
-                                     (index / Int(32).bytes()),
-                                     Parameter(), const_true()));
-        alignment += 4;
-        index += 4;
+                                     make_const(UInt(64), definition_hash),
+                                     index, Parameter(), const_true()));
+        size_t alignment = UInt(64).bytes();
+        index += UInt(64).bytes();
 
         size_t needed_alignment = parameters_alignment();
         if (needed_alignment > 1) {
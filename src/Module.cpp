@@ -2,6 +2,7 @@
 
 #include <array>
 #include <fstream>
+#include <functional>
 #include <future>
 
 #include "CodeGen_C.h"
@@ -73,6 +74,49 @@ private:
     void operator=(const TemporaryObjectFileDir &) = delete;
 };
 
+// The number of threads to compile independent parts of a Module
+// on. If we are running with HL_DEBUG_CODEGEN=1, use one, so that
+// debug output won't be utterly incomprehensible.
+size_t num_compile_threads() {
+    return (debug::debug_level() > 0) ? 1 : ThreadPool<void>::num_processors_online();
+}
+
+// Set on a thread while it runs one of the tasks below.
+thread_local bool in_independent_task = false;
+
+// Run some independent tasks, concurrently if there is more than one,
+// and wait for them all to finish. Anything that uses LLVM must make
+// its own LLVMContext. Each task draws its own names, so the output
+// doesn't depend on the number of threads or the order the tasks run
+// in. Tasks started from within a task (e.g. the outputs of each
+// target of a multitarget compile) run on the thread of the task that
+// started them: the outer tasks are already spread over every core.
+void run_independent_tasks(const std::vector<std::function<void()>> &tasks) {
+    UniqueNameFork names(tasks.size());
+    auto run_task = [&](size_t i) {
+        UniqueNameFork::Task scope(names, i);
+        bool outer = in_independent_task;
+        in_independent_task = true;
+        tasks[i]();
+        in_independent_task = outer;
+    };
+
+    const size_t num_threads = in_independent_task ? 1 : std::min(tasks.size(), num_compile_threads());
+    if (num_threads <= 1) {
+        for (size_t i = 0; i < tasks.size(); i++) {
+            run_task(i);
+        }
+        return;
+    }
+    ThreadPool<void> pool(num_threads);
+    std::vector<std::future<void>> futures;
+    for (size_t i = 0; i < tasks.size(); i++) {
+        futures.emplace_back(pool.async(run_task, i));
+    }
+    for (auto &f : futures) {
+        f.wait();
+    }
+}
 
 // Given a pathname of the form /path/to/name.ext, append suffix before ext to produce /path/to/namesuffix.ext
 std::string add_suffix(const std::string &path, const std::string &suffix) {
@@ -146,6 +190,84 @@ LoweredFunc::LoweredFunc(const std::string &name,
     }
 }
 
+void check_multitarget_targets(const std::vector<Target> &targets, const std::string &caller) {
+    user_assert(!targets.empty()) << "Must specify at least one target.\n";
+    const Target &base_target = targets.back();
+    for (const Target &target : targets) {
+        // arch-bits-os must be identical across all targets.
+        if (target.os != base_target.os ||
+            target.arch != base_target.arch ||
+            target.bits != base_target.bits) {
+            user_error << "All Targets must have matching arch-bits-os for " << caller << ".\n";
+        }
+        // Some features must match across all targets.
+        static const std::array<Target::Feature, 7> must_match_features = {{
+            Target::CPlusPlusMangling,
+            Target::JIT,
+            Target::Matlab,
+            Target::MSAN,
+            Target::NoRuntime,
+            Target::PooledMalloc,
+            Target::UserContext,
+        }};
+        for (auto f : must_match_features) {
+            if (target.has_feature(f) != base_target.has_feature(f)) {
+                user_error << "All Targets must have feature " << f << " set identically for " << caller << ".\n";
+                break;
+            }
+        }
+    }
+}
+
+Module make_multitarget_wrapper(const std::string &fn_name,
+                                const std::vector<Target> &targets,
+                                const std::vector<std::string> &sub_fn_names,
+                                const std::vector<LoweredArgument> &args) {
+    internal_assert(targets.size() > 1 && targets.size() == sub_fn_names.size());
+    const Target &base_target = targets.back();
+
+    std::vector<Expr> wrapper_args;
+    for (size_t i = 0; i < targets.size(); i++) {
+        Expr can_use = (targets[i] == base_target) ?
+                        IntImm::make(Int(32), 1) :
+                        Call::make(Int(32), "halide_can_use_target_features",
+                                   {UIntImm::make(UInt(64), target_feature_mask(targets[i]))},
+                                   Call::Extern);
+        wrapper_args.push_back(can_use != 0);
+        wrapper_args.push_back(sub_fn_names[i]);
+    }
+
+    Expr indirect_result = Call::make(Int(32), Call::call_cached_indirect_function, wrapper_args, Call::Intrinsic);
+    std::string private_result_name = unique_name(fn_name + "_result");
+    Expr private_result_var = Variable::make(Int(32), private_result_name);
+    Stmt wrapper_body = AssertStmt::make(private_result_var == 0, private_result_var);
+    wrapper_body = LetStmt::make(private_result_name, indirect_result, wrapper_body);
+
+    // Always build with NoRuntime: that's handled as a separate module.
+    //
+    // Always build with NoBoundsQuery: underlying code will implement that (or not).
+    //
+    // Always build *without* NoAsserts (ie, with Asserts enabled): that's the
+    // only way to propagate a nonzero result code to our caller. (Note that this
+    // does mean we get redundant check-for-null tests in the wrapper code for buffer_t*
+    // arguments; this is regrettable but fairly minor in terms of both code size and speed,
+    // at least for real-world code.)
+    Target wrapper_target = base_target
+        .with_feature(Target::NoRuntime)
+        .with_feature(Target::NoBoundsQuery)
+        .without_feature(Target::NoAsserts);
+
+    // If the base target specified the Matlab target, we want the Matlab target
+    // on the wrapper instead.
+    if (base_target.has_feature(Target::Matlab)) {
+        wrapper_target = wrapper_target.with_feature(Target::Matlab);
+    }
+
+    Module wrapper_module(fn_name, wrapper_target);
+    wrapper_module.append(LoweredFunc(fn_name, args, wrapper_body, LoweredFunc::ExternalPlusMetadata));
+    return wrapper_module;
+}
+
 }  // namespace Internal
 
 using namespace Halide::Internal;
@@ -280,25 +402,37 @@ Module Module::resolve_submodules() const {
     for (const auto &ec : external_code()) {
         lowered_module.append(ec);
     }
-    for (const auto &m : submodules()) {
-        Module copy(m.resolve_submodules());
-
-        // Propagate external code blocks.
-        for (const auto &ec : external_code()) {
-            // TODO(zalman): Is this the right thing to do?
-            bool already_in_list = false;
-            for (const auto &ec_sub : copy.external_code()) {
-                if (ec_sub.name() == ec.name()) {
-                    already_in_list = true;
-                    break;
+
+    // The submodules are compiled independently of each other, each
+    // to its own object, so do them concurrently, and then append
+    // them in order.
+    std::vector<Buffer<>> bufs(submodules().size());
+    std::vector<std::function<void()>> tasks;
+    for (size_t i = 0; i < submodules().size(); i++) {
+        tasks.push_back([this, i, &bufs]() {
+            Module copy(submodules()[i].resolve_submodules());
+
+            // Propagate external code blocks.
+            for (const auto &ec : external_code()) {
+                // TODO(zalman): Is this the right thing to do?
+                bool already_in_list = false;
+                for (const auto &ec_sub : copy.external_code()) {
+                    if (ec_sub.name() == ec.name()) {
+                        already_in_list = true;
+                        break;
+                    }
+                }
+                if (!already_in_list) {
+                    copy.append(ec);
                 }
             }
-            if (!already_in_list) {
-                copy.append(ec);
-            }
-        }
 
-        auto buf = copy.compile_to_buffer();
+            bufs[i] = copy.compile_to_buffer();
+        });
+    }
+    run_independent_tasks(tasks);
+
+    for (const auto &buf : bufs) {
         lowered_module.append(buf);
     }
 
@@ -314,90 +448,109 @@ void Module::compile(const Outputs &output_files) const {
         return;
     }
 
-    if (!output_files.object_name.empty() || !output_files.assembly_name.empty() ||
+    // The LLVM outputs, the C source, the C header and the stmt
+    // outputs don't depend on each other, so produce them
+    // concurrently.
+    std::vector<std::function<void()>> tasks;
+
+    const bool llvm_outputs =
+        !output_files.object_name.empty() || !output_files.assembly_name.empty() ||
         !output_files.bitcode_name.empty() || !output_files.llvm_assembly_name.empty() ||
-        !output_files.static_library_name.empty()) {
-        llvm::LLVMContext context;
-        std::unique_ptr<llvm::Module> llvm_module(compile_module_to_llvm_module(*this, context));
-
-        if (!output_files.object_name.empty()) {
-            debug(1) << "Module.compile(): object_name " << output_files.object_name << "\n";
-            auto out = make_raw_fd_ostream(output_files.object_name);
-            compile_llvm_module_to_object(*llvm_module, *out);
-        }
-        if (!output_files.static_library_name.empty()) {
-            // To simplify the code, we always create a temporary object output
-            // here, even if output_files.object_name was also set: in practice,
-            // no real-world code ever sets both object_name and static_library_name
-            // at the same time, so there is no meaningful performance advantage
-            // to be had.
-            TemporaryObjectFileDir temp_dir;
-            {
-                std::string object_name = temp_dir.add_temp_object_file(output_files.static_library_name, "", target());
-                debug(1) << "Module.compile(): temporary object_name " << object_name << "\n";
-                auto out = make_raw_fd_ostream(object_name);
+        !output_files.static_library_name.empty();
+    if (llvm_outputs) {
+        tasks.push_back([&]() {
+            llvm::LLVMContext context;
+            std::unique_ptr<llvm::Module> llvm_module(compile_module_to_llvm_module(*this, context));
+
+            if (!output_files.object_name.empty()) {
+                debug(1) << "Module.compile(): object_name " << output_files.object_name << "\n";
+                auto out = make_raw_fd_ostream(output_files.object_name);
                 compile_llvm_module_to_object(*llvm_module, *out);
-                out->flush();  // create_static_library() is happier if we do this
             }
-            debug(1) << "Module.compile(): static_library_name " << output_files.static_library_name << "\n";
-            Target base_target(target().os, target().arch, target().bits);
-            create_static_library(temp_dir.files(), base_target, output_files.static_library_name);
-        }
-        if (!output_files.assembly_name.empty()) {
-            debug(1) << "Module.compile(): assembly_name " << output_files.assembly_name << "\n";
-            auto out = make_raw_fd_ostream(output_files.assembly_name);
-            compile_llvm_module_to_assembly(*llvm_module, *out);
-        }
-        if (!output_files.bitcode_name.empty()) {
-            debug(1) << "Module.compile(): bitcode_name " << output_files.bitcode_name << "\n";
-            auto out = make_raw_fd_ostream(output_files.bitcode_name);
-            compile_llvm_module_to_llvm_bitcode(*llvm_module, *out);
-        }
-        if (!output_files.llvm_assembly_name.empty()) {
-            debug(1) << "Module.compile(): llvm_assembly_name " << output_files.llvm_assembly_name << "\n";
-            auto out = make_raw_fd_ostream(output_files.llvm_assembly_name);
-            compile_llvm_module_to_llvm_assembly(*llvm_module, *out);
-        }
-    }
-    if (!output_files.c_header_name.empty()) {
-        debug(1) << "Module.compile(): c_header_name " << output_files.c_header_name << "\n";
-        std::ofstream file(output_files.c_header_name);
-        Internal::CodeGen_C cg(file,
-                               target(),
-                               target().has_feature(Target::CPlusPlusMangling) ?
-                               Internal::CodeGen_C::CPlusPlusHeader : Internal::CodeGen_C::CHeader,
-                               output_files.c_header_name);
-        cg.compile(*this);
+            if (!output_files.static_library_name.empty()) {
+                // To simplify the code, we always create a temporary object output
+                // here, even if output_files.object_name was also set: in practice,
+                // no real-world code ever sets both object_name and static_library_name
+                // at the same time, so there is no meaningful performance advantage
+                // to be had.
+                TemporaryObjectFileDir temp_dir;
+                {
+                    std::string object_name = temp_dir.add_temp_object_file(output_files.static_library_name, "", target());
+                    debug(1) << "Module.compile(): temporary object_name " << object_name << "\n";
+                    auto out = make_raw_fd_ostream(object_name);
+                    compile_llvm_module_to_object(*llvm_module, *out);
+                    out->flush();  // create_static_library() is happier if we do this
+                }
+                debug(1) << "Module.compile(): static_library_name " << output_files.static_library_name << "\n";
+                Target base_target(target().os, target().arch, target().bits);
+                create_static_library(temp_dir.files(), base_target, output_files.static_library_name);
+            }
+            if (!output_files.assembly_name.empty()) {
+                debug(1) << "Module.compile(): assembly_name " << output_files.assembly_name << "\n";
+                auto out = make_raw_fd_ostream(output_files.assembly_name);
+                compile_llvm_module_to_assembly(*llvm_module, *out);
+            }
+            if (!output_files.bitcode_name.empty()) {
+                debug(1) << "Module.compile(): bitcode_name " << output_files.bitcode_name << "\n";
+                auto out = make_raw_fd_ostream(output_files.bitcode_name);
+                compile_llvm_module_to_llvm_bitcode(*llvm_module, *out);
+            }
+            if (!output_files.llvm_assembly_name.empty()) {
+                debug(1) << "Module.compile(): llvm_assembly_name " << output_files.llvm_assembly_name << "\n";
+                auto out = make_raw_fd_ostream(output_files.llvm_assembly_name);
+                compile_llvm_module_to_llvm_assembly(*llvm_module, *out);
+            }
+        });
     }
     if (!output_files.c_source_name.empty()) {
-        debug(1) << "Module.compile(): c_source_name " << output_files.c_source_name << "\n";
-        std::ofstream file(output_files.c_source_name);
-        //----- HLS Modification Begins -----//
-        CodeGen_C::OutputKind output_kind =
-            target().has_feature(Target::CPlusPlusMangling)
-                ? CodeGen_C::CPlusPlusImplementation
-                : CodeGen_C::CImplementation;
-        CodeGen_C *cg;
-        if (target().has_feature(Target::VivadoHLS)) {
-            cg = new CodeGen_HLS_Testbench(file, target(), output_kind);
-        } else if (target().has_feature(Target::Zynq)) {
-            cg = new CodeGen_Zynq_C(file, target(), output_kind);
-        } else {
-            cg = new CodeGen_C(file, target(), output_kind);
-        }
-        cg->compile(*this);
-        delete cg;
-        //----- HLS Modification Ends -------//
+        tasks.push_back([&]() {
+            debug(1) << "Module.compile(): c_source_name " << output_files.c_source_name << "\n";
+            std::ofstream file(output_files.c_source_name);
+            //----- HLS Modification Begins -----//
+            CodeGen_C::OutputKind output_kind =
+                target().has_feature(Target::CPlusPlusMangling)
+                    ? CodeGen_C::CPlusPlusImplementation
+                    : CodeGen_C::CImplementation;
+            CodeGen_C *cg;
+            if (target().has_feature(Target::VivadoHLS)) {
+                cg = new CodeGen_HLS_Testbench(file, target(), output_kind);
+            } else if (target().has_feature(Target::Zynq)) {
+                cg = new CodeGen_Zynq_C(file, target(), output_kind);
+            } else {
+                cg = new CodeGen_C(file, target(), output_kind);
+            }
+            cg->compile(*this);
+            delete cg;
+            //----- HLS Modification Ends -------//
+        });
+    }
+    if (!output_files.c_header_name.empty()) {
+        tasks.push_back([&]() {
+            debug(1) << "Module.compile(): c_header_name " << output_files.c_header_name << "\n";
+            std::ofstream file(output_files.c_header_name);
+            Internal::CodeGen_C cg(file,
+                                   target(),
+                                   target().has_feature(Target::CPlusPlusMangling) ?
+                                   Internal::CodeGen_C::CPlusPlusHeader : Internal::CodeGen_C::CHeader,
+                                   output_files.c_header_name);
+            cg.compile(*this);
+        });
     }
     if (!output_files.stmt_name.empty()) {
-        debug(1) << "Module.compile(): stmt_name " << output_files.stmt_name << "\n";
-        std::ofstream file(output_files.stmt_name);
-        file << *this;
+        tasks.push_back([&]() {
+            debug(1) << "Module.compile(): stmt_name " << output_files.stmt_name << "\n";
+            std::ofstream file(output_files.stmt_name);
+            file << *this;
+        });
     }
     if (!output_files.stmt_html_name.empty()) {
-        debug(1) << "Module.compile(): stmt_html_name " << output_files.stmt_html_name << "\n";
-        Internal::print_to_html(output_files.stmt_html_name, *this);
+        tasks.push_back([&]() {
+            debug(1) << "Module.compile(): stmt_html_name " << output_files.stmt_html_name << "\n";
+            Internal::print_to_html(output_files.stmt_html_name, *this);
+        });
     }
+
+    run_independent_tasks(tasks);
 }
 
 Outputs compile_standalone_runtime(const Outputs &output_files, Target t) {
@@ -443,11 +596,10 @@ void compile_multitarget(const std::string &fn_name,
         return;
     }
 
-    std::vector<std::future<void>> futures;
-    // If we are running with HL_DEBUG_CODEGEN=1, use threads=1 to enforce
-    // sequential execution, so that debug output won't be utterly incomprehensible
-    const size_t num_threads = (debug::debug_level() > 0) ? 1 : Internal::ThreadPool<void>::num_processors_online();
-    Internal::ThreadPool<void> pool(num_threads);
+    // Produce each target's module here, as producers (e.g. Generators)
+    // may not be safe to run from several threads, and compile them
+    // afterwards, concurrently.
+    std::vector<std::function<void()>> tasks;
 
     // For safety, the runtime must be built only with features common to all
     // of the targets; given an unusual ordering like
@@ -461,31 +613,11 @@ void compile_multitarget(const std::string &fn_name,
     uint64_t runtime_features_mask = (uint64_t)-1LL;
 
     TemporaryObjectFileDir temp_dir;
-    std::vector<Expr> wrapper_args;
+    check_multitarget_targets(targets, "compile_multitarget");
+
+    std::vector<std::string> sub_fn_names;
     std::vector<LoweredArgument> base_target_args;
     for (const Target &target : targets) {
-        // arch-bits-os must be identical across all targets.
-        if (target.os != base_target.os ||
-            target.arch != base_target.arch ||
-            target.bits != base_target.bits) {
-            user_error << "All Targets must have matching arch-bits-os for compile_multitarget.\n";
-        }
-        // Some features must match across all targets.
-        static const std::array<Target::Feature, 6> must_match_features = {{
-            Target::CPlusPlusMangling,
-            Target::JIT,
-            Target::Matlab,
-            Target::MSAN,
-            Target::NoRuntime,
-            Target::UserContext,
-        }};
-        for (auto f : must_match_features) {
-            if (target.has_feature(f) != base_target.has_feature(f)) {
-                user_error << "All Targets must have feature " << f << " set identically for compile_multitarget.\n";
-                break;
-            }
-        }
-
         // Each sub-target has a function name that is the 'real' name plus a suffix
         // (which defaults to the target string but can be customized via the suffixes map)
         std::string suffix = replace_all(target.to_string(), "-", "_");
@@ -511,22 +643,13 @@ void compile_multitarget(const std::string &fn_name,
         Outputs sub_out = add_suffixes(output_files, suffix);
         internal_assert(sub_out.object_name.empty());
         sub_out.object_name = temp_dir.add_temp_object_file(output_files.static_library_name, suffix, target);
-        futures.emplace_back(pool.async([](Module m, Outputs o) {
+        tasks.push_back(std::bind([](const Module &m, const Outputs &o) {
             debug(1) << "compile_multitarget: compile_sub_target " << o.object_name << "\n";
             m.compile(o);
         }, std::move(sub_module), std::move(sub_out)));
 
-        const uint64_t cur_target_mask = target_feature_mask(target);
-        Expr can_use = (target == base_target) ?
-                        IntImm::make(Int(32), 1) :
-                        Call::make(Int(32), "halide_can_use_target_features",
-                                   {UIntImm::make(UInt(64), cur_target_mask)},
-                                   Call::Extern);
-
-        runtime_features_mask &= cur_target_mask;
-
-        wrapper_args.push_back(can_use != 0);
-        wrapper_args.push_back(sub_fn_name);
+        runtime_features_mask &= target_feature_mask(target);
+        sub_fn_names.push_back(sub_fn_name);
     }
 
     // If we haven't specified "no runtime", build a runtime with the base target
@@ -545,48 +668,21 @@ void compile_multitarget(const std::string &fn_name,
         }
         Outputs runtime_out = Outputs().object(
             temp_dir.add_temp_object_file(output_files.static_library_name, "_runtime", runtime_target));
-        futures.emplace_back(pool.async([](Target t, Outputs o) {
+        tasks.push_back(std::bind([](const Target &t, const Outputs &o) {
             debug(1) << "compile_multitarget: compile_standalone_runtime " << o.static_library_name << "\n";
             compile_standalone_runtime(o, t);
         }, std::move(runtime_target), std::move(runtime_out)));
     }
 
     if (needs_wrapper) {
-        Expr indirect_result = Call::make(Int(32), Call::call_cached_indirect_function, wrapper_args, Call::Intrinsic);
-        std::string private_result_name = unique_name(fn_name + "_result");
-        Expr private_result_var = Variable::make(Int(32), private_result_name);
-        Stmt wrapper_body = AssertStmt::make(private_result_var == 0, private_result_var);
-        wrapper_body = LetStmt::make(private_result_name, indirect_result, wrapper_body);
-
-        // Always build with NoRuntime: that's handled as a separate module.
-        //
-        // Always build with NoBoundsQuery: underlying code will implement that (or not).
-        //
-        // Always build *without* NoAsserts (ie, with Asserts enabled): that's the
-        // only way to propagate a nonzero result code to our caller. (Note that this
-        // does mean we get redundant check-for-null tests in the wrapper code for buffer_t*
-        // arguments; this is regrettable but fairly minor in terms of both code size and speed,
-        // at least for real-world code.)
-        Target wrapper_target = base_target
-            .with_feature(Target::NoRuntime)
-            .with_feature(Target::NoBoundsQuery)
-            .without_feature(Target::NoAsserts);
-
-        // If the base target specified the Matlab target, we want the Matlab target
-        // on the wrapper instead.
-        if (base_target.has_feature(Target::Matlab)) {
-            wrapper_target = wrapper_target.with_feature(Target::Matlab);
-        }
-
-        Module wrapper_module(fn_name, wrapper_target);
-        wrapper_module.append(LoweredFunc(fn_name, base_target_args, wrapper_body, LoweredFunc::ExternalPlusMetadata));
+        Module wrapper_module = make_multitarget_wrapper(fn_name, targets, sub_fn_names, base_target_args);
 
         // Add a wrapper to accept old buffer_ts
         add_legacy_wrapper(wrapper_module, wrapper_module.functions().back());
 
         Outputs wrapper_out = Outputs().object(
             temp_dir.add_temp_object_file(output_files.static_library_name, "_wrapper", base_target, /* in_front*/ true));
-        futures.emplace_back(pool.async([](Module m, Outputs o) {
+        tasks.push_back(std::bind([](const Module &m, const Outputs &o) {
             debug(1) << "compile_multitarget: wrapper " << o.object_name << "\n";
             m.compile(o);
         }, std::move(wrapper_module), std::move(wrapper_out)));
@@ -596,16 +692,14 @@ void compile_multitarget(const std::string &fn_name,
         Module header_module(fn_name, base_target);
         header_module.append(LoweredFunc(fn_name, base_target_args, {}, LoweredFunc::ExternalPlusMetadata));
         Outputs header_out = Outputs().c_header(output_files.c_header_name);
-        futures.emplace_back(pool.async([](Module m, Outputs o) {
+        tasks.push_back(std::bind([](const Module &m, const Outputs &o) {
             debug(1) << "compile_multitarget: c_header_name " << o.c_header_name << "\n";
             m.compile(o);
         }, std::move(header_module), std::move(header_out)));
     }
 
     // Must wait for everything to finish before we create the static library
-    for (auto &f : futures) {
-        f.wait();
-    }
+    run_independent_tasks(tasks);
 
     if (!output_files.static_library_name.empty()) {
         debug(1) << "compile_multitarget: static_library_name " << output_files.static_library_name << "\n";
@@ -143,6 +143,27 @@ EXPORT Outputs compile_standalone_runtime(const Outputs &output_files, Target t)
 
 typedef std::function<Module(const std::string &, const Target &)> ModuleProducer;
 
+namespace Internal {
+
+/** Check that a list of targets can be dispatched between at runtime:
+ * they must share arch-bits-os and some features. Reports errors as
+ * coming from the named caller. */
+EXPORT void check_multitarget_targets(const std::vector<Target> &targets, const std::string &caller);
+
+/** Make a module containing a function that calls the first of the
+ * named sub-functions whose target's features the machine it's
+ * running on has, as reported by halide_can_use_target_features. The
+ * last target is the baseline, which is always used if no other
+ * target can be. The choice is made on the first call and cached. The
+ * sub-functions must all take the given arguments. */
+EXPORT Module make_multitarget_wrapper(const std::string &fn_name,
+                                       const std::vector<Target> &targets,
+                                       const std::vector<std::string> &sub_fn_names,
+                                       const std::vector<LoweredArgument> &args);
+
+}
+
+
 EXPORT void compile_multitarget(const std::string &fn_name,
                                 const Outputs &output_files,
                                 const std::vector<Target> &targets,
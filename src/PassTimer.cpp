@@ -0,0 +1,190 @@
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include "PassTimer.h"
+#include "Debug.h"
+#include "IRVisitor.h"
+#include "Util.h"
+
+namespace Halide {
+namespace Internal {
+
+using std::string;
+using std::vector;
+
+namespace {
+
+const size_t unknown_size = (size_t)-1;
+
+class CountIRNodes : public IRGraphVisitor {
+public:
+    size_t count() const {
+        return visited.size();
+    }
+};
+
+// The events of all the PassTimers in the process, for the Chrome
+// trace, which is rewritten in full each time a PassTimer finishes.
+struct PassTrace {
+    std::mutex mutex;
+    std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+    std::map<std::thread::id, int> thread_ids;
+    vector<string> events;
+};
+
+PassTrace &pass_trace() {
+    static PassTrace *trace = new PassTrace;
+    return *trace;
+}
+
+// Escape a string for a JSON string literal.
+string json_escape(const string &s) {
+    std::ostringstream out;
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if ((unsigned char)c < ' ') {
+            out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int)c << std::dec;
+        } else {
+            out << c;
+        }
+    }
+    return out.str();
+}
+
+string size_to_string(size_t size) {
+    return size == unknown_size ? "?" : std::to_string(size);
+}
+
+}  // namespace
+
+size_t count_ir_nodes(const Stmt &s) {
+    if (!s.defined()) {
+        return 0;
+    }
+    CountIRNodes counter;
+    s.accept(&counter);
+    return counter.count();
+}
+
+PassTimer::PassTimer(const string &phase, const string &pipeline_name)
+    : running(false), phase(phase), pipeline_name(pipeline_name) {
+    is_enabled = !get_env_variable("HL_PASS_TIMINGS").empty() ||
+        !get_env_variable("HL_PASS_TIMINGS_TRACE").empty();
+}
+
+void PassTimer::pass(const string &name, const Stmt &input) {
+    if (is_enabled) {
+        pass(name, count_ir_nodes(input));
+    }
+}
+
+void PassTimer::pass(const string &name, size_t input_size) {
+    if (!is_enabled) {
+        return;
+    }
+    done(input_size);
+    Pass p;
+    p.name = name;
+    p.input_size = input_size;
+    p.output_size = unknown_size;
+    p.start = std::chrono::steady_clock::now();
+    passes.push_back(p);
+    running = true;
+}
+
+void PassTimer::done(const Stmt &output) {
+    if (is_enabled && running) {
+        done(count_ir_nodes(output));
+    }
+}
+
+void PassTimer::done(size_t output_size) {
+    if (!is_enabled || !running) {
+        return;
+    }
+    passes.back().end = std::chrono::steady_clock::now();
+    passes.back().output_size = output_size;
+    running = false;
+}
+
+PassTimer::~PassTimer() {
+    if (!is_enabled || passes.empty()) {
+        return;
+    }
+    if (running) {
+        done(unknown_size);
+    }
+
+    if (!get_env_variable("HL_PASS_TIMINGS").empty()) {
+        size_t name_width = 5;
+        double total = 0;
+        for (const Pass &p : passes) {
+            name_width = std::max(name_width, p.name.size());
+            total += std::chrono::duration<double, std::milli>(p.end - p.start).count();
+        }
+        std::ostringstream report;
+        report << "Pass timings for " << phase << " of " << pipeline_name << ":\n"
+               << std::left << "  " << std::setw(name_width) << "pass"
+               << std::right << std::setw(12) << "time (ms)"
+               << std::setw(8) << "%"
+               << std::setw(14) << "nodes before"
+               << std::setw(14) << "nodes after" << "\n";
+        report << std::fixed << std::setprecision(3);
+        for (const Pass &p : passes) {
+            double ms = std::chrono::duration<double, std::milli>(p.end - p.start).count();
+            report << "  " << std::left << std::setw(name_width) << p.name
+                   << std::right << std::setw(12) << ms
+                   << std::setw(8) << std::setprecision(1) << (total > 0 ? 100 * ms / total : 0)
+                   << std::setprecision(3)
+                   << std::setw(14) << size_to_string(p.input_size)
+                   << std::setw(14) << size_to_string(p.output_size) << "\n";
+        }
+        report << "  " << std::left << std::setw(name_width) << "total"
+               << std::right << std::setw(12) << total << "\n";
+        debug(0) << report.str();
+    }
+
+    string trace_file = get_env_variable("HL_PASS_TIMINGS_TRACE");
+    if (!trace_file.empty()) {
+        PassTrace &trace = pass_trace();
+        std::lock_guard<std::mutex> lock(trace.mutex);
+        auto it = trace.thread_ids.find(std::this_thread::get_id());
+        if (it == trace.thread_ids.end()) {
+            it = trace.thread_ids.emplace(std::this_thread::get_id(), (int)trace.thread_ids.size() + 1).first;
+        }
+        for (const Pass &p : passes) {
+            std::ostringstream event;
+            event << "{\"name\": \"" << json_escape(p.name)
+                  << "\", \"cat\": \"" << json_escape(phase)
+                  << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << it->second
+                  << ", \"ts\": " << std::chrono::duration_cast<std::chrono::microseconds>(p.start - trace.epoch).count()
+                  << ", \"dur\": " << std::chrono::duration_cast<std::chrono::microseconds>(p.end - p.start).count()
+                  << ", \"args\": {\"pipeline\": \"" << json_escape(pipeline_name) << "\"";
+            if (p.input_size != unknown_size) {
+                event << ", \"nodes_before\": " << p.input_size;
+            }
+            if (p.output_size != unknown_size) {
+                event << ", \"nodes_after\": " << p.output_size;
+            }
+            event << "}}";
+            trace.events.push_back(event.str());
+        }
+        std::ofstream out(trace_file);
+        out << "[\n";
+        for (size_t i = 0; i < trace.events.size(); i++) {
+            out << trace.events[i] << (i + 1 < trace.events.size() ? ",\n" : "\n");
+        }
+        out << "]\n";
+        if (!out) {
+            user_warning << "Could not write pass timings to " << trace_file << "\n";
+        }
+    }
+}
+
+}  // namespace Internal
+}  // namespace Halide
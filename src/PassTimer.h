@@ -0,0 +1,75 @@
+#ifndef HALIDE_PASS_TIMER_H
+#define HALIDE_PASS_TIMER_H
+
+/** \file
+ * Defines a timer for the passes of lowering and code generation, for
+ * finding out where compile time goes. Set the environment variable
+ * HL_PASS_TIMINGS to print a report of the time taken by each pass,
+ * and the size of the IR before and after it, each time a pipeline is
+ * compiled. Set HL_PASS_TIMINGS_TRACE to a file name to also write
+ * the passes of every pipeline compiled by the process there as a
+ * Chrome trace (viewable in chrome://tracing).
+ */
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "IR.h"
+
+namespace Halide {
+namespace Internal {
+
+/** Times a sequence of passes that make up one phase of compiling a
+ * pipeline. Each call to pass() ends the pass before it, so passes
+ * are timed back to back. Does nothing unless one of the environment
+ * variables above is set. The timings are reported when the PassTimer
+ * is destroyed. */
+class PassTimer {
+public:
+    /** Begin timing a phase of compilation (e.g. "lower") of a
+     * pipeline. */
+    PassTimer(const std::string &phase, const std::string &pipeline_name);
+    ~PassTimer();
+
+    /** Whether passes are being timed. Useful to skip measuring the
+     * size of IR when they aren't. */
+    bool enabled() const {
+        return is_enabled;
+    }
+
+    /** End the current pass, if any, and begin the named one, which
+     * takes the given IR, or IR of the given size. */
+    // @{
+    void pass(const std::string &name, const Stmt &input);
+    void pass(const std::string &name, size_t input_size);
+    // @}
+
+    /** End the current pass with the IR it produced, or IR of the
+     * given size. Passes still running when the PassTimer is
+     * destroyed are ended with an unknown output size. */
+    // @{
+    void done(const Stmt &output);
+    void done(size_t output_size);
+    // @}
+
+private:
+    struct Pass {
+        std::string name;
+        std::chrono::steady_clock::time_point start, end;
+        size_t input_size, output_size;
+    };
+
+    bool is_enabled;
+    bool running;
+    std::string phase, pipeline_name;
+    std::vector<Pass> passes;
+};
+
+/** The number of distinct IR nodes in a Stmt. */
+size_t count_ir_nodes(const Stmt &s);
+
+}  // namespace Internal
+}  // namespace Halide
+
+#endif
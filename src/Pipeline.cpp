@@ -1,7 +1,10 @@
 #include <algorithm>
+#include <mutex>
 
 #include "Pipeline.h"
 #include "Argument.h"
+#include "AutoSchedule.h"
+#include "FindCalls.h"
 #include "Func.h"
 #include "InferArguments.h"
 #include "IRVisitor.h"
@@ -11,6 +14,8 @@
 #include "Outputs.h"
 #include "PrintLoopNest.h"
 
+#include "../tools/halide_benchmark.h"
+
 using namespace Halide::Internal;
 
 namespace Halide {
@@ -54,11 +59,16 @@ struct PipelineContents {
     JITModule jit_module;
     Target jit_target;
 
+    // The targets the cached jit-compiled code dispatches between at
+    // runtime, if there are several. jit_target is the last of them.
+    vector<Target> jit_targets;
+
     /** Clear all cached state */
     void invalidate_cache() {
         module = Module("", Target());
         jit_module = JITModule();
         jit_target = Target();
+        jit_targets.clear();
         inferred_args.clear();
     }
 
@@ -231,6 +241,213 @@ void Pipeline::print_loop_nest() {
     std::cerr << Halide::Internal::print_loop_nest(contents->outputs);
 }
 
+string Pipeline::footprint_report(const vector<vector<int>> &output_sizes, const Target &target) {
+    user_assert(defined()) << "Can't report the footprint of undefined Pipeline.\n";
+    return Halide::Internal::footprint_report(contents->outputs, output_sizes, target);
+}
+
+string Pipeline::auto_schedule(const vector<vector<int>> &output_sizes, const Target &target) {
+    return auto_schedule(output_sizes, AutoScheduleParams(), target);
+}
+
+string Pipeline::auto_schedule(const vector<vector<int>> &output_sizes,
+                               const AutoScheduleParams &params,
+                               const Target &target) {
+    user_assert(defined()) << "Can't auto_schedule undefined Pipeline.\n";
+    invalidate_cache();
+    return generate_schedules(contents->outputs, output_sizes, target, params);
+}
+
+namespace {
+
+// Tracks how much heap memory a pipeline being tuned has allocated.
+// The size of each allocation is stored just before it, along with
+// the pointer to free, so the allocations can be 128-byte aligned
+// like those of the default allocator.
+struct TuningAllocator {
+    static std::mutex mutex;
+    static int64_t current, peak;
+
+    static void *malloc(void *, size_t size) {
+        const size_t alignment = 128;
+        void *orig = ::malloc(size + alignment + 2 * sizeof(void *));
+        if (orig == nullptr) {
+            return nullptr;
+        }
+        void *ptr = (void *)(((size_t)orig + alignment + 2 * sizeof(void *) - 1) & ~(alignment - 1));
+        ((void **)ptr)[-1] = orig;
+        ((size_t *)ptr)[-2] = size;
+        std::lock_guard<std::mutex> lock(mutex);
+        current += size;
+        peak = std::max(peak, current);
+        return ptr;
+    }
+
+    static void free(void *, void *ptr) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            current -= ((size_t *)ptr)[-2];
+        }
+        ::free(((void **)ptr)[-1]);
+    }
+
+    static void reset() {
+        std::lock_guard<std::mutex> lock(mutex);
+        current = peak = 0;
+    }
+};
+
+std::mutex TuningAllocator::mutex;
+int64_t TuningAllocator::current = 0;
+int64_t TuningAllocator::peak = 0;
+
+// The schedules of all the functions of a pipeline, so that each
+// schedule tune_schedule tries can start from the one the pipeline
+// had to begin with.
+class ScheduleSnapshot {
+    struct Saved {
+        Function func;
+        FuncSchedule schedule;
+        vector<StageSchedule> stages;
+    };
+    vector<Saved> saved;
+
+    // Copies a FuncSchedule, sharing its wrappers with the original,
+    // as they are functions of the same pipeline.
+    static FuncSchedule copy_schedule(const FuncSchedule &s) {
+        std::map<IntrusivePtr<FunctionContents>, IntrusivePtr<FunctionContents>> copied_map;
+        for (const auto &w : s.wrappers()) {
+            copied_map[w.second] = w.second;
+        }
+        return s.deep_copy(copied_map);
+    }
+
+public:
+    ScheduleSnapshot(const vector<Function> &outputs) {
+        std::map<string, Function> env;
+        for (const Function &f : outputs) {
+            std::map<string, Function> calls = find_transitive_calls(f);
+            env.insert(calls.begin(), calls.end());
+        }
+        for (const auto &p : env) {
+            Saved s = {p.second, copy_schedule(p.second.schedule()), {p.second.definition().schedule().get_copy()}};
+            for (const Definition &def : p.second.updates()) {
+                s.stages.push_back(def.schedule().get_copy());
+            }
+            saved.push_back(s);
+        }
+    }
+
+    void restore() {
+        for (Saved &s : saved) {
+            s.func.schedule() = copy_schedule(s.schedule);
+            s.func.definition().schedule() = s.stages[0].get_copy();
+            for (size_t i = 0; i < s.func.updates().size(); i++) {
+                s.func.update(i).schedule() = s.stages[i + 1].get_copy();
+            }
+        }
+    }
+};
+
+// Counts the allocations of a pipeline with a TuningAllocator while
+// tune_schedule tries schedules on it, and puts back its allocator
+// and original schedules when done, even if trying one fails.
+class TuningScope {
+    Pipeline pipeline;
+    JITHandlers old_handlers;
+    ScheduleSnapshot original;
+
+public:
+    TuningScope(Pipeline p, const vector<Function> &outputs)
+        : pipeline(p), old_handlers(p.jit_handlers()), original(outputs) {
+        pipeline.set_custom_allocator(TuningAllocator::malloc, TuningAllocator::free);
+    }
+
+    ~TuningScope() {
+        pipeline.set_custom_allocator(old_handlers.custom_malloc, old_handlers.custom_free);
+        original.restore();
+    }
+
+    void restore_schedules() {
+        original.restore();
+    }
+};
+
+}  // namespace
+
+string Pipeline::tune_schedule(Realization dst,
+                               const string &filename,
+                               const vector<AutoScheduleParams> &candidates,
+                               const Target &target) {
+    user_assert(defined()) << "Can't tune the schedule of undefined Pipeline.\n";
+    user_assert(!candidates.empty()) << "tune_schedule needs at least one set of parameters to try.\n";
+
+    // The outputs are scheduled for the size of the buffers they're
+    // benchmarked on.
+    vector<vector<int>> output_sizes;
+    size_t buffer = 0;
+    for (const Function &f : contents->outputs) {
+        user_assert(buffer < dst.size())
+            << "The Realization passed to tune_schedule has too few buffers for the outputs of the Pipeline.\n";
+        vector<int> sizes;
+        for (int d = 0; d < dst[buffer].dimensions(); d++) {
+            sizes.push_back(dst[buffer].dim(d).extent());
+        }
+        output_sizes.push_back(sizes);
+        buffer += f.outputs();
+    }
+
+    // Benchmark each candidate with the best of several samples, each
+    // of enough iterations to be timed accurately, after a run to
+    // warm up the caches and thread pool.
+    const int samples = 5;
+    const double min_sample_ms = 10;
+    vector<TunedSchedule> measured;
+    {
+        TuningScope scope(*this, contents->outputs);
+        for (const AutoScheduleParams &params : candidates) {
+            scope.restore_schedules();
+            auto_schedule(output_sizes, params, target);
+            compile_jit(target);
+            TuningAllocator::reset();
+
+            auto run = [&]() { realize(dst, target); };
+            double warmup_ms = Tools::benchmark(1, 1, run) * 1000;
+            int iterations = std::max(1, std::min(100, (int)(min_sample_ms / std::max(warmup_ms, 1e-3))));
+            double best_ms = Tools::benchmark(samples, iterations, run) * 1000;
+
+            std::lock_guard<std::mutex> lock(TuningAllocator::mutex);
+            measured.push_back({params, best_ms, TuningAllocator::peak});
+            debug(1) << "tune_schedule: " << params.to_string() << ": "
+                     << best_ms << " ms, " << TuningAllocator::peak << " bytes\n";
+        }
+    }
+
+    vector<TunedSchedule> front = pareto_front(measured);
+    std::map<string, vector<TunedSchedule>> tuned = load_tuned_schedules(filename);
+    tuned[tuning_target_key(target)] = front;
+    save_tuned_schedules(filename, tuned);
+
+    return auto_schedule(output_sizes, front[0].params, target);
+}
+
+string Pipeline::apply_tuned_schedule(const string &filename,
+                                      const vector<vector<int>> &output_sizes,
+                                      const Target &target) {
+    user_assert(defined()) << "Can't apply a tuned schedule to undefined Pipeline.\n";
+    std::map<string, vector<TunedSchedule>> tuned = load_tuned_schedules(filename);
+    string key = tuning_target_key(target);
+    auto it = tuned.find(key);
+    AutoScheduleParams params;
+    if (it == tuned.end() || it->second.empty()) {
+        user_warning << "No schedule was tuned for " << key << " in " << filename
+                     << ", so the default auto_schedule parameters are used.\n";
+    } else {
+        params = it->second[0].params;
+    }
+    return auto_schedule(output_sizes, params, target);
+}
+
 void Pipeline::compile_to_lowered_stmt(const string &filename,
                                        const vector<Argument> &args,
                                        StmtOutputFormat fmt,
@@ -452,6 +669,73 @@ void *Pipeline::compile_jit(const Target &target_arg) {
     }
 
     contents->jit_module = jit_module;
+    contents->jit_targets.clear();
+
+    return jit_module.main_function();
+}
+
+void *Pipeline::compile_jit(const vector<Target> &targets_arg) {
+    user_assert(defined()) << "Pipeline is undefined\n";
+    user_assert(!targets_arg.empty()) << "Must specify at least one target.\n";
+
+    if (targets_arg.size() == 1) {
+        return compile_jit(targets_arg[0]);
+    }
+
+    vector<Target> targets;
+    for (Target t : targets_arg) {
+        t.set_feature(Target::JIT);
+        t.set_feature(Target::UserContext);
+        targets.push_back(t);
+    }
+    check_multitarget_targets(targets, "compile_jit");
+    const Target &base_target = targets.back();
+
+    // If we're re-jitting for the same targets, we can just keep the
+    // old jit module.
+    if (contents->jit_target == base_target &&
+        contents->jit_targets == targets &&
+        contents->jit_module.compiled()) {
+        debug(2) << "Reusing old jit module compiled for :\n" << contents->jit_target.to_string() << "\n";
+        return contents->jit_module.main_function();
+    }
+
+    infer_arguments();
+    vector<Argument> args;
+    for (const InferredArgument &arg : contents->inferred_args) {
+        args.push_back(arg.arg);
+    }
+
+    string name = generate_function_name();
+
+    std::map<std::string, JITExtern> lowered_externs = contents->jit_externs;
+    vector<JITModule> externs = make_externs_jit_module(base_target, lowered_externs);
+
+    // Compile the pipeline once per target, baseline first, so that if
+    // this creates the shared runtime, it is built for a cpu that all
+    // the targets can run on. The sub-functions become dependencies of
+    // a wrapper that picks one of them on the first call, as
+    // compile_multitarget does.
+    vector<string> sub_fn_names(targets.size());
+    vector<JITModule> sub_modules;
+    vector<LoweredArgument> base_target_args;
+    for (size_t i = targets.size(); i-- > 0;) {
+        sub_fn_names[i] = name + "_" + replace_all(targets[i].to_string(), "-", "_");
+        debug(2) << "jit-compiling " << sub_fn_names[i] << " for: " << targets[i].to_string() << "\n";
+        Module module = compile_to_module(args, sub_fn_names[i], targets[i]).resolve_submodules();
+        auto f = module.get_function_by_name(sub_fn_names[i]);
+        if (i == targets.size() - 1) {
+            base_target_args = f.args;
+        }
+        sub_modules.push_back(JITModule(module, f, externs));
+    }
+
+    Module wrapper = make_multitarget_wrapper(name, targets, sub_fn_names, base_target_args);
+    JITModule jit_module(wrapper, wrapper.get_function_by_name(name), sub_modules);
+
+    contents->jit_module = jit_module;
+    contents->jit_target = base_target;
+    contents->jit_targets = targets;
 
     return jit_module.main_function();
 }
@@ -669,6 +953,20 @@ struct JITFuncCallContext {
     }
 };
 
+// If we're profiling, report runtimes and reset profiler stats.
+void report_and_reset_profiler(const JITModule &module, JITFuncCallContext &jit_context) {
+    JITModule::Symbol report_sym = module.find_symbol_by_name("halide_profiler_report");
+    JITModule::Symbol reset_sym = module.find_symbol_by_name("halide_profiler_reset");
+    if (report_sym.address && reset_sym.address) {
+        void *uc = jit_context.user_context_param.get_scalar<void *>();
+        void (*report_fn_ptr)(void *) = (void (*)(void *))(report_sym.address);
+        report_fn_ptr(uc);
+
+        void (*reset_fn_ptr)() = (void (*)())(reset_sym.address);
+        reset_fn_ptr();
+    }
+}
+
 }  // namespace
 
 // Make a vector of void *'s to pass to the jit call using the
@@ -895,22 +1193,159 @@ void Pipeline::realize(Realization dst, const Target &t) {
     int exit_status = contents->jit_module.argv_function()(&(args[0]));
     debug(2) << "Back from jitted function. Exit status was " << exit_status << "\n";
 
-    // If we're profiling, report runtimes and reset profiler stats.
     if (target.has_feature(Target::Profile)) {
-        JITModule::Symbol report_sym =
-            contents->jit_module.find_symbol_by_name("halide_profiler_report");
-        JITModule::Symbol reset_sym =
-            contents->jit_module.find_symbol_by_name("halide_profiler_reset");
-        if (report_sym.address && reset_sym.address) {
-            void *uc = jit_context.user_context_param.get_scalar<void *>();
-            void (*report_fn_ptr)(void *) = (void (*)(void *))(report_sym.address);
-            report_fn_ptr(uc);
-
-            void (*reset_fn_ptr)() = (void (*)())(reset_sym.address);
-            reset_fn_ptr();
+        report_and_reset_profiler(contents->jit_module, jit_context);
+    }
+
+    jit_context.finalize(exit_status);
+}
+
+struct JITCallableContents {
+    mutable RefCount ref_count;
+
+    // The Pipeline, for its current custom handlers.
+    Pipeline pipeline;
+
+    // The compiled code, which may outlive the Pipeline's copy of it.
+    JITModule jit_module;
+    Target target;
+
+    // The inputs, which keep any constant Buffers and the storage of
+    // any scalar Params referenced by arg_values alive.
+    vector<InferredArgument> inferred_args;
+    Parameter user_context_param;
+
+    // The argument array passed to the argv function. The inputs
+    // come first, then one slot per output buffer.
+    vector<const void *> arg_values;
+
+    // The ImageParams, which may be rebound between calls, and their
+    // slots in arg_values.
+    vector<std::pair<size_t, Parameter>> buffer_params;
+
+    // The expected type and dimensionality of each output buffer.
+    struct OutputBufferType {
+        string name;
+        Type type;
+        int dims;
+    };
+    vector<OutputBufferType> output_types;
+};
+
+namespace Internal {
+template<>
+EXPORT RefCount &ref_count<JITCallableContents>(const JITCallableContents *p) {
+    return p->ref_count;
+}
+
+template<>
+EXPORT void destroy<JITCallableContents>(const JITCallableContents *p) {
+    delete p;
+}
+}
+
+JITCallable Pipeline::compile_to_callable(const Target &t) {
+    user_assert(defined()) << "Can't compile an undefined Pipeline\n";
+
+    // Choose the target as realize does.
+    Target target = t;
+    if (target.os == Target::OSUnknown) {
+        if (contents->jit_module.compiled()) {
+            target = contents->jit_target;
+        } else {
+            target = get_jit_target_from_environment();
+        }
+    }
+
+    compile_jit(target);
+    internal_assert(contents->jit_module.argv_function());
+
+    JITCallable result;
+    result.contents = new JITCallableContents;
+    JITCallableContents &c = *result.contents;
+    c.pipeline = *this;
+    c.jit_module = contents->jit_module;
+    c.target = target;
+    c.inferred_args = contents->inferred_args;
+    c.user_context_param = contents->user_context_arg.param;
+
+    for (const InferredArgument &arg : c.inferred_args) {
+        if (arg.param.defined() && arg.param.is_buffer()) {
+            c.buffer_params.push_back({c.arg_values.size(), arg.param});
+            c.arg_values.push_back(nullptr);
+        } else if (arg.param.defined()) {
+            c.arg_values.push_back(arg.param.get_scalar_address());
+        } else {
+            internal_assert(arg.buffer.defined());
+            c.arg_values.push_back(arg.buffer.raw_buffer());
+        }
+    }
+
+    for (Function f : contents->outputs) {
+        for (Type t : f.output_types()) {
+            c.output_types.push_back({f.name(), t, f.dimensions()});
+            c.arg_values.push_back(nullptr);
         }
     }
 
+    return result;
+}
+
+JITCallable::JITCallable() : contents(nullptr) {
+}
+
+bool JITCallable::defined() const {
+    return contents.defined();
+}
+
+void JITCallable::call(halide_buffer_t **outputs, size_t num_outputs) {
+    user_assert(defined()) << "Can't call an undefined JITCallable\n";
+    JITCallableContents &c = *contents;
+
+    user_assert(num_outputs == c.output_types.size())
+        << "JITCallable called with wrong number of output buffers (" << num_outputs
+        << ") for realizing pipeline with " << c.output_types.size()
+        << " outputs\n";
+
+    // Check the output buffers, and put them in their slots.
+    size_t first_output = c.arg_values.size() - num_outputs;
+    for (size_t i = 0; i < num_outputs; i++) {
+        const halide_buffer_t *buf = outputs[i];
+        const JITCallableContents::OutputBufferType &expected = c.output_types[i];
+        user_assert(buf && buf->host != nullptr)
+            << "Output buffer " << i << " passed to JITCallable for Func \""
+            << expected.name << "\" is unallocated.\n";
+        user_assert(buf->dimensions == expected.dims)
+            << "Can't realize Func \"" << expected.name
+            << "\" into buffer at " << (void *)buf->host
+            << " because buffer is " << buf->dimensions
+            << "-dimensional, but Func \"" << expected.name
+            << "\" is " << expected.dims << "-dimensional.\n";
+        user_assert(Type(buf->type) == expected.type)
+            << "Can't realize Func \"" << expected.name
+            << "\" into buffer at " << (void *)buf->host
+            << " because buffer has type " << Type(buf->type)
+            << ", but Func \"" << expected.name
+            << "\" has type " << expected.type << ".\n";
+        c.arg_values[first_output + i] = buf;
+    }
+
+    // ImageParams may have been rebound since the last call.
+    for (const auto &p : c.buffer_params) {
+        Buffer<> buf = p.second.get_buffer();
+        c.arg_values[p.first] = buf.defined() ? buf.raw_buffer() : nullptr;
+    }
+
+    // See Pipeline::realize for how the handlers are threaded through
+    // to the compiled code.
+    JITFuncCallContext jit_context(c.pipeline.jit_handlers(), c.user_context_param);
+
+    int exit_status = c.jit_module.argv_function()(&(c.arg_values[0]));
+
+    if (c.target.has_feature(Target::Profile)) {
+        report_and_reset_profiler(c.jit_module, jit_context);
+    }
+
     jit_context.finalize(exit_status);
 }
 
@@ -9,6 +9,7 @@
 
 #include <vector>
 
+#include "AutoSchedule.h"
 #include "ExternalCode.h"
 #include "IntrusivePtr.h"
 #include "JITModule.h"
@@ -22,6 +23,7 @@ struct Argument;
 class Func;
 struct Outputs;
 struct PipelineContents;
+struct JITCallableContents;
 
 namespace Internal {
 class IRMutator;
@@ -52,6 +54,8 @@ struct CustomLoweringPass {
 
 struct JITExtern;
 
+class JITCallable;
+
 /** A class representing a Halide pipeline. Constructed from the Func
  * or Funcs that it outputs. */
 class Pipeline {
@@ -175,6 +179,65 @@ public:
      * doing. */
     EXPORT void print_loop_nest();
 
+    /** Estimate the cost of this Pipeline's schedule before running
+     * it, given the size of each output. For each Func, reports where
+     * it is stored and the size of each allocation, the bytes it
+     * loads and stores per output pixel, how many times over it
+     * computes the points it is required over because of overlapping
+     * compute_at tiles, and how much of the target's natural vector
+     * width its vectorized loops use. The counts come from bounds
+     * inference, so they're exact for loops of constant extent, and
+     * upper bounds elsewhere. */
+    EXPORT std::string footprint_report(const std::vector<std::vector<int>> &output_sizes,
+                                        const Target &target = get_target_from_environment());
+
+    /** Choose a schedule for every Func this Pipeline uses, given an
+     * estimate of the size of each output (one extent per
+     * dimension), using the bounds each Func is required over and
+     * which Funcs call which. Pointwise Funcs are inlined, stencils
+     * are computed at tiles of their consumer where that doesn't
+     * recompute too much, and everything else is computed at root,
+     * vectorized and parallelized. Replaces the loop nests, storage
+     * orders and compute and store levels the Funcs already had; it
+     * is an error for any of them to be bounded, memoized,
+     * specialized, wrapped, or accelerated. Returns the schedule as
+     * C++ source, written in terms of the names of the Funcs and
+     * their Vars, to be checked in in place of the call to
+     * auto_schedule. */
+    EXPORT std::string auto_schedule(const std::vector<std::vector<int>> &output_sizes,
+                                     const Target &target = get_target_from_environment());
+
+    /** Choose a schedule as above, with the given tile sizes, vector
+     * factor, and limit on recomputation. */
+    EXPORT std::string auto_schedule(const std::vector<std::vector<int>> &output_sizes,
+                                     const AutoScheduleParams &params,
+                                     const Target &target = get_target_from_environment());
+
+    /** Search for the auto_schedule parameters that work best for
+     * this Pipeline on the given target. Each candidate is applied,
+     * jit-compiled, and benchmarked by realizing into dst, so any
+     * inputs must already be bound to representative data. The
+     * schedules on the Pareto front of time and peak heap memory are
+     * written to the given file, fastest first, under the target,
+     * replacing any schedules previously tuned for it and keeping the
+     * rest. The fastest schedule is applied, and returned as C++
+     * source as auto_schedule does. */
+    EXPORT std::string tune_schedule(Realization dst,
+                                     const std::string &filename,
+                                     const std::vector<AutoScheduleParams> &candidates = AutoScheduleParams::candidates(),
+                                     const Target &target = get_jit_target_from_environment());
+
+    /** Apply the fastest schedule tune_schedule found for the given
+     * target, as recorded in the given file. Features that don't
+     * change the code a pipeline runs, like JIT, are ignored when
+     * looking up the target, so Generators can use schedules tuned
+     * with the JIT for the machine they're compiling for. Falls back
+     * to the default auto_schedule parameters, with a warning, if no
+     * schedule was tuned for the target. */
+    EXPORT std::string apply_tuned_schedule(const std::string &filename,
+                                            const std::vector<std::vector<int>> &output_sizes,
+                                            const Target &target = get_target_from_environment());
+
     /** Compile to object file and header pair, with the given
      * arguments. */
     EXPORT void compile_to_file(const std::string &filename_prefix,
@@ -217,6 +280,17 @@ public:
      */
      EXPORT void *compile_jit(const Target &target = get_jit_target_from_environment());
 
+    /** Eagerly jit compile the function once for each of a list of
+     * targets, along with a wrapper that picks the first of them
+     * whose features the cpu it's running on has, using
+     * halide_can_use_target_features, just like the code produced by
+     * compile_to_multitarget_static_library. The last target is the
+     * baseline, which is used if none of the others can be. All
+     * targets must have identical arch-os-bits. Subsequent calls to
+     * realize without a target use the result. Returns the raw
+     * function pointer to the wrapper. */
+    EXPORT void *compile_jit(const std::vector<Target> &targets);
+
     /** Set the error handler function that be called in the case of
      * runtime errors during halide pipelines. If you are compiling
      * statically, you can also just define your own function with
@@ -371,6 +445,13 @@ public:
     EXPORT Realization realize(const Target &target = Target());
     // @}
 
+    /** JIT-compile this Pipeline and bind its inputs once, returning
+     * an object that can be called to realize the Pipeline into
+     * output buffers with much less overhead per call than
+     * realize. Useful when realizing small outputs many times. If the
+     * target is unspecified, it is chosen as it is by realize. */
+    EXPORT JITCallable compile_to_callable(const Target &target = Target());
+
     /** Evaluate this Pipeline into an existing allocated buffer or
      * buffers. If the buffer is also one of the arguments to the
      * function, strange things may happen, as the pipeline isn't
@@ -414,6 +495,51 @@ private:
     std::string generate_function_name() const;
 };
 
+/** A JIT-compiled Pipeline with its arguments bound up front, made by
+ * Pipeline::compile_to_callable. Calling it runs the compiled code on
+ * the given output buffers directly, with the current values of the
+ * Params and ImageParams it uses, without revisiting the Pipeline's
+ * arguments or allocating. It keeps the compiled code alive, so it
+ * remains valid if the Pipeline is later rescheduled and
+ * recompiled. A JITCallable must not be called from more than one
+ * thread at a time. */
+class JITCallable {
+    friend class Pipeline;
+
+    Internal::IntrusivePtr<JITCallableContents> contents;
+
+    static halide_buffer_t *raw_buffer_of(halide_buffer_t *b) {
+        return b;
+    }
+
+    template<typename T>
+    static halide_buffer_t *raw_buffer_of(const Buffer<T> &b) {
+        return const_cast<halide_buffer_t *>(b.raw_buffer());
+    }
+
+public:
+    /** Make an undefined JITCallable. */
+    EXPORT JITCallable();
+
+    /** Check if this JITCallable is defined. */
+    EXPORT bool defined() const;
+
+    /** Realize the Pipeline into the given output buffers, one per
+     * tuple component per output Func. Like Pipeline::realize, this
+     * does not copy data back from the GPU. */
+    EXPORT void call(halide_buffer_t **outputs, size_t num_outputs);
+
+    /** Realize the Pipeline into the given Buffers or
+     * halide_buffer_t pointers, one per tuple component per output
+     * Func. */
+    template<typename... Outputs>
+    void operator()(Outputs &&... outputs) {
+        static_assert(sizeof...(outputs) > 0, "A JITCallable must be called with at least one output");
+        halide_buffer_t *bufs[] = {raw_buffer_of(outputs)...};
+        call(bufs, sizeof...(outputs));
+    }
+};
+
 struct ExternSignature {
 private:
     Type ret_type_;       // Only meaningful if is_void_return is false; must be default value otherwise
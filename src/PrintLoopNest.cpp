@@ -1,16 +1,24 @@
 #include "PrintLoopNest.h"
+#include "AutoSchedule.h"
 #include "DeepCopy.h"
+#include "ExprUsesVar.h"
 #include "FindCalls.h"
 #include "Function.h"
 #include "Func.h"
 #include "RealizationOrder.h"
+#include "IRMutator.h"
+#include "IROperator.h"
 #include "IRPrinter.h"
+#include "Lower.h"
 #include "ScheduleFunctions.h"
 #include "Simplify.h"
 #include "SimplifySpecializations.h"
+#include "Substitute.h"
 #include "Target.h"
 #include "WrapCalls.h"
 
+#include <cmath>
+#include <iomanip>
 #include <tuple>
 
 namespace Halide {
@@ -199,5 +207,345 @@ string print_loop_nest(const vector<Function> &output_funcs) {
     return sstr.str();
 }
 
+namespace {
+
+// Counts the bytes loaded from functions and images by an expression.
+class CountLoads : public IRVisitor {
+    using IRVisitor::visit;
+
+    void visit(const Call *op) {
+        IRVisitor::visit(op);
+        if (op->call_type == Call::Halide || op->call_type == Call::Image) {
+            bytes += op->type.bytes();
+        }
+    }
+
+public:
+    int64_t bytes = 0;
+};
+
+// Remove any 'likely' intrinsics, so that the simplifier can fold
+// loop extents that use them to constants.
+class RemoveLikelyTags : public IRMutator {
+    using IRMutator::visit;
+
+    void visit(const Call *op) {
+        if (op->is_intrinsic(Call::likely) || op->is_intrinsic(Call::likely_if_innermost)) {
+            internal_assert(op->args.size() == 1);
+            expr = mutate(op->args[0]);
+        } else {
+            IRMutator::visit(op);
+        }
+    }
+};
+
+// Walks a lowered statement with constant output sizes, counting how
+// many times each loop body runs. Loops with extents that depend on
+// the loops around them, as they do after sliding window, are counted
+// at their average over the innermost loop they depend on, or at
+// their largest if that can't be worked out.
+class Footprint : public IRVisitor {
+public:
+    struct Allocation {
+        // The innermost loop the allocation is inside, or "root".
+        string level;
+        // How many times the allocation is made, and its size, or -1
+        // where they aren't known.
+        double count;
+        int64_t bytes;
+    };
+
+    struct Stats {
+        vector<Allocation> allocations;
+        // Points computed by the pure definition, and by every
+        // definition.
+        double pure_points = 0, points = 0;
+        double bytes_loaded = 0, bytes_stored = 0;
+        // Points computed, weighted by the fraction of the natural
+        // vector width of the loops they're computed in.
+        double vector_points = 0;
+        // Whether any definition is inside a loop of unknown extent.
+        bool unknown_extents = false;
+    };
+
+    map<string, Stats> stats;
+
+    Footprint(const Target &t) : target(t) {}
+
+private:
+    struct Loop {
+        string name;
+        Expr min;
+        double extent;
+        ForType for_type;
+    };
+
+    const Target &target;
+    vector<Loop> loops;
+    Scope<Interval> scope;
+    // The values of the enclosing lets, in terms of loop variables.
+    map<string, Expr> lets;
+
+    using IRVisitor::visit;
+
+    int64_t upper_bound(Expr e) {
+        Expr bound = find_constant_bound(e, Direction::Upper, scope);
+        const int64_t *value = as_const_int(bound);
+        return value ? *value : -1;
+    }
+
+    // Bounds in the scope must be simplified to constants to be
+    // used by find_constant_bound.
+    Interval bounds_of(Expr e) {
+        Interval i = bounds_of_expr_in_scope(e, scope);
+        if (i.has_lower_bound()) {
+            i.min = simplify(i.min);
+        }
+        if (i.has_upper_bound()) {
+            i.max = simplify(i.max);
+        }
+        return i;
+    }
+
+    // The value of an expression at the given iteration of each of
+    // the enclosing loops.
+    Expr at_iteration(Expr e, int iteration) {
+        map<string, Expr> vars;
+        for (const Loop &l : loops) {
+            Expr min = simplify(substitute(vars, l.min));
+            if (is_const(min)) {
+                vars[l.name] = simplify(min + iteration);
+            }
+        }
+        return simplify(substitute(vars, e));
+    }
+
+    double estimate_extent(Expr extent) {
+        Expr e = simplify(substitute(lets, extent));
+        if (const int64_t *value = as_const_int(e)) {
+            return *value;
+        }
+        Expr first = at_iteration(e, 0), later = at_iteration(e, 1);
+        const int64_t *first_value = as_const_int(first), *later_value = as_const_int(later);
+        if (first_value && later_value) {
+            for (auto it = loops.rbegin(); it != loops.rend(); it++) {
+                if (expr_uses_var(e, it->name) && it->extent > 0) {
+                    return (*first_value + (it->extent - 1) * *later_value) / it->extent;
+                }
+            }
+        }
+        return upper_bound(extent);
+    }
+
+    double trip_count() const {
+        double count = 1;
+        for (const Loop &l : loops) {
+            if (l.extent < 0) {
+                return -1;
+            }
+            count *= l.extent;
+        }
+        return count;
+    }
+
+    // The definition of a function a Provide belongs to, from the
+    // name of the innermost loop over it.
+    int stage_of(const string &func) const {
+        const string prefix = func + ".s";
+        for (auto it = loops.rbegin(); it != loops.rend(); it++) {
+            if (starts_with(it->name, prefix)) {
+                return atoi(it->name.c_str() + prefix.size());
+            }
+        }
+        return 0;
+    }
+
+    void visit(const For *op) {
+        Interval min_bounds = bounds_of(op->min);
+        Interval max_bounds = bounds_of(op->min + op->extent - 1);
+        double extent = estimate_extent(op->extent);
+        loops.push_back({op->name, substitute(lets, op->min), extent, op->for_type});
+        scope.push(op->name, Interval(min_bounds.min, max_bounds.max));
+        op->body.accept(this);
+        scope.pop(op->name);
+        loops.pop_back();
+    }
+
+    void visit(const LetStmt *op) {
+        scope.push(op->name, bounds_of(op->value));
+        lets[op->name] = substitute(lets, op->value);
+        op->body.accept(this);
+        lets.erase(op->name);
+        scope.pop(op->name);
+    }
+
+    void visit(const Realize *op) {
+        int64_t bytes = 0;
+        for (Type t : op->types) {
+            bytes += t.bytes();
+        }
+        for (const Range &r : op->bounds) {
+            int64_t extent = upper_bound(r.extent);
+            bytes = (extent < 0 || bytes < 0) ? -1 : bytes * extent;
+        }
+        stats[op->name].allocations.push_back({loops.empty() ? string("root") : loops.back().name,
+                                               trip_count(), bytes});
+        op->body.accept(this);
+    }
+
+    void visit(const Provide *op) {
+        Stats &s = stats[op->name];
+        double points = trip_count();
+        if (points < 0) {
+            s.unknown_extents = true;
+            return;
+        }
+
+        CountLoads loads;
+        int64_t stored = 0;
+        for (const Expr &e : op->args) {
+            e.accept(&loads);
+        }
+        for (const Expr &e : op->values) {
+            e.accept(&loads);
+            stored += e.type().bytes();
+        }
+
+        double lanes = 1;
+        for (const Loop &l : loops) {
+            if (l.for_type == ForType::Vectorized && l.extent > 0) {
+                lanes *= l.extent;
+            }
+        }
+        int natural_lanes = target.natural_vector_size(op->values[0].type());
+
+        s.points += points;
+        if (stage_of(op->name) == 0) {
+            s.pure_points += points;
+        }
+        s.bytes_loaded += points * loads.bytes;
+        s.bytes_stored += points * stored;
+        s.vector_points += points * std::min(1.0, lanes / natural_lanes);
+    }
+};
+
+}  // namespace
+
+string footprint_report(const vector<Function> &output_funcs,
+                        const vector<vector<int>> &output_sizes,
+                        const Target &target) {
+    user_assert(output_funcs.size() == output_sizes.size())
+        << "footprint_report needs a size for each of the " << output_funcs.size() << " outputs\n";
+    for (size_t i = 0; i < output_funcs.size(); i++) {
+        user_assert((int)output_sizes[i].size() == output_funcs[i].dimensions())
+            << "The size for output " << output_funcs[i].name() << " has "
+            << output_sizes[i].size() << " dimensions instead of " << output_funcs[i].dimensions() << "\n";
+    }
+
+    // Lower as far as storage folding, so that the loop and
+    // allocation bounds are those the pipeline would use.
+    PartialLowering lowered = lower_until(output_funcs, "footprint_report", target, LoweringPass::StorageFolding);
+    Stmt s = lowered.stmt;
+    const vector<Function> &outputs = lowered.outputs;
+    const map<string, Function> &env = lowered.env;
+    const vector<string> &order = lowered.order;
+
+    // Fix the size of the output buffers, and propagate it.
+    double output_pixels = 0;
+    for (size_t i = 0; i < outputs.size(); i++) {
+        double pixels = 1;
+        for (int size : output_sizes[i]) {
+            pixels *= size;
+        }
+        output_pixels += pixels;
+        for (int v = 0; v < outputs[i].outputs(); v++) {
+            string buffer = outputs[i].name();
+            if (outputs[i].outputs() > 1) {
+                buffer += "." + std::to_string(v);
+            }
+            for (size_t d = 0; d < output_sizes[i].size(); d++) {
+                s = LetStmt::make(buffer + ".min." + std::to_string(d), 0, s);
+                s = LetStmt::make(buffer + ".extent." + std::to_string(d), output_sizes[i][d], s);
+            }
+        }
+    }
+    s = simplify(RemoveLikelyTags().mutate(s));
+
+    Footprint footprint(target);
+    s.accept(&footprint);
+    map<string, Box> regions = required_regions(outputs, output_sizes, env, order);
+
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(2);
+    out << "Footprint of the schedule for " << target.to_string() << ", with output sizes:\n";
+    for (size_t i = 0; i < outputs.size(); i++) {
+        out << "  " << outputs[i].name() << ":";
+        for (size_t j = 0; j < output_sizes[i].size(); j++) {
+            out << (j == 0 ? " " : " x ") << output_sizes[i][j];
+        }
+        out << "\n";
+    }
+
+    double total_loaded = 0, total_stored = 0;
+    for (const string &name : order) {
+        const Function &f = env.at(name);
+        out << name << ":\n";
+        auto it = footprint.stats.find(name);
+        if (it == footprint.stats.end()) {
+            out << "  " << (f.has_extern_definition() ? "extern" : "inlined") << "\n";
+            continue;
+        }
+        const Footprint::Stats &stats = it->second;
+
+        if (stats.allocations.empty()) {
+            out << "  stored in the output buffer\n";
+        }
+        for (const Footprint::Allocation &a : stats.allocations) {
+            out << "  stored at " << a.level << ": ";
+            if (a.bytes < 0) {
+                out << "unknown size";
+            } else {
+                out << a.bytes << " bytes";
+            }
+            if (a.count < 0) {
+                out << ", allocated an unknown number of times";
+            } else if (a.count != 1) {
+                out << ", allocated " << (int64_t)std::round(a.count) << " times";
+            }
+            out << "\n";
+        }
+
+        if (stats.points > 0) {
+            out << "  loads " << stats.bytes_loaded / output_pixels << " and stores "
+                << stats.bytes_stored / output_pixels << " bytes per output pixel\n";
+            total_loaded += stats.bytes_loaded;
+            total_stored += stats.bytes_stored;
+
+            auto region = regions.find(name);
+            if (region != regions.end()) {
+                double required = 1;
+                const Box &box = region->second;
+                for (size_t i = 0; i < box.size() && required > 0; i++) {
+                    Expr extent = box[i].is_bounded() ? simplify(box[i].max - box[i].min + 1) : Expr();
+                    const int64_t *value = extent.defined() ? as_const_int(extent) : nullptr;
+                    required = value ? required * *value : -1;
+                }
+                if (required > 0) {
+                    out << "  computes " << stats.pure_points / required << "x the "
+                        << (int64_t)required << " points required\n";
+                }
+            }
+
+            out << "  vector utilization " << 100 * stats.vector_points / stats.points << "%\n";
+        }
+        if (stats.unknown_extents) {
+            out << "  some definitions are in loops of unknown extent, and aren't counted\n";
+        }
+    }
+    out << "total: loads " << total_loaded / output_pixels << " and stores "
+        << total_stored / output_pixels << " bytes per output pixel\n";
+    return out.str();
+}
+
 }
 }
@@ -9,6 +9,8 @@
 #include <string>
 #include <vector>
 
+#include "Target.h"
+
 namespace Halide {
 namespace Internal {
 
@@ -19,6 +21,18 @@ class Function;
  * the functions it uses. */
 std::string print_loop_nest(const std::vector<Function> &output_funcs);
 
+/** Estimate the memory traffic and work of the schedule of this
+ * pipeline, given the size of each output. Lowers the pipeline as far
+ * as storage folding with the output sizes substituted in, and
+ * reports for each function where it is stored and how large each
+ * allocation is, the bytes it loads and stores per output pixel, how
+ * many times over it computes the points it is required over because
+ * of overlapping compute_at tiles, and how much of the target's
+ * natural vector width its vectorized loops use. */
+std::string footprint_report(const std::vector<Function> &output_funcs,
+                             const std::vector<std::vector<int>> &output_sizes,
+                             const Target &target);
+
 }
 }
 
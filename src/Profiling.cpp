@@ -19,6 +19,65 @@ using std::map;
 using std::string;
 using std::vector;
 
+namespace {
+
+class FindHWKernels : public IRVisitor {
+    using IRVisitor::visit;
+
+    void visit(const For *op) {
+        // Producers inside loops are part of an enclosing process
+    }
+
+    void visit(const ProducerConsumer *op) {
+        if (op->is_producer) {
+            kernels.push_back(op->name);
+        }
+        IRVisitor::visit(op);
+    }
+
+public:
+    vector<string> kernels;
+};
+
+// The sizes of the runtime's halide_profiler_instrument_task and
+// halide_profiler_instrument_run on the target, whose pointers may not
+// be the size of the host's. Pointers are padded to 8 bytes, which is
+// at least as large as the runtime's layout of either struct.
+int pointer_slot_size(const Target &t) {
+    return ((t.bits / 8) + 7) / 8 * 8;
+}
+
+int instrument_task_size(const Target &t) {
+    // The run, the start and last ticks, and the current func and
+    // padding.
+    return pointer_slot_size(t) + 2 * 8 + 2 * 4;
+}
+
+int instrument_run_size(const Target &t, int num_funcs) {
+    // The pipeline and the func ticks, the start ticks and time, the
+    // number of funcs and whether to use the cycle counter, followed
+    // by the ticks of each func.
+    int ptrs = (2 * (t.bits / 8) + 7) / 8 * 8;
+    return ptrs + 2 * 8 + 2 * 4 + num_funcs * 8;
+}
+
+}
+
+vector<string> profiled_hw_kernels(Stmt hw_body) {
+    FindHWKernels finder;
+    hw_body.accept(&finder);
+    return finder.kernels;
+}
+
+Stmt update_hw_counters(const string &region_name, int num_kernels) {
+    Expr profiler_pipeline_state = Variable::make(Handle(), "profiler_pipeline_state");
+    Expr names = Variable::make(Handle(), region_name + ".hw_kernel_names");
+    Expr counters = Variable::make(Handle(), region_name + ".hw_counters");
+    return Evaluate::make(Call::make(Int(32), "halide_profiler_hw_kernels_update",
+                                     {profiler_pipeline_state, num_kernels, names, counters},
+                                     Call::Extern));
+}
+
 class InjectProfiling : public IRMutator {
 public:
     map<string, int> indices;   // maps from func name -> index in buffer.
@@ -27,7 +86,18 @@ public:
 
     string pipeline_name;
 
-    InjectProfiling(const string &pipeline_name) : pipeline_name(pipeline_name) {
+    // Whether to time the pipeline by instrumenting it with
+    // timestamps, rather than with the sampling profiler, and whether
+    // to read those from the cycle counter.
+    bool instrumented, cycle_counter;
+
+    // The size of the runtime's halide_profiler_instrument_task on the
+    // target.
+    int task_size;
+
+    InjectProfiling(const string &pipeline_name, bool instrumented, bool cycle_counter, int task_size) :
+        pipeline_name(pipeline_name), instrumented(instrumented), cycle_counter(cycle_counter),
+        task_size(task_size) {
         indices["overhead"] = 0;
         stack.push_back(0);
     }
@@ -47,6 +117,10 @@ private:
 
     bool profiling_memory = true;
 
+    // The instrumented pipeline's record of the thread of execution
+    // we're in: the pipeline body, or a task of a parallel loop.
+    string current_task = "profiler_task";
+
     // Strip down the tuple name, e.g. f.0 into f
     string normalize_name(const string &name) {
         vector<string> v = split_string(name, ".");
@@ -100,6 +174,22 @@ private:
         return size;
     }
 
+    Stmt set_current_func(int idx) {
+        Expr call;
+        if (instrumented) {
+            Expr task = Variable::make(Handle(), current_task);
+            call = Call::make(Int(32), "halide_profiler_instrument_switch",
+                              {task, idx, cycle_counter}, Call::Extern);
+        } else {
+            Expr profiler_token = Variable::make(Int(32), "profiler_token");
+            Expr profiler_state = Variable::make(Handle(), "profiler_state");
+            // This call gets inlined and becomes a single store instruction.
+            call = Call::make(Int(32), "halide_profiler_set_current_func",
+                              {profiler_state, profiler_token, idx}, Call::Extern);
+        }
+        return Evaluate::make(call);
+    }
+
     void visit(const Allocate *op) {
         int idx = get_func_id(op->name);
 
@@ -182,6 +272,11 @@ private:
     }
 
     void visit(const ProducerConsumer *op) {
+        if (op->is_producer && starts_with(op->name, "_hls_target.")) {
+            visit_hw_region(op);
+            return;
+        }
+
         int idx;
         Stmt body;
         if (op->is_producer) {
@@ -196,19 +291,43 @@ private:
             idx = stack.back();
         }
 
-        Expr profiler_token = Variable::make(Int(32), "profiler_token");
-        Expr profiler_state = Variable::make(Handle(), "profiler_state");
+        body = Block::make(set_current_func(idx), body);
 
-        // This call gets inlined and becomes a single store instruction.
-        Expr set_task = Call::make(Int(32), "halide_profiler_set_current_func",
-                                   {profiler_state, profiler_token, idx}, Call::Extern);
+        stmt = ProducerConsumer::make(op->name, op->is_producer, body);
+    }
 
-        body = Block::make(Evaluate::make(set_task), body);
+    // The body of an accelerated region runs on the fabric, which can't
+    // call into the profiler. The time the host waits for it is billed
+    // to the region, and the kernels in it count their own cycles into
+    // a buffer that the backend fills in once the accelerator is done.
+    void visit_hw_region(const ProducerConsumer *op) {
+        int idx = get_func_id(op->name);
 
-        stmt = ProducerConsumer::make(op->name, op->is_producer, body);
+        stmt = Block::make(set_current_func(idx), op);
+
+        vector<string> kernels = profiled_hw_kernels(op->body);
+        if (kernels.empty()) {
+            return;
+        }
+        int num_kernels = (int)kernels.size();
+        string counters_name = op->name + ".hw_counters";
+        string names_name = op->name + ".hw_kernel_names";
+        Stmt update = update_hw_counters(op->name, num_kernels);
+        stmt = Block::make({stmt, update, Free::make(counters_name)});
+        stmt = Allocate::make(counters_name, UInt(64), {num_kernels * 3}, const_true(), stmt);
+        for (int i = num_kernels - 1; i >= 0; i--) {
+            stmt = Block::make(Store::make(names_name, kernels[i], i, Parameter(), const_true()), stmt);
+        }
+        stmt = Block::make(stmt, Free::make(names_name));
+        stmt = Allocate::make(names_name, Handle(), {num_kernels}, const_true(), stmt);
     }
 
     void visit(const For *op) {
+        if (instrumented) {
+            visit_instrumented(op);
+            return;
+        }
+
         Stmt body = op->body;
 
         // The for loop indicates a device transition or a
@@ -260,17 +379,59 @@ private:
             stmt = Block::make({decr_active_threads, stmt, incr_active_threads});
         }
     }
+
+    // Each task of a parallel loop keeps its own record on its stack,
+    // and bills the Funcs it computes as it goes. The thread that
+    // launches the loop stops billing while it waits for the tasks,
+    // as it runs some of them itself. Offloaded and GPU loops aren't
+    // instrumented: the time spent waiting for them is billed to the
+    // Func that launched them.
+    void visit_instrumented(const For *op) {
+        if (op->device_api != DeviceAPI::None &&
+            op->device_api != DeviceAPI::Host) {
+            stmt = op;
+            return;
+        }
+        if (!op->is_parallel()) {
+            IRMutator::visit(op);
+            return;
+        }
+
+        string outer_task = current_task;
+        current_task = op->name + ".profiler_task";
+        Stmt body = mutate(op->body);
+
+        Expr task = Variable::make(Handle(), current_task);
+        Expr run = Variable::make(Handle(), "profiler_run");
+        Expr begin = Call::make(Int(32), "halide_profiler_instrument_task_begin",
+                                {task, run, stack.back(), cycle_counter}, Call::Extern);
+        Expr end = Call::make(Int(32), "halide_profiler_instrument_task_end",
+                              {task}, Call::Extern);
+        body = Block::make({Evaluate::make(begin), body, set_current_func(-1), Evaluate::make(end)});
+        Expr alloca = Call::make(Handle(), Call::alloca, {task_size}, Call::Intrinsic);
+        body = LetStmt::make(current_task, alloca, body);
+
+        current_task = outer_task;
+        stmt = For::make(op->name, op->min, op->extent, op->for_type, op->device_api, body);
+        stmt = Block::make({set_current_func(-1), stmt, set_current_func(stack.back())});
+    }
 };
 
-Stmt inject_profiling(Stmt s, string pipeline_name) {
-    InjectProfiling profiling(pipeline_name);
+Stmt inject_profiling(Stmt s, string pipeline_name, const Target &t) {
+    bool instrumented = t.has_feature(Target::ProfileInstrumented);
+    // Other architectures have no cycle counter that user code can
+    // read cheaply and reliably.
+    bool cycle_counter = (t.arch == Target::X86);
+    InjectProfiling profiling(pipeline_name, instrumented, cycle_counter, instrument_task_size(t));
     s = profiling.mutate(s);
 
     int num_funcs = (int)(profiling.indices.size());
 
     Expr func_names_buf = Variable::make(Handle(), "profiling_func_names");
     
-    Expr start_profiler = Call::make(Int(32), "halide_profiler_pipeline_start",
+    Expr start_profiler = Call::make(Int(32), instrumented ?
+                                     "halide_profiler_instrument_pipeline_start" :
+                                     "halide_profiler_pipeline_start",
                                      {pipeline_name, num_funcs, func_names_buf}, Call::Extern);
 
     Expr get_state = Call::make(Handle(), "halide_profiler_get_state", {}, Call::Extern);
@@ -292,14 +453,40 @@ Stmt inject_profiling(Stmt s, string pipeline_name) {
         s = Block::make(update_stack, s);
     }
 
-    Expr profiler_state = Variable::make(Handle(), "profiler_state");
-    Stmt incr_active_threads =
-        Evaluate::make(Call::make(Int(32), "halide_profiler_incr_active_threads",
-                                  {profiler_state}, Call::Extern));
-    Stmt decr_active_threads =
-        Evaluate::make(Call::make(Int(32), "halide_profiler_decr_active_threads",
-                                  {profiler_state}, Call::Extern));
-    s = Block::make({incr_active_threads, s, decr_active_threads});
+    if (instrumented) {
+        // The state of the run lives on the stack, followed by the
+        // ticks billed to each Func, and is folded into the profiler's
+        // stats when the pipeline returns.
+        Expr task = Variable::make(Handle(), "profiler_task");
+        Expr run = Variable::make(Handle(), "profiler_run");
+        Expr begin = Call::make(Int(32), "halide_profiler_instrument_task_begin",
+                                {task, run, 0, cycle_counter}, Call::Extern);
+        Expr end = Call::make(Int(32), "halide_profiler_instrument_switch",
+                              {task, -1, cycle_counter}, Call::Extern);
+        s = Block::make({Evaluate::make(begin), s, Evaluate::make(end)});
+        Expr task_alloca = Call::make(Handle(), Call::alloca,
+                                      {instrument_task_size(t)}, Call::Intrinsic);
+        s = LetStmt::make("profiler_task", task_alloca, s);
+
+        Expr profiler_pipeline_state = Variable::make(Handle(), "profiler_pipeline_state");
+        Expr start_run = Call::make(Int(32), "halide_profiler_instrument_run_start",
+                                    {run, profiler_pipeline_state, num_funcs, cycle_counter}, Call::Extern);
+        Expr end_run = Call::make(Int(32), Call::register_destructor,
+                                  {Expr("halide_profiler_instrument_run_end"), run}, Call::Intrinsic);
+        s = Block::make({Evaluate::make(start_run), Evaluate::make(end_run), s});
+        Expr run_alloca = Call::make(Handle(), Call::alloca,
+                                     {instrument_run_size(t, num_funcs)}, Call::Intrinsic);
+        s = LetStmt::make("profiler_run", run_alloca, s);
+    } else {
+        Expr profiler_state = Variable::make(Handle(), "profiler_state");
+        Stmt incr_active_threads =
+            Evaluate::make(Call::make(Int(32), "halide_profiler_incr_active_threads",
+                                      {profiler_state}, Call::Extern));
+        Stmt decr_active_threads =
+            Evaluate::make(Call::make(Int(32), "halide_profiler_decr_active_threads",
+                                      {profiler_state}, Call::Extern));
+        s = Block::make({incr_active_threads, s, decr_active_threads});
+    }
 
     s = LetStmt::make("profiler_pipeline_state", get_pipeline_state, s);
     s = LetStmt::make("profiler_state", get_state, s);
@@ -325,7 +512,9 @@ Stmt inject_profiling(Stmt s, string pipeline_name) {
 
     s = Block::make(s, Free::make("profiling_func_names"));
     s = Allocate::make("profiling_func_names", Handle(), {num_funcs}, const_true(), s);
-    s = Block::make(Evaluate::make(stop_profiler), s);
+    if (!instrumented) {
+        s = Block::make(Evaluate::make(stop_profiler), s);
+    }
 
     return s;
 }
@@ -14,6 +14,8 @@
  *   \<func_name\> \<total time spent in this func\> \<percentage of time spent\>
  *     (\<peak heap alloc by this func\> \<num of allocs\> \<average alloc size\> |
  *      \<worst-case peak stack alloc by this func\>)?
+ *  (accelerator cycles/run:
+ *   \<kernel_name\> \<active cycles\> \<cycles stalled on inputs\> \<cycles stalled on outputs\>)?
  *
  * Sample output:
  * memory_profiler_mandelbrot
@@ -25,6 +27,7 @@
  */
 
 #include "IR.h"
+#include "Target.h"
 
 namespace Halide {
 namespace Internal {
@@ -35,8 +38,25 @@ namespace Internal {
  * times and counts will be logged at the end. Should be done before
  * storage flattening, but after all bounds inference.
  *
+ * If the target has the ProfileInstrumented feature, the pipeline is
+ * instead instrumented to read a timestamp (the cycle counter on x86)
+ * each time a thread moves from one Func to another, which also
+ * gives the distribution of the time taken per run of each Func, and
+ * per task of the parallel loops.
  */
-Stmt inject_profiling(Stmt, std::string);
+Stmt inject_profiling(Stmt, std::string, const Target &t);
+
+/** Returns the names of the HW kernels in the body of an accelerated
+ * region (a producer named "_hls_target.*") that keep cycle counters
+ * when profiling is turned on. Kernel i owns the counters 3*i (active
+ * cycles), 3*i+1 (cycles stalled on inputs) and 3*i+2 (cycles stalled
+ * on outputs) of the buffer "<region>.hw_counters", which the backend
+ * fills in after every run of the accelerator. */
+std::vector<std::string> profiled_hw_kernels(Stmt hw_body);
+
+/** Returns the statement that adds the counters of the accelerated
+ * region REGION_NAME to the profiler's stats of the pipeline. */
+Stmt update_hw_counters(const std::string &region_name, int num_kernels);
 
 }
 }
@@ -28,6 +28,15 @@ class RemoveDeadAllocations : public IRMutator {
         IRMutator::visit(op);
     }
 
+    void visit(const Variable *op) {
+        // A reference to the allocation by name is its address, e.g.
+        // when it is passed to an extern call.
+        if (allocs.contains(op->name)) {
+            allocs.pop(op->name);
+        }
+        expr = op;
+    }
+
     void visit(const Load *op) {
         if (allocs.contains(op->name)) {
             allocs.pop(op->name);
@@ -129,6 +129,7 @@ struct FuncScheduleContents {
     std::vector<Bound> bounds;
     std::map<std::string, IntrusivePtr<Internal::FunctionContents>> wrappers;
     bool memoized;
+    bool async;
 
     //----- HLS Modification Begins -----//
     // TODO(jingpu) move it to StageSchedule
@@ -139,6 +140,7 @@ struct FuncScheduleContents {
     std::string accelerate_exit;
     LoopLevel accelerate_compute_level, accelerate_store_level;
     std::map<std::string, int> fifo_depths;   // key is the name of the consumer
+    int stream_beat_width;   // bits per beat of the stream from/to the host, 0 for one stencil per beat
     bool is_kernel_buffer;
     bool is_kernel_buffer_slice;
     std::map<std::string, Function> tap_funcs;
@@ -147,10 +149,10 @@ struct FuncScheduleContents {
 
     FuncScheduleContents()
         : store_level(LoopLevel::inlined()),
-          compute_level(LoopLevel::inlined()), memoized(false),
+          compute_level(LoopLevel::inlined()), memoized(false), async(false),
           //----- HLS Modification Begins -----//
           is_hw_kernel(false), is_accelerated(false), is_linebuffered(false),
-          is_kernel_buffer(false), is_kernel_buffer_slice(false){};
+          stream_beat_width(0), is_kernel_buffer(false), is_kernel_buffer_slice(false){};
           //----- HLS Modification Ends -------//
 
     // Pass an IRMutator through to all Exprs referenced in the FuncScheduleContents
@@ -243,6 +245,7 @@ FuncSchedule FuncSchedule::deep_copy(
     copy.contents->storage_dims = contents->storage_dims;
     copy.contents->bounds = contents->bounds;
     copy.contents->memoized = contents->memoized;
+    copy.contents->async = contents->async;
 
     //----- HLS Modification Begins -----//
     // HLS related fields
@@ -254,6 +257,7 @@ FuncSchedule FuncSchedule::deep_copy(
     copy.contents->accelerate_compute_level = contents->accelerate_compute_level;
     copy.contents->accelerate_store_level = contents->accelerate_store_level;
     copy.contents->fifo_depths = contents->fifo_depths;
+    copy.contents->stream_beat_width = contents->stream_beat_width;
     copy.contents->is_kernel_buffer = contents->is_kernel_buffer;
     copy.contents->is_kernel_buffer_slice = contents->is_kernel_buffer_slice;
     copy.contents->tap_funcs = contents->tap_funcs;
@@ -284,6 +288,14 @@ bool FuncSchedule::memoized() const {
     return contents->memoized;
 }
 
+bool &FuncSchedule::async() {
+    return contents->async;
+}
+
+bool FuncSchedule::async() const {
+    return contents->async;
+}
+
 std::vector<StorageDim> &FuncSchedule::storage_dims() {
     return contents->storage_dims;
 }
@@ -488,6 +500,14 @@ std::map<std::string, int> &FuncSchedule::fifo_depths() {
     return contents->fifo_depths;
 }
 
+int FuncSchedule::stream_beat_width() const {
+    return contents->stream_beat_width;
+}
+
+int &FuncSchedule::stream_beat_width() {
+    return contents->stream_beat_width;
+}
+
 const std::string &FuncSchedule::accelerate_exit() const{
     return contents->accelerate_exit;
 }
@@ -268,6 +268,13 @@ public:
     bool memoized() const;
     // @}
 
+    /** This flag is set to true if the func is computed by its own
+     * task, concurrently with its consumers. */
+    // @{
+    bool &async();
+    bool async() const;
+    // @}
+
     /** The list and order of dimensions used to store this
      * function. The first dimension in the vector corresponds to the
      * innermost dimension for storage (i.e. which dimension is
@@ -354,6 +361,14 @@ public:
     std::map<std::string, int> &fifo_depths();
     // @}
 
+    /** The width in bits of the beats of the stream between the host
+     * and the accelerator, if this function is an input or the output
+     * of an accelerated pipeline. Zero means one stencil per beat. */
+    // @{
+    int stream_beat_width() const;
+    int &stream_beat_width();
+    // @}
+
     /** The output functions of the hardware accelerator pipeline. */
     // @{
     const std::string &accelerate_exit() const;
@@ -1042,6 +1042,15 @@ bool validate_schedule(Function f, Stmt s, const Target &target, bool is_output,
     LoopLevel store_at = f.schedule().store_level();
     LoopLevel compute_at = f.schedule().compute_level();
 
+    if (f.schedule().async()) {
+        // The consumer of an async func is code that follows it in
+        // the pipeline, which outputs and HW kernels don't have.
+        user_assert(!is_output)
+            << "Func " << f.name() << " is an output, so it cannot be scheduled async.\n";
+        user_assert(!f.schedule().is_hw_kernel() && !f.schedule().is_accelerated())
+            << "Func " << f.name() << " is computed in a HW kernel, so it cannot be scheduled async.\n";
+    }
+
     // Outputs must be compute_root and store_root. They're really
     // store_in_user_code, but store_root is close enough.
     if (is_output) {
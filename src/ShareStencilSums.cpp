@@ -0,0 +1,513 @@
+#include "ShareStencilSums.h"
+
+#include "IRMutator.h"
+#include "IROperator.h"
+#include "IREquality.h"
+#include "IRPrinter.h"
+#include "Simplify.h"
+#include "Debug.h"
+
+#include <algorithm>
+
+namespace Halide {
+namespace Internal {
+
+using std::string;
+using std::map;
+using std::vector;
+using std::pair;
+
+namespace {
+
+// A term of an unrolled stencil accumulation,
+// i.e. coeff * factor_0 * factor_1 * ... * load
+struct StencilTerm {
+    int64_t coeff;          // the product of the constant factors, including the sign
+    vector<Expr> factors;   // the other factors, e.g. taps
+    Expr load;              // the load of the input stencil, possibly casted
+    Expr column;            // the load without its dimension 1 index
+    int64_t row;            // the dimension 1 index of the load
+};
+
+// The contribution of a column of the input stencil to an output pixel,
+// i.e. sign * scale * column_sum
+struct ColumnSum {
+    bool negative;
+    Expr scale;   // undefined if one
+    Expr sum;
+};
+
+const Call *as_stencil_load(Expr e) {
+    if (const Cast *c = e.as<Cast>()) {
+        e = c->value;
+    }
+    const Call *op = e.as<Call>();
+    if (op && op->call_type == Call::Intrinsic &&
+        ends_with(op->name, ".stencil") &&
+        !ends_with(op->name, ".tap.stencil") &&
+        op->args.size() >= 2 &&
+        as_const_int(op->args[1])) {
+        return op;
+    }
+    return nullptr;
+}
+
+class ReadsStencil : public IRVisitor {
+    const string &name;
+
+    using IRVisitor::visit;
+
+    void visit(const Call *op) {
+        IRVisitor::visit(op);
+        result = result || op->name == name;
+    }
+public:
+    bool result;
+    ReadsStencil(const string &n) : name(n), result(false) {}
+};
+
+bool reads_stencil(Expr e, const string &name) {
+    ReadsStencil r(name);
+    e.accept(&r);
+    return r.result;
+}
+
+void flatten_sum(Expr e, int sign, vector<pair<int, Expr>> &leaves) {
+    if (const Add *op = e.as<Add>()) {
+        flatten_sum(op->a, sign, leaves);
+        flatten_sum(op->b, sign, leaves);
+    } else if (const Sub *op = e.as<Sub>()) {
+        flatten_sum(op->a, sign, leaves);
+        flatten_sum(op->b, -sign, leaves);
+    } else {
+        leaves.push_back({sign, e});
+    }
+}
+
+void flatten_product(Expr e, vector<Expr> &factors) {
+    if (const Mul *op = e.as<Mul>()) {
+        flatten_product(op->a, factors);
+        flatten_product(op->b, factors);
+    } else {
+        factors.push_back(e);
+    }
+}
+
+bool parse_term(Expr e, int sign, const string &target, StencilTerm &term) {
+    const int64_t max_coeff = (int64_t)1 << 30;
+    vector<Expr> factors;
+    flatten_product(e, factors);
+
+    term.coeff = sign;
+    for (Expr f : factors) {
+        const int64_t *i = as_const_int(f);
+        const uint64_t *u = as_const_uint(f);
+        const Call *load = as_stencil_load(f);
+        if (i) {
+            term.coeff *= *i;
+        } else if (u && *u < (uint64_t)max_coeff) {
+            term.coeff *= (int64_t)*u;
+        } else if (load && !term.load.defined() && load->name != target) {
+            term.load = f;
+            vector<Expr> column_args(load->args);
+            column_args.erase(column_args.begin() + 1);
+            term.column = Call::make(load->type, load->name, column_args, Call::Intrinsic);
+            term.row = *as_const_int(load->args[1]);
+        } else if (!reads_stencil(f, target)) {
+            term.factors.push_back(f);
+        } else {
+            return false;
+        }
+        if (term.coeff > max_coeff || term.coeff < -max_coeff) {
+            return false;
+        }
+    }
+    return term.load.defined() && term.coeff != 0;
+}
+
+// Match an unrolled accumulation into a stencil, e.g.
+//   sum.stencil(0, 0) = sum.stencil(0, 0) + in.stencil(1, 2) * k
+bool parse_accumulation(Stmt s, vector<StencilTerm> &terms) {
+    const Provide *op = s.as<Provide>();
+    if (!op || !ends_with(op->name, ".stencil") || op->values.size() != 1) {
+        return false;
+    }
+    Type t = op->values[0].type();
+    if (!(t.is_int() || t.is_uint()) || t.is_bool() || t.is_vector()) {
+        return false;
+    }
+    Expr self = Call::make(t, op->name, op->args, Call::Intrinsic);
+
+    vector<pair<int, Expr>> leaves;
+    flatten_sum(op->values[0], 1, leaves);
+    bool found_self = false;
+    for (const auto &leaf : leaves) {
+        if (!found_self && leaf.first == 1 && equal(leaf.second, self)) {
+            found_self = true;
+            continue;
+        }
+        StencilTerm term;
+        if (!parse_term(leaf.second, leaf.first, op->name, term)) {
+            return false;
+        }
+        terms.push_back(term);
+    }
+    return found_self && !terms.empty();
+}
+
+int64_t gcd(int64_t a, int64_t b) {
+    a = a < 0 ? -a : a;
+    b = b < 0 ? -b : b;
+    while (b != 0) {
+        int64_t r = a % b;
+        a = b;
+        b = r;
+    }
+    return a;
+}
+
+Expr make_product(Type t, int64_t coeff, const vector<Expr> &factors, Expr last) {
+    Expr e;
+    if (coeff != 1) {
+        e = make_const(t, coeff);
+    }
+    for (Expr f : factors) {
+        e = e.defined() ? e * f : f;
+    }
+    if (last.defined()) {
+        e = e.defined() ? e * last : last;
+    }
+    return e;
+}
+
+// Factor the terms in the same column of the input stencil, such that
+// the column sum is the same for every output pixel of a separable stencil
+ColumnSum make_column_sum(Type t, vector<StencilTerm> terms) {
+    std::stable_sort(terms.begin(), terms.end(),
+                     [](const StencilTerm &a, const StencilTerm &b) { return a.row < b.row; });
+
+    // the factors common to all the terms
+    vector<Expr> common = terms[0].factors;
+    int64_t g = 0;
+    for (const StencilTerm &term : terms) {
+        vector<Expr> rest = term.factors;
+        vector<Expr> still_common;
+        for (Expr f : common) {
+            for (size_t i = 0; i < rest.size(); i++) {
+                if (equal(f, rest[i])) {
+                    still_common.push_back(f);
+                    rest.erase(rest.begin() + i);
+                    break;
+                }
+            }
+        }
+        common.swap(still_common);
+        g = gcd(g, term.coeff);
+    }
+    // keep the first term of the sum positive
+    if (terms[0].coeff < 0) {
+        g = -g;
+    }
+
+    Expr sum;
+    for (const StencilTerm &term : terms) {
+        vector<Expr> rest = term.factors;
+        for (Expr f : common) {
+            for (size_t i = 0; i < rest.size(); i++) {
+                if (equal(f, rest[i])) {
+                    rest.erase(rest.begin() + i);
+                    break;
+                }
+            }
+        }
+        int64_t c = term.coeff / g;
+        Expr e = make_product(t, c < 0 ? -c : c, rest, term.load);
+        if (!sum.defined()) {
+            sum = e;
+        } else if (c < 0) {
+            sum = sum - e;
+        } else {
+            sum = sum + e;
+        }
+    }
+    return {g < 0, make_product(t, g < 0 ? -g : g, common, Expr()), sum};
+}
+
+bool same_args(const vector<Expr> &a, const vector<Expr> &b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if (!equal(a[i], b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Rewrite a sequence of unrolled accumulations into the same stencil
+Stmt share_sums(const vector<Stmt> &run) {
+    // the terms of each output pixel, in order of appearance
+    vector<const Provide *> pixels;
+    vector<vector<StencilTerm>> pixel_terms;
+    for (Stmt s : run) {
+        const Provide *op = s.as<Provide>();
+        vector<StencilTerm> terms;
+        internal_assert(parse_accumulation(s, terms));
+        size_t i = 0;
+        while (i < pixels.size() && !same_args(pixels[i]->args, op->args)) {
+            i++;
+        }
+        if (i == pixels.size()) {
+            pixels.push_back(op);
+            pixel_terms.push_back({});
+        }
+        pixel_terms[i].insert(pixel_terms[i].end(), terms.begin(), terms.end());
+    }
+
+    // the column sums of each output pixel
+    map<Expr, int, IRDeepCompare> uses;
+    vector<vector<ColumnSum>> pixel_columns(pixels.size());
+    for (size_t i = 0; i < pixels.size(); i++) {
+        Type t = pixels[i]->values[0].type();
+        vector<vector<StencilTerm>> columns;
+        for (const StencilTerm &term : pixel_terms[i]) {
+            size_t j = 0;
+            while (j < columns.size() && !equal(columns[j][0].column, term.column)) {
+                j++;
+            }
+            if (j == columns.size()) {
+                columns.push_back({});
+            }
+            columns[j].push_back(term);
+        }
+        for (const auto &column : columns) {
+            ColumnSum c = make_column_sum(t, column);
+            uses[c.sum]++;
+            pixel_columns[i].push_back(c);
+        }
+    }
+
+    // it only pays off if some of the column sums are shared
+    map<Expr, Expr, IRDeepCompare> shared;
+    vector<pair<string, Expr>> lets;
+    for (const auto &p : uses) {
+        bool is_sum = p.first.as<Add>() || p.first.as<Sub>();
+        if (is_sum && p.second > 1) {
+            string name = unique_name(pixels[0]->name + ".column_sum");
+            shared[p.first] = Variable::make(p.first.type(), name);
+            lets.push_back({name, p.first});
+        }
+    }
+    if (shared.empty()) {
+        return Block::make(run);
+    }
+    debug(3) << "Sharing " << shared.size() << " column sums of "
+             << pixels[0]->name << " between " << pixels.size() << " pixels\n";
+
+    vector<Stmt> provides;
+    for (size_t i = 0; i < pixels.size(); i++) {
+        Type t = pixels[i]->values[0].type();
+        Expr value = Call::make(t, pixels[i]->name, pixels[i]->args, Call::Intrinsic);
+        for (const ColumnSum &c : pixel_columns[i]) {
+            auto it = shared.find(c.sum);
+            Expr sum = it == shared.end() ? c.sum : it->second;
+            Expr e = c.scale.defined() ? c.scale * sum : sum;
+            value = c.negative ? value - e : value + e;
+        }
+        provides.push_back(Provide::make(pixels[i]->name, {value}, pixels[i]->args));
+    }
+    Stmt result = Block::make(provides);
+    for (size_t i = lets.size(); i > 0; i--) {
+        result = LetStmt::make(lets[i-1].first, lets[i-1].second, result);
+    }
+    return result;
+}
+
+class ContainsLoop : public IRVisitor {
+    using IRVisitor::visit;
+
+    void visit(const For *op) {
+        result = true;
+    }
+public:
+    bool result = false;
+};
+
+class ShareStencilSumsSingleKernel : public IRMutator {
+    using IRMutator::visit;
+
+    // only the bodies of the innermost loops are rewritten, which are left
+    // alone when perfecting the loop nests of the kernel
+    bool in_innermost_loop = false;
+
+    void visit(const For *op) {
+        ContainsLoop c;
+        op->body.accept(&c);
+        bool old_in_innermost_loop = in_innermost_loop;
+        in_innermost_loop = !c.result;
+        IRMutator::visit(op);
+        in_innermost_loop = old_in_innermost_loop;
+    }
+
+    void flatten_block(Stmt s, vector<Stmt> &stmts) {
+        if (const Block *op = s.as<Block>()) {
+            flatten_block(op->first, stmts);
+            flatten_block(op->rest, stmts);
+        } else if (s.defined()) {
+            stmts.push_back(s);
+        }
+    }
+
+    void visit(const Block *op) {
+        vector<Stmt> stmts;
+        flatten_block(op, stmts);
+
+        vector<Stmt> result;
+        bool changed = false;
+        size_t i = 0;
+        while (i < stmts.size()) {
+            // find a sequence of accumulations into the same stencil
+            size_t j = i;
+            vector<StencilTerm> terms;
+            while (in_innermost_loop && j < stmts.size() &&
+                   parse_accumulation(stmts[j], terms) &&
+                   stmts[j].as<Provide>()->name == stmts[i].as<Provide>()->name) {
+                j++;
+            }
+            Stmt s;
+            if (j - i > 1) {
+                s = share_sums(vector<Stmt>(stmts.begin() + i, stmts.begin() + j));
+                changed = changed || !s.as<Block>();
+                i = j;
+            } else {
+                s = mutate(stmts[i]);
+                changed = changed || !s.same_as(stmts[i]);
+                i++;
+            }
+            result.push_back(s);
+        }
+        stmt = changed ? Block::make(result) : Stmt(op);
+    }
+};
+
+class ShareStencilSumsForPipeline : public IRMutator {
+    using IRMutator::visit;
+
+    // traverse each hw kernel
+    void visit(const ProducerConsumer *op) {
+        if (op->is_producer && ends_with(op->name, ".stream")) {
+            debug(3) << "find a HW kernel " << op->name << "\n";
+            Stmt body = ShareStencilSumsSingleKernel().mutate(op->body);
+            if (body.same_as(op->body)) {
+                stmt = op;
+            } else {
+                stmt = ProducerConsumer::make(op->name, op->is_producer, body);
+            }
+        } else {
+            IRMutator::visit(op);
+        }
+    }
+};
+
+}
+
+Stmt share_stencil_sums(Stmt s) {
+    return ShareStencilSumsForPipeline().mutate(s);
+}
+
+namespace {
+
+// Replace the loads of the input stencil by values that depend on the
+// coordinates, and the accumulated stencil by zero, so that what each
+// Provide adds to a pixel simplifies to a constant.
+class SubstituteStencils : public IRMutator {
+    using IRMutator::visit;
+
+    void visit(const Call *op) {
+        if (op->name == "in.stencil") {
+            const int64_t *x = as_const_int(op->args[0]);
+            const int64_t *y = as_const_int(op->args[1]);
+            internal_assert(x && y);
+            expr = make_const(op->type, (*x) * 7 + (*y) * 13 + 1);
+        } else if (op->name == "out.stencil") {
+            expr = make_zero(op->type);
+        } else {
+            IRMutator::visit(op);
+        }
+    }
+};
+
+// The sum of what the Provides of a statement add to each pixel
+class SumProvides : public IRVisitor {
+    using IRVisitor::visit;
+
+    void visit(const Provide *op) {
+        const int64_t *x = as_const_int(op->args[0]);
+        const int64_t *v = as_const_int(op->values[0]);
+        internal_assert(x && v) << "Expected a constant pixel value: " << Stmt(op) << "\n";
+        sums[*x] += *v;
+    }
+public:
+    map<int64_t, int64_t> sums;
+};
+
+class CountColumnSums : public IRVisitor {
+    using IRVisitor::visit;
+
+    void visit(const LetStmt *op) {
+        if (op->name.find(".column_sum") != string::npos) {
+            count++;
+        }
+        IRVisitor::visit(op);
+    }
+public:
+    int count = 0;
+};
+
+// A 3x3 stencil with the given weights, unrolled over two output pixels
+Stmt unrolled_stencil(Type t, const int weights[3]) {
+    vector<Stmt> provides;
+    for (int x = 0; x < 2; x++) {
+        Expr self = Call::make(t, "out.stencil", {x, 0}, Call::Intrinsic);
+        for (int j = 0; j < 3; j++) {
+            for (int i = 0; i < 3; i++) {
+                Expr load = Call::make(t, "in.stencil", {x + i, j}, Call::Intrinsic);
+                Expr w = make_const(t, weights[i] * weights[j]);
+                provides.push_back(Provide::make("out.stencil", {self + load * w}, {x, 0}));
+            }
+        }
+    }
+    Stmt loop = For::make("out.s1.x", 0, 16, ForType::Serial, DeviceAPI::None, Block::make(provides));
+    return ProducerConsumer::make_produce("out.stream", loop);
+}
+
+}
+
+void share_stencil_sums_test() {
+    const int weights[] = {1, 2, 1};
+
+    // The two pixels share the sums of the two columns of the input
+    // both of them cover, and still compute the same values.
+    Stmt s = unrolled_stencil(Int(32), weights);
+    Stmt shared = share_stencil_sums(s);
+
+    CountColumnSums column_sums;
+    shared.accept(&column_sums);
+    internal_assert(column_sums.count == 2)
+        << "Expected two shared column sums:\n" << shared << "\n";
+    SumProvides before, after;
+    simplify(SubstituteStencils().mutate(s)).accept(&before);
+    simplify(SubstituteStencils().mutate(shared)).accept(&after);
+    internal_assert(before.sums.size() == 2 && before.sums == after.sums)
+        << "Sharing column sums changed the result:\n" << shared << "\n";
+
+    // Floating point stencils are left alone.
+    Stmt f = unrolled_stencil(Float(32), weights);
+    internal_assert(share_stencil_sums(f).same_as(f));
+
+    std::cout << "share_stencil_sums test passed" << std::endl;
+}
+
+}
+}
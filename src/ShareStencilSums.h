@@ -0,0 +1,30 @@
+#ifndef HALIDE_SHARE_STENCIL_SUMS_H
+#define HALIDE_SHARE_STENCIL_SUMS_H
+
+/** \file
+ *
+ * Defines the transformation pass that shares the column partial sums
+ * of stencils between the unrolled output pixels of HW kernels.
+ */
+
+#include "IR.h"
+
+namespace Halide {
+namespace Internal {
+
+/** Rewrites the unrolled accumulations of integer stencils in HW
+ * kernels, e.g. a 2D convolution unrolled over several output pixels,
+ * into sums over columns of the input stencil. Column sums that are
+ * identical for different output pixels are computed once.
+ *
+ * Only integer stencils are rewritten, since reassociating their sums
+ * doesn't change the result. Floating point stencils are left alone.
+ */
+Stmt share_stencil_sums(Stmt s);
+
+EXPORT void share_stencil_sums_test();
+
+}
+}
+
+#endif
@@ -1,5 +1,6 @@
 #include <iostream>
 #include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <limits>
 #include <stdio.h>
@@ -36,6 +37,12 @@ using std::vector;
 
 namespace {
 
+std::atomic<bool> &simplify_cache_flag() {
+    static std::atomic<bool> flag(get_env_variable("HL_SIMPLIFY_CACHE") != "" &&
+                                  get_env_variable("HL_SIMPLIFY_CACHE") != "0");
+    return flag;
+}
+
 // Things that we can constant fold: Immediates and broadcasts of immediates.
 bool is_simple_const(const Expr &e) {
     if (e.as<IntImm>()) return true;
@@ -176,7 +183,8 @@ static int debug_indent = 0;
 class Simplify : public IRMutator {
 public:
     Simplify(bool r, const Scope<Interval> *bi, const Scope<ModulusRemainder> *ai) :
-        simplify_lets(r) {
+        simplify_lets(r), use_cache(simplify_cache_enabled()), compare_cache(8),
+        expr_cache(1), cache_scopes_entered(0), cache_depth(0) {
         alignment_info.set_containing_scope(ai);
 
         // Only respect the constant bounds from the containing scope.
@@ -190,8 +198,57 @@ public:
 
     }
 
-#if LOG_EXPR_MUTATIONS
     Expr mutate(const Expr &e) {
+        // Leaves aren't worth looking up.
+        if (!use_cache || !e.defined() ||
+            e.as<IntImm>() || e.as<UIntImm>() || e.as<FloatImm>() ||
+            e.as<StringImm>() || e.as<Variable>()) {
+            return mutate_uncached(e);
+        }
+
+        ExprWithCompareCache key(e, &compare_cache);
+        auto iter = expr_cache.back().find(key);
+        if (iter != expr_cache.back().end()) {
+            for (const VarUses &u : iter->second.uses) {
+                count_uses(u);
+            }
+            return iter->second.result;
+        }
+
+        size_t first_use = var_uses.size();
+        int scopes_entered = cache_scopes_entered;
+        cache_depth++;
+        Expr new_e = mutate_uncached(e);
+        cache_depth--;
+
+        // If simplifying the Expr entered a scope of its own (it
+        // contains a Let), the uses it counted aren't all of lets
+        // that are in scope here, so don't cache it.
+        if (scopes_entered == cache_scopes_entered) {
+            CacheEntry entry;
+            entry.result = new_e;
+            for (size_t i = first_use; i < var_uses.size(); i++) {
+                const VarUses &u = var_uses[i];
+                size_t j = 0;
+                while (j < entry.uses.size() && entry.uses[j].name != u.name) {
+                    j++;
+                }
+                if (j == entry.uses.size()) {
+                    entry.uses.push_back({u.name, 0, 0});
+                }
+                entry.uses[j].old_uses += u.old_uses;
+                entry.uses[j].new_uses += u.new_uses;
+            }
+            expr_cache.back().emplace(key, std::move(entry));
+        }
+        if (cache_depth == 0) {
+            var_uses.clear();
+        }
+        return new_e;
+    }
+
+    Expr mutate_uncached(const Expr &e) {
+#if LOG_EXPR_MUTATIONS
         const std::string spaces(debug_indent, ' ');
         debug(1) << spaces << "Simplifying Expr: " << e << "\n";
         debug_indent++;
@@ -203,8 +260,10 @@ public:
                 << spaces << "After:  " << new_e << "\n";
         }
         return new_e;
-    }
+#else
+        return IRMutator::mutate(e);
 #endif
+    }
 
 #if LOG_STMT_MUTATIONS
     Stmt mutate(const Stmt &s) {
@@ -236,6 +295,54 @@ private:
     Scope<pair<int64_t, int64_t>> bounds_info;
     Scope<ModulusRemainder> alignment_info;
 
+    // When the simplify cache is enabled, the simplified form of each
+    // Expr mutated is remembered, keyed on the structure of the Expr,
+    // so that identical subexpressions are simplified only once. How
+    // an Expr simplifies depends on the lets, loop bounds and
+    // alignment in scope, so there's a table per scope, pushed and
+    // popped along with them.
+    struct VarUses {
+        string name;
+        int old_uses, new_uses;
+    };
+
+    struct CacheEntry {
+        Expr result;
+        // Simplifying an Expr counts the uses of the lets it refers
+        // to, so a cache hit must count them again.
+        vector<VarUses> uses;
+    };
+
+    bool use_cache;
+    IRCompareCache compare_cache;
+    vector<map<ExprWithCompareCache, CacheEntry>> expr_cache;
+    // The uses counted while simplifying the Exprs currently being
+    // mutated.
+    vector<VarUses> var_uses;
+    int cache_scopes_entered, cache_depth;
+
+    void push_cache_scope() {
+        if (use_cache) {
+            expr_cache.emplace_back();
+            cache_scopes_entered++;
+        }
+    }
+
+    void pop_cache_scope() {
+        if (use_cache) {
+            expr_cache.pop_back();
+        }
+    }
+
+    void count_uses(const VarUses &u) {
+        VarInfo &info = var_info.ref(u.name);
+        info.old_uses += u.old_uses;
+        info.new_uses += u.new_uses;
+        if (use_cache) {
+            var_uses.push_back(u);
+        }
+    }
+
     // If we encounter a reference to a buffer (a Load, Store, Call,
     // or Provide), there's an implicit dependence on some associated
     // symbols.
@@ -243,17 +350,17 @@ private:
         for (size_t i = 0; i < dimensions; i++) {
             string stride = name + ".stride." + std::to_string(i);
             if (var_info.contains(stride)) {
-                var_info.ref(stride).old_uses++;
+                count_uses({stride, 1, 0});
             }
 
             string min = name + ".min." + std::to_string(i);
             if (var_info.contains(min)) {
-                var_info.ref(min).old_uses++;
+                count_uses({min, 1, 0});
             }
         }
 
         if (var_info.contains(name)) {
-            var_info.ref(name).old_uses++;
+            count_uses({name, 1, 0});
         }
     }
 
@@ -558,7 +665,7 @@ private:
 
     void visit(const Variable *op) {
         if (var_info.contains(op->name)) {
-            VarInfo &info = var_info.ref(op->name);
+            const VarInfo &info = var_info.ref(op->name);
 
             // if replacement is defined, we should substitute it in (unless
             // it's a var that has been hidden by a nested scope).
@@ -566,12 +673,12 @@ private:
                 internal_assert(info.replacement.type() == op->type) << "Cannot replace variable " << op->name
                     << " of type " << op->type << " with expression of type " << info.replacement.type() << "\n";
                 expr = info.replacement;
-                info.new_uses++;
+                count_uses({op->name, 0, 1});
             } else {
                 // This expression was not something deemed
                 // substitutable - no replacement is defined.
                 expr = op;
-                info.old_uses++;
+                count_uses({op->name, 1, 0});
             }
         } else {
             // We never encountered a let that defines this var. Must
@@ -4787,7 +4894,9 @@ private:
             }
         }
 
+        push_cache_scope();
         body = mutate(body);
+        pop_cache_scope();
 
         if (value_alignment_tracked) {
             alignment_info.pop(op->name);
@@ -4883,7 +4992,9 @@ private:
             bounds_info.push(op->name, { new_min_int, new_max_int });
         }
 
+        push_cache_scope();
         Stmt new_body = mutate(op->body);
+        pop_cache_scope();
 
         if (bounds_tracked) {
             bounds_info.pop(op->name);
@@ -5071,6 +5182,14 @@ private:
     }
 };
 
+bool simplify_cache_enabled() {
+    return simplify_cache_flag();
+}
+
+void set_simplify_cache_enabled(bool enabled) {
+    simplify_cache_flag() = enabled;
+}
+
 Expr simplify(Expr e, bool simplify_lets,
               const Scope<Interval> &bounds,
               const Scope<ModulusRemainder> &alignment) {
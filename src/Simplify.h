@@ -33,6 +33,17 @@ EXPORT Expr simplify(Expr, bool simplify_lets = true,
  * true at compile time. Equivalent to is_one(simplify(e)) */
 EXPORT bool can_prove(Expr e);
 
+/** Get or set whether the simplifier remembers the result of
+ * simplifying each Expr, so that structurally identical
+ * subexpressions (e.g. those of unrolled stencils) are simplified
+ * once per call to simplify rather than every time they occur. The
+ * results are the same either way. Defaults to on if the environment
+ * variable HL_SIMPLIFY_CACHE is set to something other than 0. */
+// @{
+EXPORT bool simplify_cache_enabled();
+EXPORT void set_simplify_cache_enabled(bool enabled);
+// @}
+
 /** Simplify expressions found in a statement, but don't simplify
  * across different statements. This is safe to perform at an earlier
  * stage in lowering than full simplification of a stmt. */
@@ -8,6 +8,7 @@
 #include "Debug.h"
 #include "Monotonic.h"
 #include "ExprUsesVar.h"
+#include "AsyncProducers.h"
 
 namespace Halide {
 namespace Internal {
@@ -197,7 +198,13 @@ class AttemptStorageFoldingOfFunction : public IRMutator {
                     const int max_fold = 1024;
                     const int64_t *const_max_extent = as_const_int(max_extent);
                     if (const_max_extent && *const_max_extent <= max_fold) {
-                        factor = static_cast<int>(next_power_of_two(*const_max_extent));
+                        int64_t fold_extent = *const_max_extent;
+                        if (func.schedule().async()) {
+                            // Leave room for an async producer to run
+                            // ahead of its consumer.
+                            fold_extent *= 2;
+                        }
+                        factor = static_cast<int>(next_power_of_two(fold_extent));
                     } else {
                         debug(3) << "Not folding because extent not bounded by a constant not greater than " << max_fold << "\n"
                                  << "extent = " << extent << "\n"
@@ -205,6 +212,54 @@ class AttemptStorageFoldingOfFunction : public IRMutator {
                     }
                 }
 
+                if (factor.defined() && func.schedule().async()) {
+                    // The producer runs ahead of the consumer in a
+                    // task of its own, so it must not overwrite a
+                    // fold until the consumer has moved past it. A
+                    // semaphore counts the free rows of the fold: the
+                    // producer takes the rows that become live each
+                    // iteration before computing anything, and the
+                    // consumer gives back the rows it won't touch
+                    // again. This needs the opposite end of the
+                    // footprint to move the same way.
+                    Expr loop_var = Variable::make(Int(32), op->name);
+                    Expr first = loop_var == op->min;
+                    Expr rows_needed, rows_done;
+                    Monotonic other_end;
+                    if (min_monotonic_increasing) {
+                        other_end = is_monotonic(max, op->name);
+                        Expr prev_max = substitute(op->name, loop_var - 1, max);
+                        Expr next_min = substitute(op->name, loop_var + 1, min);
+                        rows_needed = select(first, max - min + 1, max - prev_max);
+                        rows_done = next_min - min;
+                    } else {
+                        other_end = is_monotonic(min, op->name);
+                        if (other_end == Monotonic::Decreasing) {
+                            other_end = Monotonic::Increasing;
+                        }
+                        Expr prev_min = substitute(op->name, loop_var - 1, min);
+                        Expr next_max = substitute(op->name, loop_var + 1, max);
+                        rows_needed = select(first, max - min + 1, prev_min - min);
+                        rows_done = max - next_max;
+                    }
+                    if (!dims_folded.empty() ||
+                        (other_end != Monotonic::Increasing && other_end != Monotonic::Constant)) {
+                        debug(3) << "Not folding async func " << func.name()
+                                 << " because the fold can't be synchronized with its consumer\n";
+                        continue;
+                    }
+                    string sem = func.name() + ".folding_semaphore";
+                    body = Block::make(acquire_semaphore(sem, simplify(rows_needed)),
+                                       Block::make(body, release_semaphore(sem, simplify(rows_done))));
+                    Fold fold = {(int)i - 1, factor};
+                    dims_folded.push_back(fold);
+                    body = FoldStorageOfFunction(func.name(), (int)i - 1, factor).mutate(body);
+                    // The semaphore only accounts for this loop, so
+                    // don't fold any further.
+                    stmt = For::make(op->name, op->min, op->extent, op->for_type, op->device_api, body);
+                    return;
+                }
+
                 if (factor.defined()) {
                     debug(3) << "Proceeding with factor " << factor << "\n";
 
@@ -348,6 +403,18 @@ class StorageFolding : public IRMutator {
                 }
 
                 stmt = Realize::make(op->name, op->types, bounds, op->condition, body);
+
+                if (func.schedule().async()) {
+                    // All rows of the fold start out free.
+                    internal_assert(folder.dims_folded.size() == 1);
+                    string sem_name = op->name + ".folding_semaphore";
+                    Expr sem = Variable::make(Handle(), sem_name);
+                    Expr init = Call::make(Int(32), "halide_semaphore_init",
+                                           {sem, folder.dims_folded[0].factor}, Call::Extern);
+                    Expr alloca = Call::make(Handle(), Call::alloca,
+                                             {(int)sizeof(halide_semaphore_t)}, Call::Intrinsic);
+                    stmt = LetStmt::make(sem_name, alloca, Block::make(Evaluate::make(init), stmt));
+                }
             }
         }
     }
@@ -7,6 +7,7 @@
 #include "IRPrinter.h"
 #include "Simplify.h"
 #include "Bounds.h"
+#include "IREquality.h"
 
 #include <iostream>
 #include <algorithm>
@@ -396,6 +397,357 @@ Stmt add_linebuffer(Stmt s, const HWKernel &kernel) {
     return ret;
 }
 
+// A boundary condition (BoundaryConditions::repeat_edge or constant_exterior)
+// on an input of the accelerator. Instead of padding the image on the host,
+// only the part of each tile inside the source image is streamed in, and
+// the hardware fills in the rest before the line buffer.
+struct HWBorder {
+    bool is_constant;        // constant_exterior, otherwise repeat_edge
+    Expr value;              // the exterior value of constant_exterior
+    Expr source;             // a call to the underlying image
+    vector<Interval> bounds; // undefined for unbounded dimensions
+};
+
+// Match clamp(likely(var), min, max) as generated by repeat_edge
+bool match_border_clamp(Expr e, const string &var, Interval &bound) {
+    const Max *max = e.as<Max>();
+    const Min *min = max ? max->a.as<Min>() : nullptr;
+    const Call *l = min ? min->a.as<Call>() : nullptr;
+    if (!l || !l->is_intrinsic(Call::likely)) {
+        return false;
+    }
+    const Variable *v = l->args[0].as<Variable>();
+    if (!v || v->name != var) {
+        return false;
+    }
+    bound = Interval(max->b, min->b);
+    return true;
+}
+
+// Look through inlined functions that merely forward their arguments,
+// such as the lambda BoundaryConditions wraps around an ImageParam.
+Expr strip_forwarding_funcs(Expr e) {
+    const Call *c = e.as<Call>();
+    while (c && c->call_type == Call::Halide) {
+        Function f(c->func);
+        if (!f.is_pure() || f.values().size() != 1 ||
+            !f.schedule().compute_level().is_inline()) {
+            break;
+        }
+        const Call *inner = f.values()[0].as<Call>();
+        if (!inner || inner->args.size() != f.args().size() ||
+            (inner->call_type != Call::Image && inner->call_type != Call::Halide)) {
+            break;
+        }
+        for (size_t i = 0; i < inner->args.size(); i++) {
+            const Variable *v = inner->args[i].as<Variable>();
+            if (!v || v->name != f.args()[i]) {
+                return e;
+            }
+        }
+        e = Call::make(inner->type, inner->name, c->args, inner->call_type,
+                       inner->func, inner->value_index, inner->image, inner->param);
+        c = e.as<Call>();
+    }
+    return e;
+}
+
+// Match the definition of a repeat_edge function, i.e.
+//   f(x, y, ...) = source(clamp(likely(x), ...), y, ...)
+bool match_repeat_edge(Function f, HWBorder &border) {
+    if (!f.is_pure() || f.values().size() != 1) {
+        return false;
+    }
+    const Call *c = f.values()[0].as<Call>();
+    if (!c || c->args.size() != f.args().size() ||
+        (c->call_type != Call::Image && c->call_type != Call::Halide)) {
+        return false;
+    }
+    bool has_bounds = false;
+    border.bounds.resize(c->args.size());
+    for (size_t i = 0; i < c->args.size(); i++) {
+        const Variable *v = c->args[i].as<Variable>();
+        if (v && v->name == f.args()[i]) {
+            border.bounds[i] = Interval();
+        } else if (match_border_clamp(c->args[i], f.args()[i], border.bounds[i])) {
+            has_bounds = true;
+        } else {
+            return false;
+        }
+    }
+    border.is_constant = false;
+    border.source = strip_forwarding_funcs(c);
+    return has_bounds;
+}
+
+// Match the definition of a constant_exterior function, i.e.
+//   f(x, y, ...) = select(x < min_0 || ..., value, repeat_edge(x, y, ...))
+bool match_constant_exterior(Function f, HWBorder &border) {
+    if (!f.is_pure() || f.values().size() != 1) {
+        return false;
+    }
+    const Select *sel = f.values()[0].as<Select>();
+    const Call *c = sel ? sel->false_value.as<Call>() : nullptr;
+    if (!c || c->call_type != Call::Halide || !is_const(sel->true_value) ||
+        c->args.size() != f.args().size()) {
+        return false;
+    }
+    for (size_t i = 0; i < c->args.size(); i++) {
+        const Variable *v = c->args[i].as<Variable>();
+        if (!v || v->name != f.args()[i]) {
+            return false;
+        }
+    }
+    Function g(c->func);
+    if (!g.schedule().compute_level().is_inline() ||
+        !match_repeat_edge(g, border)) {
+        return false;
+    }
+
+    // the condition should select the exterior of the same bounds
+    Expr out_of_bounds = const_false();
+    for (size_t i = 0; i < border.bounds.size(); i++) {
+        if (border.bounds[i].is_bounded()) {
+            Expr x = Variable::make(Int(32), f.args()[i]);
+            out_of_bounds = (out_of_bounds ||
+                             x < border.bounds[i].min ||
+                             x >= border.bounds[i].max + 1);
+        }
+    }
+    if (!equal(simplify(sel->condition), simplify(out_of_bounds))) {
+        return false;
+    }
+    border.is_constant = true;
+    border.value = sel->true_value;
+    return true;
+}
+
+// Decide whether the boundary condition of an input kernel can be
+// moved onto the fabric
+bool extract_border(const HWKernel &kernel, HWBorder &border) {
+    if (!match_repeat_edge(kernel.func, border) &&
+        !match_constant_exterior(kernel.func, border)) {
+        if (starts_with(kernel.func.name(), "mirror_") ||
+            starts_with(kernel.func.name(), "repeat_image")) {
+            user_warning << "Boundary condition " << kernel.name
+                         << " is not supported in hardware. It is computed on the host.\n";
+        }
+        return false;
+    }
+    // only the two innermost dimensions are padded, and the pixels
+    // must arrive one at a time
+    for (size_t i = 0; i < kernel.dims.size() && i < 2; i++) {
+        if (kernel.dims[i].step != 1) {
+            user_warning << "Boundary condition " << kernel.name
+                         << " is computed on the host, as its stencil step in dimension "
+                         << i << " is not one.\n";
+            return false;
+        }
+    }
+    const Call *source = border.source.as<Call>();
+    if (source->call_type == Call::Halide &&
+        Function(source->func).schedule().compute_level().is_inline()) {
+        user_warning << "Boundary condition " << kernel.name
+                     << " is computed on the host, as its source " << source->name
+                     << " is not stored in memory.\n";
+        return false;
+    }
+    return true;
+}
+
+// IR for the border padding of an input stream
+// The stream of the valid sub-image is expanded to the full tile, and
+// feeds the linebuffer in place of the stream from memory.
+Stmt add_border(Stmt s, const HWKernel &kernel, const HWBorder &border) {
+    // Before mutation:
+    //       stmt...
+    //
+    // After mutation:
+    //       realize func.stencil_update.stream {
+    //         border(func.border.stream, func.stencil_update.stream, ...)
+    //         stmt...
+    //       }
+    string stream_name = need_linebuffer(kernel) ?
+        kernel.name + ".stencil_update.stream" : kernel.name + ".stencil.stream";
+    Expr stream_var = Variable::make(Handle(), stream_name);
+    Expr border_stream_var = Variable::make(Handle(), kernel.name + ".border.stream");
+
+    // syntax:
+    //   border(border_stream, stream, mode, value,
+    //          lo_0, valid_0, lo_1, valid_1, store_extent_0, ...)
+    Type t = kernel.func.output_types()[0];
+    vector<Expr> border_args({border_stream_var, stream_var,
+                Expr(string(border.is_constant ? "constant_exterior" : "repeat_edge")),
+                border.is_constant ? cast(t, border.value) : make_zero(t)});
+    for (size_t i = 0; i < 2; i++) {
+        if (i < kernel.dims.size()) {
+            border_args.push_back(Variable::make(Int(32), kernel.name + ".border.lo." + std::to_string(i)));
+            border_args.push_back(Variable::make(Int(32), kernel.name + ".border.valid." + std::to_string(i)));
+        } else {
+            border_args.push_back(0);
+            border_args.push_back(1);
+        }
+    }
+    for (size_t i = 0; i < kernel.dims.size(); i++) {
+        Expr store_extent = simplify(kernel.dims[i].store_bound.max -
+                                     kernel.dims[i].store_bound.min + 1);
+        border_args.push_back(store_extent);
+    }
+    Stmt border_call = Evaluate::make(Call::make(Handle(), "border", border_args, Call::Intrinsic));
+
+    Region bounds;
+    for (StencilDimSpecs dim: kernel.dims) {
+        bounds.push_back(Range(0, dim.step));
+    }
+    return Realize::make(stream_name, kernel.func.output_types(), bounds, const_true(), Block::make(border_call, s));
+}
+
+// The packing of the stencils streamed between the host and the
+// accelerator into wide beats (see Func::stream_beat_width). FACTOR
+// consecutive stencils along dimension DIM, the innermost dimension
+// the stencils are scanned over, form one beat. The beat is then a
+// contiguous burst if the dimensions up to DIM are dense in memory,
+// e.g. the pixels of a row, or the pixels of a row of an interleaved
+// color image.
+struct HWStreamPacking {
+    int dim;
+    int factor;
+    Expr num_beats;
+};
+
+bool extract_stream_packing(const HWKernel &kernel, HWStreamPacking &packing) {
+    const int beat_width = kernel.func.schedule().stream_beat_width();
+    if (beat_width == 0) {
+        return false;
+    }
+
+    int stencil_width = kernel.func.output_types()[0].bits();
+    for (const StencilDimSpecs &dim : kernel.dims) {
+        stencil_width *= dim.step;
+    }
+
+    packing.dim = -1;
+    packing.num_beats = 1;
+    int64_t num_stencils = 0;  // along the packed dimension
+    for (size_t i = 0; i < kernel.dims.size(); i++) {
+        Expr store_extent = simplify(kernel.dims[i].store_bound.max -
+                                     kernel.dims[i].store_bound.min + 1);
+        packing.num_beats = packing.num_beats * store_extent / kernel.dims[i].step;
+        const int64_t *extent = as_const_int(store_extent);
+        if (packing.dim < 0 && extent && *extent > kernel.dims[i].step) {
+            packing.dim = i;
+            num_stencils = *extent / kernel.dims[i].step;
+        } else if (packing.dim < 0 && !extent) {
+            user_warning << "The stream of " << kernel.name << " is not packed into beats, "
+                         << "as the extent of its tile is not constant.\n";
+            return false;
+        }
+    }
+
+    if (packing.dim < 0 || beat_width == stencil_width) {
+        // a tile of one stencil, or one stencil per beat anyway
+        return false;
+    }
+    if (beat_width < stencil_width || beat_width % stencil_width != 0) {
+        user_warning << "The stream of " << kernel.name << " is not packed into beats, "
+                     << "as the beat width " << beat_width << " is not a multiple of "
+                     << "the stencil size " << stencil_width << " bits.\n";
+        return false;
+    }
+    packing.factor = beat_width / stencil_width;
+    if (num_stencils % packing.factor != 0) {
+        user_warning << "The stream of " << kernel.name << " is not packed into beats, "
+                     << "as " << num_stencils << " stencils along dimension " << packing.dim
+                     << " of the tile don't fill " << packing.factor << " stencil beats.\n";
+        return false;
+    }
+    packing.num_beats = simplify(packing.num_beats / packing.factor);
+    return true;
+}
+
+// IR for the conversion between the packed stream from/to the host, and
+// the stream of stencils in the accelerator
+Stmt add_stream_packing(Stmt s, const HWKernel &kernel, const HWStreamPacking &packing) {
+    // Before mutation:
+    //       stmt...
+    //
+    // After mutation for an input:
+    //       realize func.stencil_update.stream {
+    //         unpack_stream(func.packed.stream, func.stencil_update.stream, dim, num_beats)
+    //         stmt...
+    //       }
+    //
+    // After mutation for the output:
+    //       realize func.stencil.stream {
+    //         stmt...
+    //         pack_stream(func.stencil.stream, func.packed.stream, dim, num_beats)
+    //       }
+    string stream_name = need_linebuffer(kernel) ?
+        kernel.name + ".stencil_update.stream" : kernel.name + ".stencil.stream";
+    Expr stream_var = Variable::make(Handle(), stream_name);
+    Expr packed_stream_var = Variable::make(Handle(), kernel.name + ".packed.stream");
+
+    Stmt body;
+    if (kernel.is_output) {
+        Stmt pack_call = Evaluate::make(Call::make(Handle(), "pack_stream",
+                                                   {stream_var, packed_stream_var, packing.dim, packing.num_beats},
+                                                   Call::Intrinsic));
+        body = Block::make(s, pack_call);
+    } else {
+        Stmt unpack_call = Evaluate::make(Call::make(Handle(), "unpack_stream",
+                                                     {packed_stream_var, stream_var, packing.dim, packing.num_beats},
+                                                     Call::Intrinsic));
+        body = Block::make(unpack_call, s);
+    }
+
+    Region bounds;
+    for (StencilDimSpecs dim: kernel.dims) {
+        bounds.push_back(Range(0, dim.step));
+    }
+    return Realize::make(stream_name, kernel.func.output_types(), bounds, const_true(), body);
+}
+
+class CallsFunc : public IRVisitor {
+    const string &name;
+
+    using IRVisitor::visit;
+
+    void visit(const Call *op) {
+        IRVisitor::visit(op);
+        result = result || op->name == name;
+    }
+public:
+    bool result;
+    CallsFunc(const string &n) : name(n), result(false) {}
+};
+
+// Remove the host-side computation of a function, keeping its consumers
+class RemoveRealization : public IRMutator {
+    const string &name;
+
+    using IRMutator::visit;
+
+    void visit(const Realize *op) {
+        if (op->name == name) {
+            stmt = mutate(op->body);
+        } else {
+            IRMutator::visit(op);
+        }
+    }
+
+    void visit(const ProducerConsumer *op) {
+        if (op->name != name) {
+            IRMutator::visit(op);
+        } else if (op->is_producer) {
+            stmt = Evaluate::make(0);
+        } else {
+            stmt = mutate(op->body);
+        }
+    }
+public:
+    RemoveRealization(const string &n) : name(n) {}
+};
+
 
 Stmt transform_kernel(Stmt s, const HWKernelDAG &dag, const Scope<Expr> &scope) {
     Stmt ret;
@@ -646,6 +998,8 @@ public:
 class StreamOpt : public IRMutator {
     const HWKernelDAG &dag;
     Scope<Expr> scope;
+    map<string, HWBorder> borders;
+    map<string, HWStreamPacking> packings;
 
     using IRMutator::visit;
 
@@ -671,6 +1025,18 @@ class StreamOpt : public IRMutator {
             for (const string &kernel_name : dag.input_kernels) {
                 const HWKernel &input_kernel = dag.kernels.find(kernel_name)->second;
                 new_body = add_linebuffer(new_body, input_kernel);
+                if (borders.count(kernel_name)) {
+                    new_body = add_border(new_body, input_kernel, borders.find(kernel_name)->second);
+                }
+                if (packings.count(kernel_name)) {
+                    new_body = add_stream_packing(new_body, input_kernel, packings.find(kernel_name)->second);
+                }
+            }
+
+            // pack the output stream
+            if (packings.count(dag.name)) {
+                new_body = add_stream_packing(new_body, dag.kernels.find(dag.name)->second,
+                                              packings.find(dag.name)->second);
             }
 
             // Rewrap the let statements
@@ -714,17 +1080,55 @@ class StreamOpt : public IRMutator {
                     kernel.name + ".stencil_update.stream" : kernel.name + ".stencil.stream";
 
                 string direction = kernel.is_output ? "stream_to_buffer" : "buffer_to_stream";
-                Expr stream_var = Variable::make(Handle(), stream_name);
 
-                // derive the coordinate of the sub-image block
+                // derive the coordinate and the size of the sub-image block
                 internal_assert(kernel.func.output_types().size() == 1);
-                vector<Expr> image_args;
+                vector<Expr> image_args, image_extents;
                 for (size_t i = 0; i < kernel.dims.size(); i++) {
                     image_args.push_back(kernel.dims[i].store_bound.min);
+                    image_extents.push_back(simplify(kernel.dims[i].store_bound.max - kernel.dims[i].store_bound.min + 1));
                 }
                 // TODO(jingpu) check we can use build-in calls for "address_of"
-                Expr address_of_subimage_origin = Call::make(Handle(), "address_of", {Call::make(kernel.func, image_args, 0)}, Call::Intrinsic);
-                Expr buffer_var = Variable::make(type_of<struct buffer_t *>(), kernel.name + ".buffer");
+                Expr subimage_origin = Call::make(kernel.func, image_args, 0);
+                string buffer_name = kernel.name;
+
+                const auto border_it = borders.find(name);
+                vector<pair<string, Expr>> border_lets;
+                if (border_it != borders.end()) {
+                    // stream only the part of the tile inside the source image,
+                    // the hardware pads it back to the full tile
+                    const HWBorder &border = border_it->second;
+                    const Call *source = border.source.as<Call>();
+                    stream_name = kernel.name + ".border.stream";
+                    buffer_name = source->name;
+                    for (size_t i = 0; i < kernel.dims.size(); i++) {
+                        Expr lo = 0, valid = image_extents[i];
+                        if (i < 2 && border.bounds[i].is_bounded()) {
+                            // the boundary is assumed to be never crossed in
+                            // the outer dimensions, e.g. color channels
+                            Expr tile_min = kernel.dims[i].store_bound.min;
+                            Expr tile_max = kernel.dims[i].store_bound.max;
+                            Expr valid_min = clamp(tile_min, border.bounds[i].min, border.bounds[i].max);
+                            Expr valid_max = clamp(tile_max, border.bounds[i].min, border.bounds[i].max);
+                            image_args[i] = simplify(valid_min);
+                            image_extents[i] = simplify(valid_max - valid_min + 1);
+                            lo = simplify(valid_min - tile_min);
+                            valid = image_extents[i];
+                        }
+                        if (i < 2) {
+                            border_lets.push_back(make_pair(kernel.name + ".border.lo." + std::to_string(i), lo));
+                            border_lets.push_back(make_pair(kernel.name + ".border.valid." + std::to_string(i), valid));
+                        }
+                    }
+                    subimage_origin = Call::make(source->type, source->name, image_args, source->call_type,
+                                                 source->func, source->value_index, source->image, source->param);
+                }
+                if (packings.count(name)) {
+                    stream_name = kernel.name + ".packed.stream";
+                }
+                Expr stream_var = Variable::make(Handle(), stream_name);
+                Expr address_of_subimage_origin = Call::make(Handle(), "address_of", {subimage_origin}, Call::Intrinsic);
+                Expr buffer_var = Variable::make(type_of<struct buffer_t *>(), buffer_name + ".buffer");
 
                 // add intrinsic functions to convert memory buffers to streams
                 // syntax:
@@ -732,8 +1136,8 @@ class StreamOpt : public IRMutator {
                 //                   dim_0_stride, dim_0_extent, ...)
                 vector<Expr> stream_call_args({direction, buffer_var, stream_var, address_of_subimage_origin});
                 for (size_t i = 0; i < kernel.dims.size(); i++) {
-                    stream_call_args.push_back(Variable::make(Int(32), kernel.name + ".stride." + std::to_string(i)));
-                    stream_call_args.push_back(simplify(kernel.dims[i].store_bound.max - kernel.dims[i].store_bound.min + 1));
+                    stream_call_args.push_back(Variable::make(Int(32), buffer_name + ".stride." + std::to_string(i)));
+                    stream_call_args.push_back(image_extents[i]);
                 }
                 Stmt stream_subimg = Evaluate::make(Call::make(Handle(), "stream_subimage", stream_call_args, Call::Intrinsic));
 
@@ -741,7 +1145,19 @@ class StreamOpt : public IRMutator {
                 for (StencilDimSpecs dim: kernel.dims) {
                     bounds.push_back(Range(0, dim.step));
                 }
+                const auto packing_it = packings.find(name);
+                if (packing_it != packings.end()) {
+                    // several stencils per beat
+                    const HWStreamPacking &packing = packing_it->second;
+                    int dim = packing.dim;
+                    bounds[dim] = Range(0, kernel.dims[dim].step * packing.factor);
+                }
                 new_body = Realize::make(stream_name, kernel.func.output_types(), bounds, const_true(), Block::make(stream_subimg, new_body));
+
+                // the position of the valid sub-image in the tile is passed to the hardware
+                for (size_t i = border_lets.size(); i > 0; i--) {
+                    new_body = LetStmt::make(border_lets[i-1].first, border_lets[i-1].second, new_body);
+                }
             }
 
             // Handle tap values
@@ -796,6 +1212,17 @@ class StreamOpt : public IRMutator {
                 }
             }
             */
+        } else if (borders.count(op->name)) {
+            // the boundary condition is implemented in hardware, so its
+            // host-side realization is dropped unless used elsewhere
+            IRMutator::visit(op);
+            const Realize *realize = stmt.as<Realize>();
+            internal_assert(realize);
+            CallsFunc calls(op->name);
+            realize->body.accept(&calls);
+            if (!calls.result) {
+                stmt = RemoveRealization(op->name).mutate(stmt);
+            }
         } else {
             IRMutator::visit(op);
         }
@@ -815,13 +1242,44 @@ class StreamOpt : public IRMutator {
     }
 
 public:
-    StreamOpt(const HWKernelDAG &d)
-        : dag(d) {}
+    StreamOpt(const HWKernelDAG &d, const Target &t)
+        : dag(d) {
+        vector<string> external_streams(dag.input_kernels.begin(), dag.input_kernels.end());
+        external_streams.push_back(dag.name);
+        for (const string &name : external_streams) {
+            HWStreamPacking packing;
+            if (extract_stream_packing(dag.kernels.find(name)->second, packing)) {
+                debug(3) << "stream of " << name << " is packed " << packing.factor
+                         << " stencils per beat along dimension " << packing.dim << "\n";
+                packings[name] = packing;
+            }
+        }
+
+        // The Zynq runtime can only DMA from buffers allocated by
+        // halide_zynq_cma_alloc, so the source images cannot be
+        // streamed in directly
+        if (t.has_feature(Target::Zynq)) {
+            return;
+        }
+        for (const string &name : dag.input_kernels) {
+            HWBorder border;
+            if (extract_border(dag.kernels.find(name)->second, border)) {
+                debug(3) << "boundary condition " << name << " is implemented in hardware\n";
+                borders[name] = border;
+                if (packings.count(name)) {
+                    // the border process consumes one stencil per beat
+                    user_warning << "The stream of " << name << " is not packed into beats, "
+                                 << "as its boundary condition is implemented in hardware.\n";
+                    packings.erase(name);
+                }
+            }
+        }
+    }
 };
 
-Stmt stream_opt(Stmt s, const HWKernelDAG &dag) {
+Stmt stream_opt(Stmt s, const HWKernelDAG &dag, const Target &t) {
     debug(3) << s << "\n";
-    s = StreamOpt(dag).mutate(s);
+    s = StreamOpt(dag, t).mutate(s);
     debug(3) << s << "\n";
     return s;
 }
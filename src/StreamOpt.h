@@ -8,13 +8,15 @@
 
 #include "IR.h"
 #include "ExtractHWKernelDAG.h"
+#include "Target.h"
 
 namespace Halide {
 namespace Internal {
 
-/** Perform streaming optimization
+/** Perform streaming optimization. Boundary conditions on the inputs
+ * are moved into the hardware pipeline, unless the target is Zynq.
  */
-Stmt stream_opt(Stmt s, const HWKernelDAG &dag);
+Stmt stream_opt(Stmt s, const HWKernelDAG &dag, const Target &t);
 
 }
 }
@@ -268,6 +268,8 @@ const std::map<std::string, Target::Feature> feature_name_map = {
     {"trace_loads", Target::TraceLoads},
     {"trace_stores", Target::TraceStores},
     {"trace_realizations", Target::TraceRealizations},
+    {"pooled_malloc", Target::PooledMalloc},
+    {"profile_instrumented", Target::ProfileInstrumented},
 };
 
 bool lookup_feature(const std::string &tok, Target::Feature &result) {
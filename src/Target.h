@@ -89,6 +89,8 @@ struct Target {
         TraceLoads = halide_target_feature_trace_loads,
         TraceStores = halide_target_feature_trace_stores,
         TraceRealizations = halide_target_feature_trace_realizations,
+        PooledMalloc = halide_target_feature_pooled_malloc,
+        ProfileInstrumented = halide_target_feature_profile_instrumented,
         FeatureEnd = halide_target_feature_end
     };
     Target() : os(OSUnknown), arch(ArchUnknown), bits(0) {}
@@ -237,6 +237,32 @@ private:
                                  ProducerConsumer::make(op->name, op->is_producer, new_body));
         }
     }
+
+    void visit(const For *op) {
+        IRMutator::visit(op);
+        if (!trace_all_realizations || !op->is_parallel()) return;
+        op = stmt.as<For>();
+        internal_assert(op);
+
+        // Throw a tracing call around each task of a parallel loop,
+        // so that a timeline of the trace shows how the work is
+        // spread across threads.
+        TraceEventBuilder builder;
+        builder.func = op->name;
+        builder.parent_id = Variable::make(Int(32), "pipeline.trace_id");
+        builder.coordinates = {Variable::make(Int(32), op->name)};
+        builder.event = halide_trace_begin_task;
+        Expr begin_task_call = builder.build();
+
+        string trace_id = op->name + ".trace_id";
+        builder.event = halide_trace_end_task;
+        builder.parent_id = Variable::make(Int(32), trace_id);
+        Expr end_task_call = builder.build();
+
+        Stmt new_body = Block::make(op->body, Evaluate::make(end_task_call));
+        new_body = LetStmt::make(trace_id, begin_task_call, new_body);
+        stmt = For::make(op->name, op->min, op->extent, op->for_type, op->device_api, new_body);
+    }
 };
 
 class RemoveRealizeOverOutput : public IRMutator {
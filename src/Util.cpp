@@ -93,12 +93,53 @@ namespace {
 const int num_unique_name_counters = (1 << 14);
 std::atomic<int> unique_name_counters[num_unique_name_counters];
 
+// The counters of the UniqueNameFork task running on this thread, if
+// any.
+thread_local std::vector<int> *task_unique_name_counters = nullptr;
+
 int unique_count(size_t h) {
     h = h & (num_unique_name_counters - 1);
+    if (task_unique_name_counters) {
+        return (*task_unique_name_counters)[h]++;
+    }
     return unique_name_counters[h]++;
 }
 }
 
+UniqueNameFork::UniqueNameFork(size_t num_tasks) : parent(task_unique_name_counters) {
+    std::vector<int> snapshot(num_unique_name_counters);
+    for (int i = 0; i < num_unique_name_counters; i++) {
+        snapshot[i] = parent ? (*parent)[i] : unique_name_counters[i].load();
+    }
+    counters.resize(num_tasks, snapshot);
+}
+
+UniqueNameFork::~UniqueNameFork() {
+    for (int i = 0; i < num_unique_name_counters; i++) {
+        int count = 0;
+        for (const auto &c : counters) {
+            count = std::max(count, c[i]);
+        }
+        if (parent) {
+            (*parent)[i] = std::max((*parent)[i], count);
+        } else {
+            // Other threads may be drawing names too.
+            int old = unique_name_counters[i].load();
+            while (old < count && !unique_name_counters[i].compare_exchange_weak(old, count)) {
+            }
+        }
+    }
+}
+
+UniqueNameFork::Task::Task(UniqueNameFork &fork, size_t task) : outer(task_unique_name_counters) {
+    internal_assert(task < fork.counters.size());
+    task_unique_name_counters = &fork.counters[task];
+}
+
+UniqueNameFork::Task::~Task() {
+    task_unique_name_counters = outer;
+}
+
 // There are three possible families of names returned by the methods below:
 // 1) char pattern: (char that isn't '$') + number (e.g. v234)
 // 2) string pattern: (string without '$') + '$' + number (e.g. fr#nk82$42)
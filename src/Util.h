@@ -94,6 +94,41 @@ EXPORT std::string unique_name(char prefix);
 EXPORT std::string unique_name(const std::string &prefix);
 // @}
 
+/** Run some tasks that draw names from unique_name concurrently,
+ * without the names they get depending on how they happen to be
+ * scheduled. Each task draws from its own copy of the counters
+ * unique_name uses, taken when the UniqueNameFork is made, so it gets
+ * the names it would have got had it run alone, first. Once the fork
+ * is destroyed, the counters of the thread that made it are advanced
+ * past any name drawn by any of the tasks.
+ *
+ * Different tasks may be given the same names, so the things they
+ * produce must not share a namespace, e.g. they're separate LLVM
+ * modules, in which generated names have internal linkage. */
+class UniqueNameFork {
+public:
+    UniqueNameFork(size_t num_tasks);
+    ~UniqueNameFork();
+
+    /** Draw names from the counters of one of the tasks on this
+     * thread, while this is in scope. */
+    class Task {
+    public:
+        Task(UniqueNameFork &fork, size_t task);
+        ~Task();
+    private:
+        std::vector<int> *outer;
+        Task(const Task &) = delete;
+        void operator=(const Task &) = delete;
+    };
+
+private:
+    std::vector<int> *parent;
+    std::vector<std::vector<int>> counters;
+    UniqueNameFork(const UniqueNameFork &) = delete;
+    void operator=(const UniqueNameFork &) = delete;
+};
+
 /** Test if the first string starts with the second string */
 EXPORT bool starts_with(const std::string &str, const std::string &prefix);
 
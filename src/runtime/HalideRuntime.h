@@ -152,6 +152,30 @@ extern int halide_default_do_task(void *user_context, halide_task_t f, int idx,
                                   uint8_t *closure);
 // @}
 
+/** Run size tasks (min through min + size - 1) concurrently, each on
+ * its own thread, and return once all of them have finished. Unlike
+ * halide_do_par_for, the tasks may block waiting on each other, so
+ * this is used for Funcs scheduled async, which run as a separate
+ * task feeding their consumer. Returns zero if all the tasks return
+ * zero, or else the return value of the failing task with the lowest
+ * index. */
+extern int halide_do_async_fork(void *user_context, halide_task_t task,
+                                int min, int size, uint8_t *closure);
+
+/** A counting semaphore, used to synchronize the tasks started by
+ * halide_do_async_fork. halide_semaphore_acquire blocks until the
+ * count is at least n and then decrements it by n. It returns zero,
+ * or an error code if the semaphore was closed because the task
+ * that would have released it failed. */
+//@{
+struct halide_semaphore_t {
+    uint64_t _private[2];
+};
+extern int halide_semaphore_init(struct halide_semaphore_t *, int n);
+extern int halide_semaphore_release(struct halide_semaphore_t *, int n);
+extern int halide_semaphore_acquire(struct halide_semaphore_t *, int n);
+//@}
+
 struct halide_thread;
 
 /** Spawn a thread. Returns a handle to the thread for the purposes of
@@ -180,6 +204,35 @@ extern void halide_join_thread(struct halide_thread *);
  */
 extern int halide_set_num_threads(int n);
 
+/** Describe the NUMA topology of the machine to Halide's thread
+ * pool: cpu_nodes[i] is the NUMA node of cpu i, for num_cpus
+ * cpus. Passing NULL cpu_nodes goes back to the topology reported by
+ * the OS, which is only known on Linux; elsewhere, all cpus are
+ * assumed to be on one node. Returns the number of NUMA nodes, or an
+ * error code if cpu_nodes is given with num_cpus < 1.
+ *
+ * The thread pool assigns its worker threads to the nodes round
+ * robin, and hands out the iterations of parallel loops to them in
+ * contiguous ranges per node, the same way each time a loop of the
+ * same size runs. Workers that have already been spawned keep the
+ * node and cpu they were given. halide_shutdown_thread_pool forgets
+ * the topology, so the OS's is used again afterwards.
+ *
+ * (As with halide_set_num_threads, this only applies to the default
+ * implementation of halide_do_par_for.)
+ */
+extern int halide_set_cpu_topology(int num_cpus, const int *cpu_nodes);
+
+/** Get the topology used by Halide's thread pool. Writes the NUMA
+ * node of up to max_cpus cpus to cpu_nodes and the number of nodes to
+ * num_nodes, if they are not NULL. Returns the number of cpus. */
+extern int halide_get_cpu_topology(int max_cpus, int *cpu_nodes, int *num_nodes);
+
+/** Pin each worker thread spawned by Halide's thread pool from now on
+ * to one cpu of its NUMA node. Defaults to false, or to the value of
+ * the environment variable HL_PIN_THREADS. Returns the old value. */
+extern bool halide_set_thread_pinning(bool pin);
+
 /** Halide calls these functions to allocate and free memory. To
  * replace in AOT code, use the halide_set_custom_malloc and
  * halide_set_custom_free, or (on platforms that support weak
@@ -208,6 +261,44 @@ extern halide_malloc_t halide_set_custom_malloc(halide_malloc_t user_malloc);
 extern halide_free_t halide_set_custom_free(halide_free_t user_free);
 //@}
 
+/** Counters describing the pooling allocator that replaces the
+ * default halide_malloc/halide_free on Linux and Android targets with
+ * the pooled_malloc feature. */
+struct halide_pooled_malloc_stats_t {
+    /** Calls to halide_default_malloc, the ones served from the pool,
+     * and the blocks allocated from the system. */
+    uint64_t allocations, pool_hits, system_allocations;
+
+    /** Bytes in blocks handed out and not yet freed, and bytes in
+     * freed blocks kept for reuse. */
+    int64_t bytes_in_use, bytes_cached;
+
+    /** Bytes in blocks mapped from the huge pages reserved by the
+     * system (MAP_HUGETLB). */
+    int64_t huge_page_bytes;
+
+    /** Bytes in blocks mapped from ordinary pages when no huge pages
+     * were reserved. The kernel is asked to back these with
+     * transparent huge pages, but may not. */
+    int64_t thp_advised_bytes;
+};
+
+/** These are only present in runtimes built with the pooled_malloc
+ * feature. The profiler reports the counters if they are. */
+//@{
+extern void halide_pooled_malloc_get_stats(struct halide_pooled_malloc_stats_t *stats);
+
+/** Set the most bytes of freed blocks to keep for reuse (256MB by
+ * default), and the size from which blocks are mapped directly and
+ * backed by huge pages if possible (2MB by default, zero to
+ * disable). A max_cached_bytes of zero or less also releases the
+ * blocks kept so far. */
+extern void halide_pooled_malloc_set_limits(int64_t max_cached_bytes, int64_t huge_page_threshold);
+
+/** Return all the freed blocks kept for reuse to the system. */
+extern void halide_pooled_malloc_release_unused();
+//@}
+
 /** Halide calls these functions to interact with the underlying
  * system runtime functions. To replace in AOT code on platforms that
  * support weak linking, define these functions yourself, or use
@@ -325,7 +416,9 @@ enum halide_trace_event_code_t {halide_trace_load = 0,
                                 halide_trace_consume = 6,
                                 halide_trace_end_consume = 7,
                                 halide_trace_begin_pipeline = 8,
-                                halide_trace_end_pipeline = 9};
+                                halide_trace_end_pipeline = 9,
+                                halide_trace_begin_task = 10,
+                                halide_trace_end_task = 11};
 
 struct halide_trace_event_t {
     /** The name of the Func or Pipeline that this event refers to */
@@ -379,7 +472,9 @@ struct halide_trace_event_t {
  * implementation either prints events via halide_print, or if
  * HL_TRACE_FILE is defined, dumps the trace to that file in a
  * sequence of trace packets. The header for a trace packet is defined
- * below. If the trace is going to be large, you may want to make the
+ * below. Packets are buffered and written out in large batches, at
+ * the latest when a pipeline ends or halide_shutdown_trace is
+ * called. If the trace is going to be large, you may want to make the
  * file a named pipe, and then read from that pipe into gzip.
  *
  * halide_trace returns a unique ID which will be passed to future
@@ -395,8 +490,14 @@ struct halide_trace_event_t {
  * |  |  +--load
  * |  |  +--end_consume
  * |  +--end_realization
+ * +--begin_task
+ * |  +--end_task
  * +--end_pipeline
  *
+ * With trace_realizations, each task of a parallel loop is bracketed
+ * by begin_task and end_task events, named after the loop, with the
+ * loop index as the only coordinate.
+ *
  * Threading means that ownership cannot be inferred from the ordering
  * of events. There can be many active realizations of a given
  * function, or many active productions for a single
@@ -475,6 +576,24 @@ extern void halide_set_trace_file(int fd);
  * information to stdout. */
 extern int halide_get_trace_file(void *user_context);
 
+/** The formats the default trace handler can write a trace file in. */
+enum halide_trace_format_t {
+    /** A sequence of halide_trace_packet_t. */
+    halide_trace_format_packets = 0,
+    /** A timeline in the JSON format read by Chrome's about:tracing
+     * (and Perfetto). Each realization, produce, consume and parallel
+     * task is an interval on the timeline of the thread that ran it,
+     * and so are copies between host and device memory. Loads and
+     * stores are left out. */
+    halide_trace_format_chrome = 1
+};
+
+/** Set the format the default trace handler writes trace files
+ * in. If never called, Halide uses the chrome format if the
+ * environment variable HL_TRACE_FORMAT is set to "chrome", and
+ * packets otherwise. */
+extern void halide_set_trace_format(enum halide_trace_format_t format);
+
 /** If tracing is writing to a file. This call closes that file
  * (flushing the trace). Returns zero on success. */
 extern int halide_shutdown_trace();
@@ -580,6 +699,57 @@ extern int halide_get_gpu_device(void *user_context);
  */
 extern void halide_memoization_cache_set_size(int64_t size);
 
+/** Set the number of hash buckets the memoization cache starts out
+ * with. The cache is split into shards with a lock each, and the
+ * buckets are divided evenly between them, rounding up to a power of
+ * two per shard. Each shard grows its table as entries are added, so
+ * this is only worth raising when many small results are memoized.
+ * Calling this with zero restores the default.
+ */
+extern void halide_memoization_cache_set_table_size(int32_t size);
+
+/** Attach a file that results which took at least min_cost_ns to
+ * compute are also written to, so that later runs of the program can
+ * load them instead of recomputing them. The file is memory-mapped,
+ * and created or resized to the given size, and results are only
+ * added while they fit. Pass a NULL path to detach the file. The
+ * fingerprint should identify the build of the program, e.g. a hash
+ * of its version. Results in a file written with a different
+ * fingerprint are discarded. Results are keyed on the definitions of
+ * the memoized Funcs and the values of the parameters they depend on,
+ * but not on the contents of Buffers or on extern functions they
+ * call, which the fingerprint must cover. This is only supported on
+ * 64-bit POSIX platforms. Returns nonzero on failure. */
+extern int halide_memoization_cache_set_backing_file(void *user_context, const char *path,
+                                                     int64_t size, int64_t min_cost_ns,
+                                                     uint64_t fingerprint);
+
+/** Counters describing the use of the memoization cache since it was
+ * last cleaned up. */
+struct halide_memoization_cache_stats_t {
+    /** Lookups that found an entry, and ones that didn't. */
+    uint64_t hits, misses;
+
+    /** Results stored into the cache, and ones evicted from it to
+     * keep it within its size. */
+    uint64_t stores, evictions;
+
+    /** The number of entries currently in the cache. */
+    uint64_t entries;
+
+    /** The number of bytes used by cached results, and the size set
+     * by halide_memoization_cache_set_size. */
+    int64_t current_size, max_size;
+
+    /** Lookups answered from the backing file, and results written
+     * to it. Results loaded from the backing file also count as
+     * stores. */
+    uint64_t backing_loads, backing_saves;
+};
+
+/** Get the counters of the memoization cache. */
+extern void halide_memoization_cache_get_stats(struct halide_memoization_cache_stats_t *stats);
+
 /** Given a cache key for a memoized result, currently constructed
  *  from the Func name and top-level Func name plus the arguments of
  *  the computation, determine if the result is in the cache and
@@ -946,8 +1116,10 @@ typedef enum halide_target_feature_t {
     //----- HLS Modification Begins -----//
     halide_target_feature_vivado_hls = 49,  ///< Enable Vivado HLS code generation.
     halide_target_feature_zynq = 50, ///< Enable Xilinx Zynq runtime.
-    halide_target_feature_end = 51 ///< A sentinel. Every target is considered to have this feature, and setting this feature does nothing.
     //----- HLS Modification Ends -------//
+    halide_target_feature_pooled_malloc = 51, ///< On Linux and Android, use a halide_malloc that pools freed memory for reuse. See halide_pooled_malloc_get_stats.
+    halide_target_feature_profile_instrumented = 52, ///< With profile, time each Func by instrumenting the pipeline with timestamps instead of sampling it.
+    halide_target_feature_end = 53 ///< A sentinel. Every target is considered to have this feature, and setting this feature does nothing.
 } halide_target_feature_t;
 
 /** This function is called internally by Halide in some situations to determine
@@ -1268,13 +1440,57 @@ struct halide_filter_metadata_t {
 
 /** The functions below here are relevant for pipelines compiled with
  * the -profile target flag, which runs a sampling profiler thread
- * alongside the pipeline. */
+ * alongside the pipeline. With the -profile_instrumented flag as
+ * well, the pipeline instead reads a timestamp each time a thread
+ * moves from one Func to another, and the report includes the
+ * minimum, mean and 99th percentile time per run of each Func, and
+ * per task of the parallel loops. */
+
+/** The hardware performance counters the sampling profiler can
+ * attribute to Funcs. They are read if the environment variable
+ * HL_PROFILER_COUNTERS is set to 1 when the profiler starts, on
+ * platforms that support it (currently x86 Linux), and are left out
+ * of the report if the system doesn't allow them to be read. They
+ * are counted over all threads, so the counts reported for a Func
+ * that ran while other threads were busy include the other threads'
+ * work, and are marked approximate. */
+typedef enum halide_profiler_counter_t {
+    halide_profiler_cycles = 0,
+    halide_profiler_instructions = 1,
+    halide_profiler_llc_misses = 2,
+    halide_profiler_branch_misses = 3,
+    halide_profiler_num_counters = 4
+} halide_profiler_counter_t;
+
+/** The number of buckets in a halide_profiler_distribution. */
+enum {
+    halide_profiler_distribution_buckets = 256
+};
+
+/** A histogram of durations, measured in ticks of the timestamp
+ * counter read by pipelines compiled with the profile_instrumented
+ * target flag. Durations under four ticks have a bucket each. Longer
+ * ones are bucketed by their leading three bits: four buckets to
+ * each power of two. */
+struct halide_profiler_distribution {
+    /** The number of durations recorded. */
+    uint64_t count;
+
+    /** The sum, shortest and longest of the durations recorded. */
+    uint64_t sum, min, max;
+
+    uint64_t buckets[halide_profiler_distribution_buckets];
+};
 
 /** Per-Func state tracked by the sampling profiler. */
 struct halide_profiler_func_stats {
     /** Total time taken evaluating this Func (in nanoseconds). */
     uint64_t time;
 
+    /** The hardware counters counted by all threads while evaluating
+     * this Func, indexed by halide_profiler_counter_t. */
+    uint64_t counters[halide_profiler_num_counters];
+
     /** The current memory allocation of this Func. */
     uint64_t memory_current;
 
@@ -1290,6 +1506,11 @@ struct halide_profiler_func_stats {
     /** The average number of thread pool worker threads active while computing this Func. */
     uint64_t active_threads_numerator, active_threads_denominator;
 
+    /** The time spent evaluating this Func in each run of its
+     * pipeline, in timestamp ticks. NULL unless the pipeline was
+     * compiled with the profile_instrumented target flag. */
+    struct halide_profiler_distribution *invocations;
+
     /** The name of this Func. A global constant string. */
     const char *name;
 
@@ -1297,12 +1518,33 @@ struct halide_profiler_func_stats {
     int num_allocs;
 };
 
+/** Per-kernel cycle counters of a hardware accelerator (e.g. the HLS
+ * kernels of a Zynq pipeline). The counters are read back after every
+ * run of the accelerator and accumulated here. */
+struct halide_profiler_hw_kernel_stats {
+    /** The number of cycles this kernel made progress. */
+    uint64_t active;
+
+    /** The number of cycles this kernel waited for its inputs. */
+    uint64_t stalled_in;
+
+    /** The number of cycles this kernel waited for its outputs to drain. */
+    uint64_t stalled_out;
+
+    /** The name of this kernel. A global constant string. */
+    const char *name;
+};
+
 /** Per-pipeline state tracked by the sampling profiler. These exist
  * in a linked list. */
 struct halide_profiler_pipeline_stats {
     /** Total time spent inside this pipeline (in nanoseconds) */
     uint64_t time;
 
+    /** The hardware counters counted inside this pipeline, indexed by
+     * halide_profiler_counter_t. */
+    uint64_t counters[halide_profiler_num_counters];
+
     /** The current memory allocation of funcs in this pipeline. */
     uint64_t memory_current;
 
@@ -1316,12 +1558,26 @@ struct halide_profiler_pipeline_stats {
      * work while computing this pipeline. */
     uint64_t active_threads_numerator, active_threads_denominator;
 
+    /** The timestamp ticks and nanoseconds counted across the
+     * instrumented runs of this pipeline. Their ratio converts the
+     * distributions below to time. */
+    uint64_t instrumented_ticks, instrumented_ns;
+
+    /** The duration of each run of this pipeline, and of each task of
+     * its parallel loops, in timestamp ticks. NULL unless the pipeline
+     * was compiled with the profile_instrumented target flag. */
+    struct halide_profiler_distribution *invocations, *tasks;
+
     /** The name of this pipeline. A global constant string. */
     const char *name;
 
     /** An array containing states for each Func in this pipeline. */
     struct halide_profiler_func_stats *funcs;
 
+    /** An array containing the counters of each hardware kernel run
+     * by this pipeline. NULL if the pipeline runs no accelerator. */
+    struct halide_profiler_hw_kernel_stats *hw_kernels;
+
     /** The next pipeline_stats pointer. It's a void * because types
      * in the Halide runtime may not currently be recursive. */
     void *next;
@@ -1329,6 +1585,9 @@ struct halide_profiler_pipeline_stats {
     /** The number of funcs in this pipeline. */
     int num_funcs;
 
+    /** The number of hardware kernels in this pipeline. */
+    int num_hw_kernels;
+
     /** An internal base id used to identify the funcs in this pipeline. */
     int first_func_id;
 
@@ -1373,6 +1632,42 @@ struct halide_profiler_state {
 
     /** Is the profiler thread running. */
     bool started;
+
+    /** Is the profiler thread reading hardware counters. */
+    bool counters_enabled;
+
+    /** Has a pipeline compiled with the profile_instrumented target
+     * flag run. If so, the report is printed at exit even if the
+     * profiler thread never started. */
+    bool instrumented;
+};
+
+/** The state of one run of a pipeline compiled with the
+ * profile_instrumented target flag. It lives on the stack of the
+ * pipeline, followed by the ticks billed to each of its Funcs. */
+struct halide_profiler_instrument_run {
+    struct halide_profiler_pipeline_stats *pipeline;
+    uint64_t *func_ticks;
+    uint64_t start_ticks;
+    uint64_t start_ns;
+    int num_funcs;
+    /** Whether the timestamps are read from the cycle counter, or
+     * from the clock. */
+    int cycle_counter;
+};
+
+/** The state of one thread of execution of an instrumented pipeline:
+ * the pipeline body itself, or a task of one of its parallel
+ * loops. Time is billed to the Func the task is in each time it moves
+ * to another one, so this lives on the stack of the task and is only
+ * touched by the thread running it. */
+struct halide_profiler_instrument_task {
+    struct halide_profiler_instrument_run *run;
+    uint64_t start_ticks;
+    uint64_t last_ticks;
+    /** The Func being billed, or -1 if none is. */
+    int current_func;
+    int padding;
 };
 
 /** Profiler func ids with special meanings. */
@@ -71,6 +71,14 @@ extern int halide_zynq_hwacc_launch(struct cma_buffer_t bufs[]);
  * TASK_ID finishes. */
 extern int halide_zynq_hwacc_sync(int task_id);
 
+/** Read the cycle counters of the accelerator run with TASK_ID, which
+ * must have been synchronized. Every profiled kernel of the accelerator
+ * has three counters: the cycles it was active, stalled on its inputs,
+ * and stalled on its outputs. The counters are read through the AXI-Lite
+ * interface of the accelerator, and are left zero if the accelerator
+ * was built without them. */
+extern int halide_zynq_hwacc_counters(int task_id, uint64_t *counters, int num_counters);
+
 #ifdef __cplusplus
 } // End extern "C"
 #endif
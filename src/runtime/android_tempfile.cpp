@@ -4,6 +4,13 @@
 extern "C" {
 
 extern int mkstemps(char *, int);
+extern int ftruncate(int, long);
+extern void *mmap(void *, size_t, int, int, int, long);
+extern int munmap(void *, size_t);
+
+#define HALIDE_PROT_READ_WRITE 3
+#define HALIDE_MAP_SHARED 1
+#define HALIDE_MAP_FAILED ((void *)-1)
 
 // Note that the Android implementation is identical to the Posix version, except that
 // the root is /data/local/tmp rather than /tmp
@@ -33,4 +40,32 @@ WEAK int halide_create_temp_file(void *user_context, const char *prefix, const c
     return 0;
 }
 
+WEAK void *halide_map_file(void *user_context, const char *path, size_t size) {
+#ifdef BITS_64
+    // The off_t arguments are only known to be longs on 64-bit platforms.
+    void *f = fopen(path, "a+");
+    if (!f) {
+        return NULL;
+    }
+    void *addr = NULL;
+    if (ftruncate(fileno(f), (long)size) == 0) {
+        addr = mmap(NULL, size, HALIDE_PROT_READ_WRITE, HALIDE_MAP_SHARED, fileno(f), 0);
+        if (addr == HALIDE_MAP_FAILED) {
+            addr = NULL;
+        }
+    }
+    // The mapping keeps the file open.
+    fclose(f);
+    return addr;
+#else
+    return NULL;
+#endif
+}
+
+WEAK void halide_unmap_file(void *user_context, void *addr, size_t size) {
+#ifdef BITS_64
+    munmap(addr, size);
+#endif
+}
+
 }  // extern "C"
@@ -3,12 +3,12 @@
 #include "printer.h"
 #include "scoped_mutex_lock.h"
 
-// This is temporary code. In particular, the hash table is stupid and
-// currently thread safety is accomplished via large granularity spin
-// locks. It is mainly intended to prove the programming model and
-// runtime interface for memoization. We'll improve the implementation
-// later. In the meantime, on some platforms it can be replaced by a
-// platform specific LRU cache such as libcache from Apple.
+// A sharded cache. Thread safety is accomplished via a lock per
+// shard, so memoized Funcs can be looked up from parallel loops.
+// Entries are evicted by how recently they were used and how
+// expensive they were to compute for their size. On some platforms it
+// can be replaced by a platform specific cache such as libcache from
+// Apple.
 
 namespace Halide { namespace Runtime { namespace Internal {
 
@@ -73,12 +73,13 @@ WEAK bool buffer_has_shape(const halide_buffer_t *buf, const halide_dimension_t
 }
 
 // Each host block has extra space to store a header just before the contents.
-// 16 is chosen to keep that alignment.
-// The header holds the cache key hash and pointer to the hash entry.
+// 32 is chosen to keep that alignment.
+// The header holds the cache key hash, pointer to the hash entry, and
+// when the computation of the contents started.
 //
 // This is an optimization the number of cycles it takes for the cache
 // to operate.
-const size_t extra_bytes_host_bytes = 16;
+const size_t extra_bytes_host_bytes = 32;
 
 struct CacheEntry {
     CacheEntry *next;
@@ -89,6 +90,9 @@ struct CacheEntry {
     uint8_t *key;
     uint32_t hash;
     uint32_t in_use_count; // 0 if none returned from halide_cache_lookup
+    uint64_t last_use; // The use_clock of its shard when last looked up or stored
+    uint64_t cost_ns; // How long the contents took to compute, or 0 if unknown
+    uint64_t priority; // Entries with lower priority are evicted first
     uint32_t tuple_count;
     // The shape of the computed data. There may be more data allocated than this.
     int32_t dimensions;
@@ -108,6 +112,7 @@ struct CacheEntry {
 struct CacheBlockHeader {
     CacheEntry *entry;
     uint32_t hash;
+    int64_t compute_start_ns;
 };
 
 WEAK CacheBlockHeader *get_pointer_to_header(uint8_t * host) {
@@ -123,6 +128,9 @@ WEAK bool CacheEntry::init(const uint8_t *cache_key, size_t cache_key_size,
     key_size = cache_key_size;
     hash = key_hash;
     in_use_count = 0;
+    last_use = 0;
+    cost_ns = 0;
+    priority = 0;
     tuple_count = tuples;
     dimensions = computed_bounds_buf->dimensions;
 
@@ -181,134 +189,818 @@ WEAK void CacheEntry::destroy() {
     halide_free(NULL, metadata_storage);
 }
 
-WEAK uint32_t djb_hash(const uint8_t *key, size_t key_size)  {
-    uint32_t h = 5381;
-    for (size_t i = 0; i < key_size; i++) {
-      h = (h << 5) + h + key[i];
+// Hash the key a word at a time. Keys are mostly the names and
+// coordinates of the memoized Func, so this is several times faster
+// than mixing in one byte at a time.
+WEAK uint32_t hash_key(const uint8_t *key, size_t key_size)  {
+    const uint64_t m = 0x9e3779b97f4a7c15ULL;
+    uint64_t h = key_size * m;
+    size_t i = 0;
+    for (; i + 8 <= key_size; i += 8) {
+        uint64_t word;
+        memcpy(&word, key + i, 8);
+        h = (h ^ word) * m;
+        h ^= h >> 29;
+    }
+    uint64_t tail = 0;
+    for (; i < key_size; i++) {
+        tail = (tail << 8) | key[i];
     }
-    return h;
+    h = (h ^ tail) * m;
+    h ^= h >> 32;
+    return (uint32_t)h;
 }
 
-WEAK halide_mutex memoization_lock;
-
-const size_t kHashTableSize = 256;
-
-WEAK CacheEntry *cache_entries[kHashTableSize];
-
-WEAK CacheEntry *most_recently_used = NULL;
-WEAK CacheEntry *least_recently_used = NULL;
+// The cache is split into shards, each with its own lock, hash table
+// and LRU list, so that lookups from parallel loops rarely contend
+// for a lock. The top bits of the hash of a key pick its shard, and
+// the bottom bits pick the bucket within the shard.
+const int kCacheShardBits = 4;
+const int kNumCacheShards = 1 << kCacheShardBits;
+
+struct CacheShard {
+    halide_mutex lock;
+    // A power of two number of buckets, or NULL if nothing has been
+    // stored in the shard yet.
+    CacheEntry **buckets;
+    uint32_t num_buckets;
+    uint32_t num_entries;
+    CacheEntry *most_recently_used;
+    CacheEntry *least_recently_used;
+    // Counts the lookups and stores of the shard, to order its
+    // entries by when they were last used. Each shard has its own
+    // clock so that using an entry doesn't write to a cache line
+    // shared with the other shards. Entries in different shards are
+    // only compared by it when their priorities are equal, in which
+    // case evicting them in roughly LRU order is good enough.
+    uint64_t use_clock;
+    uint64_t hits, misses, stores, evictions;
+} __attribute__((aligned(64)));
+
+WEAK CacheShard cache_shards[kNumCacheShards];
+
+// The number of hash buckets a new cache starts out with, over all
+// shards. The tables of the shards grow as entries are added.
+const uint32_t kDefaultTableSize = 256;
+WEAK uint32_t table_size = kDefaultTableSize;
 
 const uint64_t kDefaultCacheSize = 1 << 20;
 WEAK int64_t max_cache_size = kDefaultCacheSize;
 WEAK int64_t current_cache_size = 0;
 
+WEAK CacheShard *shard_for_hash(uint32_t h) {
+    return &cache_shards[h >> (32 - kCacheShardBits)];
+}
+
+WEAK uint32_t bucket_for_hash(const CacheShard *shard, uint32_t h) {
+    return h & (shard->num_buckets - 1);
+}
+
+WEAK uint64_t next_use_already_locked(CacheShard *shard) {
+    return ++shard->use_clock;
+}
+
+// Not every runtime has a clock (e.g. QuRT and bare metal ones), so
+// the cost of results is only measured if there is one.
+WEAK int64_t current_time_ns(void *user_context) {
+    return halide_current_time_ns ? halide_current_time_ns(user_context) : 0;
+}
+
+// Entries are evicted greedy-dual-size style: an entry's priority is
+// the cost per byte of recomputing it, on top of the priority of the
+// last entry evicted at the time of its last use. Cheap, large
+// entries go first, but expensive ones age out eventually if they
+// aren't used. With no costs known, this is LRU.
+WEAK uint64_t eviction_inflation = 0;
+
+WEAK void set_priority(CacheEntry *entry) {
+    uint64_t bytes = 0;
+    for (uint32_t i = 0; i < entry->tuple_count; i++) {
+        bytes += entry->buf[i].size_in_bytes();
+    }
+    if (bytes == 0) {
+        bytes = 1;
+    }
+    entry->priority = __atomic_load_n(&eviction_inflation, __ATOMIC_RELAXED) +
+        (entry->cost_ns << 10) / bytes;
+}
+
+WEAK bool evict_before(const CacheEntry *a, const CacheEntry *b) {
+    return (a->priority < b->priority ||
+            (a->priority == b->priority && a->last_use < b->last_use));
+}
+
+// Rehash the entries of a shard into the given number of buckets.
+WEAK bool resize_shard_already_locked(CacheShard *shard, uint32_t num_buckets) {
+    size_t bytes = num_buckets * sizeof(CacheEntry *);
+    CacheEntry **buckets = (CacheEntry **)halide_malloc(NULL, bytes);
+    if (!buckets) {
+        return false;
+    }
+    memset(buckets, 0, bytes);
+    for (uint32_t i = 0; i < shard->num_buckets; i++) {
+        CacheEntry *entry = shard->buckets[i];
+        while (entry != NULL) {
+            CacheEntry *next = entry->next;
+            uint32_t index = entry->hash & (num_buckets - 1);
+            entry->next = buckets[index];
+            buckets[index] = entry;
+            entry = next;
+        }
+    }
+    halide_free(NULL, shard->buckets);
+    shard->buckets = buckets;
+    shard->num_buckets = num_buckets;
+    return true;
+}
+
+// Make sure there's room in the table of a shard for one more entry,
+// keeping chains short on average. Returns false if the shard has no
+// table at all.
+WEAK bool reserve_entry_already_locked(CacheShard *shard) {
+    uint32_t num_buckets = shard->num_buckets;
+    if (num_buckets == 0) {
+        num_buckets = table_size / kNumCacheShards;
+        if (num_buckets == 0) {
+            num_buckets = 1;
+        }
+    }
+    while (shard->num_entries + 1 > num_buckets * 2) {
+        num_buckets *= 2;
+    }
+    if (num_buckets != shard->num_buckets) {
+        // If growing fails, live with longer chains.
+        resize_shard_already_locked(shard, num_buckets);
+    }
+    return shard->num_buckets != 0;
+}
+
 #if CACHE_DEBUGGING
 WEAK void validate_cache() {
     print(NULL) << "validating cache, "
                 << "current size " << current_cache_size
                 << " of maximum " << max_cache_size << "\n";
-    int entries_in_hash_table = 0;
-    for (size_t i = 0; i < kHashTableSize; i++) {
-        CacheEntry *entry = cache_entries[i];
-        while (entry != NULL) {
-            entries_in_hash_table++;
-            if (entry->more_recent == NULL && entry != most_recently_used) {
-                halide_print(NULL, "cache invalid case 1\n");
-                __builtin_trap();
+    for (int s = 0; s < kNumCacheShards; s++) {
+        CacheShard *shard = &cache_shards[s];
+        ScopedMutexLock lock(&shard->lock);
+        uint32_t entries_in_hash_table = 0;
+        for (uint32_t i = 0; i < shard->num_buckets; i++) {
+            CacheEntry *entry = shard->buckets[i];
+            while (entry != NULL) {
+                entries_in_hash_table++;
+                if (shard_for_hash(entry->hash) != shard ||
+                    bucket_for_hash(shard, entry->hash) != i) {
+                    halide_print(NULL, "cache invalid case 0\n");
+                    __builtin_trap();
+                }
+                if (entry->more_recent == NULL && entry != shard->most_recently_used) {
+                    halide_print(NULL, "cache invalid case 1\n");
+                    __builtin_trap();
+                }
+                if (entry->less_recent == NULL && entry != shard->least_recently_used) {
+                    halide_print(NULL, "cache invalid case 2\n");
+                    __builtin_trap();
+                }
+                entry = entry->next;
             }
-            if (entry->less_recent == NULL && entry != least_recently_used) {
-                halide_print(NULL, "cache invalid case 2\n");
-                __builtin_trap();
+        }
+        uint32_t entries_from_mru = 0;
+        CacheEntry *mru_chain = shard->most_recently_used;
+        while (mru_chain != NULL) {
+            entries_from_mru++;
+            mru_chain = mru_chain->less_recent;
+        }
+        uint32_t entries_from_lru = 0;
+        CacheEntry *lru_chain = shard->least_recently_used;
+        while (lru_chain != NULL) {
+            entries_from_lru++;
+            lru_chain = lru_chain->more_recent;
+        }
+        if (entries_in_hash_table != entries_from_mru ||
+            entries_in_hash_table != shard->num_entries) {
+            halide_print(NULL, "cache invalid case 3\n");
+            __builtin_trap();
+        }
+        if (entries_in_hash_table != entries_from_lru) {
+            halide_print(NULL, "cache invalid case 4\n");
+            __builtin_trap();
+        }
+    }
+    if (current_cache_size < 0) {
+        halide_print(NULL, "cache size is negative\n");
+        __builtin_trap();
+    }
+}
+#endif
+
+// Move an entry to the front of the LRU list of its shard.
+WEAK void touch_entry_already_locked(CacheShard *shard, CacheEntry *entry) {
+    entry->last_use = next_use_already_locked(shard);
+    set_priority(entry);
+    if (entry == shard->most_recently_used) {
+        return;
+    }
+    halide_assert(NULL, entry->more_recent != NULL);
+    if (entry->less_recent != NULL) {
+        entry->less_recent->more_recent = entry->more_recent;
+    } else {
+        halide_assert(NULL, shard->least_recently_used == entry);
+        shard->least_recently_used = entry->more_recent;
+    }
+    entry->more_recent->less_recent = entry->less_recent;
+
+    entry->more_recent = NULL;
+    entry->less_recent = shard->most_recently_used;
+    if (shard->most_recently_used != NULL) {
+        shard->most_recently_used->more_recent = entry;
+    }
+    shard->most_recently_used = entry;
+}
+
+// The entry of a shard nobody is using to evict first. Only the least
+// recently used few are considered, to keep pruning cheap.
+const int kEvictionCandidates = 8;
+
+WEAK CacheEntry *eviction_candidate_already_locked(CacheShard *shard) {
+    CacheEntry *best = NULL;
+    int considered = 0;
+    for (CacheEntry *candidate = shard->least_recently_used;
+         candidate != NULL && considered < kEvictionCandidates;
+         candidate = candidate->more_recent) {
+        if (candidate->in_use_count == 0) {
+            considered++;
+            if (best == NULL || evict_before(candidate, best)) {
+                best = candidate;
             }
-            entry = entry->next;
         }
     }
-    int entries_from_mru = 0;
-    CacheEntry *mru_chain = most_recently_used;
-    while (mru_chain != NULL) {
-        entries_from_mru++;
-        mru_chain = mru_chain->less_recent;
+    return best;
+}
+
+WEAK void evict_already_locked(CacheShard *shard, CacheEntry *prune_candidate) {
+    uint32_t index = bucket_for_hash(shard, prune_candidate->hash);
+
+    // Remove from hash table
+    CacheEntry *prev_hash_entry = shard->buckets[index];
+    if (prev_hash_entry == prune_candidate) {
+        shard->buckets[index] = prune_candidate->next;
+    } else {
+        while (prev_hash_entry != NULL && prev_hash_entry->next != prune_candidate) {
+            prev_hash_entry = prev_hash_entry->next;
+        }
+        halide_assert(NULL, prev_hash_entry != NULL);
+        prev_hash_entry->next = prune_candidate->next;
     }
-    int entries_from_lru = 0;
-    CacheEntry *lru_chain = least_recently_used;
-    while (lru_chain != NULL) {
-        entries_from_lru++;
-        lru_chain = lru_chain->more_recent;
+
+    // Remove from less recent chain.
+    CacheEntry *more_recent = prune_candidate->more_recent;
+    if (shard->least_recently_used == prune_candidate) {
+        shard->least_recently_used = more_recent;
     }
-    print(NULL) << "hash entries " << entries_in_hash_table
-                << ", mru entries " << entries_from_mru
-                << ", lru entries " << entries_from_lru << "\n";
-    if (entries_in_hash_table != entries_from_mru) {
-        halide_print(NULL, "cache invalid case 3\n");
-        __builtin_trap();
+    if (more_recent != NULL) {
+        more_recent->less_recent = prune_candidate->less_recent;
     }
-    if (entries_in_hash_table != entries_from_lru) {
-        halide_print(NULL, "cache invalid case 4\n");
-        __builtin_trap();
+
+    // Remove from more recent chain.
+    if (shard->most_recently_used == prune_candidate) {
+        shard->most_recently_used = prune_candidate->less_recent;
     }
-    if (current_cache_size < 0) {
-        halide_print(NULL, "cache size is negative\n");
-        __builtin_trap();
+    if (prune_candidate->less_recent != NULL) {
+        prune_candidate->less_recent->more_recent = more_recent;
     }
+
+    // Decrease cache used amount.
+    int64_t freed_size = 0;
+    for (uint32_t i = 0; i < prune_candidate->tuple_count; i++) {
+        freed_size += prune_candidate->buf[i].size_in_bytes();
+    }
+    __sync_fetch_and_sub(&current_cache_size, freed_size);
+    shard->num_entries--;
+    shard->evictions++;
+
+    // Deallocate the entry.
+    prune_candidate->destroy();
+    halide_free(NULL, prune_candidate);
 }
-#endif
 
+// Evict entries nobody is using until the cache fits in its budget,
+// lowest priority first over all shards. Must be called without
+// holding the lock of any shard.
 WEAK void prune_cache() {
 #if CACHE_DEBUGGING
     validate_cache();
 #endif
-    CacheEntry *prune_candidate = least_recently_used;
-    while (current_cache_size > max_cache_size &&
-           prune_candidate != NULL) {
-        CacheEntry *more_recent = prune_candidate->more_recent;
-
-        if (prune_candidate->in_use_count == 0) {
-            uint32_t h = prune_candidate->hash;
-            uint32_t index = h % kHashTableSize;
-
-            // Remove from hash table
-            CacheEntry *prev_hash_entry = cache_entries[index];
-            if (prev_hash_entry == prune_candidate) {
-                cache_entries[index] = prune_candidate->next;
-            } else {
-                while (prev_hash_entry != NULL && prev_hash_entry->next != prune_candidate) {
-                    prev_hash_entry = prev_hash_entry->next;
-                }
-                halide_assert(NULL, prev_hash_entry != NULL);
-                prev_hash_entry->next = prune_candidate->next;
-            }
-
-            // Remove from less recent chain.
-            if (least_recently_used == prune_candidate) {
-                least_recently_used = more_recent;
+    while (__atomic_load_n(&current_cache_size, __ATOMIC_RELAXED) >
+           __atomic_load_n(&max_cache_size, __ATOMIC_RELAXED)) {
+        CacheShard *victim_shard = NULL;
+        CacheEntry victim;
+        for (int s = 0; s < kNumCacheShards; s++) {
+            CacheShard *shard = &cache_shards[s];
+            ScopedMutexLock lock(&shard->lock);
+            CacheEntry *candidate = eviction_candidate_already_locked(shard);
+            if (candidate && (victim_shard == NULL || evict_before(candidate, &victim))) {
+                victim_shard = shard;
+                victim.priority = candidate->priority;
+                victim.last_use = candidate->last_use;
             }
-            if (more_recent != NULL) {
-                more_recent->less_recent = prune_candidate->less_recent;
+        }
+        if (victim_shard == NULL) {
+            break;
+        }
+        // The candidate may have been used or evicted since we
+        // looked, in which case this picks the next one in the shard.
+        ScopedMutexLock lock(&victim_shard->lock);
+        CacheEntry *candidate = eviction_candidate_already_locked(victim_shard);
+        if (candidate) {
+            uint64_t inflation = __atomic_load_n(&eviction_inflation, __ATOMIC_RELAXED);
+            if (candidate->priority > inflation) {
+                __atomic_store_n(&eviction_inflation, candidate->priority, __ATOMIC_RELAXED);
             }
+            evict_already_locked(victim_shard, candidate);
+        }
+    }
+#if CACHE_DEBUGGING
+    validate_cache();
+#endif
+}
+
+
+// Add a result to the cache, unless an equal one is already there
+// or it can't be allocated, in which case the buffers are marked as
+// belonging to no entry so halide_memoization_cache_release frees
+// them. Returns whether it was added. A new entry starts out in use
+// by the caller.
+WEAK bool insert_entry(void *user_context, const uint8_t *cache_key, int32_t size, uint32_t h,
+                       const halide_buffer_t *computed_bounds,
+                       int32_t tuple_count, halide_buffer_t **tuple_buffers,
+                       uint64_t cost_ns) {
+    CacheShard *shard = shard_for_hash(h);
+
+    halide_mutex_lock(&shard->lock);
 
-            // Remove from more recent chain.
-            if (most_recently_used == prune_candidate) {
-                most_recently_used = prune_candidate->less_recent;
+    CacheEntry *entry = shard->num_buckets ? shard->buckets[bucket_for_hash(shard, h)] : NULL;
+    while (entry != NULL) {
+        if (entry->hash == h && entry->key_size == (size_t)size &&
+            keys_equal(entry->key, cache_key, size) &&
+            buffer_has_shape(computed_bounds, entry->computed_bounds) &&
+            entry->tuple_count == (uint32_t)tuple_count) {
+
+            bool all_bounds_equal = true;
+            bool no_host_pointers_equal = true;
+            {
+                for (int32_t i = 0; all_bounds_equal && i < tuple_count; i++) {
+                    halide_buffer_t *buf = tuple_buffers[i];
+                    all_bounds_equal = buffer_has_shape(tuple_buffers[i], entry->buf[i].dim);
+                    if (entry->buf[i].host == buf->host) {
+                        no_host_pointers_equal = false;
+                    }
+                }
             }
-            if (prune_candidate->less_recent != NULL) {
-                prune_candidate->less_recent = more_recent;
+            if (all_bounds_equal) {
+                halide_assert(user_context, no_host_pointers_equal);
+                // This entry is still in use by the caller. Mark it as having no cache entry
+                // so halide_memoization_cache_release can free the buffer.
+                for (int32_t i = 0; i < tuple_count; i++) {
+                    get_pointer_to_header(tuple_buffers[i]->host)->entry = NULL;
+
+                }
+                halide_mutex_unlock(&shard->lock);
+                return false;
             }
+        }
+        entry = entry->next;
+    }
+
+    uint64_t added_size = 0;
+    {
+        for (int32_t i = 0; i < tuple_count; i++) {
+            halide_buffer_t *buf = tuple_buffers[i];
+            added_size += buf->size_in_bytes();
+        }
+    }
+
+    CacheEntry *new_entry = NULL;
+    bool inited = false;
+    if (reserve_entry_already_locked(shard)) {
+        new_entry = (CacheEntry *)halide_malloc(NULL, sizeof(CacheEntry));
+    }
+    if (new_entry) {
+        inited = new_entry->init(cache_key, size, h, computed_bounds, tuple_count, tuple_buffers);
+    }
+    if (!inited) {
+        // This entry is still in use by the caller. Mark it as having no cache entry
+        // so halide_memoization_cache_release can free the buffer.
+        for (int32_t i = 0; i < tuple_count; i++) {
+            get_pointer_to_header(tuple_buffers[i]->host)->entry = NULL;
+        }
+
+        if (new_entry) {
+            halide_free(user_context, new_entry);
+        }
+        halide_mutex_unlock(&shard->lock);
+        return false;
+    }
+
+    uint32_t index = bucket_for_hash(shard, h);
+    new_entry->next = shard->buckets[index];
+    new_entry->less_recent = shard->most_recently_used;
+    if (shard->most_recently_used != NULL) {
+        shard->most_recently_used->more_recent = new_entry;
+    }
+    shard->most_recently_used = new_entry;
+    if (shard->least_recently_used == NULL) {
+        shard->least_recently_used = new_entry;
+    }
+    shard->buckets[index] = new_entry;
+    shard->num_entries++;
+    shard->stores++;
+
+    new_entry->in_use_count = tuple_count;
+    new_entry->last_use = next_use_already_locked(shard);
+    new_entry->cost_ns = cost_ns;
+    set_priority(new_entry);
+
+    for (int32_t i = 0; i < tuple_count; i++) {
+        get_pointer_to_header(tuple_buffers[i]->host)->entry = new_entry;
+    }
+
+    halide_mutex_unlock(&shard->lock);
+
+    // The new entry is in use, so this evicts others to make room
+    // for it.
+    __sync_fetch_and_add(&current_cache_size, (int64_t)added_size);
+    prune_cache();
+
+    return true;
+}
+
+// An optional memory-mapped file that expensive results are also
+// written to, so that they survive restarts of the process. It holds
+// a header followed by records appended one after another. Lookups
+// that miss in memory look for a record with the same key and shape,
+// and load it back into the cache. The file is only meant to be read
+// back by the same build of the same program on the same machine.
+const uint32_t kBackingFileMagic = 0x434d4c48;  // "HLMC"
+const uint32_t kBackingFileVersion = 2;
+
+struct BackingFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    // Identifies the build of the program that wrote the file. The
+    // records of a file written by a different build are dropped.
+    uint64_t fingerprint;
+    // The size of the file, including this header.
+    uint64_t size;
+    // The bytes of complete records following this header.
+    uint64_t used;
+};
+
+// Followed by the key padded to 8 bytes and the computed bounds, and
+// then a BackingTuple for each tuple element.
+struct BackingRecord {
+    // Including this struct. A multiple of 8.
+    uint64_t record_size;
+    uint64_t cost_ns;
+    uint32_t hash;
+    uint32_t key_size;
+    int32_t dimensions;
+    int32_t tuple_count;
+};
+
+// Followed by the allocated shape and the contents padded to 8 bytes.
+struct BackingTuple {
+    halide_type_t type;
+    uint32_t padding;
+    uint64_t data_size;
+};
 
-            // Decrease cache used amount.
-            for (uint32_t i = 0; i < prune_candidate->tuple_count; i++) {
-                current_cache_size -= prune_candidate->buf[i].size_in_bytes();
+struct BackingIndexEntry {
+    uint32_t hash;
+    // kNoBackingRecord if the slot is empty.
+    uint64_t offset;
+};
+
+const uint64_t kNoBackingRecord = ~(uint64_t)0;
+
+// Where to find the records with each hash, so lookups don't walk the
+// file. The index is split into shards in the same way as the cache,
+// each with its own lock, so that lookups that miss in memory only
+// contend when their keys land in the same shard. Each shard is an
+// open addressing table with a power of two number of slots.
+struct BackingIndexShard {
+    halide_mutex lock;
+    BackingIndexEntry *slots;
+    uint32_t num_slots, num_records;
+} __attribute__((aligned(64)));
+
+WEAK BackingIndexShard backing_index[kNumCacheShards];
+
+struct BackingFile {
+    // Held while appending a record, after the lock of the index
+    // shard it goes in.
+    halide_mutex lock;
+    // NULL if no file is attached. Only changed while holding the
+    // locks of all the index shards and the lock above.
+    uint8_t *data;
+    uint64_t min_cost_ns;
+    // Updated atomically.
+    uint64_t loads, saves;
+};
+
+WEAK BackingFile backing_file;
+
+WEAK BackingIndexShard *backing_index_for_hash(uint32_t h) {
+    return &backing_index[h >> (32 - kCacheShardBits)];
+}
+
+// Take every lock of the backing file, to attach or detach it.
+WEAK void lock_backing_file() {
+    for (int s = 0; s < kNumCacheShards; s++) {
+        halide_mutex_lock(&backing_index[s].lock);
+    }
+    halide_mutex_lock(&backing_file.lock);
+}
+
+WEAK void unlock_backing_file() {
+    halide_mutex_unlock(&backing_file.lock);
+    for (int s = kNumCacheShards - 1; s >= 0; s--) {
+        halide_mutex_unlock(&backing_index[s].lock);
+    }
+}
+
+WEAK uint64_t align_to_8(uint64_t x) {
+    return (x + 7) & ~(uint64_t)7;
+}
+
+WEAK BackingFileHeader *backing_file_header() {
+    return (BackingFileHeader *)backing_file.data;
+}
+
+WEAK BackingRecord *backing_record_at(uint64_t offset) {
+    return (BackingRecord *)(backing_file.data + sizeof(BackingFileHeader) + offset);
+}
+
+WEAK uint8_t *backing_record_key(BackingRecord *rec) {
+    return (uint8_t *)(rec + 1);
+}
+
+WEAK halide_dimension_t *backing_record_bounds(BackingRecord *rec) {
+    return (halide_dimension_t *)(backing_record_key(rec) + align_to_8(rec->key_size));
+}
+
+WEAK BackingTuple *backing_record_first_tuple(BackingRecord *rec) {
+    return (BackingTuple *)(backing_record_bounds(rec) + rec->dimensions);
+}
+
+WEAK halide_dimension_t *backing_tuple_shape(BackingTuple *t) {
+    return (halide_dimension_t *)(t + 1);
+}
+
+WEAK uint8_t *backing_tuple_data(BackingTuple *t, int32_t dimensions) {
+    return (uint8_t *)(backing_tuple_shape(t) + dimensions);
+}
+
+WEAK BackingTuple *backing_tuple_next(BackingTuple *t, int32_t dimensions) {
+    return (BackingTuple *)(backing_tuple_data(t, dimensions) + align_to_8(t->data_size));
+}
+
+// Check that a record found in the file lies within the bytes
+// available to it, in case the file was truncated or is garbage.
+WEAK bool backing_record_is_valid(BackingRecord *rec, uint64_t available) {
+    if (available < sizeof(BackingRecord) ||
+        rec->record_size < sizeof(BackingRecord) ||
+        rec->record_size > available ||
+        rec->record_size % 8 != 0 ||
+        rec->dimensions < 0 || rec->tuple_count <= 0) {
+        return false;
+    }
+    uint8_t *end = (uint8_t *)rec + rec->record_size;
+    uint64_t shape_bytes = (uint64_t)rec->dimensions * sizeof(halide_dimension_t);
+    uint8_t *p = (uint8_t *)rec + sizeof(BackingRecord) + align_to_8(rec->key_size) + shape_bytes;
+    for (int32_t i = 0; i < rec->tuple_count; i++) {
+        if (p > end || (uint64_t)(end - p) < sizeof(BackingTuple) + shape_bytes) {
+            return false;
+        }
+        BackingTuple *t = (BackingTuple *)p;
+        uint64_t rest = (uint64_t)(end - p) - sizeof(BackingTuple) - shape_bytes;
+        if (align_to_8(t->data_size) > rest) {
+            return false;
+        }
+        p = (uint8_t *)backing_tuple_next(t, rec->dimensions);
+    }
+    return p == end;
+}
+
+WEAK void insert_backing_index_slot(BackingIndexEntry *slots, uint32_t num_slots,
+                                    uint32_t hash, uint64_t offset) {
+    uint32_t i = hash & (num_slots - 1);
+    while (slots[i].offset != kNoBackingRecord) {
+        i = (i + 1) & (num_slots - 1);
+    }
+    slots[i].hash = hash;
+    slots[i].offset = offset;
+}
+
+// Add a record to its shard of the index, growing the shard's table
+// to keep it at most half full.
+WEAK bool add_to_backing_index_already_locked(BackingIndexShard *shard, uint32_t hash, uint64_t offset) {
+    if ((shard->num_records + 1) * 2 > shard->num_slots) {
+        uint32_t num_slots = shard->num_slots ? shard->num_slots * 2 : 64;
+        BackingIndexEntry *slots =
+            (BackingIndexEntry *)halide_malloc(NULL, num_slots * sizeof(BackingIndexEntry));
+        if (!slots) {
+            return false;
+        }
+        for (uint32_t i = 0; i < num_slots; i++) {
+            slots[i].offset = kNoBackingRecord;
+        }
+        for (uint32_t i = 0; i < shard->num_slots; i++) {
+            if (shard->slots[i].offset != kNoBackingRecord) {
+                insert_backing_index_slot(slots, num_slots, shard->slots[i].hash, shard->slots[i].offset);
             }
+        }
+        halide_free(NULL, shard->slots);
+        shard->slots = slots;
+        shard->num_slots = num_slots;
+    }
+    insert_backing_index_slot(shard->slots, shard->num_slots, hash, offset);
+    shard->num_records++;
+    return true;
+}
+
+// Must be called with all the locks of the backing file held.
+WEAK void detach_backing_file_already_locked(void *user_context) {
+    if (backing_file.data) {
+        halide_unmap_file(user_context, backing_file.data, backing_file_header()->size);
+        backing_file.data = NULL;
+    }
+    for (int s = 0; s < kNumCacheShards; s++) {
+        BackingIndexShard *shard = &backing_index[s];
+        halide_free(NULL, shard->slots);
+        shard->slots = NULL;
+        shard->num_slots = 0;
+        shard->num_records = 0;
+    }
+}
 
-            // Deallocate the entry.
-            prune_candidate->destroy();
-            halide_free(NULL, prune_candidate);
+// Find the record for a key and shape. Must be called with the lock
+// of the index shard for its hash held.
+WEAK BackingRecord *find_backing_record_already_locked(BackingIndexShard *shard,
+                                                       const uint8_t *cache_key, int32_t size, uint32_t h,
+                                                       const halide_buffer_t *computed_bounds,
+                                                       int32_t tuple_count, halide_buffer_t **tuple_buffers) {
+    if (shard->num_slots == 0) {
+        return NULL;
+    }
+    for (uint32_t i = h & (shard->num_slots - 1);
+         shard->slots[i].offset != kNoBackingRecord;
+         i = (i + 1) & (shard->num_slots - 1)) {
+        if (shard->slots[i].hash != h) {
+            continue;
         }
+        BackingRecord *rec = backing_record_at(shard->slots[i].offset);
+        if (rec->key_size != (uint32_t)size ||
+            rec->tuple_count != tuple_count ||
+            rec->dimensions != computed_bounds->dimensions ||
+            !keys_equal(backing_record_key(rec), cache_key, size) ||
+            !buffer_has_shape(computed_bounds, backing_record_bounds(rec))) {
+            continue;
+        }
+        bool all_tuples_equal = true;
+        BackingTuple *t = backing_record_first_tuple(rec);
+        for (int32_t j = 0; all_tuples_equal && j < tuple_count; j++) {
+            const halide_buffer_t *buf = tuple_buffers[j];
+            all_tuples_equal = (t->type == buf->type &&
+                                t->data_size == buf->size_in_bytes() &&
+                                buffer_has_shape(buf, backing_tuple_shape(t)));
+            t = backing_tuple_next(t, rec->dimensions);
+        }
+        if (all_tuples_equal) {
+            return rec;
+        }
+    }
+    return NULL;
+}
 
-        prune_candidate = more_recent;
+// Fill in the buffers of a lookup that missed in memory from the
+// backing file, if it has the result.
+WEAK bool load_from_backing_file(const uint8_t *cache_key, int32_t size, uint32_t h,
+                                 const halide_buffer_t *computed_bounds,
+                                 int32_t tuple_count, halide_buffer_t **tuple_buffers,
+                                 uint64_t *cost_ns) {
+    BackingIndexShard *shard = backing_index_for_hash(h);
+    ScopedMutexLock lock(&shard->lock);
+    if (!backing_file.data) {
+        return false;
     }
-#if CACHE_DEBUGGING
-    validate_cache();
-#endif
+    BackingRecord *rec = find_backing_record_already_locked(shard, cache_key, size, h, computed_bounds,
+                                                            tuple_count, tuple_buffers);
+    if (!rec) {
+        return false;
+    }
+    BackingTuple *t = backing_record_first_tuple(rec);
+    for (int32_t i = 0; i < tuple_count; i++) {
+        memcpy(tuple_buffers[i]->host, backing_tuple_data(t, rec->dimensions), t->data_size);
+        t = backing_tuple_next(t, rec->dimensions);
+    }
+    *cost_ns = rec->cost_ns;
+    __sync_fetch_and_add(&backing_file.loads, 1);
+    return true;
+}
+
+// Append a newly stored result to the backing file, if it was
+// expensive enough and there's room.
+WEAK void save_to_backing_file(const uint8_t *cache_key, int32_t size, uint32_t h,
+                               const halide_buffer_t *computed_bounds,
+                               int32_t tuple_count, halide_buffer_t **tuple_buffers,
+                               uint64_t cost_ns) {
+    BackingIndexShard *shard = backing_index_for_hash(h);
+    ScopedMutexLock shard_lock(&shard->lock);
+    if (!backing_file.data || cost_ns < backing_file.min_cost_ns ||
+        find_backing_record_already_locked(shard, cache_key, size, h, computed_bounds,
+                                           tuple_count, tuple_buffers)) {
+        return;
+    }
+
+    int32_t dimensions = computed_bounds->dimensions;
+    uint64_t shape_bytes = (uint64_t)dimensions * sizeof(halide_dimension_t);
+    uint64_t record_size = sizeof(BackingRecord) + align_to_8(size) + shape_bytes;
+    for (int32_t i = 0; i < tuple_count; i++) {
+        const halide_buffer_t *buf = tuple_buffers[i];
+        // Results that live on a device aren't saved.
+        if (buf->host == NULL || buf->device_dirty()) {
+            return;
+        }
+        record_size += sizeof(BackingTuple) + shape_bytes + align_to_8(buf->size_in_bytes());
+    }
+
+    ScopedMutexLock append_lock(&backing_file.lock);
+    BackingFileHeader *header = backing_file_header();
+    if (record_size > header->size - sizeof(BackingFileHeader) - header->used) {
+        return;
+    }
+
+    uint64_t offset = header->used;
+    BackingRecord *rec = backing_record_at(offset);
+    rec->record_size = record_size;
+    rec->cost_ns = cost_ns;
+    rec->hash = h;
+    rec->key_size = size;
+    rec->dimensions = dimensions;
+    rec->tuple_count = tuple_count;
+    memcpy(backing_record_key(rec), cache_key, size);
+    memcpy(backing_record_bounds(rec), computed_bounds->dim, shape_bytes);
+    BackingTuple *t = backing_record_first_tuple(rec);
+    for (int32_t i = 0; i < tuple_count; i++) {
+        const halide_buffer_t *buf = tuple_buffers[i];
+        t->type = buf->type;
+        t->padding = 0;
+        t->data_size = buf->size_in_bytes();
+        memcpy(backing_tuple_shape(t), buf->dim, shape_bytes);
+        memcpy(backing_tuple_data(t, dimensions), buf->host, t->data_size);
+        t = backing_tuple_next(t, dimensions);
+    }
+
+    // Only count the record once it's complete, so a crash while
+    // writing it leaves the file valid.
+    if (add_to_backing_index_already_locked(shard, h, offset)) {
+        __atomic_store_n(&header->used, offset + record_size, __ATOMIC_RELEASE);
+        __sync_fetch_and_add(&backing_file.saves, 1);
+    }
+}
+
+// Index the records already in a newly mapped file, dropping anything
+// after the first one that doesn't look right. Must be called with all
+// the locks of the backing file held.
+WEAK bool attach_backing_file_already_locked(uint64_t size, uint64_t fingerprint) {
+    BackingFileHeader *header = backing_file_header();
+    if (header->magic != kBackingFileMagic ||
+        header->version != kBackingFileVersion ||
+        header->fingerprint != fingerprint ||
+        header->size != size ||
+        header->used > size - sizeof(BackingFileHeader)) {
+        // A new file, or one from a different version, build or size.
+        header->magic = kBackingFileMagic;
+        header->version = kBackingFileVersion;
+        header->fingerprint = fingerprint;
+        header->size = size;
+        header->used = 0;
+        return true;
+    }
+
+    uint64_t offset = 0;
+    while (offset < header->used) {
+        BackingRecord *rec = backing_record_at(offset);
+        if (!backing_record_is_valid(rec, header->used - offset)) {
+            break;
+        }
+        if (!add_to_backing_index_already_locked(backing_index_for_hash(rec->hash), rec->hash, offset)) {
+            return false;
+        }
+        offset += rec->record_size;
+    }
+    header->used = offset;
+    return true;
 }
 
 }}} // namespace Halide::Runtime::Internal
@@ -320,18 +1012,80 @@ WEAK void halide_memoization_cache_set_size(int64_t size) {
         size = kDefaultCacheSize;
     }
 
-    ScopedMutexLock lock(&memoization_lock);
-
-    max_cache_size = size;
+    __atomic_store_n(&max_cache_size, size, __ATOMIC_RELAXED);
     prune_cache();
 }
 
+WEAK void halide_memoization_cache_set_table_size(int32_t size) {
+    if (size <= 0) {
+        size = kDefaultTableSize;
+    }
+
+    // Round up to a power of two buckets per shard.
+    uint32_t per_shard = 1;
+    while (per_shard * kNumCacheShards < (uint32_t)size) {
+        per_shard *= 2;
+    }
+    table_size = per_shard * kNumCacheShards;
+
+    for (int s = 0; s < kNumCacheShards; s++) {
+        CacheShard *shard = &cache_shards[s];
+        ScopedMutexLock lock(&shard->lock);
+        if (shard->num_buckets != 0 && shard->num_buckets < per_shard) {
+            resize_shard_already_locked(shard, per_shard);
+        }
+    }
+}
+
+WEAK int halide_memoization_cache_set_backing_file(void *user_context, const char *path,
+                                                   int64_t size, int64_t min_cost_ns,
+                                                   uint64_t fingerprint) {
+    lock_backing_file();
+    detach_backing_file_already_locked(user_context);
+    int result = 0;
+    if (path == NULL) {
+        // Just detach it.
+    } else if (size <= (int64_t)sizeof(BackingFileHeader) || halide_map_file == NULL) {
+        result = halide_error_code_generic_error;
+    } else {
+        size = (int64_t)align_to_8(size);
+        backing_file.data = (uint8_t *)halide_map_file(user_context, path, size);
+        if (backing_file.data == NULL) {
+            error(user_context) << "Could not map memoization cache backing file " << path << "\n";
+            result = halide_error_code_generic_error;
+        } else if (!attach_backing_file_already_locked(size, fingerprint)) {
+            detach_backing_file_already_locked(user_context);
+            result = halide_error_code_out_of_memory;
+        } else {
+            backing_file.min_cost_ns = min_cost_ns > 0 ? min_cost_ns : 0;
+        }
+    }
+    unlock_backing_file();
+    return result;
+}
+
+WEAK void halide_memoization_cache_get_stats(halide_memoization_cache_stats_t *stats) {
+    memset(stats, 0, sizeof(halide_memoization_cache_stats_t));
+    for (int s = 0; s < kNumCacheShards; s++) {
+        CacheShard *shard = &cache_shards[s];
+        ScopedMutexLock lock(&shard->lock);
+        stats->hits += shard->hits;
+        stats->misses += shard->misses;
+        stats->stores += shard->stores;
+        stats->evictions += shard->evictions;
+        stats->entries += shard->num_entries;
+    }
+    stats->current_size = __atomic_load_n(&current_cache_size, __ATOMIC_RELAXED);
+    stats->max_size = __atomic_load_n(&max_cache_size, __ATOMIC_RELAXED);
+
+    stats->backing_loads = __atomic_load_n(&backing_file.loads, __ATOMIC_RELAXED);
+    stats->backing_saves = __atomic_load_n(&backing_file.saves, __ATOMIC_RELAXED);
+}
+
 WEAK int halide_memoization_cache_lookup(void *user_context, const uint8_t *cache_key, int32_t size,
                                          halide_buffer_t *computed_bounds, int32_t tuple_count, halide_buffer_t **tuple_buffers) {
-    uint32_t h = djb_hash(cache_key, size);
-    uint32_t index = h % kHashTableSize;
-
-    ScopedMutexLock lock(&memoization_lock);
+    uint32_t h = hash_key(cache_key, size);
+    CacheShard *shard = shard_for_hash(h);
 
 #if CACHE_DEBUGGING
     debug_print_key(user_context, "halide_memoization_cache_lookup", cache_key, size);
@@ -346,52 +1100,43 @@ WEAK int halide_memoization_cache_lookup(void *user_context, const uint8_t *cach
     }
 #endif
 
-    CacheEntry *entry = cache_entries[index];
-    while (entry != NULL) {
-        if (entry->hash == h && entry->key_size == (size_t)size &&
-            keys_equal(entry->key, cache_key, size) &&
-            buffer_has_shape(computed_bounds, entry->computed_bounds) &&
-            entry->tuple_count == (uint32_t)tuple_count) {
-
-            // Check all the tuple buffers have the same bounds (they should).
-            bool all_bounds_equal = true;
-            for (int32_t i = 0; all_bounds_equal && i < tuple_count; i++) {
-                all_bounds_equal = buffer_has_shape(tuple_buffers[i], entry->buf[i].dim);
-            }
+    {
+        ScopedMutexLock lock(&shard->lock);
 
-            if (all_bounds_equal) {
-                if (entry != most_recently_used) {
-                    halide_assert(user_context, entry->more_recent != NULL);
-                    if (entry->less_recent != NULL) {
-                        entry->less_recent->more_recent = entry->more_recent;
-                    } else {
-                        halide_assert(user_context, least_recently_used == entry);
-                        least_recently_used = entry->more_recent;
-                    }
-                    halide_assert(user_context, entry->more_recent != NULL);
-                    entry->more_recent->less_recent = entry->less_recent;
+        CacheEntry *entry = shard->num_buckets ? shard->buckets[bucket_for_hash(shard, h)] : NULL;
+        while (entry != NULL) {
+            if (entry->hash == h && entry->key_size == (size_t)size &&
+                keys_equal(entry->key, cache_key, size) &&
+                buffer_has_shape(computed_bounds, entry->computed_bounds) &&
+                entry->tuple_count == (uint32_t)tuple_count) {
 
-                    entry->more_recent = NULL;
-                    entry->less_recent = most_recently_used;
-                    if (most_recently_used != NULL) {
-                        most_recently_used->more_recent = entry;
-                    }
-                    most_recently_used = entry;
+                // Check all the tuple buffers have the same bounds (they should).
+                bool all_bounds_equal = true;
+                for (int32_t i = 0; all_bounds_equal && i < tuple_count; i++) {
+                    all_bounds_equal = buffer_has_shape(tuple_buffers[i], entry->buf[i].dim);
                 }
 
-                for (int32_t i = 0; i < tuple_count; i++) {
-                    halide_buffer_t *buf = tuple_buffers[i];
-                    *buf = entry->buf[i];
-                }
+                if (all_bounds_equal) {
+                    touch_entry_already_locked(shard, entry);
+                    shard->hits++;
+
+                    for (int32_t i = 0; i < tuple_count; i++) {
+                        halide_buffer_t *buf = tuple_buffers[i];
+                        *buf = entry->buf[i];
+                    }
 
-                entry->in_use_count += tuple_count;
+                    entry->in_use_count += tuple_count;
 
-                return 0;
+                    return 0;
+                }
             }
+            entry = entry->next;
         }
-        entry = entry->next;
+
+        shard->misses++;
     }
 
+    int64_t start_ns = current_time_ns(user_context);
     for (int32_t i = 0; i < tuple_count; i++) {
         halide_buffer_t *buf = tuple_buffers[i];
 
@@ -408,11 +1153,17 @@ WEAK int halide_memoization_cache_lookup(void *user_context, const uint8_t *cach
         CacheBlockHeader *header = get_pointer_to_header(buf->host);
         header->hash = h;
         header->entry = NULL;
+        header->compute_start_ns = start_ns;
     }
 
-#if CACHE_DEBUGGING
-    validate_cache();
-#endif
+    // A result saved by an earlier run saves computing it again.
+    uint64_t cost_ns = 0;
+    if (load_from_backing_file(cache_key, size, h, computed_bounds,
+                               tuple_count, tuple_buffers, &cost_ns)) {
+        insert_entry(user_context, cache_key, size, h, computed_bounds,
+                     tuple_count, tuple_buffers, cost_ns);
+        return 0;
+    }
 
     return 1;
 }
@@ -422,11 +1173,8 @@ WEAK int halide_memoization_cache_store(void *user_context, const uint8_t *cache
                                         int32_t tuple_count, halide_buffer_t **tuple_buffers) {
     debug(user_context) << "halide_memoization_cache_store\n";
 
-    uint32_t h = get_pointer_to_header(tuple_buffers[0]->host)->hash;
-
-    uint32_t index = h % kHashTableSize;
-
-    ScopedMutexLock lock(&memoization_lock);
+    CacheBlockHeader *header = get_pointer_to_header(tuple_buffers[0]->host);
+    uint32_t h = header->hash;
 
 #if CACHE_DEBUGGING
     debug_print_key(user_context, "halide_memoization_cache_store", cache_key, size);
@@ -441,88 +1189,22 @@ WEAK int halide_memoization_cache_store(void *user_context, const uint8_t *cache
     }
 #endif
 
-    CacheEntry *entry = cache_entries[index];
-    while (entry != NULL) {
-        if (entry->hash == h && entry->key_size == (size_t)size &&
-            keys_equal(entry->key, cache_key, size) &&
-            buffer_has_shape(computed_bounds, entry->computed_bounds) &&
-            entry->tuple_count == (uint32_t)tuple_count) {
-
-            bool all_bounds_equal = true;
-            bool no_host_pointers_equal = true;
-            {
-                for (int32_t i = 0; all_bounds_equal && i < tuple_count; i++) {
-                    halide_buffer_t *buf = tuple_buffers[i];
-                    all_bounds_equal = buffer_has_shape(tuple_buffers[i], entry->buf[i].dim);
-                    if (entry->buf[i].host == buf->host) {
-                        no_host_pointers_equal = false;
-                    }
-                }
-            }
-            if (all_bounds_equal) {
-                halide_assert(user_context, no_host_pointers_equal);
-                // This entry is still in use by the caller. Mark it as having no cache entry
-                // so halide_memoization_cache_release can free the buffer.
-                for (int32_t i = 0; i < tuple_count; i++) {
-                    get_pointer_to_header(tuple_buffers[i]->host)->entry = NULL;
-
-                }
-                return 0;
-            }
-        }
-        entry = entry->next;
-    }
-
-    uint64_t added_size = 0;
-    {
-        for (int32_t i = 0; i < tuple_count; i++) {
-            halide_buffer_t *buf = tuple_buffers[i];
-            added_size += buf->size_in_bytes();
+    // How long the result took to compute, if the clock was running
+    // when it was looked up.
+    uint64_t cost_ns = 0;
+    if (header->compute_start_ns > 0) {
+        int64_t end_ns = current_time_ns(user_context);
+        if (end_ns > header->compute_start_ns) {
+            cost_ns = end_ns - header->compute_start_ns;
         }
     }
-    current_cache_size += added_size;
-    prune_cache();
 
-    CacheEntry *new_entry = (CacheEntry *)halide_malloc(NULL, sizeof(CacheEntry));
-    bool inited = false;
-    if (new_entry) {
-        inited = new_entry->init(cache_key, size, h, computed_bounds, tuple_count, tuple_buffers);
+    if (insert_entry(user_context, cache_key, size, h, computed_bounds,
+                     tuple_count, tuple_buffers, cost_ns)) {
+        save_to_backing_file(cache_key, size, h, computed_bounds,
+                             tuple_count, tuple_buffers, cost_ns);
     }
-    if (!inited) {
-        current_cache_size -= added_size;
-
-        // This entry is still in use by the caller. Mark it as having no cache entry
-        // so halide_memoization_cache_release can free the buffer.
-        for (int32_t i = 0; i < tuple_count; i++) {
-            get_pointer_to_header(tuple_buffers[i]->host)->entry = NULL;
-        }
 
-        if (new_entry) {
-            halide_free(user_context, new_entry);
-        }
-        return 0;
-    }
-
-    new_entry->next = cache_entries[index];
-    new_entry->less_recent = most_recently_used;
-    if (most_recently_used != NULL) {
-        most_recently_used->more_recent = new_entry;
-    }
-    most_recently_used = new_entry;
-    if (least_recently_used == NULL) {
-        least_recently_used = new_entry;
-    }
-    cache_entries[index] = new_entry;
-
-    new_entry->in_use_count = tuple_count;
-
-    for (int32_t i = 0; i < tuple_count; i++) {
-        get_pointer_to_header(tuple_buffers[i]->host)->entry = new_entry;
-    }
-
-#if CACHE_DEBUGGING
-    validate_cache();
-#endif
     debug(user_context) << "Exiting halide_memoization_cache_store\n";
 
     return 0;
@@ -536,13 +1218,10 @@ WEAK void halide_memoization_cache_release(void *user_context, void *host) {
     if (entry == NULL) {
         halide_free(user_context, header);
     } else {
-        ScopedMutexLock lock(&memoization_lock);
+        ScopedMutexLock lock(&shard_for_hash(entry->hash)->lock);
 
         halide_assert(user_context, entry->in_use_count > 0);
         entry->in_use_count--;
-#if CACHE_DEBUGGING
-        validate_cache();
-#endif
     }
 
     debug(user_context) << "Exited halide_memoization_cache_release.\n";
@@ -550,20 +1229,29 @@ WEAK void halide_memoization_cache_release(void *user_context, void *host) {
 
 WEAK void halide_memoization_cache_cleanup() {
     debug(NULL) << "halide_memoization_cache_cleanup\n";
-    for (size_t i = 0; i < kHashTableSize; i++) {
-        CacheEntry *entry = cache_entries[i];
-        cache_entries[i] = NULL;
-        while (entry != NULL) {
-            CacheEntry *next = entry->next;
-            entry->destroy();
-            halide_free(NULL, entry);
-            entry = next;
+    for (int s = 0; s < kNumCacheShards; s++) {
+        CacheShard *shard = &cache_shards[s];
+        for (uint32_t i = 0; i < shard->num_buckets; i++) {
+            CacheEntry *entry = shard->buckets[i];
+            while (entry != NULL) {
+                CacheEntry *next = entry->next;
+                entry->destroy();
+                halide_free(NULL, entry);
+                entry = next;
+            }
         }
+        halide_free(NULL, shard->buckets);
+        halide_mutex_destroy(&shard->lock);
+        memset(shard, 0, sizeof(CacheShard));
     }
     current_cache_size = 0;
-    most_recently_used = NULL;
-    least_recently_used = NULL;
-    halide_mutex_destroy(&memoization_lock);
+
+    // Everything in the backing file has been written already.
+    lock_backing_file();
+    detach_backing_file_already_locked(NULL);
+    backing_file.loads = 0;
+    backing_file.saves = 0;
+    unlock_backing_file();
 }
 
 namespace {
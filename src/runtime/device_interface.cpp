@@ -41,7 +41,11 @@ WEAK int copy_to_host_already_locked(void *user_context, struct halide_buffer_t
         debug(user_context) << "copy_to_host_already_locked " << buf << " interface is NULL\n";
         return halide_error_code_no_device_interface;
     }
+    int64_t start = halide_trace_timeline_start(user_context);
     int result = interface->copy_to_host(user_context, buf);
+    if (start >= 0) {
+        halide_trace_timeline_interval(user_context, "copy_to_host", "copy", start, buf->size_in_bytes());
+    }
     if (result != 0) {
         debug(user_context) << "copy_to_host_already_locked " << buf << " device copy_to_host returned an error\n";
         return halide_error_code_copy_to_host_failed;
@@ -131,7 +135,11 @@ WEAK int halide_copy_to_device(void *user_context,
             debug(user_context) << "halide_copy_to_device " << buf << " dev_dirty is true error\n";
             return halide_error_code_copy_to_device_failed;
         } else {
+            int64_t start = halide_trace_timeline_start(user_context);
             result = device_interface->copy_to_device(user_context, buf);
+            if (start >= 0) {
+                halide_trace_timeline_interval(user_context, "copy_to_device", "copy", start, buf->size_in_bytes());
+            }
             if (result == 0) {
                 buf->set_host_dirty(false);
             } else {
@@ -35,6 +35,36 @@ WEAK halide_thread *halide_spawn_thread(void (*f)(void *), void *closure) {
     return NULL;
 }
 
+// Without threads the tasks of an async fork run one after another,
+// which works as long as no task waits on a later one.
+WEAK int halide_do_async_fork(void *user_context, halide_task_t f,
+                                int min, int size, uint8_t *closure) {
+    return halide_default_do_par_for(user_context, f, min, size, closure);
+}
+
+WEAK int halide_semaphore_init(halide_semaphore_t *s, int n) {
+    *(int *)s = n;
+    return 0;
+}
+
+WEAK int halide_semaphore_release(halide_semaphore_t *s, int n) {
+    *(int *)s += n;
+    return 0;
+}
+
+WEAK int halide_semaphore_acquire(halide_semaphore_t *s, int n) {
+    // Nobody else could release it, so waiting would deadlock.
+    if (*(int *)s < n) {
+        halide_error(NULL, "halide_semaphore_acquire would block forever without threads.");
+        return halide_error_code_generic_error;
+    }
+    *(int *)s -= n;
+    return 0;
+}
+
+WEAK void halide_semaphore_close(void *user_context, void *s) {
+}
+
 WEAK void halide_mutex_destroy(halide_mutex *mutex_arg) {
 }
 
@@ -54,6 +84,27 @@ WEAK int halide_set_num_threads(int n) {
     return 1;
 }
 
+// There are no worker threads, so describe the machine as a single
+// cpu on a single NUMA node.
+WEAK int halide_set_cpu_topology(int num_cpus, const int *cpu_nodes) {
+    return 1;
+}
+
+WEAK int halide_get_cpu_topology(int max_cpus, int *cpu_nodes, int *num_nodes) {
+    int num_cpus = 1;
+    if (cpu_nodes && max_cpus > 0) {
+        cpu_nodes[0] = 0;
+    }
+    if (num_nodes) {
+        *num_nodes = 1;
+    }
+    return num_cpus;
+}
+
+WEAK bool halide_set_thread_pinning(bool pin) {
+    return false;
+}
+
 WEAK halide_do_task_t halide_set_custom_do_task(halide_do_task_t f) {
     halide_do_task_t result = custom_do_task;
     custom_do_task = f;
@@ -24,6 +24,8 @@ extern long dispatch_semaphore_wait(dispatch_semaphore_t dsema, dispatch_time_t
 extern long dispatch_semaphore_signal(dispatch_semaphore_t dsema);
 extern void dispatch_release(void *object);
 
+extern void *pthread_self();
+
 }
 
 namespace Halide { namespace Runtime { namespace Internal {
@@ -89,6 +91,71 @@ WEAK void halide_do_gcd_task(void *job, size_t idx) {
                                     j->closure);
 }
 
+struct gcd_async_task {
+    halide_gcd_job *job;
+    int idx;
+    int exit_status;
+};
+
+WEAK void halide_do_gcd_async_task(void *arg) {
+    gcd_async_task *t = (gcd_async_task *)arg;
+    t->exit_status = halide_do_task(t->job->user_context, t->job->f, t->idx,
+                                    t->job->closure);
+}
+
+// The representation of halide_semaphore_t.
+struct gcd_semaphore {
+    int value;
+    int closed;
+};
+
+// A thread waiting on a semaphore. It sleeps on a dispatch semaphore
+// of its own, because nothing destroys a halide_semaphore_t that
+// could release a dispatch semaphore stored in it.
+struct semaphore_waiter {
+    dispatch_semaphore_t wakeup;
+    semaphore_waiter *next;
+};
+
+// Threads waiting on any semaphore, protected by a mutex. Releasing
+// or closing a semaphore wakes all of them, and they check their
+// semaphore again. A waiter checks its semaphore and adds itself to
+// the list without releasing the mutex in between, and a release
+// changes the semaphore before taking the mutex, so a waiter can't
+// miss a release.
+WEAK halide_mutex semaphore_waiters_lock = { { 0 } };
+WEAK semaphore_waiter *semaphore_waiters = NULL;
+
+WEAK void wake_semaphore_waiters() {
+    halide_mutex_lock(&semaphore_waiters_lock);
+    semaphore_waiter *w = semaphore_waiters;
+    semaphore_waiters = NULL;
+    while (w) {
+        // Read next before waking the waiter, which owns w.
+        semaphore_waiter *next = w->next;
+        dispatch_semaphore_signal(w->wakeup);
+        w = next;
+    }
+    halide_mutex_unlock(&semaphore_waiters_lock);
+}
+
+// Returns 1 if n units were taken, -1 if the semaphore is closed, and
+// 0 if not enough units are available yet.
+WEAK int try_acquire_semaphore(gcd_semaphore *sem, int n) {
+    while (true) {
+        int value = __atomic_load_n(&sem->value, __ATOMIC_SEQ_CST);
+        if (value >= n) {
+            if (__sync_bool_compare_and_swap(&sem->value, value, value - n)) {
+                return 1;
+            }
+        } else if (__atomic_load_n(&sem->closed, __ATOMIC_SEQ_CST)) {
+            return -1;
+        } else {
+            return 0;
+        }
+    }
+}
+
 }}}  // namespace Halide::Runtime::Internal
 
 extern "C" {
@@ -134,6 +201,80 @@ WEAK halide_do_par_for_t custom_do_par_for = halide_default_do_par_for;
 
 extern "C" {
 
+WEAK int halide_do_async_fork(void *user_context, halide_task_t f,
+                                int min, int size, uint8_t *closure) {
+    if (size <= 0) {
+        return 0;
+    }
+
+    halide_gcd_job job;
+    job.f = f;
+    job.user_context = user_context;
+    job.closure = closure;
+    job.min = min;
+    job.exit_status = 0;
+
+    // The tasks may wait on each other, so they can't share the
+    // bounded set of threads dispatch_apply_f uses. Give each one
+    // beyond the first a thread of its own.
+    gcd_async_task *tasks = (gcd_async_task *)__builtin_alloca(size * sizeof(gcd_async_task));
+    halide_thread **threads = (halide_thread **)__builtin_alloca(size * sizeof(halide_thread *));
+    for (int i = 1; i < size; i++) {
+        tasks[i].job = &job;
+        tasks[i].idx = min + i;
+        tasks[i].exit_status = 0;
+        threads[i] = halide_spawn_thread(halide_do_gcd_async_task, &tasks[i]);
+    }
+    int result = halide_do_task(user_context, f, min, closure);
+    for (int i = 1; i < size; i++) {
+        halide_join_thread(threads[i]);
+        if (!result) {
+            result = tasks[i].exit_status;
+        }
+    }
+    return result;
+}
+
+WEAK int halide_semaphore_init(halide_semaphore_t *s, int n) {
+    gcd_semaphore *sem = (gcd_semaphore *)s;
+    sem->value = n;
+    sem->closed = 0;
+    return 0;
+}
+
+WEAK int halide_semaphore_release(halide_semaphore_t *s, int n) {
+    gcd_semaphore *sem = (gcd_semaphore *)s;
+    __sync_add_and_fetch(&sem->value, n);
+    wake_semaphore_waiters();
+    return 0;
+}
+
+WEAK int halide_semaphore_acquire(halide_semaphore_t *s, int n) {
+    gcd_semaphore *sem = (gcd_semaphore *)s;
+    int result = try_acquire_semaphore(sem, n);
+    if (result == 0) {
+        semaphore_waiter self;
+        self.wakeup = dispatch_semaphore_create(0);
+        halide_mutex_lock(&semaphore_waiters_lock);
+        while ((result = try_acquire_semaphore(sem, n)) == 0) {
+            self.next = semaphore_waiters;
+            semaphore_waiters = &self;
+            halide_mutex_unlock(&semaphore_waiters_lock);
+            dispatch_semaphore_wait(self.wakeup, DISPATCH_TIME_FOREVER);
+            halide_mutex_lock(&semaphore_waiters_lock);
+        }
+        halide_mutex_unlock(&semaphore_waiters_lock);
+        dispatch_release(self.wakeup);
+    }
+    return result > 0 ? 0 : halide_error_code_generic_error;
+}
+
+WEAK void halide_semaphore_close(void *user_context, void *s) {
+    gcd_semaphore *sem = (gcd_semaphore *)s;
+    __atomic_store_n(&sem->closed, 1, __ATOMIC_SEQ_CST);
+    wake_semaphore_waiters();
+}
+
 WEAK void halide_mutex_destroy(halide_mutex *mutex_arg) {
     gcd_mutex *mutex = (gcd_mutex *)mutex_arg;
     if (mutex->once != 0) {
@@ -156,6 +297,10 @@ WEAK void halide_mutex_unlock(halide_mutex *mutex_arg) {
 WEAK void halide_shutdown_thread_pool() {
 }
 
+WEAK uint64_t halide_host_current_thread_id() {
+    return (uint64_t)(uintptr_t)pthread_self();
+}
+
 WEAK int halide_set_num_threads(int n) {
     if (n < 0) {
         halide_error(NULL, "halide_set_num_threads: must be >= 0.");
@@ -165,6 +310,27 @@ WEAK int halide_set_num_threads(int n) {
     return old_custom_num_threads;
 }
 
+// Grand Central Dispatch places the threads, so describe the machine
+// as a single cpu on a single NUMA node.
+WEAK int halide_set_cpu_topology(int num_cpus, const int *cpu_nodes) {
+    return 1;
+}
+
+WEAK int halide_get_cpu_topology(int max_cpus, int *cpu_nodes, int *num_nodes) {
+    int num_cpus = 1;
+    if (cpu_nodes && max_cpus > 0) {
+        cpu_nodes[0] = 0;
+    }
+    if (num_nodes) {
+        *num_nodes = 1;
+    }
+    return num_cpus;
+}
+
+WEAK bool halide_set_thread_pinning(bool pin) {
+    return false;
+}
+
 WEAK halide_do_task_t halide_set_custom_do_task(halide_do_task_t f) {
     halide_do_task_t result = custom_do_task;
     custom_do_task = f;
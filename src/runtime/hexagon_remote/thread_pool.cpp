@@ -82,6 +82,18 @@ void halide_cond_wait(struct halide_cond *cond, struct halide_mutex *mutex) {
     qurt_cond_wait((qurt_cond_t *)cond, (qurt_mutex_t *)mutex);
 }
 
+// There's a single node, and we don't pin threads.
+int halide_host_cpu_nodes(int max_cpus, int *cpu_nodes) {
+    return 0;
+}
+
+int halide_host_current_cpu() {
+    return -1;
+}
+
+int halide_pin_current_thread(int cpu) {
+    return -1;
+}
 
 #define WEAK
 #include "../thread_pool_common.h"
@@ -0,0 +1,214 @@
+#include "HalideRuntime.h"
+#include "scoped_spin_lock.h"
+
+// Hardware performance counters for the sampling profiler, read with
+// perf_event_open. Each thread that runs Halide code registers itself
+// while it does so, and the profiler thread reads the counters of all
+// of them. Only linked into x86 Linux runtimes, as the syscall numbers
+// vary across platforms.
+
+extern "C" {
+
+extern int syscall(int num, ...);
+extern ssize_t read(int fd, void *buf, size_t count);
+
+// -- x64 is 298 and 186
+// -- i386 is 336 and 224
+#ifdef BITS_64
+#define SYS_PERF_EVENT_OPEN 298
+#define SYS_GETTID 186
+#endif
+
+#ifdef BITS_32
+#define SYS_PERF_EVENT_OPEN 336
+#define SYS_GETTID 224
+#endif
+
+}
+
+namespace Halide { namespace Runtime { namespace Internal {
+
+// The leading fields of the kernel's struct perf_event_attr, up to
+// PERF_ATTR_SIZE_VER0. The kernel treats the rest as zero.
+struct perf_event_attr_ver0 {
+    uint32_t type;
+    uint32_t size;
+    uint64_t config;
+    uint64_t sample_period;
+    uint64_t sample_type;
+    uint64_t read_format;
+    uint64_t flags;
+    uint32_t wakeup_events;
+    uint32_t bp_type;
+    uint64_t bp_addr;
+};
+
+const uint32_t kPerfTypeHardware = 0;
+const uint64_t kPerfFormatGroup = 8;
+const uint64_t kPerfFlagExcludeKernel = 1 << 5;
+const uint64_t kPerfFlagExcludeHV = 1 << 6;
+
+// The hardware events counted, in the order of halide_profiler_counter_t.
+const uint64_t perf_event_configs[halide_profiler_num_counters] = {
+    0,  // PERF_COUNT_HW_CPU_CYCLES
+    1,  // PERF_COUNT_HW_INSTRUCTIONS
+    3,  // PERF_COUNT_HW_CACHE_MISSES (usually the last level cache)
+    5,  // PERF_COUNT_HW_BRANCH_MISSES
+};
+
+// The most threads counted at once.
+const int kMaxPerfThreads = 256;
+
+struct PerfThread {
+    int tid;
+    // The number of registrations not yet matched by an
+    // unregistration. Nested pipelines register a thread again.
+    int refs;
+    // The fds of the group, the leader first, or -1 if the counters
+    // couldn't be opened.
+    int fds[halide_profiler_num_counters];
+};
+
+struct PerfCounters {
+    volatile int lock;
+    bool enabled;
+    int num_threads;
+    PerfThread threads[kMaxPerfThreads];
+    // The final counts of the threads that have unregistered, so that
+    // the totals don't drop when they do.
+    uint64_t retired[halide_profiler_num_counters];
+};
+
+WEAK PerfCounters perf_counters;
+
+WEAK void perf_close_group(int *fds) {
+    for (int i = 0; i < halide_profiler_num_counters; i++) {
+        if (fds[i] >= 0) {
+            close(fds[i]);
+            fds[i] = -1;
+        }
+    }
+}
+
+// Open a group of counters for a thread of this process.
+WEAK void perf_open_group(int tid, int *fds) {
+    for (int i = 0; i < halide_profiler_num_counters; i++) {
+        fds[i] = -1;
+    }
+    int leader = -1;
+    for (int i = 0; i < halide_profiler_num_counters; i++) {
+        perf_event_attr_ver0 attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type = kPerfTypeHardware;
+        attr.size = sizeof(attr);
+        attr.config = perf_event_configs[i];
+        attr.read_format = kPerfFormatGroup;
+        // Leaving out the kernel keeps this working for unprivileged
+        // users under the default perf_event_paranoid setting.
+        attr.flags = kPerfFlagExcludeKernel | kPerfFlagExcludeHV;
+        int fd = syscall(SYS_PERF_EVENT_OPEN, &attr, tid, -1, leader, 0);
+        if (fd < 0) {
+            // Counting only some of the events would misattribute
+            // the rest, so give up on this thread.
+            perf_close_group(fds);
+            return;
+        }
+        fds[i] = fd;
+        if (leader < 0) {
+            leader = fd;
+        }
+    }
+}
+
+// Add the current counts of a thread to the totals. Returns false if
+// they couldn't be read.
+WEAK bool perf_read_group(const PerfThread *t, uint64_t *totals) {
+    if (t->fds[0] < 0) {
+        return false;
+    }
+    // Laid out as the number of counters, and then their values.
+    uint64_t values[1 + halide_profiler_num_counters];
+    if (read(t->fds[0], values, sizeof(values)) != (ssize_t)sizeof(values)) {
+        return false;
+    }
+    for (int j = 0; j < halide_profiler_num_counters; j++) {
+        totals[j] += values[1 + j];
+    }
+    return true;
+}
+
+}}} // namespace Halide::Runtime::Internal
+
+extern "C" {
+
+WEAK void halide_perf_counters_register_thread() {
+    int tid = syscall(SYS_GETTID);
+    ScopedSpinLock lock(&perf_counters.lock);
+    for (int i = 0; i < perf_counters.num_threads; i++) {
+        if (perf_counters.threads[i].tid == tid) {
+            perf_counters.threads[i].refs++;
+            return;
+        }
+    }
+    if (perf_counters.num_threads == kMaxPerfThreads) {
+        return;
+    }
+    PerfThread *t = &perf_counters.threads[perf_counters.num_threads++];
+    t->tid = tid;
+    t->refs = 1;
+    if (perf_counters.enabled) {
+        perf_open_group(tid, t->fds);
+    } else {
+        for (int j = 0; j < halide_profiler_num_counters; j++) {
+            t->fds[j] = -1;
+        }
+    }
+}
+
+WEAK void halide_perf_counters_unregister_thread() {
+    int tid = syscall(SYS_GETTID);
+    ScopedSpinLock lock(&perf_counters.lock);
+    for (int i = 0; i < perf_counters.num_threads; i++) {
+        PerfThread *t = &perf_counters.threads[i];
+        if (t->tid != tid) {
+            continue;
+        }
+        if (--t->refs == 0) {
+            // Keep what the thread counted, and forget about it, so
+            // that its tid can be used by a new thread.
+            perf_read_group(t, perf_counters.retired);
+            perf_close_group(t->fds);
+            *t = perf_counters.threads[--perf_counters.num_threads];
+        }
+        return;
+    }
+}
+
+WEAK bool halide_perf_counters_enable() {
+    ScopedSpinLock lock(&perf_counters.lock);
+    if (!perf_counters.enabled) {
+        perf_counters.enabled = true;
+        // Threads registered so far start counting now.
+        for (int i = 0; i < perf_counters.num_threads; i++) {
+            perf_open_group(perf_counters.threads[i].tid, perf_counters.threads[i].fds);
+        }
+    }
+    for (int i = 0; i < perf_counters.num_threads; i++) {
+        if (perf_counters.threads[i].fds[0] >= 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+WEAK void halide_perf_counters_read(uint64_t *totals) {
+    ScopedSpinLock lock(&perf_counters.lock);
+    for (int j = 0; j < halide_profiler_num_counters; j++) {
+        totals[j] = perf_counters.retired[j];
+    }
+    for (int i = 0; i < perf_counters.num_threads; i++) {
+        perf_read_group(&perf_counters.threads[i], totals);
+    }
+}
+
+}
@@ -0,0 +1,330 @@
+#include "HalideRuntime.h"
+#include "runtime_internal.h"
+#include "scoped_spin_lock.h"
+
+// An allocator that keeps freed blocks in free lists by size class,
+// and hands them out again to later allocations, including ones made
+// by later runs of the pipeline. Large blocks are mapped directly,
+// backed by huge pages if the system has them. Used in place of
+// posix_allocator when targeting Linux or Android with the
+// pooled_malloc feature. The mmap constants below are Linux's.
+
+extern "C" {
+
+extern void *malloc(size_t);
+extern void free(void *);
+extern void *mmap(void *, size_t, int, int, int, long);
+extern int munmap(void *, size_t);
+extern int madvise(void *, size_t, int);
+
+#define HALIDE_POOL_PROT_READ_WRITE 3
+#define HALIDE_POOL_MAP_PRIVATE_ANONYMOUS 0x22
+#define HALIDE_POOL_MAP_HUGETLB 0x40000
+#define HALIDE_POOL_MAP_FAILED ((void *)-1)
+#define HALIDE_POOL_MADV_HUGEPAGE 14
+
+}
+
+namespace Halide { namespace Runtime { namespace Internal {
+
+// The alignment of the pointers returned, as in posix_allocator.
+const size_t kPoolAlignment = 128;
+
+// Size classes are spaced four to each power of two from 256 bytes
+// (at most 25% waste) up to 1GB. Larger blocks aren't pooled.
+const int kPoolMinClassBits = 8;
+const int kPoolMaxClassBits = 30;
+const int kPoolNumClasses = 1 + (kPoolMaxClassBits - kPoolMinClassBits) * 4;
+
+// Free lists are sharded by a hash of the calling thread's id, so
+// that threads rarely contend for a shard's lock, and a thread that
+// frees a block it allocated puts it back where it will find it
+// again.
+const int kPoolNumShardBits = 4;
+const int kPoolNumShards = 1 << kPoolNumShardBits;
+
+const size_t kHugePageSize = 2 * 1024 * 1024;
+
+enum PoolMapping {
+    // From malloc.
+    kPoolNotMapped = 0,
+    // Mapped from the huge pages reserved with MAP_HUGETLB.
+    kPoolMappedHugeTLB = 1,
+    // Mapped from ordinary pages, with madvise asking for transparent
+    // huge pages, which the kernel may or may not provide.
+    kPoolMappedAdvised = 2
+};
+
+// Stored just before each pointer returned.
+struct PoolBlockHeader {
+    // The start of the underlying allocation.
+    void *orig;
+    // The size of the underlying allocation.
+    size_t block_size;
+    // The size class, or -1 if the block isn't pooled.
+    int32_t size_class;
+    // How the block was allocated: one of PoolMapping.
+    int32_t mapped;
+    // The next block in a free list.
+    PoolBlockHeader *next;
+};
+
+struct PoolShard {
+    volatile int lock;
+    PoolBlockHeader *free_blocks[kPoolNumClasses];
+} __attribute__((aligned(64)));
+
+WEAK PoolShard pool_shards[kPoolNumShards];
+
+// The most bytes the free lists hold. Blocks freed beyond that go
+// back to the system.
+WEAK int64_t pool_max_cached_bytes = 256 * 1024 * 1024;
+
+// Blocks at least this large are mapped directly. Zero disables it.
+WEAK size_t pool_huge_page_threshold = kHugePageSize;
+
+// Cleared after the first MAP_HUGETLB failure, which means the system
+// has no huge pages reserved. Transparent huge pages are asked for
+// instead.
+WEAK bool pool_try_hugetlb = true;
+
+WEAK halide_pooled_malloc_stats_t pool_stats;
+
+WEAK PoolBlockHeader *pool_header(void *ptr) {
+    return ((PoolBlockHeader *)ptr) - 1;
+}
+
+WEAK PoolShard *pool_shard_for_this_thread() {
+    if (!halide_host_current_thread_id) {
+        return &pool_shards[0];
+    }
+    uint64_t x = halide_host_current_thread_id();
+    x *= 0x9e3779b97f4a7c15ULL;
+    return &pool_shards[x >> (64 - kPoolNumShardBits)];
+}
+
+WEAK int pool_size_class(size_t bytes) {
+    if (bytes <= ((size_t)1 << kPoolMinClassBits)) {
+        return 0;
+    }
+    int bits = 63 - __builtin_clzll((uint64_t)(bytes - 1));
+    if (bits >= kPoolMaxClassBits) {
+        return -1;
+    }
+    size_t sub = ((bytes - 1) - ((size_t)1 << bits)) >> (bits - 2);
+    return 1 + (bits - kPoolMinClassBits) * 4 + (int)sub;
+}
+
+WEAK size_t pool_class_size(int size_class) {
+    if (size_class == 0) {
+        return (size_t)1 << kPoolMinClassBits;
+    }
+    int bits = kPoolMinClassBits + (size_class - 1) / 4;
+    size_t sub = (size_class - 1) % 4;
+    return ((size_t)1 << bits) + ((sub + 1) << (bits - 2));
+}
+
+// Map a block, and set how it was mapped.
+WEAK void *pool_map(size_t bytes, int32_t *mapping) {
+    if (pool_try_hugetlb) {
+        void *orig = mmap(NULL, bytes, HALIDE_POOL_PROT_READ_WRITE,
+                          HALIDE_POOL_MAP_PRIVATE_ANONYMOUS | HALIDE_POOL_MAP_HUGETLB, -1, 0);
+        if (orig != HALIDE_POOL_MAP_FAILED) {
+            *mapping = kPoolMappedHugeTLB;
+            return orig;
+        }
+        pool_try_hugetlb = false;
+    }
+    void *orig = mmap(NULL, bytes, HALIDE_POOL_PROT_READ_WRITE,
+                      HALIDE_POOL_MAP_PRIVATE_ANONYMOUS, -1, 0);
+    if (orig == HALIDE_POOL_MAP_FAILED) {
+        return NULL;
+    }
+    madvise(orig, bytes, HALIDE_POOL_MADV_HUGEPAGE);
+    *mapping = kPoolMappedAdvised;
+    return orig;
+}
+
+WEAK int64_t *pool_mapped_bytes_stat(int32_t mapping) {
+    return mapping == kPoolMappedHugeTLB ? &pool_stats.huge_page_bytes : &pool_stats.thp_advised_bytes;
+}
+
+// Get a new block of the given size from the system, and set up its
+// header.
+WEAK void *pool_allocate_block(size_t block_size, int size_class) {
+    int32_t mapped = kPoolNotMapped;
+    void *orig;
+    void *ptr;
+    if (pool_huge_page_threshold != 0 && block_size >= pool_huge_page_threshold) {
+        block_size = (block_size + kHugePageSize - 1) & ~(kHugePageSize - 1);
+        orig = pool_map(block_size, &mapped);
+        if (orig == NULL) {
+            return NULL;
+        }
+        ptr = (uint8_t *)orig + kPoolAlignment;
+        __sync_fetch_and_add(pool_mapped_bytes_stat(mapped), (int64_t)block_size);
+    } else {
+        orig = malloc(block_size);
+        if (orig == NULL) {
+            return NULL;
+        }
+        ptr = (void *)(((size_t)orig + sizeof(PoolBlockHeader) + kPoolAlignment - 1) & ~(kPoolAlignment - 1));
+    }
+    PoolBlockHeader *header = pool_header(ptr);
+    header->orig = orig;
+    header->block_size = block_size;
+    header->size_class = size_class;
+    header->mapped = mapped;
+    header->next = NULL;
+    __sync_fetch_and_add(&pool_stats.system_allocations, 1);
+    return ptr;
+}
+
+WEAK void pool_free_block(PoolBlockHeader *header) {
+    if (header->mapped != kPoolNotMapped) {
+        __sync_fetch_and_sub(pool_mapped_bytes_stat(header->mapped), (int64_t)header->block_size);
+        munmap(header->orig, header->block_size);
+    } else {
+        free(header->orig);
+    }
+}
+
+}}} // namespace Halide::Runtime::Internal
+
+extern "C" {
+
+WEAK void *halide_default_malloc(void *user_context, size_t x) {
+    // Leave room for the header and for aligning the pointer.
+    size_t needed = x + sizeof(PoolBlockHeader) + kPoolAlignment - 1;
+    int size_class = pool_size_class(needed);
+    __sync_fetch_and_add(&pool_stats.allocations, 1);
+
+    void *ptr = NULL;
+    if (size_class >= 0) {
+        PoolShard *shard = pool_shard_for_this_thread();
+        PoolBlockHeader *header = NULL;
+        {
+            ScopedSpinLock lock(&shard->lock);
+            header = shard->free_blocks[size_class];
+            if (header) {
+                shard->free_blocks[size_class] = header->next;
+            }
+        }
+        if (header) {
+            __sync_fetch_and_add(&pool_stats.pool_hits, 1);
+            __sync_fetch_and_sub(&pool_stats.bytes_cached, (int64_t)header->block_size);
+            ptr = header + 1;
+        } else {
+            ptr = pool_allocate_block(pool_class_size(size_class), size_class);
+        }
+    } else {
+        ptr = pool_allocate_block(needed, size_class);
+    }
+
+    if (ptr == NULL) {
+        // Will result in a failed assertion and a call to halide_error
+        return NULL;
+    }
+    __sync_fetch_and_add(&pool_stats.bytes_in_use, (int64_t)pool_header(ptr)->block_size);
+    return ptr;
+}
+
+WEAK void halide_default_free(void *user_context, void *ptr) {
+    PoolBlockHeader *header = pool_header(ptr);
+    int64_t block_size = (int64_t)header->block_size;
+    __sync_fetch_and_sub(&pool_stats.bytes_in_use, block_size);
+
+    // Keep the block for reuse if there's room in the pool.
+    if (header->size_class >= 0 &&
+        __sync_add_and_fetch(&pool_stats.bytes_cached, block_size) <= pool_max_cached_bytes) {
+        PoolShard *shard = pool_shard_for_this_thread();
+        ScopedSpinLock lock(&shard->lock);
+        header->next = shard->free_blocks[header->size_class];
+        shard->free_blocks[header->size_class] = header;
+        return;
+    }
+    if (header->size_class >= 0) {
+        __sync_fetch_and_sub(&pool_stats.bytes_cached, block_size);
+    }
+    pool_free_block(header);
+}
+
+WEAK void halide_pooled_malloc_get_stats(halide_pooled_malloc_stats_t *stats) {
+    stats->allocations = __atomic_load_n(&pool_stats.allocations, __ATOMIC_RELAXED);
+    stats->pool_hits = __atomic_load_n(&pool_stats.pool_hits, __ATOMIC_RELAXED);
+    stats->system_allocations = __atomic_load_n(&pool_stats.system_allocations, __ATOMIC_RELAXED);
+    stats->bytes_in_use = __atomic_load_n(&pool_stats.bytes_in_use, __ATOMIC_RELAXED);
+    stats->bytes_cached = __atomic_load_n(&pool_stats.bytes_cached, __ATOMIC_RELAXED);
+    stats->huge_page_bytes = __atomic_load_n(&pool_stats.huge_page_bytes, __ATOMIC_RELAXED);
+    stats->thp_advised_bytes = __atomic_load_n(&pool_stats.thp_advised_bytes, __ATOMIC_RELAXED);
+}
+
+WEAK void halide_pooled_malloc_set_limits(int64_t max_cached_bytes, int64_t huge_page_threshold) {
+    pool_max_cached_bytes = max_cached_bytes;
+    pool_huge_page_threshold = huge_page_threshold > 0 ? (size_t)huge_page_threshold : 0;
+    if (max_cached_bytes <= 0) {
+        halide_pooled_malloc_release_unused();
+    }
+}
+
+WEAK void halide_pooled_malloc_release_unused() {
+    for (int s = 0; s < kPoolNumShards; s++) {
+        PoolShard *shard = &pool_shards[s];
+        for (int c = 0; c < kPoolNumClasses; c++) {
+            PoolBlockHeader *header;
+            {
+                ScopedSpinLock lock(&shard->lock);
+                header = shard->free_blocks[c];
+                shard->free_blocks[c] = NULL;
+            }
+            while (header) {
+                PoolBlockHeader *next = header->next;
+                __sync_fetch_and_sub(&pool_stats.bytes_cached, (int64_t)header->block_size);
+                pool_free_block(header);
+                header = next;
+            }
+        }
+    }
+}
+
+namespace {
+
+__attribute__((destructor))
+WEAK void halide_pooled_malloc_cleanup() {
+    halide_pooled_malloc_release_unused();
+}
+
+}
+
+}
+
+namespace Halide { namespace Runtime { namespace Internal {
+
+WEAK halide_malloc_t custom_malloc = halide_default_malloc;
+WEAK halide_free_t custom_free = halide_default_free;
+
+}}} // namespace Halide::Runtime::Internal
+
+extern "C" {
+
+WEAK halide_malloc_t halide_set_custom_malloc(halide_malloc_t user_malloc) {
+    halide_malloc_t result = custom_malloc;
+    custom_malloc = user_malloc;
+    return result;
+}
+
+WEAK halide_free_t halide_set_custom_free(halide_free_t user_free) {
+    halide_free_t result = custom_free;
+    custom_free = user_free;
+    return result;
+}
+
+WEAK void *halide_malloc(void *user_context, size_t x) {
+    return custom_malloc(user_context, x);
+}
+
+WEAK void halide_free(void *user_context, void *ptr) {
+    custom_free(user_context, ptr);
+}
+
+}
@@ -20,6 +20,7 @@ typedef long pthread_t;
 extern int pthread_create(pthread_t *, const void * attr,
                           void *(*start_routine)(void *), void * arg);
 extern int pthread_join(pthread_t thread, void **retval);
+extern pthread_t pthread_self();
 extern int pthread_cond_init(halide_cond *cond, const void *attr);
 extern int pthread_cond_wait(halide_cond *cond, halide_mutex *mutex);
 extern int pthread_cond_broadcast(halide_cond *cond);
@@ -29,6 +30,11 @@ extern int pthread_mutex_lock(halide_mutex *mutex);
 extern int pthread_mutex_unlock(halide_mutex *mutex);
 extern int pthread_mutex_destroy(halide_mutex *mutex);
 
+// The topology and affinity functions below are Linux-specific, which
+// is fine because this module is only used on Linux and Android.
+extern int sched_getcpu();
+extern int sched_setaffinity(int pid, size_t cpusetsize, const void *mask);
+
 } // extern "C"
 
 namespace Halide { namespace Runtime { namespace Internal {
@@ -42,6 +48,64 @@ WEAK void *spawn_thread_helper(void *arg) {
     t->f(t->closure);
     return NULL;
 }
+
+// Read a list of ids in the format used by sysfs, e.g. "0-3,8-11", and
+// call f(id, arg) for each of them. Returns false if the file can't
+// be read.
+WEAK bool read_sysfs_id_list(const char *path, void (*f)(int, void *), void *arg) {
+    void *file = fopen(path, "r");
+    if (!file) {
+        return false;
+    }
+    char buf[4096];
+    size_t n = fread(buf, 1, sizeof(buf) - 1, file);
+    fclose(file);
+    buf[n] = 0;
+
+    const char *c = buf;
+    while (*c >= '0' && *c <= '9') {
+        int lo = atoi(c), hi = lo;
+        while (*c >= '0' && *c <= '9') c++;
+        if (*c == '-') {
+            c++;
+            hi = atoi(c);
+            while (*c >= '0' && *c <= '9') c++;
+        }
+        for (int id = lo; id <= hi; id++) {
+            f(id, arg);
+        }
+        if (*c == ',') {
+            c++;
+        }
+    }
+    return true;
+}
+
+struct cpu_nodes_state {
+    int *cpu_nodes;
+    int max_cpus;
+    int node;
+    int num_found;
+};
+
+WEAK void set_cpu_node(int cpu, void *arg) {
+    cpu_nodes_state *state = (cpu_nodes_state *)arg;
+    if (cpu < state->max_cpus) {
+        state->cpu_nodes[cpu] = state->node;
+        state->num_found++;
+    }
+}
+
+WEAK void read_node_cpus(int node, void *arg) {
+    cpu_nodes_state *state = (cpu_nodes_state *)arg;
+    char path[128];
+    char *dst = halide_string_to_string(path, path + sizeof(path), "/sys/devices/system/node/node");
+    dst = halide_int64_to_string(dst, path + sizeof(path), node, 1);
+    halide_string_to_string(dst, path + sizeof(path), "/cpulist");
+    state->node = node;
+    read_sysfs_id_list(path, set_cpu_node, state);
+}
+
 }}} // namespace Halide::Runtime::Internal
 
 extern "C" {
@@ -91,4 +155,31 @@ WEAK void halide_cond_wait(struct halide_cond *cond, struct halide_mutex *mutex)
     pthread_cond_wait(cond, mutex);
 }
 
+WEAK int halide_host_cpu_nodes(int max_cpus, int *cpu_nodes) {
+    cpu_nodes_state state = {cpu_nodes, max_cpus, 0, 0};
+    if (!read_sysfs_id_list("/sys/devices/system/node/online", read_node_cpus, &state)) {
+        return 0;
+    }
+    return state.num_found;
+}
+
+WEAK int halide_host_current_cpu() {
+    return sched_getcpu();
+}
+
+WEAK uint64_t halide_host_current_thread_id() {
+    return (uint64_t)pthread_self();
+}
+
+WEAK int halide_pin_current_thread(int cpu) {
+    // Enough for a cpu_set_t of 4096 cpus.
+    uint64_t mask[64];
+    if (cpu < 0 || cpu >= 64 * 64) {
+        return -1;
+    }
+    memset(mask, 0, sizeof(mask));
+    mask[cpu / 64] = (uint64_t)1 << (cpu % 64);
+    return sched_setaffinity(0, sizeof(mask), mask);
+}
+
 } // extern "C"
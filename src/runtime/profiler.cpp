@@ -38,6 +38,9 @@ WEAK halide_profiler_pipeline_stats *find_or_create_pipeline(const char *pipelin
     p->num_funcs = num_funcs;
     p->runs = 0;
     p->time = 0;
+    for (int j = 0; j < halide_profiler_num_counters; j++) {
+        p->counters[j] = 0;
+    }
     p->samples = 0;
     p->memory_current = 0;
     p->memory_peak = 0;
@@ -45,6 +48,12 @@ WEAK halide_profiler_pipeline_stats *find_or_create_pipeline(const char *pipelin
     p->num_allocs = 0;
     p->active_threads_numerator = 0;
     p->active_threads_denominator = 0;
+    p->hw_kernels = NULL;
+    p->num_hw_kernels = 0;
+    p->instrumented_ticks = 0;
+    p->instrumented_ns = 0;
+    p->invocations = NULL;
+    p->tasks = NULL;
     p->funcs = (halide_profiler_func_stats *)malloc(num_funcs * sizeof(halide_profiler_func_stats));
     if (!p->funcs) {
         free(p);
@@ -52,6 +61,9 @@ WEAK halide_profiler_pipeline_stats *find_or_create_pipeline(const char *pipelin
     }
     for (int i = 0; i < num_funcs; i++) {
         p->funcs[i].time = 0;
+        for (int j = 0; j < halide_profiler_num_counters; j++) {
+            p->funcs[i].counters[j] = 0;
+        }
         p->funcs[i].name = (const char *)(func_names[i]);
         p->funcs[i].memory_current = 0;
         p->funcs[i].memory_peak = 0;
@@ -60,13 +72,15 @@ WEAK halide_profiler_pipeline_stats *find_or_create_pipeline(const char *pipelin
         p->funcs[i].stack_peak = 0;
         p->funcs[i].active_threads_numerator = 0;
         p->funcs[i].active_threads_denominator = 0;
+        p->funcs[i].invocations = NULL;
     }
     s->first_free_id += num_funcs;
     s->pipelines = p;
     return p;
 }
 
-WEAK void bill_func(halide_profiler_state *s, int func_id, uint64_t time, int active_threads) {
+WEAK void bill_func(halide_profiler_state *s, int func_id, uint64_t time, int active_threads,
+                    const uint64_t *counters) {
     halide_profiler_pipeline_stats *p_prev = NULL;
     for (halide_profiler_pipeline_stats *p = s->pipelines; p;
          p = (halide_profiler_pipeline_stats *)(p->next)) {
@@ -82,6 +96,12 @@ WEAK void bill_func(halide_profiler_state *s, int func_id, uint64_t time, int ac
             f->active_threads_numerator += active_threads;
             f->active_threads_denominator += 1;
             p->time += time;
+            if (counters) {
+                for (int j = 0; j < halide_profiler_num_counters; j++) {
+                    f->counters[j] += counters[j];
+                    p->counters[j] += counters[j];
+                }
+            }
             p->samples++;
             p->active_threads_numerator += active_threads;
             p->active_threads_denominator += 1;
@@ -102,6 +122,10 @@ WEAK void sampling_profiler_thread(void *) {
 
         uint64_t t1 = halide_current_time_ns(NULL);
         uint64_t t = t1;
+        uint64_t counters[halide_profiler_num_counters], counters_now[halide_profiler_num_counters];
+        if (s->counters_enabled) {
+            halide_perf_counters_read(counters);
+        }
         while (1) {
             int func, active_threads;
             if (s->get_remote_profiler_state) {
@@ -113,12 +137,25 @@ WEAK void sampling_profiler_thread(void *) {
                 active_threads = s->active_threads;
             }
             uint64_t t_now = halide_current_time_ns(NULL);
+            uint64_t *counters_delta = NULL;
+            if (s->counters_enabled) {
+                halide_perf_counters_read(counters_now);
+                for (int j = 0; j < halide_profiler_num_counters; j++) {
+                    // The totals only drop if a thread's counters
+                    // can't be read.
+                    uint64_t now = counters_now[j];
+                    counters_now[j] = now > counters[j] ? now - counters[j] : 0;
+                    counters[j] = now;
+                }
+                counters_delta = counters_now;
+            }
             if (func == halide_profiler_please_stop) {
                 break;
             } else if (func >= 0) {
                 // Assume all time since I was last awake is due to
-                // the currently running func.
-                bill_func(s, func, t_now - t, active_threads);
+                // the currently running func. The same goes for the
+                // counters, which are summed over all threads.
+                bill_func(s, func, t_now - t, active_threads, counters_delta);
             }
             t = t_now;
 
@@ -135,6 +172,35 @@ WEAK void sampling_profiler_thread(void *) {
     halide_mutex_unlock(&s->lock);
 }
 
+// Allocate the distributions that instrumented runs of a pipeline
+// fill in: one for its runs, one for its parallel tasks, and one per
+// Func. They're allocated together, and freed with p->invocations.
+WEAK bool create_distributions(halide_profiler_pipeline_stats *p) {
+    size_t count = 2 + p->num_funcs;
+    halide_profiler_distribution *d =
+        (halide_profiler_distribution *)malloc(count * sizeof(halide_profiler_distribution));
+    if (!d) return false;
+    memset(d, 0, count * sizeof(halide_profiler_distribution));
+    for (size_t i = 0; i < count; i++) {
+        d[i].min = (uint64_t)-1;
+    }
+    p->invocations = d;
+    p->tasks = d + 1;
+    for (int i = 0; i < p->num_funcs; i++) {
+        p->funcs[i].invocations = d + 2 + i;
+    }
+    return true;
+}
+
+// As read by the instrumented pipeline (see profiler_inlined.cpp).
+WEAK uint64_t instrument_ticks(int cycle_counter) {
+    if (cycle_counter) {
+        return __builtin_readcyclecounter();
+    } else {
+        return halide_current_time_ns(NULL);
+    }
+}
+
 }}}
 
 namespace {
@@ -151,6 +217,93 @@ void sync_compare_max_and_swap(T *ptr, T val) {
     }
 }
 
+template <typename T>
+void sync_compare_min_and_swap(T *ptr, T val) {
+    T old_val = *ptr;
+    while (val < old_val) {
+        T temp = old_val;
+        old_val = __sync_val_compare_and_swap(ptr, old_val, val);
+        if (temp == old_val) {
+            return;
+        }
+    }
+}
+
+// The parallel tasks of a run record into the same distribution
+// concurrently.
+void record_duration(halide_profiler_distribution *d, uint64_t ticks) {
+    int bucket = (int)ticks;
+    if (ticks >= 4) {
+        int bits = 63 - __builtin_clzll(ticks);
+        bucket = bits * 4 + (int)((ticks >> (bits - 2)) & 3);
+    }
+    __sync_fetch_and_add(&d->count, 1);
+    __sync_fetch_and_add(&d->sum, ticks);
+    __sync_fetch_and_add(&d->buckets[bucket], 1);
+    sync_compare_min_and_swap(&d->min, ticks);
+    sync_compare_max_and_swap(&d->max, ticks);
+}
+
+// An upper bound on the given percentile of a distribution: the
+// largest duration of the bucket it falls in.
+uint64_t distribution_percentile(const halide_profiler_distribution *d, int percent) {
+    uint64_t rank = (d->count * percent + 99) / 100;
+    uint64_t seen = 0;
+    for (int b = 0; b < halide_profiler_distribution_buckets; b++) {
+        seen += d->buckets[b];
+        if (seen >= rank) {
+            if (b < 8) {
+                return b;
+            }
+            int bits = b / 4;
+            uint64_t bound = ((uint64_t)(4 + b % 4 + 1) << (bits - 2)) - 1;
+            return bound < d->max ? bound : d->max;
+        }
+    }
+    return d->max;
+}
+
+// Print the minimum, mean and 99th percentile of a distribution in
+// milliseconds.
+template <typename StringStream>
+void print_distribution(StringStream &sstr, const char *label,
+                        const halide_profiler_distribution *d, double ns_per_tick) {
+    double ms_per_tick = ns_per_tick / 1000000.0;
+    sstr << label << " min: " << (float)(d->min * ms_per_tick);
+    sstr.erase(3);
+    sstr << "ms  mean: " << (float)((double)d->sum / d->count * ms_per_tick);
+    sstr.erase(3);
+    sstr << "ms  p99: " << (float)(distribution_percentile(d, 99) * ms_per_tick);
+    sstr.erase(3);
+    sstr << "ms\n";
+}
+
+// Print the hardware counters per run, with the instructions per
+// cycle and the misses per thousand instructions, which tell compute
+// bound stages from memory bound ones. The counters are summed over
+// all threads, but billed to the one Func being profiled, so a Func's
+// counters also include whatever other threads were doing while it
+// ran. Those are marked approximate.
+template <typename StringStream>
+void print_counters(StringStream &sstr, const char *indent, const uint64_t *counters, int runs,
+                    bool approximate) {
+    uint64_t cycles = counters[halide_profiler_cycles];
+    uint64_t instructions = counters[halide_profiler_instructions];
+    float ipc = cycles ? (float)instructions / cycles : 0.0f;
+    float kinst = instructions / 1000.0f + 1e-10f;
+    sstr << indent << "cycles/run: " << cycles / runs
+         << "  ipc: " << ipc;
+    sstr.erase(4);
+    sstr << "  llc misses/kinst: " << counters[halide_profiler_llc_misses] / kinst;
+    sstr.erase(4);
+    sstr << "  branch misses/kinst: " << counters[halide_profiler_branch_misses] / kinst;
+    sstr.erase(4);
+    if (approximate) {
+        sstr << "  (approximate)";
+    }
+    sstr << "\n";
+}
+
 }
 
 extern "C" {
@@ -180,7 +333,19 @@ WEAK int halide_profiler_pipeline_start(void *user_context,
 
     ScopedMutexLock lock(&s->lock);
 
+    // The threads running Halide code count towards the hardware
+    // counters, if they're supported.
+    if (halide_perf_counters_register_thread) {
+        halide_perf_counters_register_thread();
+    }
+
     if (!s->started) {
+        if (!s->counters_enabled && halide_perf_counters_enable) {
+            const char *counters_str = getenv("HL_PROFILER_COUNTERS");
+            if (counters_str && atoi(counters_str)) {
+                s->counters_enabled = halide_perf_counters_enable();
+            }
+        }
         halide_start_clock(user_context);
         halide_spawn_thread(sampling_profiler_thread, NULL);
         s->started = true;
@@ -197,6 +362,93 @@ WEAK int halide_profiler_pipeline_start(void *user_context,
     return p->first_func_id;
 }
 
+// The counterpart of halide_profiler_pipeline_start for pipelines
+// compiled with the profile_instrumented target flag, which time
+// themselves, so it doesn't start the profiler thread.
+WEAK int halide_profiler_instrument_pipeline_start(void *user_context,
+                                                   const char *pipeline_name,
+                                                   int num_funcs,
+                                                   const uint64_t *func_names) {
+    halide_profiler_state *s = halide_profiler_get_state();
+
+    ScopedMutexLock lock(&s->lock);
+
+    // Registered the same way as for the sampling profiler, as both
+    // unregister in halide_profiler_pipeline_end.
+    if (halide_perf_counters_register_thread) {
+        halide_perf_counters_register_thread();
+    }
+
+    if (!s->instrumented) {
+        halide_start_clock(user_context);
+        s->instrumented = true;
+    }
+
+    halide_profiler_pipeline_stats *p =
+        find_or_create_pipeline(pipeline_name, num_funcs, func_names);
+    if (!p || (!p->invocations && !create_distributions(p))) {
+        // Allocating space to track the statistics failed.
+        return halide_error_out_of_memory(user_context);
+    }
+    p->runs++;
+
+    return p->first_func_id;
+}
+
+// Called at the start of an instrumented run, with the run's state on
+// the pipeline's stack, followed by space for a tick count per Func.
+WEAK int halide_profiler_instrument_run_start(void *user_context,
+                                              halide_profiler_instrument_run *run,
+                                              void *pipeline_state,
+                                              int num_funcs,
+                                              int cycle_counter) {
+    halide_profiler_pipeline_stats *p_stats = (halide_profiler_pipeline_stats *) pipeline_state;
+    halide_assert(user_context, p_stats != NULL);
+
+    run->pipeline = p_stats;
+    run->func_ticks = (uint64_t *)(run + 1);
+    memset(run->func_ticks, 0, num_funcs * sizeof(uint64_t));
+    run->num_funcs = num_funcs;
+    run->cycle_counter = cycle_counter;
+    run->start_ns = halide_current_time_ns(user_context);
+    run->start_ticks = instrument_ticks(cycle_counter);
+    return 0;
+}
+
+// Registered as a destructor of an instrumented run, so that runs that
+// fail are counted too. Converts the ticks billed to each Func to time
+// at the rate the timestamp advanced over the run.
+WEAK void halide_profiler_instrument_run_end(void *user_context, void *obj) {
+    halide_profiler_instrument_run *run = (halide_profiler_instrument_run *)obj;
+    uint64_t ticks = instrument_ticks(run->cycle_counter) - run->start_ticks;
+    uint64_t ns = halide_current_time_ns(user_context) - run->start_ns;
+    double ns_per_tick = ticks ? (double)ns / ticks : 0.0;
+
+    halide_profiler_state *s = halide_profiler_get_state();
+    ScopedMutexLock lock(&s->lock);
+
+    halide_profiler_pipeline_stats *p = run->pipeline;
+    p->time += ns;
+    p->instrumented_ticks += ticks;
+    p->instrumented_ns += ns;
+    record_duration(p->invocations, ticks);
+    for (int i = 0; i < run->num_funcs; i++) {
+        uint64_t func_ticks = run->func_ticks[i];
+        if (func_ticks) {
+            halide_profiler_func_stats *f = p->funcs + i;
+            f->time += (uint64_t)(func_ticks * ns_per_tick);
+            record_duration(f->invocations, func_ticks);
+        }
+    }
+}
+
+// Called at the end of each task of a parallel loop of an instrumented
+// run, once the task has stopped billing Funcs.
+WEAK int halide_profiler_instrument_task_end(halide_profiler_instrument_task *task) {
+    record_duration(task->run->pipeline->tasks, task->last_ticks - task->start_ticks);
+    return 0;
+}
+
 WEAK void halide_profiler_stack_peak_update(void *user_context,
                                             void *pipeline_state,
                                             uint64_t *f_values) {
@@ -283,6 +535,57 @@ WEAK void halide_profiler_memory_free(void *user_context,
     __sync_sub_and_fetch(&f_stats->memory_current, decr);
 }
 
+WEAK int halide_profiler_hw_kernels_update(void *user_context,
+                                           void *pipeline_state,
+                                           int num_kernels,
+                                           const uint64_t *kernel_names,
+                                           const uint64_t *counters) {
+    halide_profiler_pipeline_stats *p_stats = (halide_profiler_pipeline_stats *) pipeline_state;
+    halide_assert(user_context, p_stats != NULL);
+
+    halide_profiler_state *s = halide_profiler_get_state();
+    ScopedMutexLock lock(&s->lock);
+
+    // The counters are laid out as {active, stalled_in, stalled_out}
+    // per kernel. A pipeline may run several accelerators, so new
+    // kernels are appended to the ones seen before.
+    for (int i = 0; i < num_kernels; i++) {
+        const char *name = (const char *)(kernel_names[i]);
+        halide_profiler_hw_kernel_stats *k = NULL;
+        for (int j = 0; j < p_stats->num_hw_kernels; j++) {
+            // Kernel names are global constant strings, so they can be
+            // compared by pointer.
+            if (p_stats->hw_kernels[j].name == name) {
+                k = p_stats->hw_kernels + j;
+                break;
+            }
+        }
+        if (!k) {
+            int n = p_stats->num_hw_kernels;
+            halide_profiler_hw_kernel_stats *kernels =
+                (halide_profiler_hw_kernel_stats *)malloc((n + 1) * sizeof(halide_profiler_hw_kernel_stats));
+            if (!kernels) {
+                return halide_error_out_of_memory(user_context);
+            }
+            if (n) {
+                memcpy(kernels, p_stats->hw_kernels, n * sizeof(halide_profiler_hw_kernel_stats));
+            }
+            free(p_stats->hw_kernels);
+            p_stats->hw_kernels = kernels;
+            p_stats->num_hw_kernels = n + 1;
+            k = kernels + n;
+            k->active = 0;
+            k->stalled_in = 0;
+            k->stalled_out = 0;
+            k->name = name;
+        }
+        k->active += counters[3*i];
+        k->stalled_in += counters[3*i + 1];
+        k->stalled_out += counters[3*i + 2];
+    }
+    return 0;
+}
+
 WEAK void halide_profiler_report_unlocked(void *user_context, halide_profiler_state *s) {
 
     char line_buf[1024];
@@ -299,16 +602,34 @@ WEAK void halide_profiler_report_unlocked(void *user_context, halide_profiler_st
         }
         bool serial = p->active_threads_numerator == p->active_threads_denominator;
         float threads = p->active_threads_numerator / (p->active_threads_denominator + 1e-10);
+        // Instrumented runs take no samples, and bill each thread's
+        // time to the Func it's in.
+        bool instrumented = p->invocations && p->invocations->count;
+        double ns_per_tick = 0.0;
+        if (instrumented) {
+            ns_per_tick = (double)p->instrumented_ns / (p->instrumented_ticks + 1e-10);
+        }
         sstr << p->name << "\n"
-             << " total time: " << t << " ms"
-             << "  samples: " << p->samples
-             << "  runs: " << p->runs
+             << " total time: " << t << " ms";
+        if (!instrumented) {
+            sstr << "  samples: " << p->samples;
+        }
+        sstr << "  runs: " << p->runs
              << "  time/run: " << t / p->runs << " ms\n";
-        if (!serial) {
+        if (instrumented) {
+            print_distribution(sstr, " time/run", p->invocations, ns_per_tick);
+            if (p->tasks->count) {
+                sstr << " parallel tasks: " << p->tasks->count;
+                print_distribution(sstr, "  time/task", p->tasks, ns_per_tick);
+            }
+        } else if (!serial) {
             sstr << " average threads used: " << threads << "\n";
         }
         sstr << " heap allocations: " << p->num_allocs
              << "  peak heap usage: " << p->memory_peak << " bytes\n";
+        if (s->counters_enabled) {
+            print_counters(sstr, " ", p->counters, p->runs, false);
+        }
         halide_print(user_context, sstr.str());
 
         bool print_f_states = p->time || p->memory_total;
@@ -322,6 +643,17 @@ WEAK void halide_profiler_report_unlocked(void *user_context, halide_profiler_st
             }
         }
 
+        // The percentages of instrumented runs are of the thread time
+        // billed to all Funcs, which exceeds the pipeline's time when
+        // it runs parallel loops.
+        uint64_t total_time = p->time;
+        if (instrumented) {
+            total_time = 0;
+            for (int i = 0; i < p->num_funcs; i++) {
+                total_time += p->funcs[i].time;
+            }
+        }
+
         if (print_f_states) {
             for (int i = 0; i < p->num_funcs; i++) {
                 size_t cursor = 0;
@@ -345,8 +677,8 @@ WEAK void halide_profiler_report_unlocked(void *user_context, halide_profiler_st
                 while (sstr.size() < cursor) sstr << " ";
 
                 int percent = 0;
-                if (p->time != 0) {
-                    percent = (100*fs->time) / p->time;
+                if (total_time != 0) {
+                    percent = (100*fs->time) / total_time;
                 }
                 sstr << "(" << percent << "%)";
                 cursor += 8;
@@ -378,10 +710,70 @@ WEAK void halide_profiler_report_unlocked(void *user_context, halide_profiler_st
                     sstr << " stack: " << fs->stack_peak;
                 }
                 sstr << "\n";
+                if (s->counters_enabled && fs->counters[halide_profiler_cycles]) {
+                    bool shared = fs->active_threads_numerator > fs->active_threads_denominator;
+                    print_counters(sstr, "    ", fs->counters, p->runs, shared);
+                }
+                if (instrumented && fs->invocations->count) {
+                    print_distribution(sstr, "    time/run", fs->invocations, ns_per_tick);
+                }
 
                 halide_print(user_context, sstr.str());
             }
         }
+
+        if (p->num_hw_kernels) {
+            halide_print(user_context, " accelerator cycles/run:\n");
+        }
+        for (int i = 0; i < p->num_hw_kernels; i++) {
+            size_t cursor = 0;
+            sstr.clear();
+            halide_profiler_hw_kernel_stats *ks = p->hw_kernels + i;
+
+            sstr << "  " << ks->name << ": ";
+            cursor += 25;
+            while (sstr.size() < cursor) sstr << " ";
+
+            uint64_t total = ks->active + ks->stalled_in + ks->stalled_out;
+            sstr << "active: " << ks->active / p->runs;
+            cursor += 20;
+            while (sstr.size() < cursor) sstr << " ";
+
+            int percent = 0;
+            if (total != 0) {
+                percent = (100*ks->stalled_in) / total;
+            }
+            sstr << "stalled in: " << ks->stalled_in / p->runs << " (" << percent << "%)";
+            cursor += 30;
+            while (sstr.size() < cursor) sstr << " ";
+
+            percent = 0;
+            if (total != 0) {
+                percent = (100*ks->stalled_out) / total;
+            }
+            sstr << "stalled out: " << ks->stalled_out / p->runs << " (" << percent << "%)\n";
+
+            halide_print(user_context, sstr.str());
+        }
+    }
+
+    // The pooling allocator serves every pipeline, so its counters
+    // are reported once.
+    if (halide_pooled_malloc_get_stats) {
+        halide_pooled_malloc_stats_t pool;
+        halide_pooled_malloc_get_stats(&pool);
+        if (pool.allocations) {
+            int percent = (100 * pool.pool_hits) / pool.allocations;
+            sstr.clear();
+            sstr << "pooled heap allocations: " << pool.allocations
+                 << "  from pool: " << pool.pool_hits << " (" << percent << "%)"
+                 << "  from system: " << pool.system_allocations << "\n"
+                 << " in use: " << pool.bytes_in_use << " bytes"
+                 << "  cached: " << pool.bytes_cached << " bytes"
+                 << "  huge pages: " << pool.huge_page_bytes << " bytes"
+                 << "  advised: " << pool.thp_advised_bytes << " bytes\n";
+            halide_print(user_context, sstr.str());
+        }
     }
 }
 
@@ -405,6 +797,8 @@ WEAK void halide_profiler_reset() {
         halide_profiler_pipeline_stats *p = s->pipelines;
         s->pipelines = (halide_profiler_pipeline_stats *)(p->next);
         free(p->funcs);
+        free(p->hw_kernels);
+        free(p->invocations);
         free(p);
     }
     s->first_free_id = 0;
@@ -414,13 +808,15 @@ namespace {
 __attribute__((destructor))
 WEAK void halide_profiler_shutdown() {
     halide_profiler_state *s = halide_profiler_get_state();
-    if (!s->started) return;
-    s->current_func = halide_profiler_please_stop;
-    do {
-        // Memory barrier.
-        __sync_synchronize();
-    } while (s->started);
-    s->current_func = halide_profiler_outside_of_halide;
+    if (!s->started && !s->instrumented) return;
+    if (s->started) {
+        s->current_func = halide_profiler_please_stop;
+        do {
+            // Memory barrier.
+            __sync_synchronize();
+        } while (s->started);
+        s->current_func = halide_profiler_outside_of_halide;
+    }
 
     // Print results. No need to lock anything because we just shut
     // down the thread.
@@ -434,6 +830,9 @@ WEAK void halide_profiler_shutdown() {
 
 WEAK void halide_profiler_pipeline_end(void *user_context, void *state) {
     ((halide_profiler_state *)state)->current_func = halide_profiler_outside_of_halide;
+    if (halide_perf_counters_unregister_thread) {
+        halide_perf_counters_unregister_thread();
+    }
 }
 
 } // extern "C"
@@ -1,5 +1,22 @@
 #include "HalideRuntime.h"
 
+namespace Halide { namespace Runtime { namespace Internal {
+
+// The timestamp read by pipelines compiled with the
+// profile_instrumented target flag. The pipeline passes cycle_counter
+// as a constant, so only one of these survives inlining. The cycle
+// counter is only read on x86 (rdtsc), which can read it cheaply from
+// user code at a constant rate. Elsewhere this reads the clock.
+__attribute__((always_inline)) inline uint64_t inlined_instrument_ticks(int cycle_counter) {
+    if (cycle_counter) {
+        return __builtin_readcyclecounter();
+    } else {
+        return halide_current_time_ns(NULL);
+    }
+}
+
+}}}
+
 extern "C" {
 
 WEAK __attribute__((always_inline)) int halide_profiler_set_current_func(halide_profiler_state *state, int tok, int t) {
@@ -28,4 +45,30 @@ WEAK __attribute__((always_inline)) int halide_profiler_decr_active_threads(hali
     return ret;
 }
 
+WEAK __attribute__((always_inline)) int halide_profiler_instrument_task_begin(halide_profiler_instrument_task *task,
+                                                                              halide_profiler_instrument_run *run,
+                                                                              int func, int cycle_counter) {
+    uint64_t now = inlined_instrument_ticks(cycle_counter);
+    task->run = run;
+    task->start_ticks = now;
+    task->last_ticks = now;
+    task->current_func = func;
+    return 0;
+}
+
+// Bill the time since the last switch to the Func the task was in,
+// and start billing the given one (or none, if it's negative).
+WEAK __attribute__((always_inline)) int halide_profiler_instrument_switch(halide_profiler_instrument_task *task,
+                                                                          int func, int cycle_counter) {
+    uint64_t now = inlined_instrument_ticks(cycle_counter);
+    int current = task->current_func;
+    if (current >= 0) {
+        // The tasks of a parallel loop may be billing the same Func.
+        __sync_fetch_and_add(task->run->func_ticks + current, now - task->last_ticks);
+    }
+    task->current_func = func;
+    task->last_ticks = now;
+    return 0;
+}
+
 }
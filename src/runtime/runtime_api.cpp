@@ -48,6 +48,7 @@ extern "C" __attribute__((used)) void *halide_runtime_api_functions[] = {
     (void *)&halide_device_release,
     (void *)&halide_device_sync,
     (void *)&halide_device_sync_legacy,
+    (void *)&halide_do_async_fork,
     (void *)&halide_do_par_for,
     (void *)&halide_do_task,
     (void *)&halide_double_to_string,
@@ -82,6 +83,7 @@ extern "C" __attribute__((used)) void *halide_runtime_api_functions[] = {
     (void *)&halide_float16_bits_to_float,
     (void *)&halide_free,
     (void *)&halide_get_cpu_features,
+    (void *)&halide_get_cpu_topology,
     (void *)&halide_get_gpu_device,
     (void *)&halide_get_library_symbol,
     (void *)&halide_get_symbol,
@@ -105,9 +107,12 @@ extern "C" __attribute__((used)) void *halide_runtime_api_functions[] = {
     (void *)&halide_malloc,
     (void *)&halide_matlab_call_pipeline,
     (void *)&halide_memoization_cache_cleanup,
+    (void *)&halide_memoization_cache_get_stats,
     (void *)&halide_memoization_cache_lookup,
     (void *)&halide_memoization_cache_release,
+    (void *)&halide_memoization_cache_set_backing_file,
     (void *)&halide_memoization_cache_set_size,
+    (void *)&halide_memoization_cache_set_table_size,
     (void *)&halide_memoization_cache_store,
     (void *)&halide_metal_acquire_context,
     (void *)&halide_metal_detach_buffer,
@@ -150,6 +155,10 @@ extern "C" __attribute__((used)) void *halide_runtime_api_functions[] = {
     (void *)&halide_print,
     (void *)&halide_profiler_get_pipeline_state,
     (void *)&halide_profiler_get_state,
+    (void *)&halide_profiler_instrument_pipeline_start,
+    (void *)&halide_profiler_instrument_run_end,
+    (void *)&halide_profiler_instrument_run_start,
+    (void *)&halide_profiler_instrument_task_end,
     (void *)&halide_profiler_memory_allocate,
     (void *)&halide_profiler_memory_free,
     (void *)&halide_profiler_pipeline_start,
@@ -160,6 +169,11 @@ extern "C" __attribute__((used)) void *halide_runtime_api_functions[] = {
     (void *)&halide_qurt_hvx_unlock,
     (void *)&halide_qurt_hvx_unlock_as_destructor,
     (void *)&halide_release_jit_module,
+    (void *)&halide_semaphore_acquire,
+    (void *)&halide_semaphore_close,
+    (void *)&halide_semaphore_init,
+    (void *)&halide_semaphore_release,
+    (void *)&halide_set_cpu_topology,
     (void *)&halide_set_custom_can_use_target_features,
     (void *)&halide_set_custom_do_par_for,
     (void *)&halide_set_custom_do_task,
@@ -173,7 +187,9 @@ extern "C" __attribute__((used)) void *halide_runtime_api_functions[] = {
     (void *)&halide_set_error_handler,
     (void *)&halide_set_gpu_device,
     (void *)&halide_set_num_threads,
+    (void *)&halide_set_thread_pinning,
     (void *)&halide_set_trace_file,
+    (void *)&halide_set_trace_format,
     (void *)&halide_shutdown_thread_pool,
     (void *)&halide_shutdown_trace,
     (void *)&halide_sleep_ms,
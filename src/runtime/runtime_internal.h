@@ -78,6 +78,7 @@ int fileno(void *);
 int fclose(void *);
 int close(int);
 size_t fwrite(const void *, size_t, size_t, void *);
+size_t fread(void *, size_t, size_t, void *);
 ssize_t write(int fd, const void *buf, size_t bytes);
 int remove(const char *pathname);
 int ioctl(int fd, unsigned long request, ...);
@@ -110,6 +111,26 @@ WEAK void *halide_load_library(const char *name);
 // If lib is NULL, this call should be equivalent to halide_get_symbol(name).
 WEAK void *halide_get_library_symbol(void *lib, const char *name);
 
+// Map the named file into memory read/write and shared, creating it
+// or resizing it to the given size first. Returns NULL on failure, or
+// if the platform doesn't support it. Used for the memoization
+// cache's backing store.
+WEAK void *halide_map_file(void *user_context, const char *path, size_t size);
+WEAK void halide_unmap_file(void *user_context, void *addr, size_t size);
+
+struct halide_pooled_malloc_stats_t;
+// Only present when the pooling allocator is linked in.
+WEAK void halide_pooled_malloc_get_stats(halide_pooled_malloc_stats_t *stats);
+
+// Hardware counters for the profiler. Only present on some platforms.
+// Threads register themselves while they run Halide code, and once
+// enabled the counters of all registered threads, and the final counts
+// of the threads that have unregistered, are summed by _read.
+WEAK void halide_perf_counters_register_thread();
+WEAK void halide_perf_counters_unregister_thread();
+WEAK bool halide_perf_counters_enable();
+WEAK void halide_perf_counters_read(uint64_t *totals);
+
 WEAK int halide_start_clock(void *user_context);
 WEAK int64_t halide_current_time_ns(void *user_context);
 WEAK void halide_sleep_ms(void *user_context, int ms);
@@ -130,12 +151,32 @@ WEAK void halide_profiler_memory_free(void *user_context,
                                       void *pipeline_state,
                                       int func_id,
                                       uint64_t decr);
+WEAK int halide_profiler_hw_kernels_update(void *user_context,
+                                           void *pipeline_state,
+                                           int num_kernels,
+                                           const uint64_t *kernel_names,
+                                           const uint64_t *counters);
 WEAK int halide_profiler_pipeline_start(void *user_context,
                                         const char *pipeline_name,
                                         int num_funcs,
                                         const uint64_t *func_names);
+WEAK int halide_profiler_instrument_pipeline_start(void *user_context,
+                                                   const char *pipeline_name,
+                                                   int num_funcs,
+                                                   const uint64_t *func_names);
+WEAK int halide_profiler_instrument_run_start(void *user_context,
+                                              struct halide_profiler_instrument_run *run,
+                                              void *pipeline_state,
+                                              int num_funcs,
+                                              int cycle_counter);
+WEAK void halide_profiler_instrument_run_end(void *user_context, void *run);
+WEAK int halide_profiler_instrument_task_end(struct halide_profiler_instrument_task *task);
 WEAK int halide_host_cpu_count();
 
+WEAK int64_t halide_trace_timeline_start(void *user_context);
+WEAK void halide_trace_timeline_interval(void *user_context, const char *name, const char *category,
+                                         int64_t start_ns, uint64_t bytes);
+
 WEAK int halide_device_and_host_malloc(void *user_context, struct halide_buffer_t *buf,
                                        const struct halide_device_interface_t *device_interface);
 WEAK int halide_device_and_host_free(void *user_context, struct halide_buffer_t *buf);
@@ -158,6 +199,22 @@ WEAK void halide_cond_destroy(struct halide_cond *cond);
 WEAK void halide_cond_broadcast(struct halide_cond *cond);
 WEAK void halide_cond_wait(struct halide_cond *cond, struct halide_mutex *mutex);
 
+// Close a semaphore, so that any acquire that can't be satisfied
+// anymore fails instead of blocking. Registered as a destructor of
+// the tasks started by halide_do_async_fork.
+WEAK void halide_semaphore_close(void *user_context, void *sem);
+
+// CPU topology and thread pinning, as used by the common thread
+// pool. halide_host_cpu_nodes writes the NUMA node of up to max_cpus
+// cpus and returns how many it found, or zero if the OS doesn't
+// say. halide_host_current_cpu returns -1 if unknown.
+WEAK int halide_host_cpu_nodes(int max_cpus, int *cpu_nodes);
+WEAK int halide_host_current_cpu();
+WEAK int halide_pin_current_thread(int cpu);
+
+// An id of the calling thread, unique among the threads running.
+WEAK uint64_t halide_host_current_thread_id();
+
 WEAK int halide_trace_helper(void *user_context,
                              const char *func,
                              void *value, int *coords,
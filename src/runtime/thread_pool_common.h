@@ -1,19 +1,77 @@
 
 namespace Halide { namespace Runtime { namespace Internal {
 
+// The work queue and thread pool is weak, so one big work queue is shared by all halide functions
+#define MAX_THREADS 4096
+
+// Jobs are split into at most this many slices. Any further threads
+// working on a job only claim iterations from the existing slices.
+#define MAX_SLICES 256
+
+// The slices of jobs with at most this many of them live on the stack
+// of the thread calling do_par_for. Larger jobs put them on the heap.
+#define INLINE_SLICES 16
+
+// Likewise for the tasks of an async fork.
+#define INLINE_ASYNC_TASKS 8
+
+// A contiguous range of the iterations of a job. Each thread working
+// on a job owns at most one slice, from the front of which it claims
+// iterations one at a time. A thread whose slice is empty steals the
+// back half of another slice. Both operations are a compare-and-swap
+// on the packed range, so no lock is held while claiming iterations.
+struct work_slice {
+    // The unclaimed iterations [lo, hi), relative to the min of the
+    // job, packed as (hi << 32) | lo.
+    uint64_t range;
+    // The NUMA node whose threads should work on this slice, and
+    // whether a thread already owns it. Protected by the work queue
+    // mutex.
+    int node;
+    bool taken;
+    // Keep slices on separate cache lines.
+    uint8_t padding[64 - 2 * sizeof(uint64_t)];
+};
+
 struct work {
     work *next_job;
     int (*f)(void *, int, uint8_t *);
     void *user_context;
-    int next, max;
+    int min;
     uint8_t *closure;
+    // The number of iterations that have not yet completed. Updated
+    // atomically by each thread as it stops working on the job.
+    int remaining;
+    // The following fields are protected by the work queue mutex.
+    int num_slices, owner_slice;
     int active_workers;
+    bool queued;
     int exit_status;
-    bool running() { return next < max || active_workers > 0; }
+    work_slice *slices;
+    bool running() {
+        return __atomic_load_n(&remaining, __ATOMIC_ACQUIRE) > 0 || active_workers > 0;
+    }
+};
+
+// A task started by halide_do_async_fork. Each one runs on its own
+// helper thread, because it may block on a semaphore until another
+// task of the same fork makes progress.
+struct async_task {
+    async_task *next;
+    int (*f)(void *, int, uint8_t *);
+    void *user_context;
+    int idx;
+    uint8_t *closure;
+    int result;
+    bool done;
+};
+
+// The representation of halide_semaphore_t.
+struct semaphore_impl {
+    int value;
+    int closed;
 };
 
-// The work queue and thread pool is weak, so one big work queue is shared by all halide functions
-#define MAX_THREADS 64
 struct work_queue_t {
     // all fields are protected by this mutex.
     halide_mutex mutex;
@@ -40,11 +98,36 @@ struct work_queue_t {
     halide_cond wakeup_b_team;
 
     // Keep track of threads so they can be joined at shutdown
-    halide_thread *threads[MAX_THREADS];
+    halide_thread **threads;
+    int threads_capacity;
 
     // The number threads created
     int threads_created;
 
+    // The NUMA node of each cpu, numbered densely from zero.
+    int *cpu_nodes;
+    int num_cpus, num_nodes;
+
+    // Whether worker threads should be pinned to cpus when they are
+    // spawned, and whether that has been decided yet.
+    bool pin_threads, pin_threads_initialized;
+
+    // Tasks of async forks waiting for a helper thread.
+    async_task *async_tasks;
+
+    // The number of helper threads not running a task, minus the
+    // number of waiting tasks. Kept non-negative by spawning helper
+    // threads, so every task gets a thread of its own.
+    int num_async_idle;
+
+    // Keep track of helper threads so they can be joined at shutdown
+    halide_thread **async_threads;
+    int async_threads_created, async_threads_capacity;
+
+    // Broadcast when async tasks are added, when one finishes, and
+    // when a semaphore is released or closed.
+    halide_cond wakeup_async, async_done, wakeup_semaphores;
+
     // The desired number threads doing work.
     int desired_num_threads;
 
@@ -68,6 +151,119 @@ WEAK int clamp_num_threads(int desired_num_threads) {
     return desired_num_threads;
 }
 
+// Number the NUMA nodes in cpu_nodes densely from zero, in
+// increasing order of their original numbers, and return the number
+// of nodes.
+WEAK int compact_cpu_nodes(int num_cpus, int *cpu_nodes) {
+    int *ids = (int *)malloc(num_cpus * sizeof(int));
+    if (!ids) {
+        // Out of memory. Put all the cpus on one node.
+        memset(cpu_nodes, 0, num_cpus * sizeof(int));
+        return 1;
+    }
+    memcpy(ids, cpu_nodes, num_cpus * sizeof(int));
+    int num_nodes = 0;
+    int last_id = -1;
+    while (true) {
+        // Find the next smallest node number.
+        bool found = false;
+        int id = 0;
+        for (int i = 0; i < num_cpus; i++) {
+            int n = ids[i] < 0 ? 0 : ids[i];
+            if (n > last_id && (!found || n < id)) {
+                id = n;
+                found = true;
+            }
+        }
+        if (!found) {
+            break;
+        }
+        for (int i = 0; i < num_cpus; i++) {
+            if ((ids[i] < 0 ? 0 : ids[i]) == id) {
+                cpu_nodes[i] = num_nodes;
+            }
+        }
+        num_nodes++;
+        last_id = id;
+    }
+    free(ids);
+    return num_nodes;
+}
+
+// Set the topology to the given one, or to the one reported by the
+// OS if cpu_nodes is NULL, in which case num_cpus is ignored.
+WEAK void set_cpu_topology_already_locked(int num_cpus, const int *cpu_nodes) {
+    if (work_queue.cpu_nodes) {
+        free(work_queue.cpu_nodes);
+    }
+    if (!cpu_nodes) {
+        num_cpus = halide_host_cpu_count();
+        if (num_cpus < 1) {
+            num_cpus = 1;
+        }
+    }
+    work_queue.cpu_nodes = (int *)malloc(num_cpus * sizeof(int));
+    if (!work_queue.cpu_nodes) {
+        // Out of memory. Describe the machine as having no known
+        // cpus on a single node, and try again next time.
+        work_queue.num_cpus = 0;
+        work_queue.num_nodes = 1;
+        return;
+    }
+    if (cpu_nodes) {
+        memcpy(work_queue.cpu_nodes, cpu_nodes, num_cpus * sizeof(int));
+    } else {
+        // Any cpus the OS doesn't tell us about go on node zero.
+        memset(work_queue.cpu_nodes, 0, num_cpus * sizeof(int));
+        halide_host_cpu_nodes(num_cpus, work_queue.cpu_nodes);
+    }
+    work_queue.num_cpus = num_cpus;
+    work_queue.num_nodes = compact_cpu_nodes(num_cpus, work_queue.cpu_nodes);
+}
+
+WEAK void init_pin_threads_already_locked() {
+    if (!work_queue.pin_threads_initialized) {
+        char *pin_str = getenv("HL_PIN_THREADS");
+        work_queue.pin_threads = pin_str && atoi(pin_str);
+        work_queue.pin_threads_initialized = true;
+    }
+}
+
+// Worker thread i (the thread calling do_par_for counts as thread 0)
+// works on the NUMA nodes round robin, so that each node gets a
+// share of the threads.
+WEAK int thread_node(int i) {
+    return i % work_queue.num_nodes;
+}
+
+// Pick a cpu on a worker thread's node for it to be pinned to.
+WEAK int thread_cpu(int i) {
+    int node = thread_node(i);
+    int node_cpus = 0;
+    for (int c = 0; c < work_queue.num_cpus; c++) {
+        node_cpus += (work_queue.cpu_nodes[c] == node);
+    }
+    if (node_cpus == 0) {
+        return -1;
+    }
+    int k = (i / work_queue.num_nodes) % node_cpus;
+    for (int c = 0; c < work_queue.num_cpus; c++) {
+        if (work_queue.cpu_nodes[c] == node && k-- == 0) {
+            return c;
+        }
+    }
+    return -1;
+}
+
+// The NUMA node the calling thread is currently running on.
+WEAK int current_node() {
+    int cpu = halide_host_current_cpu();
+    if (cpu >= 0 && cpu < work_queue.num_cpus) {
+        return work_queue.cpu_nodes[cpu];
+    }
+    return 0;
+}
+
 WEAK int default_desired_num_threads() {
     int desired_num_threads = 0;
     char *threads_str = getenv("HL_NUM_THREADS");
@@ -83,7 +279,138 @@ WEAK int default_desired_num_threads() {
     return desired_num_threads;
 }
 
-WEAK void worker_thread_already_locked(work *owned_job) {
+// Make room for n more threads in a list of threads to join at
+// shutdown, growing it as needed. Returns false if out of memory, in
+// which case the list is unchanged.
+WEAK bool reserve_threads(halide_thread ***threads, int count, int *capacity, int n) {
+    if (count + n <= *capacity) {
+        return true;
+    }
+    int new_capacity = *capacity ? *capacity : 16;
+    while (new_capacity < count + n) {
+        new_capacity *= 2;
+    }
+    halide_thread **new_threads = (halide_thread **)malloc(new_capacity * sizeof(halide_thread *));
+    if (!new_threads) {
+        return false;
+    }
+    if (*threads) {
+        memcpy(new_threads, *threads, count * sizeof(halide_thread *));
+        free(*threads);
+    }
+    *threads = new_threads;
+    *capacity = new_capacity;
+    return true;
+}
+
+WEAK uint64_t pack_range(uint32_t lo, uint32_t hi) {
+    return ((uint64_t)hi << 32) | lo;
+}
+
+// Claim the first unclaimed iteration of a slice.
+WEAK bool claim_front(work_slice *slice, int *idx) {
+    uint64_t range = __atomic_load_n(&slice->range, __ATOMIC_ACQUIRE);
+    while (true) {
+        uint32_t lo = (uint32_t)range, hi = (uint32_t)(range >> 32);
+        if (lo >= hi) {
+            return false;
+        }
+        uint64_t old = __sync_val_compare_and_swap(&slice->range, range, pack_range(lo + 1, hi));
+        if (old == range) {
+            *idx = (int)lo;
+            return true;
+        }
+        range = old;
+    }
+}
+
+// Take the back half of a slice with at least two unclaimed iterations.
+WEAK bool steal_back(work_slice *slice, uint32_t *stolen_lo, uint32_t *stolen_hi) {
+    uint64_t range = __atomic_load_n(&slice->range, __ATOMIC_ACQUIRE);
+    while (true) {
+        uint32_t lo = (uint32_t)range, hi = (uint32_t)(range >> 32);
+        if (lo >= hi || hi - lo < 2) {
+            return false;
+        }
+        uint32_t mid = lo + (hi - lo) / 2;
+        uint64_t old = __sync_val_compare_and_swap(&slice->range, range, pack_range(lo, mid));
+        if (old == range) {
+            *stolen_lo = mid;
+            *stolen_hi = hi;
+            return true;
+        }
+        range = old;
+    }
+}
+
+// Claim an iteration of a job for a thread on the given NUMA node
+// that owns the given slice (or no slice, if slot is -1). Returns
+// false once no unclaimed iterations were found. Iterations are only
+// ever moved into a slice by the thread that owns it, so any
+// iterations missed by a racing scan are still claimed by that owner.
+WEAK bool claim_task(work *job, int slot, int node, int *idx) {
+    if (slot >= 0 && claim_front(&job->slices[slot], idx)) {
+        return true;
+    }
+
+    // My slice is empty. Look for work in the others, first in the
+    // slices of my own NUMA node.
+    int start = slot + 1;
+    for (int i = 0; i < 2 * job->num_slices; i++) {
+        int victim = (start + i) % job->num_slices;
+        bool local = job->slices[victim].node == node;
+        if (victim == slot || local != (i < job->num_slices)) {
+            continue;
+        }
+        uint32_t lo, hi;
+        if (slot >= 0 && steal_back(&job->slices[victim], &lo, &hi)) {
+            // Do the first stolen iteration now, and keep the rest in
+            // my own slice. Nobody else can modify my slice while it
+            // is empty.
+            *idx = (int)lo;
+            __atomic_store_n(&job->slices[slot].range, pack_range(lo + 1, hi), __ATOMIC_RELEASE);
+            return true;
+        }
+        if (claim_front(&job->slices[victim], idx)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Take ownership of an unowned slice of a job, preferably one of the
+// given NUMA node. Returns -1 if all slices are owned. Must be called
+// with the lock held.
+WEAK int take_slice(work *job, int node) {
+    int slot = -1;
+    for (int i = 0; i < job->num_slices; i++) {
+        if (!job->slices[i].taken) {
+            if (job->slices[i].node == node) {
+                slot = i;
+                break;
+            } else if (slot < 0) {
+                slot = i;
+            }
+        }
+    }
+    if (slot >= 0) {
+        job->slices[slot].taken = true;
+    }
+    return slot;
+}
+
+// Remove a job from the job stack. Must be called with the lock held.
+WEAK void dequeue_job(work *job) {
+    for (work **j = &work_queue.jobs; *j; j = &((*j)->next_job)) {
+        if (*j == job) {
+            *j = job->next_job;
+            break;
+        }
+    }
+    job->queued = false;
+}
+
+WEAK void worker_thread_already_locked(work *owned_job, int node) {
     // If I'm a job owner, then I was the thread that called
     // do_par_for, and I should only stay in this function until my
     // job is complete. If I'm a lowly worker thread, I should stay in
@@ -108,33 +435,53 @@ WEAK void worker_thread_already_locked(work *owned_job) {
                 work_queue.a_team_size++;
             }
         } else {
-            // Grab the next job.
-            work *job = work_queue.jobs;
-
-            // Claim a task from it.
-            work myjob = *job;
-            job->next++;
-
-            // If there were no more tasks pending for this job,
-            // remove it from the stack.
-            if (job->next == job->max) {
-                work_queue.jobs = job->next_job;
+            // Grab a job. Owners help on their own job first, using
+            // the slice that was reserved for them. Everyone else
+            // takes the job on top of the stack and an unowned slice
+            // of it, if any remain.
+            work *job;
+            int slot;
+            if (owned_job && owned_job->queued) {
+                job = owned_job;
+                slot = job->owner_slice;
+            } else {
+                job = work_queue.jobs;
+                slot = take_slice(job, node);
             }
 
             // Increment the active_worker count so that other threads
             // are aware that this job is still in progress even
-            // though there are no outstanding tasks for it.
+            // though there may be no outstanding tasks for it.
             job->active_workers++;
 
-            // Release the lock and do the task.
+            // Release the lock and do tasks until none can be
+            // claimed.
             halide_mutex_unlock(&work_queue.mutex);
-            int result = halide_do_task(myjob.user_context, myjob.f, myjob.next,
-                                        myjob.closure);
+            int idx, completed = 0, exit_status = 0;
+            while (claim_task(job, slot, node, &idx)) {
+                int result = halide_do_task(job->user_context, job->f, job->min + idx,
+                                            job->closure);
+                if (result) {
+                    exit_status = result;
+                }
+                completed++;
+            }
+            // The job can't be seen as finished while we're still
+            // active on it, so it's enough to count the completed
+            // tasks once.
+            __sync_sub_and_fetch(&job->remaining, completed);
             halide_mutex_lock(&work_queue.mutex);
 
-            // If this task failed, set the exit status on the job.
-            if (result) {
-                job->exit_status = result;
+            // If any of our tasks failed, set the exit status on the
+            // job. The owner reads it under the lock.
+            if (exit_status) {
+                job->exit_status = exit_status;
+            }
+
+            // There are no more tasks to claim from this job, so
+            // remove it from the stack.
+            if (job->queued) {
+                dequeue_job(job);
             }
 
             // We are no longer active on this job
@@ -149,35 +496,68 @@ WEAK void worker_thread_already_locked(work *owned_job) {
     }
 }
 
-WEAK void worker_thread(void *) {
+WEAK void async_helper_thread(void *) {
+    if (halide_perf_counters_register_thread) {
+        halide_perf_counters_register_thread();
+    }
     halide_mutex_lock(&work_queue.mutex);
-    worker_thread_already_locked(NULL);
-    halide_mutex_unlock(&work_queue.mutex);
-}
-
-}}}  // namespace Halide::Runtime::Internal
+    while (work_queue.running()) {
+        if (work_queue.async_tasks) {
+            async_task *task = work_queue.async_tasks;
+            work_queue.async_tasks = task->next;
 
-using namespace Halide::Runtime::Internal;
-
-extern "C" {
+            halide_mutex_unlock(&work_queue.mutex);
+            int result = halide_do_task(task->user_context, task->f, task->idx, task->closure);
+            halide_mutex_lock(&work_queue.mutex);
 
-WEAK int halide_default_do_task(void *user_context, halide_task_t f, int idx,
-                                uint8_t *closure) {
-    return f(user_context, idx, closure);
+            task->result = result;
+            task->done = true;
+            work_queue.num_async_idle++;
+            halide_cond_broadcast(&work_queue.async_done);
+        } else {
+            halide_cond_wait(&work_queue.wakeup_async, &work_queue.mutex);
+        }
+    }
+    halide_mutex_unlock(&work_queue.mutex);
+    if (halide_perf_counters_unregister_thread) {
+        halide_perf_counters_unregister_thread();
+    }
 }
 
-WEAK int halide_default_do_par_for(void *user_context, halide_task_t f,
-                                   int min, int size, uint8_t *closure) {
-    // Grab the lock. If it hasn't been initialized yet, then the
-    // field will be zero-initialized because it's a static global.
-    halide_mutex_lock(&work_queue.mutex);
+WEAK bool semaphore_try_acquire(semaphore_impl *sem, int n) {
+    int value = __atomic_load_n(&sem->value, __ATOMIC_ACQUIRE);
+    while (value >= n) {
+        int old = __sync_val_compare_and_swap(&sem->value, value, value - n);
+        if (old == value) {
+            return true;
+        }
+        value = old;
+    }
+    return false;
+}
 
+// Initialize the work queue if this is the first use since startup
+// or shutdown. Must be called with the lock held. If it hasn't been
+// initialized yet, then the lock is zero-initialized because it's a
+// static global.
+WEAK void initialize_work_queue_already_locked() {
     if (!work_queue.initialized) {
         work_queue.shutdown = false;
         halide_cond_init(&work_queue.wakeup_owners);
         halide_cond_init(&work_queue.wakeup_a_team);
         halide_cond_init(&work_queue.wakeup_b_team);
+        halide_cond_init(&work_queue.wakeup_async);
+        halide_cond_init(&work_queue.async_done);
+        halide_cond_init(&work_queue.wakeup_semaphores);
         work_queue.jobs = NULL;
+        work_queue.async_tasks = NULL;
+        work_queue.num_async_idle = 0;
+        work_queue.async_threads_created = 0;
+
+        if (!work_queue.cpu_nodes) {
+            set_cpu_topology_already_locked(0, NULL);
+        }
+        init_pin_threads_already_locked();
 
         // Compute the desired number of threads to use. Other code
         // can also mess with this value, but only when the work queue
@@ -193,24 +573,107 @@ WEAK int halide_default_do_par_for(void *user_context, halide_task_t f,
 
         work_queue.initialized = true;
     }
+}
+
+WEAK void worker_thread(void *arg) {
+    int i = (int)(intptr_t)arg;
+    if (halide_perf_counters_register_thread) {
+        halide_perf_counters_register_thread();
+    }
+    halide_mutex_lock(&work_queue.mutex);
+    if (work_queue.pin_threads) {
+        halide_pin_current_thread(thread_cpu(i));
+    }
+    worker_thread_already_locked(NULL, thread_node(i));
+    halide_mutex_unlock(&work_queue.mutex);
+    if (halide_perf_counters_unregister_thread) {
+        halide_perf_counters_unregister_thread();
+    }
+}
+
+}}}  // namespace Halide::Runtime::Internal
+
+using namespace Halide::Runtime::Internal;
+
+extern "C" {
+
+WEAK int halide_default_do_task(void *user_context, halide_task_t f, int idx,
+                                uint8_t *closure) {
+    return f(user_context, idx, closure);
+}
+
+WEAK int halide_default_do_par_for(void *user_context, halide_task_t f,
+                                   int min, int size, uint8_t *closure) {
+    if (size <= 0) {
+        return 0;
+    }
+
+    halide_mutex_lock(&work_queue.mutex);
+
+    initialize_work_queue_already_locked();
 
     while (work_queue.threads_created < work_queue.desired_num_threads - 1) {
         // We might need to make some new threads, if work_queue.desired_num_threads has
-        // increased.
-        work_queue.threads[work_queue.threads_created++] =
-            halide_spawn_thread(worker_thread, NULL);
+        // increased. If we can't keep track of any more threads,
+        // make do with the ones we have; idle threads steal the
+        // iterations of the slices nobody works on.
+        if (!reserve_threads(&work_queue.threads, work_queue.threads_created,
+                             &work_queue.threads_capacity, 1)) {
+            break;
+        }
+        // Worker threads are numbered from one. The thread calling
+        // do_par_for counts as thread zero.
+        halide_thread *thread =
+            halide_spawn_thread(worker_thread, (void *)(intptr_t)(work_queue.threads_created + 1));
+        work_queue.threads[work_queue.threads_created++] = thread;
     }
 
     // Make the job.
     work job;
     job.f = f;               // The job should call this function. It takes an index and a closure.
     job.user_context = user_context;
-    job.next = min;          // Start at this index.
-    job.max  = min + size;   // Keep going until one less than this index.
+    job.min = min;           // Start at this index.
     job.closure = closure;   // Use this closure.
+    job.remaining = size;    // Nothing has been done yet.
     job.exit_status = 0;     // The job hasn't failed yet
     job.active_workers = 0;  // Nobody is working on this yet
 
+    // Split the iterations into one contiguous slice per thread. The
+    // slices are grouped by NUMA node, in the same way each time a
+    // loop of the same size runs, so that threads tend to revisit the
+    // memory that their node touched first. One slice on the calling
+    // thread's node is reserved for it.
+    job.num_slices = size < work_queue.desired_num_threads ? size : work_queue.desired_num_threads;
+    if (job.num_slices > MAX_SLICES) {
+        job.num_slices = MAX_SLICES;
+    }
+    work_slice inline_slices[INLINE_SLICES];
+    job.slices = inline_slices;
+    if (job.num_slices > INLINE_SLICES) {
+        job.slices = (work_slice *)malloc(job.num_slices * sizeof(work_slice));
+        if (!job.slices) {
+            // Out of memory. Fewer slices just means more stealing.
+            job.slices = inline_slices;
+            job.num_slices = INLINE_SLICES;
+        }
+    }
+    int node = -1;
+    int node_end = 0;
+    for (int i = 0; i < job.num_slices; i++) {
+        while (i >= node_end) {
+            node++;
+            node_end += job.num_slices / work_queue.num_nodes +
+                (node < job.num_slices % work_queue.num_nodes ? 1 : 0);
+        }
+        uint32_t lo = (uint32_t)(((int64_t)size * i) / job.num_slices);
+        uint32_t hi = (uint32_t)(((int64_t)size * (i + 1)) / job.num_slices);
+        job.slices[i].range = pack_range(lo, hi);
+        job.slices[i].node = node;
+        job.slices[i].taken = false;
+    }
+    int my_node = current_node();
+    job.owner_slice = take_slice(&job, my_node);
+
     if (!work_queue.jobs && size < work_queue.desired_num_threads) {
         // If there's no nested parallelism happening and there are
         // fewer tasks to do than threads, then set the target A team
@@ -228,6 +691,7 @@ WEAK int halide_default_do_par_for(void *user_context, halide_task_t f,
     // Push the job onto the stack.
     job.next_job = work_queue.jobs;
     work_queue.jobs = &job;
+    job.queued = true;
 
     // Wake up our A team.
     halide_cond_broadcast(&work_queue.wakeup_a_team);
@@ -239,15 +703,149 @@ WEAK int halide_default_do_par_for(void *user_context, halide_task_t f,
     }
 
     // Do some work myself.
-    worker_thread_already_locked(&job);
+    worker_thread_already_locked(&job, my_node);
+
+    // The job lives on this stack frame, so make sure nobody can
+    // still find it.
+    if (job.queued) {
+        dequeue_job(&job);
+    }
 
     halide_mutex_unlock(&work_queue.mutex);
 
+    if (job.slices != inline_slices) {
+        free(job.slices);
+    }
+
     // Return zero if the job succeeded, otherwise return the exit
     // status of one of the failing jobs (whichever one failed last).
     return job.exit_status;
 }
 
+WEAK int halide_do_async_fork(void *user_context, halide_task_t f,
+                                int min, int size, uint8_t *closure) {
+    if (size <= 0) {
+        return 0;
+    }
+
+    async_task inline_tasks[INLINE_ASYNC_TASKS];
+    async_task *tasks = inline_tasks;
+    if (size > INLINE_ASYNC_TASKS) {
+        tasks = (async_task *)malloc(size * sizeof(async_task));
+        if (!tasks) {
+            halide_error(user_context, "halide_do_async_fork: out of memory.");
+            return halide_error_code_out_of_memory;
+        }
+    }
+    for (int i = 0; i < size; i++) {
+        tasks[i].next = NULL;
+        tasks[i].f = f;
+        tasks[i].user_context = user_context;
+        tasks[i].idx = min + i;
+        tasks[i].closure = closure;
+        tasks[i].result = 0;
+        tasks[i].done = false;
+    }
+
+    halide_mutex_lock(&work_queue.mutex);
+    initialize_work_queue_already_locked();
+
+    // The tasks may wait on each other, so they must all get a
+    // thread. Make sure we can keep track of the ones we spawn before
+    // handing out any of the tasks.
+    int to_spawn = (size - 1) - work_queue.num_async_idle;
+    if (to_spawn > 0 &&
+        !reserve_threads(&work_queue.async_threads, work_queue.async_threads_created,
+                         &work_queue.async_threads_capacity, to_spawn)) {
+        halide_mutex_unlock(&work_queue.mutex);
+        if (tasks != inline_tasks) {
+            free(tasks);
+        }
+        halide_error(user_context, "halide_do_async_fork: out of memory.");
+        return halide_error_code_out_of_memory;
+    }
+
+    // Hand all but the first task to helper threads, spawning more of
+    // them if there aren't enough idle ones.
+    for (int i = 1; i < size; i++) {
+        tasks[i].next = work_queue.async_tasks;
+        work_queue.async_tasks = &tasks[i];
+        if (--work_queue.num_async_idle < 0) {
+            halide_thread *thread = halide_spawn_thread(async_helper_thread, NULL);
+            work_queue.async_threads[work_queue.async_threads_created++] = thread;
+            work_queue.num_async_idle++;
+        }
+    }
+    halide_cond_broadcast(&work_queue.wakeup_async);
+    halide_mutex_unlock(&work_queue.mutex);
+
+    // Do the first task myself.
+    tasks[0].result = halide_do_task(user_context, f, min, closure);
+    tasks[0].done = true;
+
+    // Wait for the others.
+    halide_mutex_lock(&work_queue.mutex);
+    for (int i = 1; i < size; i++) {
+        while (!tasks[i].done) {
+            halide_cond_wait(&work_queue.async_done, &work_queue.mutex);
+        }
+    }
+    halide_mutex_unlock(&work_queue.mutex);
+
+    int result = 0;
+    for (int i = 0; i < size && !result; i++) {
+        result = tasks[i].result;
+    }
+    if (tasks != inline_tasks) {
+        free(tasks);
+    }
+    return result;
+}
+
+WEAK int halide_semaphore_init(halide_semaphore_t *s, int n) {
+    semaphore_impl *sem = (semaphore_impl *)s;
+    sem->value = n;
+    sem->closed = 0;
+    return 0;
+}
+
+WEAK int halide_semaphore_release(halide_semaphore_t *s, int n) {
+    semaphore_impl *sem = (semaphore_impl *)s;
+    __sync_add_and_fetch(&sem->value, n);
+    // Taking the lock makes sure that nobody is between checking the
+    // semaphore and going to sleep.
+    halide_mutex_lock(&work_queue.mutex);
+    halide_cond_broadcast(&work_queue.wakeup_semaphores);
+    halide_mutex_unlock(&work_queue.mutex);
+    return 0;
+}
+
+WEAK int halide_semaphore_acquire(halide_semaphore_t *s, int n) {
+    semaphore_impl *sem = (semaphore_impl *)s;
+    if (semaphore_try_acquire(sem, n)) {
+        return 0;
+    }
+    int result = 0;
+    halide_mutex_lock(&work_queue.mutex);
+    while (!semaphore_try_acquire(sem, n)) {
+        if (__atomic_load_n(&sem->closed, __ATOMIC_ACQUIRE)) {
+            result = halide_error_code_generic_error;
+            break;
+        }
+        halide_cond_wait(&work_queue.wakeup_semaphores, &work_queue.mutex);
+    }
+    halide_mutex_unlock(&work_queue.mutex);
+    return result;
+}
+
+WEAK void halide_semaphore_close(void *user_context, void *s) {
+    semaphore_impl *sem = (semaphore_impl *)s;
+    __atomic_store_n(&sem->closed, 1, __ATOMIC_RELEASE);
+    halide_mutex_lock(&work_queue.mutex);
+    halide_cond_broadcast(&work_queue.wakeup_semaphores);
+    halide_mutex_unlock(&work_queue.mutex);
+}
+
 WEAK int halide_set_num_threads(int n) {
     if (n < 0) {
         halide_error(NULL, "halide_set_num_threads: must be >= 0.");
@@ -265,6 +863,43 @@ WEAK int halide_set_num_threads(int n) {
     return old;
 }
 
+WEAK int halide_set_cpu_topology(int num_cpus, const int *cpu_nodes) {
+    if (cpu_nodes && num_cpus <= 0) {
+        halide_error(NULL, "halide_set_cpu_topology: num_cpus must be > 0 when cpu_nodes is given.");
+        return halide_error_code_generic_error;
+    }
+    halide_mutex_lock(&work_queue.mutex);
+    set_cpu_topology_already_locked(num_cpus, cpu_nodes);
+    int num_nodes = work_queue.num_nodes;
+    halide_mutex_unlock(&work_queue.mutex);
+    return num_nodes;
+}
+
+WEAK int halide_get_cpu_topology(int max_cpus, int *cpu_nodes, int *num_nodes) {
+    halide_mutex_lock(&work_queue.mutex);
+    if (!work_queue.cpu_nodes) {
+        set_cpu_topology_already_locked(0, NULL);
+    }
+    int num_cpus = work_queue.num_cpus;
+    if (cpu_nodes && num_cpus > 0) {
+        memcpy(cpu_nodes, work_queue.cpu_nodes, (num_cpus < max_cpus ? num_cpus : max_cpus) * sizeof(int));
+    }
+    if (num_nodes) {
+        *num_nodes = work_queue.num_nodes;
+    }
+    halide_mutex_unlock(&work_queue.mutex);
+    return num_cpus;
+}
+
+WEAK bool halide_set_thread_pinning(bool pin) {
+    halide_mutex_lock(&work_queue.mutex);
+    init_pin_threads_already_locked();
+    bool old = work_queue.pin_threads;
+    work_queue.pin_threads = pin;
+    halide_mutex_unlock(&work_queue.mutex);
+    return old;
+}
+
 WEAK void halide_shutdown_thread_pool() {
     if (!work_queue.initialized) return;
 
@@ -275,18 +910,35 @@ WEAK void halide_shutdown_thread_pool() {
     halide_cond_broadcast(&work_queue.wakeup_owners);
     halide_cond_broadcast(&work_queue.wakeup_a_team);
     halide_cond_broadcast(&work_queue.wakeup_b_team);
+    halide_cond_broadcast(&work_queue.wakeup_async);
     halide_mutex_unlock(&work_queue.mutex);
 
     // Wait until they leave
     for (int i = 0; i < work_queue.threads_created; i++) {
         halide_join_thread(work_queue.threads[i]);
     }
+    for (int i = 0; i < work_queue.async_threads_created; i++) {
+        halide_join_thread(work_queue.async_threads[i]);
+    }
 
     // Tidy up
+    free(work_queue.threads);
+    work_queue.threads = NULL;
+    work_queue.threads_capacity = 0;
+    free(work_queue.async_threads);
+    work_queue.async_threads = NULL;
+    work_queue.async_threads_capacity = 0;
+    free(work_queue.cpu_nodes);
+    work_queue.cpu_nodes = NULL;
+    work_queue.num_cpus = 0;
+    work_queue.num_nodes = 0;
     halide_mutex_destroy(&work_queue.mutex);
     halide_cond_destroy(&work_queue.wakeup_owners);
     halide_cond_destroy(&work_queue.wakeup_a_team);
     halide_cond_destroy(&work_queue.wakeup_b_team);
+    halide_cond_destroy(&work_queue.wakeup_async);
+    halide_cond_destroy(&work_queue.async_done);
+    halide_cond_destroy(&work_queue.wakeup_semaphores);
     work_queue.initialized = false;
 }
 
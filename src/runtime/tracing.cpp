@@ -10,10 +10,339 @@ typedef int32_t (*trace_fn)(void *, const halide_trace_event_t *);
 
 namespace Halide { namespace Runtime { namespace Internal {
 
+// A spin lock that many threads can hold shared at once, or one
+// thread can hold exclusively. Threads waiting for exclusive access
+// keep new shared holders out, so they can't be starved.
+class SharedExclusiveSpinLock {
+    volatile uint32_t lock;
+
+    // Covers a single bit indicating one owner has exclusive
+    // access. The waiting bit can be set while the exclusive bit is
+    // set, but the bits masked by shared_mask must be zero while this
+    // bit is set.
+    const static uint32_t exclusive_held_mask = 0x80000000;
+
+    // Set to indicate a thread needs to acquire exclusive
+    // access. Other fields of the lock may be set, but no shared
+    // access request will proceed while this bit is set.
+    const static uint32_t exclusive_waiting_mask = 0x40000000;
+
+    // Count of threads currently holding shared access. Must be zero
+    // if the exclusive bit is set. Cannot increase if the waiting bit
+    // is set.
+    const static uint32_t shared_mask = 0x3fffffff;
+
+public:
+    __attribute__((always_inline)) void acquire_shared() {
+        while (1) {
+            uint32_t x = lock & shared_mask;
+            if (__sync_bool_compare_and_swap(&lock, x, x + 1)) {
+                return;
+            }
+        }
+    }
+
+    __attribute__((always_inline)) void release_shared() {
+        __sync_fetch_and_sub(&lock, 1);
+    }
+
+    __attribute__((always_inline)) void acquire_exclusive() {
+        while (1) {
+            // If multiple threads are trying to acquire exclusive
+            // ownership, we may need to rerequest exclusive waiting
+            // while we spin, as it gets unset whenever a thread
+            // acquires exclusive ownership.
+            __sync_fetch_and_or(&lock, exclusive_waiting_mask);
+            if (__sync_bool_compare_and_swap(&lock, exclusive_waiting_mask, exclusive_held_mask)) {
+                return;
+            }
+        }
+    }
+
+    __attribute__((always_inline)) void release_exclusive() {
+        __sync_fetch_and_and(&lock, ~exclusive_held_mask);
+    }
+};
+
+const static int halide_trace_buffer_size = 1024*1024;
+
+// Binary trace packets are batched into one buffer shared by all
+// threads, which is written out in a single write when it fills
+// up. Threads claim space for a packet with an atomic add, and only
+// take the lock exclusively to flush, so they don't serialize on
+// each other the rest of the time. Packets appear in the file in the
+// order their space was claimed. Starts out zeroed.
+class TraceBuffer {
+    SharedExclusiveSpinLock lock;
+    uint32_t cursor, overage;
+    // The file the buffered packets are destined for.
+    int fd;
+    uint8_t buf[halide_trace_buffer_size];
+
+    // Attempt to atomically acquire space in the buffer to write a
+    // packet to the given file. Returns NULL if the buffer was full,
+    // or holds packets for another file.
+    __attribute__((always_inline)) halide_trace_packet_t *try_acquire_packet(void *user_context, int f, uint32_t size) {
+        lock.acquire_shared();
+        halide_assert(user_context, size <= halide_trace_buffer_size);
+        if (f != fd) {
+            lock.release_shared();
+            return NULL;
+        }
+        uint32_t my_cursor = __sync_fetch_and_add(&cursor, size);
+        if (my_cursor + size > sizeof(buf)) {
+            // Don't try to back it out: instead, just allow this request to fail
+            // (along with all subsequent requests) and record the 'overage'
+            // so that we know how much to back out when a flush occurs.
+            __sync_fetch_and_add(&overage, size);
+            lock.release_shared();
+            return NULL;
+        } else {
+            return (halide_trace_packet_t *)(buf + my_cursor);
+        }
+    }
+
+public:
+    // Wait for all writers to finish with their packets, stall any
+    // new writers, and flush the buffer to its file. Later packets go
+    // to the given file.
+    __attribute__((always_inline)) void flush(void *user_context, int new_fd) {
+        lock.acquire_exclusive();
+        bool success = true;
+        if (cursor) {
+            cursor -= overage;
+            success = (cursor == (uint32_t)write(fd, buf, cursor));
+            cursor = 0;
+            overage = 0;
+        }
+        fd = new_fd;
+        lock.release_exclusive();
+        halide_assert(user_context, success && "Could not write to trace file");
+    }
+
+    // Acquire and return a packet's worth of space in the trace
+    // buffer, flushing the trace buffer to the given fd to make space
+    // if necessary. The region acquired is protected from other
+    // threads writing or reading to it, so it must be released before
+    // a flush can occur.
+    __attribute__((always_inline)) halide_trace_packet_t *acquire_packet(void *user_context, int f, uint32_t size) {
+        halide_trace_packet_t *packet = NULL;
+        while (!(packet = try_acquire_packet(user_context, f, size))) {
+            // Couldn't acquire space to write a packet. Flush and try again.
+            flush(user_context, f);
+        }
+        return packet;
+    }
+
+    __attribute__((always_inline)) int file() const {
+        return fd;
+    }
+
+    // Release a packet, allowing it to be written out with flush
+    __attribute__((always_inline)) void release_packet(halide_trace_packet_t *) {
+        // Need a memory barrier to guarantee all the writes are done.
+        __sync_synchronize();
+        lock.release_shared();
+    }
+};
+
+WEAK TraceBuffer *halide_trace_buffer = NULL;
 WEAK int halide_trace_file = 0;
 WEAK int halide_trace_file_lock = 0;
 WEAK bool halide_trace_file_initialized = false;
 WEAK void *halide_trace_file_internally_opened = NULL;
+WEAK halide_trace_format_t halide_trace_format = halide_trace_format_packets;
+WEAK bool halide_trace_format_initialized = false;
+
+WEAK void ensure_trace_buffer(void *user_context) {
+    if (!halide_trace_buffer) {
+        ScopedSpinLock lock(&halide_trace_file_lock);
+        if (!halide_trace_buffer) {
+            TraceBuffer *buffer = (TraceBuffer *)malloc(sizeof(TraceBuffer));
+            halide_assert(user_context, buffer && "Failed to allocate trace buffer\n");
+            memset(buffer, 0, sizeof(TraceBuffer));
+            __sync_synchronize();
+            halide_trace_buffer = buffer;
+        }
+    }
+}
+
+// The Chrome trace format is a JSON array of events. It's written
+// without the closing bracket until the file is done with, which the
+// trace viewers accept, so that a trace cut short is still readable.
+// The file that has been started, or 0.
+WEAK int chrome_trace_file = 0;
+WEAK int chrome_trace_lock = 0;
+
+// Chrome lays out the timeline by thread. Threads are numbered from
+// one in the order they first write an event, which keeps the
+// timeline's rows small and in a stable order. On platforms without a
+// thread id, everything is on one row.
+const int kMaxChromeThreads = 256;
+WEAK uint64_t chrome_thread_ids[kMaxChromeThreads];
+WEAK int chrome_num_threads = 0;
+
+WEAK int chrome_thread_id() {
+    if (!halide_host_current_thread_id) {
+        return 1;
+    }
+    uint64_t id = halide_host_current_thread_id();
+    int n = __atomic_load_n(&chrome_num_threads, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < n; i++) {
+        if (chrome_thread_ids[i] == id) {
+            return i + 1;
+        }
+    }
+    ScopedSpinLock lock(&chrome_trace_lock);
+    n = chrome_num_threads;
+    for (int i = 0; i < n; i++) {
+        if (chrome_thread_ids[i] == id) {
+            return i + 1;
+        }
+    }
+    if (n == kMaxChromeThreads) {
+        // Lump any more threads together.
+        return n;
+    }
+    chrome_thread_ids[n] = id;
+    __atomic_store_n(&chrome_num_threads, n + 1, __ATOMIC_RELEASE);
+    return n + 1;
+}
+
+// Write the start of the array to a file, if it isn't started yet.
+WEAK void chrome_trace_start(void *user_context, int fd) {
+    if (__atomic_load_n(&chrome_trace_file, __ATOMIC_ACQUIRE) == fd) {
+        return;
+    }
+    ScopedSpinLock lock(&chrome_trace_lock);
+    if (chrome_trace_file != fd) {
+        halide_start_clock(user_context);
+        const char *header = "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"Halide\"}}";
+        size_t len = strlen(header);
+        bool success = (len == (size_t)write(fd, header, len));
+        halide_assert(user_context, success && "Could not write to trace file");
+        __atomic_store_n(&chrome_trace_file, fd, __ATOMIC_RELEASE);
+    }
+}
+
+// Close the array in the file started, once all its events are
+// written out.
+WEAK void chrome_trace_finish() {
+    if (chrome_trace_file > 0) {
+        write(chrome_trace_file, "\n]\n", 3);
+        chrome_trace_file = 0;
+    }
+}
+
+// Timestamps are in microseconds.
+template<typename StringStream>
+void chrome_trace_timestamp(StringStream &ss, const char *key, int64_t ns) {
+    int64_t frac = ns % 1000;
+    ss << ",\"" << key << "\":" << ns / 1000 << (frac < 10 ? ".00" : frac < 100 ? ".0" : ".") << frac;
+}
+
+// Write a string as a JSON string literal. Func names can contain
+// quotes or backslashes (e.g. from a user-chosen name), which would
+// otherwise end the string early or escape the next character.
+template<typename StringStream>
+void chrome_trace_string(StringStream &ss, const char *str) {
+    const char *hex = "0123456789abcdef";
+    char chunk[64];
+    size_t n = 0;
+    ss << "\"";
+    for (const char *c = str; *c; c++) {
+        if (n + 7 >= sizeof(chunk)) {
+            chunk[n] = 0;
+            ss << chunk;
+            n = 0;
+        }
+        unsigned char u = (unsigned char)*c;
+        if (u == '"' || u == '\\') {
+            chunk[n++] = '\\';
+            chunk[n++] = u;
+        } else if (u < 0x20) {
+            chunk[n++] = '\\';
+            chunk[n++] = 'u';
+            chunk[n++] = '0';
+            chunk[n++] = '0';
+            chunk[n++] = hex[u >> 4];
+            chunk[n++] = hex[u & 0xf];
+        } else {
+            chunk[n++] = u;
+        }
+    }
+    chunk[n] = 0;
+    ss << chunk << "\"";
+}
+
+// Append an event to the trace, through the shared trace buffer.
+WEAK void chrome_trace_write(void *user_context, int fd, const char *event, uint32_t size) {
+    chrome_trace_start(user_context, fd);
+    ensure_trace_buffer(user_context);
+    // The buffer deals in packets, but they're just bytes.
+    uint8_t *dst = (uint8_t *)halide_trace_buffer->acquire_packet(user_context, fd, size);
+    memcpy(dst, event, size);
+    halide_trace_buffer->release_packet((halide_trace_packet_t *)dst);
+}
+
+// Write a trace event as the beginning or end of an interval on the
+// timeline of the calling thread. Loads and stores are left out.
+WEAK void chrome_trace_event(void *user_context, int fd, const halide_trace_event_t *e) {
+    const char *category = NULL;
+    switch (e->event) {
+    case halide_trace_begin_pipeline:
+    case halide_trace_end_pipeline:
+        category = "pipeline";
+        break;
+    case halide_trace_begin_realization:
+    case halide_trace_end_realization:
+        category = "realization";
+        break;
+    case halide_trace_produce:
+    case halide_trace_end_produce:
+        category = "produce";
+        break;
+    case halide_trace_consume:
+    case halide_trace_end_consume:
+        category = "consume";
+        break;
+    case halide_trace_begin_task:
+    case halide_trace_end_task:
+        category = "task";
+        break;
+    default:
+        return;
+    }
+    bool begin = (e->event == halide_trace_begin_pipeline ||
+                  e->event == halide_trace_begin_realization ||
+                  e->event == halide_trace_produce ||
+                  e->event == halide_trace_consume ||
+                  e->event == halide_trace_begin_task);
+
+    char buffer[1024];
+    Printer<StringStreamPrinter, sizeof(buffer)> ss(user_context, buffer);
+    int64_t now = halide_current_time_ns(user_context);
+    if (begin) {
+        ss << ",\n{\"name\":";
+        chrome_trace_string(ss, e->func);
+        ss << ",\"cat\":\"" << category << "\",\"ph\":\"B\"";
+    } else {
+        ss << ",\n{\"ph\":\"E\"";
+    }
+    chrome_trace_timestamp(ss, "ts", now);
+    ss << ",\"pid\":1,\"tid\":" << chrome_thread_id();
+    if (begin && e->dimensions) {
+        // The region, or the index of the task.
+        ss << ",\"args\":{\"" << (e->event == halide_trace_begin_task ? "index" : "region") << "\":[";
+        for (int i = 0; i < e->dimensions; i++) {
+            ss << (i ? "," : "") << e->coordinates[i];
+        }
+        ss << "]}";
+    }
+    ss << "}";
+    ss.msan_annotate_is_initialized();
+    chrome_trace_write(user_context, fd, ss.str(), ss.size());
+}
 
 }}}
 
@@ -36,31 +365,47 @@ WEAK int32_t halide_default_trace(void *user_context, const halide_trace_event_t
         uint32_t total_size = (total_size_without_padding + 3) & ~3;
         uint32_t padding_bytes = total_size - total_size_without_padding;
 
-        // The packet header
-        halide_trace_packet_t header;
-        header.size = total_size;
-        header.id = my_id;
-        header.type = e->type;
-        header.event = e->event;
-        header.parent_id = e->parent_id;
-        header.value_index = e->value_index;
-        header.dimensions = e->dimensions;
-
-        size_t written = 0;
-        {
-            ScopedSpinLock lock(&halide_trace_file_lock);
-            written += write(fd, &header, sizeof(header));
-            if (e->coordinates) {
-                written += write(fd, e->coordinates, coords_bytes);
-            }
-            if (e->value) {
-                written += write(fd, e->value, value_bytes);
+        if (halide_trace_format == halide_trace_format_chrome) {
+            chrome_trace_event(user_context, fd, e);
+            if (e->event == halide_trace_end_pipeline) {
+                halide_trace_buffer->flush(user_context, fd);
             }
-            written += write(fd, e->func, name_bytes);
-            uint32_t zero = 0;
-            written += write(fd, &zero, padding_bytes);
+            return my_id;
+        }
+
+        ensure_trace_buffer(user_context);
+
+        halide_trace_packet_t *packet = halide_trace_buffer->acquire_packet(user_context, fd, total_size);
+
+        // The packet header
+        packet->size = total_size;
+        packet->id = my_id;
+        packet->type = e->type;
+        packet->event = e->event;
+        packet->parent_id = e->parent_id;
+        packet->value_index = e->value_index;
+        packet->dimensions = e->dimensions;
+
+        uint8_t *dst = (uint8_t *)(packet + 1);
+        if (e->coordinates) {
+            memcpy(dst, e->coordinates, coords_bytes);
+        }
+        dst += coords_bytes;
+        if (e->value) {
+            memcpy(dst, e->value, value_bytes);
+        }
+        dst += value_bytes;
+        memcpy(dst, e->func, name_bytes);
+        dst += name_bytes;
+        memset(dst, 0, padding_bytes);
+
+        halide_trace_buffer->release_packet(packet);
+
+        // Flush at the end of each pipeline, so whoever is reading
+        // the trace sees all of it without waiting for the next one.
+        if (e->event == halide_trace_end_pipeline) {
+            halide_trace_buffer->flush(user_context, fd);
         }
-        halide_assert(user_context, written == total_size && "Can't write to trace file");
 
     } else {
         uint8_t buffer[4096];
@@ -81,7 +426,9 @@ WEAK int32_t halide_default_trace(void *user_context, const halide_trace_event_t
                                      "Consume",
                                      "End consume",
                                      "Begin pipeline",
-                                     "End pipeline"};
+                                     "End pipeline",
+                                     "Begin task",
+                                     "End task"};
 
         // Only print out the value on stores and loads.
         bool print_value = (e->event < 2);
@@ -182,16 +529,35 @@ WEAK trace_fn halide_set_custom_trace(trace_fn t) {
 }
 
 WEAK void halide_set_trace_file(int fd) {
+    // Packets already buffered belong to the old file.
+    if (halide_trace_buffer && halide_trace_buffer->file() > 0) {
+        halide_trace_buffer->flush(NULL, fd);
+    }
+    if (chrome_trace_file != fd) {
+        chrome_trace_finish();
+    }
     halide_trace_file = fd;
     halide_trace_file_initialized = true;
 }
 
+WEAK void halide_set_trace_format(halide_trace_format_t format) {
+    halide_trace_format = format;
+    halide_trace_format_initialized = true;
+}
+
 extern int errno;
 
 WEAK int halide_get_trace_file(void *user_context) {
     // Prevent multiple threads both trying to initialize the trace
     // file at the same time.
     ScopedSpinLock lock(&halide_trace_file_lock);
+    if (!halide_trace_format_initialized) {
+        const char *format = getenv("HL_TRACE_FORMAT");
+        if (format && !strcmp(format, "chrome")) {
+            halide_trace_format = halide_trace_format_chrome;
+        }
+        halide_trace_format_initialized = true;
+    }
     if (!halide_trace_file_initialized) {
         const char *trace_file_name = getenv("HL_TRACE_FILE");
         if (trace_file_name) {
@@ -211,6 +577,14 @@ WEAK int32_t halide_trace(void *user_context, const halide_trace_event_t *e) {
 }
 
 WEAK int halide_shutdown_trace() {
+    if (halide_trace_buffer) {
+        if (halide_trace_buffer->file() > 0) {
+            halide_trace_buffer->flush(NULL, 0);
+        }
+        free(halide_trace_buffer);
+        halide_trace_buffer = NULL;
+    }
+    chrome_trace_finish();
     if (halide_trace_file_internally_opened) {
         int ret = fclose(halide_trace_file_internally_opened);
         halide_trace_file = 0;
@@ -254,4 +628,39 @@ WEAK int halide_trace_helper(void *user_context,
     return halide_trace(user_context, &event);
 }
 
+// Intervals other than the ones traced by the pipeline (e.g. device
+// copies) are only recorded once the default trace handler has started
+// writing a Chrome trace to the trace file, whether it was called
+// directly or by a handler that forwards to it, as the JIT's does.
+// Returns the start of the interval, or -1 if it isn't.
+WEAK int64_t halide_trace_timeline_start(void *user_context) {
+    int fd = halide_get_trace_file(user_context);
+    if (fd <= 0 || halide_trace_format != halide_trace_format_chrome ||
+        __atomic_load_n(&chrome_trace_file, __ATOMIC_ACQUIRE) != fd) {
+        return -1;
+    }
+    return halide_current_time_ns(user_context);
+}
+
+WEAK void halide_trace_timeline_interval(void *user_context, const char *name, const char *category,
+                                         int64_t start_ns, uint64_t bytes) {
+    int fd = halide_get_trace_file(user_context);
+    if (fd <= 0) {
+        return;
+    }
+    char buffer[256];
+    Printer<StringStreamPrinter, sizeof(buffer)> ss(user_context, buffer);
+    ss << ",\n{\"name\":";
+    chrome_trace_string(ss, name);
+    ss << ",\"cat\":";
+    chrome_trace_string(ss, category);
+    ss << ",\"ph\":\"X\"";
+    chrome_trace_timestamp(ss, "ts", start_ns);
+    chrome_trace_timestamp(ss, "dur", halide_current_time_ns(user_context) - start_ns);
+    ss << ",\"pid\":1,\"tid\":" << chrome_thread_id()
+       << ",\"args\":{\"bytes\":" << bytes << "}}";
+    ss.msan_annotate_is_initialized();
+    chrome_trace_write(user_context, fd, ss.str(), ss.size());
+}
+
 }
@@ -27,6 +27,10 @@ extern WIN32API void EnterCriticalSection(CriticalSection *);
 extern WIN32API void LeaveCriticalSection(CriticalSection *);
 extern WIN32API int32_t WaitForSingleObject(Thread, int32_t timeout);
 extern WIN32API bool InitOnceExecuteOnce(InitOnce *, bool WIN32API (*f)(InitOnce *, void *, void **), void *, void **);
+extern WIN32API Thread GetCurrentThread();
+extern WIN32API uint32_t GetCurrentThreadId();
+extern WIN32API uint32_t GetCurrentProcessorNumber();
+extern WIN32API uintptr_t SetThreadAffinityMask(Thread, uintptr_t);
 
 } // extern "C"
 
@@ -112,6 +116,26 @@ WEAK void halide_cond_wait(struct halide_cond *cond_arg, struct halide_mutex *mu
     SleepConditionVariableCS(cond, &mutex->critical_section, -1);
 }
 
+WEAK int halide_host_cpu_nodes(int max_cpus, int *cpu_nodes) {
+    // We don't read the NUMA topology on windows yet.
+    return 0;
+}
+
+WEAK int halide_host_current_cpu() {
+    return (int)GetCurrentProcessorNumber();
+}
+
+WEAK uint64_t halide_host_current_thread_id() {
+    return GetCurrentThreadId();
+}
+
+WEAK int halide_pin_current_thread(int cpu) {
+    if (cpu < 0 || cpu >= (int)(8 * sizeof(uintptr_t))) {
+        return -1;
+    }
+    return SetThreadAffinityMask(GetCurrentThread(), (uintptr_t)1 << cpu) ? 0 : -1;
+}
+
 WEAK int halide_host_cpu_count() {
     // Apparently a standard windows environment variable
     char *num_cores = getenv("NUMBER_OF_PROCESSORS");
@@ -10,6 +10,7 @@
 #define FREE_IMAGE 1002 // Release buffer
 #define PROCESS_IMAGE 1003 // Push to stencil path
 #define PEND_PROCESSED 1004 // Retreive from stencil path
+#define READ_COUNTERS 1005 // Read the kernel cycle counters of a finished run
 
 #endif
 
@@ -168,4 +169,27 @@ WEAK int halide_zynq_hwacc_sync(int task_id){
     return res;
 }
 
+// argument of the READ_COUNTERS ioctl
+typedef struct hwacc_counters_t {
+    int task_id;
+    int num_counters;
+    uint64_t *counters;
+} hwacc_counters_t;
+
+WEAK int halide_zynq_hwacc_counters(int task_id, uint64_t *counters, int num_counters) {
+    debug(0) << "halide_zynq_hwacc_counters\n";
+    memset(counters, 0, num_counters * sizeof(uint64_t));
+    if (fd_hwacc == 0) {
+        error(NULL) << "Zynq runtime is uninitialized.\n";
+        return -1;
+    }
+    hwacc_counters_t args = {task_id, num_counters, counters};
+    int res = ioctl(fd_hwacc, READ_COUNTERS, (long unsigned int)&args);
+    if (res < 0) {
+        // The bitstream or the driver has no counters. Leave them zero.
+        debug(0) << "hwacc device provides no kernel cycle counters.\n";
+    }
+    return res;
+}
+
 }
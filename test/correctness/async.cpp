@@ -0,0 +1,59 @@
+#include <stdio.h>
+#include "Halide.h"
+
+using namespace Halide;
+
+int check(const Buffer<int> &im) {
+    for (int y = 0; y < im.height(); y++) {
+        for (int x = 0; x < im.width(); x++) {
+            int correct = (x + y) + (x + y + 1) + 1;
+            if (im(x, y) != correct) {
+                printf("im(%d, %d) = %d instead of %d\n", x, y, im(x, y), correct);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    Var x, y;
+
+    {
+        // The producer computes all of f in its own task while the
+        // consumer waits for it.
+        Func f, g;
+        f(x, y) = x + y;
+        g(x, y) = f(x, y) + f(x, y+1) + 1;
+        f.compute_root().async();
+
+        if (check(g.realize(64, 64))) return -1;
+    }
+
+    {
+        // The producer computes f a scanline ahead of the consumer,
+        // into a circular buffer that it can't overwrite until the
+        // consumer is done with it.
+        Func f, g;
+        f(x, y) = x + y;
+        g(x, y) = f(x, y) + f(x, y+1) + 1;
+        f.store_root().compute_at(g, y).async();
+
+        if (check(g.realize(64, 1024))) return -1;
+    }
+
+    {
+        // Async producers can be nested inside parallel loops.
+        Func f, g;
+        f(x, y) = x + y;
+        g(x, y) = f(x, y) + f(x, y+1) + 1;
+        Var yo, yi;
+        g.split(y, yo, yi, 32).parallel(yo);
+        f.store_at(g, yo).compute_at(g, yi).async();
+
+        if (check(g.realize(64, 1024))) return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
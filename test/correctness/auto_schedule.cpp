@@ -0,0 +1,76 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+
+Func make_pipeline(Buffer<int> input, Func *blur_y_out = nullptr) {
+    Var x("x"), y("y");
+    Func in("in"), blur_x("blur_x"), blur_y("blur_y"), sum_rows("sum_rows"), out("out");
+    in(x, y) = input(clamp(x, 0, input.width() - 1), clamp(y, 0, input.height() - 1));
+    blur_x(x, y) = in(x - 1, y) + in(x, y) + in(x + 1, y);
+    blur_y(x, y) = blur_x(x, y - 1) + blur_x(x, y) + blur_x(x, y + 1);
+
+    RDom r(0, 8);
+    sum_rows(x, y) = 0;
+    sum_rows(x, y) += in(x, y * 8 + r);
+
+    out(x, y) = blur_y(x, y) * 2 + sum_rows(x, y);
+    if (blur_y_out) {
+        *blur_y_out = blur_y;
+    }
+    return out;
+}
+
+int main(int argc, char **argv) {
+    const int W = 256, H = 128;
+    Buffer<int> input(W, H * 8);
+    input.for_each_element([&](int x, int y) { input(x, y) = (x * 7 + y * 13) % 64; });
+
+    // Schedule the pipeline before making the reference one, so that
+    // its functions get the names the checks below look for.
+    Func blur_y;
+    Func out = make_pipeline(input, &blur_y);
+
+    // auto_schedule replaces any schedule already there, including
+    // one left by an earlier call with different parameters.
+    Var x("x"), y("y"), xo("x_o"), xi("x_i");
+    blur_y.compute_root().split(x, xo, xi, 8).reorder_storage(y, x).async();
+    AutoScheduleParams params;
+    params.tile_width = 32;
+    params.tile_height = 8;
+    out.auto_schedule({W, H}, params);
+
+    std::string schedule = out.auto_schedule({W, H});
+    printf("%s", schedule.c_str());
+    const Internal::FuncSchedule &blur_y_schedule = blur_y.function().schedule();
+    if (!blur_y_schedule.compute_level().is_inline() || blur_y_schedule.async() ||
+        blur_y_schedule.storage_dims()[0].var != "x") {
+        printf("blur_y should have been inlined, with its storage order and async reset\n");
+        return -1;
+    }
+
+    // The pointwise blur_y should be inlined, blur_x and sum_rows
+    // computed at tiles of out, and in, which both use, at root.
+    if (schedule.find("blur_y") != std::string::npos ||
+        schedule.find("blur_x\n        .compute_at(out, x_o)") == std::string::npos ||
+        schedule.find("sum_rows\n        .compute_at(out, x_o)") == std::string::npos ||
+        schedule.find("in\n        .compute_root()") == std::string::npos ||
+        schedule.find(".vectorize(") == std::string::npos) {
+        printf("Unexpected schedule\n");
+        return -1;
+    }
+
+    Buffer<int> result = out.realize(W, H);
+    Buffer<int> correct = make_pipeline(input).realize(W, H);
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            if (result(x, y) != correct(x, y)) {
+                printf("result(%d, %d) = %d instead of %d\n", x, y, result(x, y), correct(x, y));
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,85 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+
+enum Schedule {
+    Inline,
+    Root,
+    Tiled,
+    SlidingWindow
+};
+
+std::string report(Schedule schedule) {
+    ImageParam input(Float(32), 2);
+    Var x("x"), y("y"), xo("xo"), yo("yo"), xi("xi"), yi("yi");
+    Func blur_x("blur_x"), blur_y("blur_y");
+    blur_x(x, y) = input(x - 1, y) + input(x, y) + input(x + 1, y);
+    blur_y(x, y) = blur_x(x, y - 1) + blur_x(x, y) + blur_x(x, y + 1);
+
+    switch (schedule) {
+    case Inline:
+        break;
+    case Root:
+        blur_x.compute_root();
+        break;
+    case Tiled:
+        blur_y.tile(x, y, xo, yo, xi, yi, 64, 8).vectorize(xi, 8);
+        blur_x.compute_at(blur_y, xo).vectorize(x, 8);
+        break;
+    case SlidingWindow:
+        blur_x.store_root().compute_at(blur_y, y);
+        break;
+    }
+
+    std::string r = blur_y.footprint_report({256, 256}, Target("x86-64-linux-avx"));
+    printf("%s\n", r.c_str());
+    return r;
+}
+
+bool contains(const std::string &report, const std::string &s) {
+    if (report.find(s) == std::string::npos) {
+        printf("Expected the report to contain \"%s\"\n", s.c_str());
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    // Inlined, blur_x is recomputed for each of the three rows of
+    // blur_y that use it, so each output pixel loads nine floats.
+    std::string inlined = report(Inline);
+    if (!contains(inlined, "inlined") ||
+        !contains(inlined, "loads 36.00 and stores 4.00 bytes per output pixel")) {
+        return -1;
+    }
+
+    // At root, blur_x is computed once over the 256 x 258 region
+    // blur_y needs.
+    std::string root = report(Root);
+    if (!contains(root, "stored at root: 264192 bytes") ||
+        !contains(root, "computes 1.00x the 66048 points required") ||
+        !contains(root, "total: loads 24.09 and stores 8.03 bytes per output pixel")) {
+        return -1;
+    }
+
+    // Computed per 64 x 8 tile, blur_x computes two extra rows for
+    // each eight of blur_y, and both are fully vectorized.
+    std::string tiled = report(Tiled);
+    if (!contains(tiled, "2560 bytes, allocated 128 times") ||
+        !contains(tiled, "computes 1.24x the 66048 points required") ||
+        !contains(tiled, "vector utilization 100.00%")) {
+        return -1;
+    }
+
+    // With a sliding window, blur_x computes one new row per row of
+    // blur_y, in a circular buffer of four rows.
+    std::string sliding = report(SlidingWindow);
+    if (!contains(sliding, "stored at root: 4096 bytes") ||
+        !contains(sliding, "computes 1.00x the 66048 points required")) {
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,111 @@
+#include "Halide.h"
+#include <stdio.h>
+#include <fstream>
+#include <sstream>
+
+#include "test/common/halide_test_dirs.h"
+
+using namespace Halide;
+
+std::string read_file(const std::string &filename) {
+    std::ifstream f(filename);
+    std::ostringstream contents;
+    contents << f.rdbuf();
+    return contents.str();
+}
+
+bool contains(const std::string &s, const std::string &pattern) {
+    return s.find(pattern) != std::string::npos;
+}
+
+enum class Border {
+    RepeatEdge,
+    ConstantExterior,
+    Mirror
+};
+
+// Accelerate a 3x3 box filter of a bounded input, and return the
+// generated kernel and the lowered host code.
+void compile(Border border, const Target &target, std::string &kernel, std::string &stmt) {
+    Var x("x"), y("y"), xo("xo"), yo("yo"), xi("xi"), yi("yi");
+    ImageParam in(UInt(8), 2, "in");
+
+    Func bounded;
+    switch (border) {
+    case Border::RepeatEdge:
+        bounded = BoundaryConditions::repeat_edge(in);
+        break;
+    case Border::ConstantExterior:
+        bounded = BoundaryConditions::constant_exterior(in, 7);
+        break;
+    case Border::Mirror:
+        bounded = BoundaryConditions::mirror_image(in);
+        break;
+    }
+
+    Func blur("blur"), hw_output("hw_output"), output("output");
+    blur(x, y) = cast<uint8_t>((cast<uint16_t>(bounded(x - 1, y - 1)) + bounded(x, y - 1) + bounded(x + 1, y - 1) +
+                                bounded(x - 1, y) + bounded(x, y) + bounded(x + 1, y) +
+                                bounded(x - 1, y + 1) + bounded(x, y + 1) + bounded(x + 1, y + 1)) / 9);
+    hw_output(x, y) = blur(x, y);
+    output(x, y) = hw_output(x, y);
+
+    output.tile(x, y, xo, yo, xi, yi, 64, 64);
+    bounded.compute_at(output, xo);
+    hw_output.compute_at(output, xo).tile(x, y, xo, yo, xi, yi, 64, 64);
+    hw_output.accelerate({bounded}, xi, xo);
+
+    std::string dir = Internal::get_test_tmp_dir();
+    std::string testbench = dir + "hls_border.cpp";
+    Internal::ensure_no_file_exists(testbench);
+    Internal::ensure_no_file_exists(dir + "hls_target.cpp");
+    output.compile_to_hls(testbench, {in}, "hls_border", target);
+    Internal::assert_file_exists(dir + "hls_target.cpp");
+    kernel = read_file(dir + "hls_target.cpp");
+
+    std::string stmt_file = dir + "hls_border.stmt";
+    output.compile_to_lowered_stmt(stmt_file, {in}, Text, target);
+    stmt = read_file(stmt_file);
+}
+
+int main(int argc, char **argv) {
+    Target target = get_host_target().with_feature(Target::CPlusPlusMangling);
+    std::string kernel, stmt;
+
+    // The accelerator pads the streamed tile itself, so the host only
+    // sends the part inside the image, and doesn't realize the
+    // bounded Func.
+    compile(Border::RepeatEdge, target, kernel, stmt);
+    if (!contains(kernel, "border<false, 66, 66>(") ||
+        !contains(stmt, "repeat_edge.border.lo.0") ||
+        contains(stmt, "allocate repeat_edge[")) {
+        printf("repeat_edge was not moved into the accelerator\n");
+        return -1;
+    }
+
+    compile(Border::ConstantExterior, target, kernel, stmt);
+    if (!contains(kernel, "border<true, 66, 66>(") ||
+        contains(stmt, "allocate constant_exterior[")) {
+        printf("constant_exterior was not moved into the accelerator\n");
+        return -1;
+    }
+
+    // Mirroring stays on the host.
+    compile(Border::Mirror, target, kernel, stmt);
+    if (contains(kernel, "border<")) {
+        printf("mirror_image should have stayed on the host\n");
+        return -1;
+    }
+
+    // So does everything on Zynq, which can't DMA from the user's
+    // buffers.
+    Target zynq(Target::Linux, Target::ARM, 32, {Target::Zynq, Target::CPlusPlusMangling});
+    compile(Border::RepeatEdge, zynq, kernel, stmt);
+    if (contains(kernel, "border<")) {
+        printf("repeat_edge should have stayed on the host for Zynq\n");
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
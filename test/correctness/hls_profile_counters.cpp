@@ -0,0 +1,94 @@
+#include "Halide.h"
+#include <stdio.h>
+#include <fstream>
+#include <sstream>
+
+#include "test/common/halide_test_dirs.h"
+
+using namespace Halide;
+
+std::string read_file(const std::string &filename) {
+    std::ifstream f(filename);
+    std::ostringstream contents;
+    contents << f.rdbuf();
+    return contents.str();
+}
+
+bool contains(const std::string &s, const std::string &pattern) {
+    return s.find(pattern) != std::string::npos;
+}
+
+// Accelerate a pipeline of two kernels, and return the generated
+// kernel and testbench.
+void compile(const Target &target, std::string &kernel, std::string &testbench) {
+    Var x("x"), y("y"), xo("xo"), yo("yo"), xi("xi"), yi("yi");
+    ImageParam in(UInt(8), 2, "in");
+
+    Func in_copy("in_copy"), blur("blur"), hw_output("hw_output"), output("output");
+    in_copy(x, y) = in(x, y);
+    blur(x, y) = cast<uint8_t>((cast<uint16_t>(in_copy(x, y)) + in_copy(x + 1, y) + in_copy(x + 2, y)) / 3);
+    hw_output(x, y) = blur(x, y) + 1;
+    output(x, y) = hw_output(x, y);
+
+    output.tile(x, y, xo, yo, xi, yi, 64, 64);
+    in_copy.compute_at(output, xo);
+    hw_output.compute_at(output, xo).tile(x, y, xo, yo, xi, yi, 64, 64);
+    hw_output.accelerate({in_copy}, xi, xo);
+    blur.linebuffer();
+
+    std::string dir = Internal::get_test_tmp_dir();
+    std::string testbench_file = dir + "hls_profile_counters.cpp";
+    Internal::ensure_no_file_exists(testbench_file);
+    Internal::ensure_no_file_exists(dir + "hls_target.cpp");
+    output.compile_to_hls(testbench_file, {in}, "hls_profile_counters", target);
+    kernel = read_file(dir + "hls_target.cpp");
+    testbench = read_file(testbench_file);
+}
+
+int main(int argc, char **argv) {
+    Target target = get_host_target().with_feature(Target::CPlusPlusMangling);
+    std::string kernel, testbench;
+
+    compile(target, kernel, testbench);
+    if (contains(kernel, "hw_counter_") || contains(testbench, "hw_counters")) {
+        printf("Cycle counters were added without profiling\n");
+        return -1;
+    }
+
+    // Each of the two kernels counts its active and stalled cycles
+    // into three ports of the accelerator.
+    compile(target.with_feature(Target::Profile), kernel, testbench);
+    for (int i = 0; i < 6; i++) {
+        std::string port = "hw_counter_" + std::to_string(i);
+        if (!contains(kernel, "uint64_t &" + port) ||
+            !contains(kernel, "port=" + port + " bundle=config")) {
+            printf("Missing counter port %s\n", port.c_str());
+            return -1;
+        }
+    }
+    if (contains(kernel, "hw_counter_6")) {
+        printf("Too many counter ports\n");
+        return -1;
+    }
+    for (int i = 0; i < 2; i++) {
+        std::string n = std::to_string(i);
+        if (!contains(kernel, "_hw_active_" + n + "++;") ||
+            !contains(kernel, ".empty()) _hw_stalled_in_" + n + "++;") ||
+            !contains(kernel, ".full()) _hw_stalled_out_" + n + "++;")) {
+            printf("Kernel %d doesn't count its cycles\n", i);
+            return -1;
+        }
+    }
+
+    // The testbench passes the counters to the accelerator, and
+    // reports them to the profiler once it returns.
+    size_t call = testbench.find("hw_counters[5]);");
+    size_t update = testbench.find("halide_profiler_hw_kernels_update(_profiler_pipeline_state, 2, ");
+    if (call == std::string::npos || update == std::string::npos || update < call) {
+        printf("The testbench doesn't collect the counters\n");
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,88 @@
+#include "Halide.h"
+#include <stdio.h>
+#include <fstream>
+#include <sstream>
+
+#include "test/common/halide_test_dirs.h"
+
+using namespace Halide;
+
+std::string read_file(const std::string &filename) {
+    std::ifstream f(filename);
+    std::ostringstream contents;
+    contents << f.rdbuf();
+    return contents.str();
+}
+
+bool contains(const std::string &s, const std::string &pattern) {
+    return s.find(pattern) != std::string::npos;
+}
+
+// Accelerate a pointwise pipeline over 64x64 tiles with the given beat
+// width on both of its streams, and return the generated kernel and
+// testbench.
+void compile(int bits, std::string &kernel, std::string &testbench) {
+    Var x("x"), y("y"), xo("xo"), yo("yo"), xi("xi"), yi("yi");
+    ImageParam in(UInt(8), 2, "in");
+
+    Func in_copy("in_copy"), hw_output("hw_output"), output("output");
+    in_copy(x, y) = in(x, y);
+    hw_output(x, y) = in_copy(x, y) * 2;
+    output(x, y) = hw_output(x, y);
+
+    output.tile(x, y, xo, yo, xi, yi, 64, 64);
+    in_copy.compute_at(output, xo);
+    hw_output.compute_at(output, xo).tile(x, y, xo, yo, xi, yi, 64, 64);
+    hw_output.accelerate({in_copy}, xi, xo);
+    in_copy.stream_beat_width(bits);
+    hw_output.stream_beat_width(bits);
+
+    Target target = get_host_target().with_feature(Target::CPlusPlusMangling);
+    std::string dir = Internal::get_test_tmp_dir();
+    std::string testbench_file = dir + "hls_stream_beat_width.cpp";
+    Internal::ensure_no_file_exists(testbench_file);
+    Internal::ensure_no_file_exists(dir + "hls_target.cpp");
+    output.compile_to_hls(testbench_file, {in}, "hls_stream_beat_width", target);
+    kernel = read_file(dir + "hls_target.cpp");
+    testbench = read_file(testbench_file);
+}
+
+int main(int argc, char **argv) {
+    std::string kernel, testbench;
+
+    // 64 bit beats hold eight 8-bit stencils, which the accelerator
+    // splits up in front of the kernel and merges behind it.
+    compile(64, kernel, testbench);
+    if (!contains(kernel, "hls::stream<AxiPackedStencil<uint8_t, 8, 1> > &arg_0") ||
+        !contains(kernel, "hls::stream<AxiPackedStencil<uint8_t, 8, 1> > &arg_1") ||
+        !contains(kernel, "unpack_stream<0>(") ||
+        !contains(kernel, "pack_stream<0>(")) {
+        printf("The streams were not packed into 64 bit beats\n");
+        return -1;
+    }
+    if (!contains(testbench, "subimage_to_stream(_in_copy_buffer, _in_copy_packed_stream") ||
+        !contains(testbench, "stream_to_subimage(_hw_output_buffer, _hw_output_packed_stream")) {
+        printf("The testbench doesn't stream the packed beats\n");
+        return -1;
+    }
+
+    compile(128, kernel, testbench);
+    if (!contains(kernel, "AxiPackedStencil<uint8_t, 16, 1>")) {
+        printf("The streams were not packed into 128 bit beats\n");
+        return -1;
+    }
+
+    // Neither three nor five stencils per beat divide the tile, so
+    // those streams are not packed.
+    for (int bits : {24, 40}) {
+        compile(bits, kernel, testbench);
+        if (contains(kernel, "pack_stream") ||
+            !contains(kernel, "hls::stream<AxiPackedStencil<uint8_t, 1, 1> > &arg_0")) {
+            printf("A beat width of %d bits should fall back to one stencil per beat\n", bits);
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,68 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+
+// The Debug feature makes a pipeline print as it runs, so it's used
+// here to tell which of the targets was picked.
+int prints = 0;
+void my_print(void *user_context, const char *message) {
+    prints++;
+}
+
+bool run(const std::vector<Target> &targets, bool expect_debug) {
+    Func f;
+    Var x, y;
+    f(x, y) = x * 3 + y;
+    f.vectorize(x, 8);
+    f.set_custom_print(&my_print);
+    f.compile_jit(targets);
+
+    prints = 0;
+    Buffer<int> out = f.realize(32, 32);
+    for (int y = 0; y < out.height(); y++) {
+        for (int x = 0; x < out.width(); x++) {
+            if (out(x, y) != x * 3 + y) {
+                printf("out(%d, %d) = %d instead of %d\n", x, y, out(x, y), x * 3 + y);
+                return false;
+            }
+        }
+    }
+
+    if ((prints > 0) != expect_debug) {
+        printf("Expected the %s target to be used\n", expect_debug ? "first" : "last");
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    Target host = get_jit_target_from_environment();
+
+    // Debug isn't a cpu feature, so the first target can be used.
+    if (!run({host.with_feature(Target::Debug), host}, true)) {
+        return -1;
+    }
+
+    // A target with a cpu feature this machine doesn't have must not
+    // be used.
+    if (host.arch == Target::X86) {
+        Target::Feature missing = Target::FeatureEnd;
+        for (Target::Feature f : {Target::SSE41, Target::AVX, Target::AVX2,
+                                  Target::FMA, Target::F16C, Target::AVX512}) {
+            if (!get_host_target().has_feature(f)) {
+                missing = f;
+                break;
+            }
+        }
+        if (missing != Target::FeatureEnd) {
+            Target unusable = host.with_feature(missing).with_feature(Target::Debug);
+            if (!run({unusable, host}, false)) {
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
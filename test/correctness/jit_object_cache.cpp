@@ -0,0 +1,116 @@
+#include "Halide.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+int main(int argc, char **argv) {
+    printf("Skipping test on Windows\n");
+    return 0;
+}
+#else
+
+#include <dirent.h>
+#include <map>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace Halide;
+
+// The files in a directory, and their inodes. Saving an entry to the
+// cache writes a new file and renames it into place, so an entry
+// compiled again gets a new inode even if its contents are the same.
+std::map<std::string, ino_t> list_dir(const std::string &dir) {
+    std::map<std::string, ino_t> result;
+    DIR *d = opendir(dir.c_str());
+    if (!d) {
+        return result;
+    }
+    while (dirent *e = readdir(d)) {
+        std::string name = e->d_name;
+        struct stat s;
+        if (name != "." && name != ".." && stat((dir + "/" + name).c_str(), &s) == 0) {
+            result[name] = s.st_ino;
+        }
+    }
+    closedir(d);
+    return result;
+}
+
+int run_pipeline(int k) {
+    Func f("f");
+    Var x("x"), y("y");
+    f(x, y) = x * k + y;
+    f.vectorize(x, 4);
+
+    Buffer<int> out = f.realize(16, 16);
+    for (int y = 0; y < out.height(); y++) {
+        for (int x = 0; x < out.width(); x++) {
+            if (out(x, y) != x * k + y) {
+                printf("out(%d, %d) = %d instead of %d\n", x, y, out(x, y), x * k + y);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    std::string dir = Internal::dir_make_temp();
+    setenv("HL_JIT_CACHE_DIR", dir.c_str(), 1);
+
+    // Compile the pipeline in a child process first, as a stand-in for
+    // an earlier run of the program.
+    pid_t pid = fork();
+    if (pid == 0) {
+        exit(run_pipeline(3) ? 1 : 0);
+    }
+    int status = 0;
+    if (pid < 0 || waitpid(pid, &status, 0) != pid ||
+        !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        printf("The child process failed\n");
+        return -1;
+    }
+    std::map<std::string, ino_t> entries = list_dir(dir);
+    if (entries.empty()) {
+        printf("Nothing was saved to the JIT cache\n");
+        return -1;
+    }
+
+    // The same pipeline compiled here should be loaded from the cache,
+    // leaving the entries as they were.
+    if (run_pipeline(3)) {
+        return -1;
+    }
+    if (list_dir(dir) != entries) {
+        printf("An identical pipeline was compiled again\n");
+        return -1;
+    }
+
+    // A different one should be compiled and saved, and leave the
+    // existing entries alone.
+    if (run_pipeline(5)) {
+        return -1;
+    }
+    std::map<std::string, ino_t> new_entries = list_dir(dir);
+    if (new_entries.size() != entries.size() + 1) {
+        printf("A different pipeline wasn't saved to the JIT cache\n");
+        return -1;
+    }
+    for (const auto &e : entries) {
+        if (new_entries[e.first] != e.second) {
+            printf("%s was saved again\n", e.first.c_str());
+            return -1;
+        }
+    }
+
+    for (const auto &e : list_dir(dir)) {
+        Internal::file_unlink(dir + "/" + e.first);
+    }
+    Internal::dir_rmdir(dir);
+
+    printf("Success!\n");
+    return 0;
+}
+
+#endif
@@ -0,0 +1,114 @@
+#include "Halide.h"
+#include <stdio.h>
+#include <functional>
+
+using namespace Halide;
+
+bool check(const Buffer<int> &result, std::function<int(int, int)> correct) {
+    for (int y = 0; y < result.height(); y++) {
+        for (int x = 0; x < result.width(); x++) {
+            if (result(x, y) != correct(x, y)) {
+                printf("result(%d, %d) = %d instead of %d\n", x, y, result(x, y), correct(x, y));
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    Var x("x"), y("y");
+
+    {
+        // The region of f computed depends on the value bounds of h,
+        // which depend on the range of p. Lowering again after the
+        // range changes must not reuse the old bounds.
+        Param<int> p;
+        Func f("f"), h("h"), out("out");
+        h(x, y) = p + x % 2;
+        f(x, y) = x * 2 + y;
+        out(x, y) = f(h(x, y), y);
+        h.compute_root();
+        f.compute_root();
+
+        p.set_range(0, 10);
+        p.set(5);
+        Buffer<int> result = out.realize(8, 8);
+        if (!check(result, [](int x, int y) { return (5 + x % 2) * 2 + y; })) {
+            return -1;
+        }
+
+        p.set_range(0, 100);
+        p.set(50);
+        // Any change to the schedule lowers the pipeline again.
+        f.compute_root();
+        result = out.realize(8, 8);
+        if (!check(result, [](int x, int y) { return (50 + x % 2) * 2 + y; })) {
+            return -1;
+        }
+    }
+
+    {
+        // The value bounds of a Func that uses a Param with no range
+        // can be cached too, and must not be reused once it has one.
+        Param<int> p;
+        Func f("f"), h("h"), out("out");
+        h(x, y) = clamp(p, 0, 10) + x % 2;
+        f(x, y) = x * 2 + y;
+        out(x, y) = f(h(x, y) + p, y);
+        h.compute_root();
+        f.compute_root();
+
+        p.set(3);
+        Buffer<int> result = out.realize(8, 8);
+        if (!check(result, [](int x, int y) { return (3 + x % 2 + 3) * 2 + y; })) {
+            return -1;
+        }
+
+        p.set_range(0, 20);
+        p.set(20);
+        f.compute_root();
+        result = out.realize(8, 8);
+        if (!check(result, [](int x, int y) { return (10 + x % 2 + 20) * 2 + y; })) {
+            return -1;
+        }
+    }
+
+    {
+        // Switching back and forth between schedules, as tuning does,
+        // lowers the same Funcs again with value bounds from the
+        // cache. They must still be right for each schedule.
+        const int W = 128, H = 128;
+        Buffer<int> in(W + 2, H + 2);
+        in.for_each_element([&](int x, int y) { in(x, y) = (x * 7 + y * 13) % 64; });
+
+        Func blur_x("blur_x"), blur_y("blur_y");
+        blur_x(x, y) = in(x, y) + in(x + 1, y) + in(x + 2, y);
+        blur_y(x, y) = blur_x(x, y) + blur_x(x, y + 1) + blur_x(x, y + 2);
+        auto correct = [&](int x, int y) {
+            int sum = 0;
+            for (int dy = 0; dy < 3; dy++) {
+                for (int dx = 0; dx < 3; dx++) {
+                    sum += in(x + dx, y + dy);
+                }
+            }
+            return sum;
+        };
+
+        AutoScheduleParams schedules[2];
+        schedules[1].tile_width = 32;
+        schedules[1].tile_height = 8;
+        schedules[1].vector_factor = 2;
+
+        for (int i = 0; i < 4; i++) {
+            blur_y.auto_schedule({W, H}, schedules[i % 2]);
+            Buffer<int> result = blur_y.realize(W, H);
+            if (!check(result, correct)) {
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,65 @@
+#include "Halide.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+
+using namespace Halide;
+
+#ifdef _WIN32
+#define DLLEXPORT __declspec(dllexport)
+#else
+#define DLLEXPORT
+#endif
+
+const int max_size = 10000;
+std::atomic<int> runs[max_size];
+
+// Count the runs of each iteration. Some iterations take much longer
+// than others, so that threads finish their own slices at different
+// times and steal from each other.
+extern "C" DLLEXPORT int count_run(int x) {
+    volatile int work = 0;
+    for (int i = 0; i < (x % 7) * 1000; i++) {
+        work = work + i;
+    }
+    runs[x]++;
+    return x;
+}
+HalideExtern_1(int, count_run, int);
+
+bool check(int size) {
+    for (int i = 0; i < max_size; i++) {
+        runs[i] = 0;
+    }
+
+    Var x;
+    Func f;
+    f(x) = count_run(x);
+    f.parallel(x);
+    Buffer<int> out = f.realize(size);
+
+    for (int i = 0; i < size; i++) {
+        if (out(i) != i || runs[i] != 1) {
+            printf("Iteration %d of %d ran %d times\n", i, size, (int)runs[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    // More threads than fit in the slices kept on the stack, so that
+    // large loops put their slices on the heap.
+    setenv("HL_NUM_THREADS", "40", 1);
+
+    // Loops with fewer iterations than threads get a slice per
+    // iteration, on the stack. The rest get a slice per thread.
+    for (int size : {1, 5, 16, 17, 39, 40, 41, 1000, max_size}) {
+        if (!check(size)) {
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
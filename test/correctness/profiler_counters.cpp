@@ -0,0 +1,130 @@
+#include "Halide.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+using namespace Halide;
+
+std::vector<std::string> report;
+void my_print(void *, const char *msg) {
+    report.push_back(msg);
+}
+
+bool contains(const std::string &s, const std::string &pattern) {
+    return s.find(pattern) != std::string::npos;
+}
+
+// Check a line of hardware counters, and return whether it's marked
+// approximate.
+bool check_counters_line(const std::string &line, bool *approximate) {
+    unsigned long long cycles = 0;
+    float ipc = 0, llc = -1, branch = -1;
+    size_t start = line.find("cycles/run:");
+    if (start == std::string::npos ||
+        sscanf(line.c_str() + start, "cycles/run: %llu  ipc: %f  llc misses/kinst: %f  branch misses/kinst: %f",
+               &cycles, &ipc, &llc, &branch) != 4 ||
+        cycles == 0 || ipc <= 0 || llc < 0 || branch < 0) {
+        printf("Bad counters: %s\n", line.c_str());
+        return false;
+    }
+    *approximate = contains(line, "(approximate)");
+    return true;
+}
+
+// Profile a pipeline with a slow Func, computed serially or in
+// parallel, and check the counters in its report. Returns -1 on
+// failure, 0 if the counters were left out, and 1 if they were
+// reported.
+int run_test(bool parallel) {
+    Func slow("slow"), out("out");
+    Var x, y;
+    Expr e = cast<float>(x + y);
+    for (int i = 0; i < 100; i++) {
+        e = sin(e);
+    }
+    slow(x, y) = e;
+    out(x, y) = slow(x, y) * 2;
+    slow.compute_root();
+    if (parallel) {
+        slow.parallel(y);
+    }
+
+    report.clear();
+    out.set_custom_print(&my_print);
+    Target t = get_jit_target_from_environment().with_feature(Target::Profile);
+    out.realize(1000, 1000, t);
+
+    bool pipeline_seen = false, slow_seen = false, counters_seen = false;
+    for (const std::string &msg : report) {
+        size_t counters = msg.find("cycles/run:");
+        if (contains(msg, " total time:")) {
+            pipeline_seen = true;
+            if (counters != std::string::npos) {
+                // The pipeline's totals are exact.
+                bool approximate;
+                if (!check_counters_line(msg.substr(counters), &approximate) || approximate) {
+                    printf("Bad pipeline counters in:\n%s", msg.c_str());
+                    return -1;
+                }
+                counters_seen = true;
+            }
+        } else if (contains(msg, "  slow: ")) {
+            slow_seen = true;
+            if (counters_seen != (counters != std::string::npos)) {
+                printf("The counters were reported for the pipeline or slow, but not both:\n%s", msg.c_str());
+                return -1;
+            }
+            if (counters != std::string::npos) {
+                bool approximate;
+                if (!check_counters_line(msg.substr(counters), &approximate)) {
+                    return -1;
+                }
+                // Only a Func that shared its samples with other
+                // threads gets their counts too.
+                float threads = 1;
+                size_t t = msg.find("threads: ");
+                if (t != std::string::npos) {
+                    threads = atof(msg.c_str() + t + 9);
+                }
+                if (approximate != (threads > 1)) {
+                    printf("slow used %f threads, but its counters are%s marked approximate:\n%s",
+                           threads, approximate ? "" : " not", msg.c_str());
+                    return -1;
+                }
+            }
+        }
+    }
+    if (!pipeline_seen || !slow_seen) {
+        printf("Missing lines in the report:\n");
+        for (const std::string &msg : report) {
+            printf("%s", msg.c_str());
+        }
+        return -1;
+    }
+    return counters_seen ? 1 : 0;
+}
+
+int main(int argc, char **argv) {
+    // Read when the profiler starts.
+    setenv("HL_PROFILER_COUNTERS", "1", 1);
+
+    int serial = run_test(false);
+    int parallel = run_test(true);
+    if (serial < 0 || parallel < 0) {
+        return -1;
+    }
+    if (serial != parallel) {
+        printf("The counters were only reported for some runs\n");
+        return -1;
+    }
+    if (!serial) {
+        // perf_event_open isn't allowed here, or the counters aren't
+        // supported on this platform. The report should still be
+        // there, without them.
+        printf("Hardware counters are not available; checked the report without them\n");
+    }
+
+    printf("Success!\n");
+    return 0;
+}
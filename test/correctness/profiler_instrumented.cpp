@@ -0,0 +1,91 @@
+#include "Halide.h"
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+using namespace Halide;
+
+std::vector<std::string> report;
+void my_print(void *, const char *msg) {
+    report.push_back(msg);
+}
+
+// Find a distribution with the given label in the report, and check
+// that its minimum, mean and 99th percentile are in order.
+bool check_distribution(const std::string &msg, const std::string &label) {
+    size_t start = msg.find(label + " min: ");
+    float min = -1, mean = -1, p99 = -1;
+    if (start == std::string::npos ||
+        sscanf(msg.c_str() + start + label.size(), " min: %fms  mean: %fms  p99: %fms",
+               &min, &mean, &p99) != 3) {
+        printf("No %s distribution in:\n%s", label.c_str(), msg.c_str());
+        return false;
+    }
+    if (min < 0 || min > mean || mean > p99) {
+        printf("%s: min %f, mean %f and p99 %f are out of order\n", label.c_str(), min, mean, p99);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    // The rows of g take different amounts of time, so its tasks have
+    // a spread of durations.
+    Func f("f"), g("g"), out("out");
+    Var x, y;
+    f(x, y) = cast<float>(x + y);
+    Expr e = f(x, y);
+    RDom r(0, 200);
+    g(x, y) = 0.0f;
+    g(x, y) += select(r < y * 3, sin(e + r), 0.0f);
+    out(x, y) = g(x, y) + f(x, y);
+
+    f.compute_root();
+    g.compute_root().parallel(y);
+    out.set_custom_print(&my_print);
+
+    Target t = get_jit_target_from_environment()
+        .with_feature(Target::Profile)
+        .with_feature(Target::ProfileInstrumented);
+    out.realize(256, 64, t);
+
+    bool pipeline_seen = false;
+    int funcs_seen = 0;
+    for (const std::string &msg : report) {
+        if (msg.find(" total time:") != std::string::npos) {
+            pipeline_seen = true;
+            int tasks = 0;
+            size_t p = msg.find(" parallel tasks: ");
+            if (p != std::string::npos) {
+                sscanf(msg.c_str() + p, " parallel tasks: %d", &tasks);
+            }
+            if (tasks != 64) {
+                printf("Expected 64 parallel tasks, got %d\n", tasks);
+                return -1;
+            }
+            if (!check_distribution(msg, " time/run") ||
+                !check_distribution(msg, "  time/task")) {
+                return -1;
+            }
+        } else {
+            for (const char *name : {"  f: ", "  g: ", "  out: "}) {
+                if (msg.find(name) == 0) {
+                    if (!check_distribution(msg, "    time/run")) {
+                        return -1;
+                    }
+                    funcs_seen++;
+                }
+            }
+        }
+    }
+    if (!pipeline_seen || funcs_seen != 3) {
+        printf("Missing lines in the report:\n");
+        for (const std::string &msg : report) {
+            printf("%s", msg.c_str());
+        }
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
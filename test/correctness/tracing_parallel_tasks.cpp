@@ -0,0 +1,66 @@
+#include "Halide.h"
+#include <stdio.h>
+#include <map>
+#include <mutex>
+
+using namespace Halide;
+
+std::mutex lock;
+std::map<int, int> open_tasks;
+int tasks_seen[16];
+int errors = 0;
+
+int my_trace(void *user_context, const halide_trace_event_t *e) {
+    static int id = 1;
+    std::lock_guard<std::mutex> guard(lock);
+    int my_id = id++;
+    if (e->event == halide_trace_begin_task) {
+        if (e->dimensions != 1 || std::string(e->func) != "f.s0.y") {
+            printf("Bad begin task event for %s\n", e->func);
+            errors++;
+        } else {
+            int idx = e->coordinates[0];
+            if (idx < 0 || idx >= 16) {
+                printf("Task index out of range: %d\n", idx);
+                errors++;
+            } else {
+                tasks_seen[idx]++;
+                open_tasks[my_id] = idx;
+            }
+        }
+    } else if (e->event == halide_trace_end_task) {
+        if (!open_tasks.erase(e->parent_id)) {
+            printf("End task event that doesn't match a begin task event\n");
+            errors++;
+        }
+    }
+    return my_id;
+}
+
+int main(int argc, char **argv) {
+    Func f;
+    Var x, y;
+    f(x, y) = x + y;
+    f.parallel(y);
+    f.set_custom_trace(&my_trace);
+
+    Target t = get_jit_target_from_environment().with_feature(Target::TraceRealizations);
+    f.realize(8, 16, t);
+
+    for (int i = 0; i < 16; i++) {
+        if (tasks_seen[i] != 1) {
+            printf("Task %d was traced %d times\n", i, tasks_seen[i]);
+            return -1;
+        }
+    }
+    if (!open_tasks.empty()) {
+        printf("%d tasks were never ended\n", (int)open_tasks.size());
+        return -1;
+    }
+    if (errors) {
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
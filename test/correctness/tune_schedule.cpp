@@ -0,0 +1,99 @@
+#include "Halide.h"
+#include <stdio.h>
+#include <fstream>
+
+#include "test/common/halide_test_dirs.h"
+
+using namespace Halide;
+
+Func make_pipeline(ImageParam input) {
+    Var x("x"), y("y");
+    Func clamped = BoundaryConditions::repeat_edge(input);
+    Func blur_x("blur_x"), blur_y("blur_y");
+    blur_x(x, y) = clamped(x - 1, y) + clamped(x, y) + clamped(x + 1, y);
+    blur_y(x, y) = blur_x(x, y - 1) + blur_x(x, y) + blur_x(x, y + 1);
+    return blur_y;
+}
+
+bool check(const Buffer<int> &result, const Buffer<int> &correct) {
+    for (int y = 0; y < result.height(); y++) {
+        for (int x = 0; x < result.width(); x++) {
+            if (result(x, y) != correct(x, y)) {
+                printf("result(%d, %d) = %d instead of %d\n", x, y, result(x, y), correct(x, y));
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    const int W = 256, H = 256;
+    ImageParam input(Int(32), 2);
+    Buffer<int> in(W, H);
+    in.for_each_element([&](int x, int y) { in(x, y) = (x * 7 + y * 13) % 64; });
+    input.set(in);
+
+    Buffer<int> correct = make_pipeline(input).realize(W, H);
+
+    std::string filename = Internal::get_test_tmp_dir() + "tune_schedule.txt";
+    Internal::ensure_no_file_exists(filename);
+
+    // Only try a few candidates, to keep the test quick.
+    std::vector<AutoScheduleParams> candidates(3);
+    candidates[0].max_recompute = 0;
+    candidates[1].tile_width = 32;
+    candidates[1].tile_height = 8;
+    candidates[2].vector_factor = 2;
+
+    Target target = get_jit_target_from_environment();
+    Buffer<int> result(W, H);
+    Func tuned = make_pipeline(input);
+    std::string schedule = tuned.tune_schedule(result, filename, candidates, target);
+    printf("%s", schedule.c_str());
+    Internal::assert_file_exists(filename);
+
+    result.fill(0);
+    tuned.realize(result);
+    if (!check(result, correct)) {
+        return -1;
+    }
+
+    // The file should have at least one schedule for the target, and
+    // the fastest should be the one applied.
+    std::ifstream f(filename);
+    std::string key = target.without_feature(Target::JIT).to_string();
+    std::string line, first;
+    while (std::getline(f, line)) {
+        if (line.compare(0, key.size() + 1, key + " ") == 0 && first.empty()) {
+            first = line;
+        }
+    }
+    if (first.empty()) {
+        printf("No schedule recorded for %s\n", key.c_str());
+        return -1;
+    }
+    printf("Fastest schedule: %s\n", first.c_str());
+
+    // A Generator compiling for the same machine gets the same
+    // parameters, which the first line of the schedule describes.
+    Func loaded = make_pipeline(input);
+    std::string loaded_schedule = loaded.apply_tuned_schedule(filename, {W, H}, target.without_feature(Target::JIT));
+    auto params_of = [](const std::string &s) {
+        size_t start = s.find(" with "), end = s.find(" and estimated");
+        return s.substr(start, end - start);
+    };
+    if (params_of(loaded_schedule) != params_of(schedule)) {
+        printf("Loaded schedule differs from the tuned one:\n%s", loaded_schedule.c_str());
+        return -1;
+    }
+
+    result.fill(0);
+    loaded.realize(result);
+    if (!check(result, correct)) {
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,20 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    Func f, g;
+    Var x, y;
+
+    f(x, y) = x + y;
+    g(x, y) = f(x, y) + f(x + 1, y);
+
+    // auto_schedule can't reset memoization, so it should refuse to
+    // schedule the pipeline rather than keep it.
+    f.compute_root().memoize();
+    g.auto_schedule({128, 128});
+
+    printf("Should have refused to auto-schedule a memoized Func!\n");
+    return -1;
+}
@@ -0,0 +1,131 @@
+#include "HalideRuntime.h"
+#include "HalideBuffer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "memoize_backing_file.h"
+#include "test/common/halide_test_dirs.h"
+
+using namespace Halide::Runtime;
+
+int calls = 0;
+
+extern "C" int count_calls(int x, int y) {
+    calls++;
+    return x + y;
+}
+
+enum Outcome {
+    Computed = 0,
+    Loaded = 1,
+    Failed = 2
+};
+
+// Run the pipeline once with the given backing file, and report
+// whether the memoized result came from the file.
+int run_child(const char *path, uint64_t fingerprint, int scale) {
+    if (halide_memoization_cache_set_backing_file(NULL, path, 1 << 20, 0, fingerprint) != 0) {
+        printf("Could not attach the backing file\n");
+        return Failed;
+    }
+
+    Buffer<int> out(32, 32);
+    if (memoize_backing_file(scale, out) != 0) {
+        printf("memoize_backing_file failed\n");
+        return Failed;
+    }
+    for (int y = 0; y < out.height(); y++) {
+        for (int x = 0; x < out.width(); x++) {
+            if (out(x, y) != (x + y) * scale + 1) {
+                printf("out(%d, %d) = %d instead of %d\n", x, y, out(x, y), (x + y) * scale + 1);
+                return Failed;
+            }
+        }
+    }
+
+    halide_memoization_cache_stats_t stats;
+    halide_memoization_cache_get_stats(&stats);
+    if (calls == 0 && stats.backing_loads == 1 && stats.backing_saves == 0) {
+        return Loaded;
+    } else if (calls == out.width() * out.height() && stats.backing_loads == 0 && stats.backing_saves == 1) {
+        return Computed;
+    }
+    printf("%d calls, %llu loads and %llu saves\n", calls,
+           (unsigned long long)stats.backing_loads, (unsigned long long)stats.backing_saves);
+    return Failed;
+}
+
+#ifndef _WIN32
+// Run the pipeline in a new process, so that nothing but the backing
+// file carries over from the previous run.
+int run_in_new_process(const char *argv0, const std::string &path, uint64_t fingerprint, int scale) {
+    std::string fingerprint_str = std::to_string(fingerprint);
+    std::string scale_str = std::to_string(scale);
+    pid_t pid = fork();
+    if (pid == 0) {
+        execl(argv0, argv0, path.c_str(), fingerprint_str.c_str(), scale_str.c_str(), (char *)NULL);
+        _exit(Failed);
+    }
+    int status = 0;
+    if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status)) {
+        return Failed;
+    }
+    return WEXITSTATUS(status);
+}
+#endif
+
+int main(int argc, char **argv) {
+    if (argc == 4) {
+        return run_child(argv[1], strtoull(argv[2], NULL, 10), atoi(argv[3]));
+    }
+
+#ifdef _WIN32
+    printf("Skipping test because the backing file is only supported on POSIX platforms\n");
+    printf("Success!\n");
+    return 0;
+#else
+    if (sizeof(void *) != 8) {
+        printf("Skipping test because the backing file is only supported on 64-bit platforms\n");
+        printf("Success!\n");
+        return 0;
+    }
+
+    std::string path = Halide::Internal::get_test_tmp_dir() + "memoize_backing_file.cache";
+    remove(path.c_str());
+
+    struct {
+        uint64_t fingerprint;
+        int scale;
+        int expected;
+        const char *what;
+    } runs[] = {
+        {1, 3, Computed, "The first run"},
+        {1, 3, Loaded, "A run of the same build"},
+        {1, 5, Computed, "A run with a different parameter"},
+        {1, 5, Loaded, "A second run with that parameter"},
+        {1, 3, Loaded, "A run with the first parameter again"},
+        {2, 3, Computed, "A run of a different build"},
+        {2, 3, Loaded, "A second run of that build"},
+    };
+    for (const auto &run : runs) {
+        int outcome = run_in_new_process(argv[0], path, run.fingerprint, run.scale);
+        if (outcome != run.expected) {
+            printf("%s should have %s the result, but %s\n", run.what,
+                   run.expected == Loaded ? "loaded" : "computed",
+                   outcome == Loaded ? "loaded it" : outcome == Computed ? "computed it" : "failed");
+            return -1;
+        }
+    }
+
+    remove(path.c_str());
+    printf("Success!\n");
+    return 0;
+#endif
+}
@@ -0,0 +1,26 @@
+#include "Halide.h"
+
+namespace {
+
+HalideExtern_2(int, count_calls, int, int);
+
+class MemoizeBackingFile : public Halide::Generator<MemoizeBackingFile> {
+public:
+    Param<int> scale{"scale"};
+
+    Func build() {
+        Func f("f"), g("g");
+        Var x, y;
+
+        f(x, y) = count_calls(x, y) * scale;
+        g(x, y) = f(x, y) + 1;
+
+        f.compute_root().memoize();
+
+        return g;
+    }
+};
+
+Halide::RegisterGenerator<MemoizeBackingFile> register_my_gen{"memoize_backing_file"};
+
+}  // namespace
@@ -0,0 +1,176 @@
+#include "HalideRuntime.h"
+#include "HalideBuffer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memoize_threads.h"
+
+using namespace Halide::Runtime;
+
+// Each key's result is a 16x16 int32 buffer, and there are enough
+// keys to fill every shard of the cache several times over.
+const int kSize = 16;
+const int kResultBytes = kSize * kSize * sizeof(int32_t);
+const int kNumKeys = 200;
+const int kNumThreads = 8;
+const int kIterations = 2000;
+
+volatile bool failed = false;
+
+int32_t value_of(int key, int x, int y) {
+    return key * 65536 + y * 256 + x;
+}
+
+// Look up the result for a key directly through the runtime's cache
+// API, computing and storing it on a miss, and check it on a hit.
+void lookup_or_store(int key) {
+    char cache_key[32];
+    int key_size = snprintf(cache_key, sizeof(cache_key), "memoize_threads key %d", key);
+
+    halide_dimension_t computed_shape[2] = {{0, kSize, 1, 0}, {0, kSize, kSize, 0}};
+    halide_dimension_t shape[2] = {{0, kSize, 1, 0}, {0, kSize, kSize, 0}};
+    halide_buffer_t computed_bounds;
+    memset(&computed_bounds, 0, sizeof(computed_bounds));
+    computed_bounds.dimensions = 2;
+    computed_bounds.dim = computed_shape;
+    halide_buffer_t buf;
+    memset(&buf, 0, sizeof(buf));
+    buf.type = halide_type_of<int32_t>();
+    buf.dimensions = 2;
+    buf.dim = shape;
+    halide_buffer_t *tuple_buffers[1] = {&buf};
+
+    int result = halide_memoization_cache_lookup(NULL, (const uint8_t *)cache_key, key_size,
+                                                 &computed_bounds, 1, tuple_buffers);
+    if (result < 0) {
+        printf("Lookup of key %d failed\n", key);
+        failed = true;
+        return;
+    }
+    int32_t *data = (int32_t *)buf.host;
+    if (result == 0) {
+        for (int y = 0; y < kSize; y++) {
+            for (int x = 0; x < kSize; x++) {
+                if (data[y * kSize + x] != value_of(key, x, y)) {
+                    printf("Hit for key %d has the wrong contents at (%d, %d)\n", key, x, y);
+                    failed = true;
+                }
+            }
+        }
+    } else {
+        for (int y = 0; y < kSize; y++) {
+            for (int x = 0; x < kSize; x++) {
+                data[y * kSize + x] = value_of(key, x, y);
+            }
+        }
+        halide_memoization_cache_store(NULL, (const uint8_t *)cache_key, key_size,
+                                       &computed_bounds, 1, tuple_buffers);
+    }
+    halide_memoization_cache_release(NULL, buf.host);
+}
+
+void hammer_cache(void *arg) {
+    unsigned seed = (unsigned)(uintptr_t)arg;
+    for (int i = 0; i < kIterations && !failed; i++) {
+        // Most lookups go to a few hot keys, so there are both hits
+        // and evictions.
+        seed = seed * 1103515245 + 12345;
+        int r = (seed >> 8) % 100;
+        int key = r < 70 ? r % 8 : (seed >> 16) % kNumKeys;
+        lookup_or_store(key);
+    }
+}
+
+void run_pipeline(void *arg) {
+    unsigned seed = (unsigned)(uintptr_t)arg;
+    Buffer<int32_t> out(kSize, kSize);
+    for (int i = 0; i < kIterations / 10 && !failed; i++) {
+        seed = seed * 1103515245 + 12345;
+        int key = (seed >> 8) % 16;
+        if (memoize_threads(key, out) != 0) {
+            printf("memoize_threads failed\n");
+            failed = true;
+            return;
+        }
+        for (int y = 0; y < kSize; y++) {
+            for (int x = 0; x < kSize; x++) {
+                if (out(x, y) != value_of(key, x, y) * 2) {
+                    printf("out(%d, %d) = %d for key %d\n", x, y, out(x, y), key);
+                    failed = true;
+                    return;
+                }
+            }
+        }
+    }
+}
+
+bool run_threads(void (*f)(void *)) {
+    halide_thread *threads[kNumThreads];
+    for (int i = 0; i < kNumThreads; i++) {
+        threads[i] = halide_spawn_thread(f, (void *)(uintptr_t)(i + 1));
+    }
+    for (int i = 0; i < kNumThreads; i++) {
+        halide_join_thread(threads[i]);
+    }
+    return !failed;
+}
+
+int main(int argc, char **argv) {
+    // Room for a tenth of the keys.
+    const int64_t max_size = kResultBytes * kNumKeys / 10;
+    halide_memoization_cache_set_size(max_size);
+
+    if (!run_threads(hammer_cache)) {
+        return -1;
+    }
+
+    halide_memoization_cache_stats_t stats;
+    halide_memoization_cache_get_stats(&stats);
+    if (stats.hits + stats.misses != (uint64_t)kNumThreads * kIterations) {
+        printf("%llu hits and %llu misses for %d lookups\n",
+               (unsigned long long)stats.hits, (unsigned long long)stats.misses,
+               kNumThreads * kIterations);
+        return -1;
+    }
+    // A store of a result another thread stored first is dropped.
+    if (stats.hits == 0 || stats.stores == 0 || stats.stores > stats.misses) {
+        printf("Expected hits, and at most one store per miss\n");
+        return -1;
+    }
+    if (stats.evictions == 0 || stats.entries != stats.stores - stats.evictions) {
+        printf("Expected evictions, and the entries not evicted to remain\n");
+        return -1;
+    }
+
+    // Entries in use can push the cache over its size for a while.
+    // Now that nothing is, setting the size prunes it back to that.
+    halide_memoization_cache_set_size(max_size);
+    halide_memoization_cache_get_stats(&stats);
+    if (stats.current_size > max_size ||
+        stats.current_size != (int64_t)stats.entries * kResultBytes) {
+        printf("The cache holds %lld bytes in %llu entries with a limit of %lld\n",
+               (long long)stats.current_size, (unsigned long long)stats.entries,
+               (long long)max_size);
+        return -1;
+    }
+
+    // The cache starts empty again after cleaning up, and the
+    // generated code's lookups and stores are just as safe to run
+    // from many threads.
+    halide_memoization_cache_cleanup();
+    halide_memoization_cache_set_size(max_size);
+    if (!run_threads(run_pipeline)) {
+        return -1;
+    }
+    halide_memoization_cache_get_stats(&stats);
+    // Each of the 16 keys is stored again only after being evicted.
+    if (stats.hits == 0 || stats.stores > 16 + stats.evictions) {
+        printf("The pipeline's results were not reused\n");
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,27 @@
+#include "Halide.h"
+
+namespace {
+
+class MemoizeThreads : public Halide::Generator<MemoizeThreads> {
+public:
+    Param<int> key{"key"};
+
+    Func build() {
+        // A memoized Func whose results are keyed on a parameter, so
+        // that calls with different values of it get different
+        // entries in the cache.
+        Func f("f"), g("g");
+        Var x, y;
+
+        f(x, y) = x + y * 256 + key * 65536;
+        g(x, y) = f(x, y) * 2;
+
+        f.compute_root().memoize();
+
+        return g;
+    }
+};
+
+Halide::RegisterGenerator<MemoizeThreads> register_my_gen{"memoize_threads"};
+
+}  // namespace
@@ -0,0 +1,83 @@
+#include "HalideRuntime.h"
+#include "HalideBuffer.h"
+
+#include <stdio.h>
+
+#include "nested_parallel_numa.h"
+
+using namespace Halide::Runtime;
+
+bool run_and_check() {
+    Buffer<int> out(8, 100, 12);
+    int ret = nested_parallel_numa(out);
+    if (ret) {
+        printf("Non zero exit code: %d\n", ret);
+        return false;
+    }
+    for (int z = 0; z < out.channels(); z++) {
+        for (int y = 0; y < out.height(); y++) {
+            for (int x = 0; x < out.width(); x++) {
+                int correct = x;
+                for (int r = 0; r < y % 8 * 8; r++) {
+                    correct += r + y * 3 + z * 5;
+                }
+                if (out(x, y, z) != correct) {
+                    printf("out(%d, %d, %d) = %d instead of %d\n",
+                           x, y, z, out(x, y, z), correct);
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    // Pretend to be a machine with three NUMA nodes of 32 cpus each,
+    // with the nodes numbered sparsely and the cpus of each node not
+    // contiguous.
+    const int num_cpus = 96;
+    int cpu_nodes[num_cpus];
+    for (int i = 0; i < num_cpus; i++) {
+        cpu_nodes[i] = (i % 3) * 10;
+    }
+    if (halide_set_cpu_topology(num_cpus, cpu_nodes) != 3) {
+        printf("Expected three NUMA nodes\n");
+        return -1;
+    }
+    int got_nodes[num_cpus];
+    int num_nodes = 0;
+    if (halide_get_cpu_topology(num_cpus, got_nodes, &num_nodes) != num_cpus || num_nodes != 3) {
+        printf("halide_get_cpu_topology doesn't report the topology that was set\n");
+        return -1;
+    }
+    for (int i = 0; i < num_cpus; i++) {
+        if (got_nodes[i] != i % 3) {
+            printf("cpu %d is on node %d instead of %d\n", i, got_nodes[i], i % 3);
+            return -1;
+        }
+    }
+
+    // More threads than the thread pool used to be able to hold.
+    halide_set_num_threads(100);
+    for (int i = 0; i < 20; i++) {
+        if (!run_and_check()) {
+            return -1;
+        }
+    }
+
+    // Shutting down forgets the topology, and the pool starts up
+    // again on the next use.
+    halide_shutdown_thread_pool();
+    if (halide_get_cpu_topology(0, NULL, &num_nodes) < 1 || num_nodes < 1) {
+        printf("No topology after shutting down the thread pool\n");
+        return -1;
+    }
+    halide_set_num_threads(3);
+    if (!run_and_check()) {
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
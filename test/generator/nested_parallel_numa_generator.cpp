@@ -0,0 +1,27 @@
+#include "Halide.h"
+
+namespace {
+
+class NestedParallelNuma : public Halide::Generator<NestedParallelNuma> {
+public:
+    Func build() {
+        // Three levels of parallel loops, the innermost of which has
+        // fewer iterations than there are threads, and rows of uneven
+        // cost, so that the slices of each job get stolen from.
+        Func f, g;
+        Var x, y, z;
+
+        RDom r(0, 64);
+        f(x, y, z) = x + y * 3 + z * 5;
+        g(x, y, z) = sum(select(r < y % 8 * 8, f(r, y, z), 0)) + x;
+
+        g.parallel(z).parallel(y);
+        f.compute_at(g, y).parallel(x, 16);
+
+        return g;
+    }
+};
+
+Halide::RegisterGenerator<NestedParallelNuma> register_my_gen{"nested_parallel_numa"};
+
+}  // namespace
@@ -0,0 +1,157 @@
+#include "HalideRuntime.h"
+#include "HalideBuffer.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "pooled_malloc.h"
+
+using namespace Halide::Runtime;
+
+#ifdef __linux__
+
+const int kSize = 128;
+const int kNumThreads = 4;
+const int kIterations = 1000;
+
+halide_pooled_malloc_stats_t get_stats() {
+    halide_pooled_malloc_stats_t stats;
+    halide_pooled_malloc_get_stats(&stats);
+    return stats;
+}
+
+bool run_pipeline() {
+    Buffer<int32_t> out(kSize, kSize);
+    if (pooled_malloc(out) != 0) {
+        printf("pooled_malloc failed\n");
+        return false;
+    }
+    for (int y = 0; y < kSize; y++) {
+        for (int x = 0; x < kSize; x++) {
+            int correct = x + y * 256 + (x + 1) + (y + 1) * 256;
+            if (out(x, y) != correct) {
+                printf("out(%d, %d) = %d instead of %d\n", x, y, out(x, y), correct);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+volatile bool failed = false;
+
+void malloc_and_free(void *arg) {
+    size_t size = (size_t)(uintptr_t)arg;
+    for (int i = 0; i < kIterations; i++) {
+        uint8_t *p = (uint8_t *)halide_malloc(NULL, size);
+        if (!p) {
+            failed = true;
+            return;
+        }
+        p[0] = p[size - 1] = (uint8_t)i;
+        halide_free(NULL, p);
+    }
+}
+
+#endif
+
+int main(int argc, char **argv) {
+#ifdef __linux__
+    // The first run allocates f from the system. Later runs get the
+    // same block back from the pool.
+    halide_pooled_malloc_stats_t before = get_stats();
+    for (int i = 0; i < 10; i++) {
+        if (!run_pipeline()) {
+            return -1;
+        }
+    }
+    halide_pooled_malloc_stats_t after = get_stats();
+    if (after.allocations - before.allocations != 10 ||
+        after.system_allocations - before.system_allocations != 1 ||
+        after.pool_hits - before.pool_hits != 9 ||
+        after.bytes_in_use != before.bytes_in_use ||
+        after.bytes_cached <= before.bytes_cached) {
+        printf("f was not reused from the pool: %llu allocations, %llu from the system, %llu from the pool\n",
+               (unsigned long long)(after.allocations - before.allocations),
+               (unsigned long long)(after.system_allocations - before.system_allocations),
+               (unsigned long long)(after.pool_hits - before.pool_hits));
+        return -1;
+    }
+
+    // Blocks are aligned, and a block freed is handed out again to the
+    // next allocation of its size from the same thread.
+    for (size_t size : {1, 100, 257, 1000, 4096, 100000}) {
+        void *p = halide_malloc(NULL, size);
+        if (!p || ((uintptr_t)p % 128) != 0) {
+            printf("Bad allocation of %d bytes: %p\n", (int)size, p);
+            return -1;
+        }
+        memset(p, 0, size);
+        halide_free(NULL, p);
+        void *q = halide_malloc(NULL, size);
+        halide_free(NULL, q);
+        if (q != p) {
+            printf("A block of %d bytes was not reused\n", (int)size);
+            return -1;
+        }
+    }
+
+    // Blocks at least as large as the threshold are mapped directly,
+    // either from reserved huge pages or from ordinary pages advised
+    // to use transparent ones, and are counted as one or the other.
+    const size_t big = 3 * 1024 * 1024;
+    before = get_stats();
+    void *p = halide_malloc(NULL, big);
+    after = get_stats();
+    int64_t mapped = (after.huge_page_bytes + after.thp_advised_bytes) -
+                     (before.huge_page_bytes + before.thp_advised_bytes);
+    if (!p || mapped < (int64_t)big || mapped % (2 * 1024 * 1024) != 0) {
+        printf("A block of %d bytes mapped %lld bytes\n", (int)big, (long long)mapped);
+        return -1;
+    }
+    memset(p, 0, big);
+    halide_free(NULL, p);
+
+    // Threads mostly get their blocks from their own shards, and
+    // never hold more than one block at a time.
+    before = get_stats();
+    halide_thread *threads[kNumThreads];
+    for (int i = 0; i < kNumThreads; i++) {
+        threads[i] = halide_spawn_thread(malloc_and_free, (void *)(uintptr_t)(5000 + i));
+    }
+    for (int i = 0; i < kNumThreads; i++) {
+        halide_join_thread(threads[i]);
+    }
+    after = get_stats();
+    if (failed ||
+        after.allocations - before.allocations != kNumThreads * kIterations ||
+        after.system_allocations - before.system_allocations > kNumThreads ||
+        after.bytes_in_use != before.bytes_in_use) {
+        printf("Threads allocated %llu blocks from the system\n",
+               (unsigned long long)(after.system_allocations - before.system_allocations));
+        return -1;
+    }
+
+    // With no room in the pool, everything cached goes back to the
+    // system, including the mapped block.
+    halide_pooled_malloc_set_limits(0, 2 * 1024 * 1024);
+    after = get_stats();
+    if (after.bytes_cached != 0 || after.huge_page_bytes != 0 || after.thp_advised_bytes != 0) {
+        printf("%lld bytes are still cached, %lld of them mapped\n",
+               (long long)after.bytes_cached, (long long)(after.huge_page_bytes + after.thp_advised_bytes));
+        return -1;
+    }
+    if (!run_pipeline()) {
+        return -1;
+    }
+    if (get_stats().bytes_cached != 0) {
+        printf("A block was cached with no room in the pool\n");
+        return -1;
+    }
+#else
+    printf("Skipping test: the pooling allocator is Linux-only\n");
+#endif
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,24 @@
+#include "Halide.h"
+
+namespace {
+
+class PooledMalloc : public Halide::Generator<PooledMalloc> {
+public:
+    Func build() {
+        // f is too big for the stack, so each run of the pipeline
+        // allocates it on the heap.
+        Func f("f"), g("g");
+        Var x, y;
+
+        f(x, y) = x + y * 256;
+        g(x, y) = f(x, y) + f(x + 1, y + 1);
+
+        f.compute_root();
+
+        return g;
+    }
+};
+
+Halide::RegisterGenerator<PooledMalloc> register_my_gen{"pooled_malloc"};
+
+}  // namespace
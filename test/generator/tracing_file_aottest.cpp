@@ -0,0 +1,194 @@
+#include "HalideRuntime.h"
+#include "HalideBuffer.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "tracing_file.h"
+#include "test/common/halide_test_dirs.h"
+
+using namespace Halide::Runtime;
+
+const int kSize = 4;
+
+std::string read_file(const std::string &filename) {
+    std::string contents;
+    FILE *f = fopen(filename.c_str(), "rb");
+    if (!f) {
+        return contents;
+    }
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        contents.append(buf, n);
+    }
+    fclose(f);
+    return contents;
+}
+
+int count(const std::string &s, const std::string &pattern) {
+    int n = 0;
+    for (size_t i = s.find(pattern); i != std::string::npos; i = s.find(pattern, i + 1)) {
+        n++;
+    }
+    return n;
+}
+
+// Run the pipeline with the default trace handler writing to the
+// given file, and return what it wrote.
+std::string trace_to_file(const std::string &filename) {
+    FILE *f = fopen(filename.c_str(), "wb");
+    if (!f) {
+        printf("Could not open %s\n", filename.c_str());
+        return "";
+    }
+    halide_set_trace_file(fileno(f));
+
+    Buffer<int32_t> out(kSize, kSize);
+    if (tracing_file(out) != 0) {
+        printf("tracing_file failed\n");
+    }
+    for (int y = 0; y < kSize; y++) {
+        for (int x = 0; x < kSize; x++) {
+            if (out(x, y) != (x + y * 10) * 2) {
+                printf("out(%d, %d) = %d\n", x, y, out(x, y));
+                return "";
+            }
+        }
+    }
+
+    // A realization named by the user can have quotes and
+    // backslashes in its name.
+    halide_trace_event_t event;
+    memset(&event, 0, sizeof(event));
+    event.func = "a \"quoted\\name\"";
+    event.event = halide_trace_begin_realization;
+    event.type = halide_type_of<int32_t>();
+    halide_default_trace(NULL, &event);
+    event.event = halide_trace_end_realization;
+    halide_default_trace(NULL, &event);
+
+    // Changing the trace file writes out everything buffered for
+    // this one.
+    halide_set_trace_file(0);
+    fclose(f);
+    return read_file(filename);
+}
+
+bool check_packets(const std::string &trace) {
+    std::vector<const halide_trace_packet_t *> packets;
+    for (size_t i = 0; i < trace.size();) {
+        const halide_trace_packet_t *p = (const halide_trace_packet_t *)(trace.data() + i);
+        if (p->size < sizeof(halide_trace_packet_t) || p->size % 4 || i + p->size > trace.size()) {
+            printf("Bad packet size %u at offset %d\n", p->size, (int)i);
+            return false;
+        }
+        packets.push_back(p);
+        i += p->size;
+    }
+    if (packets.size() < 2 ||
+        packets[0]->event != halide_trace_begin_pipeline ||
+        strcmp(packets[0]->func(), "tracing_file") ||
+        packets[packets.size() - 3]->event != halide_trace_end_pipeline) {
+        printf("The pipeline's events are not at the start and end of the trace\n");
+        return false;
+    }
+
+    int begin_realizations = 0, end_realizations = 0;
+    int produce_f = 0, produce_g = 0, stores = 0;
+    int f_id = 0;
+    for (const halide_trace_packet_t *p : packets) {
+        std::string func = p->func();
+        switch (p->event) {
+        case halide_trace_begin_realization:
+            begin_realizations++;
+            break;
+        case halide_trace_end_realization:
+            end_realizations++;
+            break;
+        case halide_trace_produce:
+            if (func == "f") {
+                produce_f++;
+                f_id = p->id;
+            } else if (func == "g") {
+                produce_g++;
+            }
+            break;
+        case halide_trace_store: {
+            const int *c = p->coordinates();
+            int value = *(const int32_t *)p->value();
+            if (func != "f" || p->dimensions != 2 || p->parent_id != f_id ||
+                value != c[0] + c[1] * 10) {
+                printf("Bad store to %s(%d, %d) = %d\n", func.c_str(), c[0], c[1], value);
+                return false;
+            }
+            stores++;
+            break;
+        }
+        default:
+            break;
+        }
+    }
+    // Realizations of f, g and the one made by hand.
+    if (begin_realizations != 3 || end_realizations != 3 ||
+        produce_f != 1 || produce_g != 1 || stores != kSize * kSize) {
+        printf("Expected 3 realizations, one production each of f and g, and %d stores; "
+               "got %d/%d, %d, %d and %d\n", kSize * kSize,
+               begin_realizations, end_realizations, produce_f, produce_g, stores);
+        return false;
+    }
+    if (strcmp(packets.back()->func(), "a \"quoted\\name\"")) {
+        printf("The name of the last packet was mangled: %s\n", packets.back()->func());
+        return false;
+    }
+    return true;
+}
+
+bool check_chrome(const std::string &trace) {
+    if (trace.compare(0, 2, "[\n") || trace.size() < 3 ||
+        trace.compare(trace.size() - 3, 3, "\n]\n")) {
+        printf("The trace is not a closed JSON array\n");
+        return false;
+    }
+    // Loads and stores are left out. Everything else begins and ends
+    // an interval.
+    int begins = count(trace, "\"ph\":\"B\"");
+    int ends = count(trace, "\"ph\":\"E\"");
+    if (begins != ends || begins < 6) {
+        printf("%d intervals were begun and %d ended\n", begins, ends);
+        return false;
+    }
+    if (count(trace, "{\"name\":\"tracing_file\",\"cat\":\"pipeline\"") != 1 ||
+        count(trace, "{\"name\":\"f\",\"cat\":\"realization\"") != 1 ||
+        count(trace, "{\"name\":\"f\",\"cat\":\"produce\"") != 1 ||
+        count(trace, "{\"name\":\"f\",\"cat\":\"consume\"") != 1 ||
+        count(trace, "{\"name\":\"g\",\"cat\":\"produce\"") != 1 ||
+        count(trace, "\"region\":[0,4,0,4]") < 3) {
+        printf("Missing events:\n%s\n", trace.c_str());
+        return false;
+    }
+    if (count(trace, "{\"name\":\"a \\\"quoted\\\\name\\\"\",\"cat\":\"realization\"") != 1) {
+        printf("The quoted name was not escaped:\n%s\n", trace.c_str());
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    std::string dir = Halide::Internal::get_test_tmp_dir();
+
+    halide_set_trace_format(halide_trace_format_packets);
+    if (!check_packets(trace_to_file(dir + "tracing_file.trace"))) {
+        return -1;
+    }
+
+    halide_set_trace_format(halide_trace_format_chrome);
+    if (!check_chrome(trace_to_file(dir + "tracing_file.json"))) {
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
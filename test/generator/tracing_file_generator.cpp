@@ -0,0 +1,23 @@
+#include "Halide.h"
+
+namespace {
+
+class TracingFile : public Halide::Generator<TracingFile> {
+public:
+    Func build() {
+        Func f("f"), g("g");
+        Var x, y;
+
+        f(x, y) = x + y * 10;
+        g(x, y) = f(x, y) * 2;
+
+        f.compute_root().trace_stores().trace_realizations();
+        g.trace_realizations();
+
+        return g;
+    }
+};
+
+Halide::RegisterGenerator<TracingFile> register_my_gen{"tracing_file"};
+
+}  // namespace
@@ -17,6 +17,7 @@
 #include "Interval.h"
 #include "Associativity.h"
 #include "Generator.h"
+#include "ShareStencilSums.h"
 
 using namespace Halide;
 using namespace Halide::Internal;
@@ -39,6 +40,7 @@ int main(int argc, const char **argv) {
     interval_test();
     associativity_test();
     generator_test();
+    share_stencil_sums_test();
 
     return 0;
 }
@@ -0,0 +1,52 @@
+#include "Halide.h"
+#include "halide_benchmark.h"
+#include <stdio.h>
+
+using namespace Halide;
+using namespace Halide::Tools;
+
+int main(int argc, char **argv) {
+    ImageParam in(Int(32), 2);
+    Param<int> offset;
+    Func f;
+    Var x, y;
+    f(x, y) = in(x, y) * 2 + offset;
+
+    Buffer<int> input(8, 8), output(8, 8);
+    input.for_each_element([&](int x, int y) { input(x, y) = x + y * 8; });
+    in.set(input);
+    offset.set(3);
+
+    f.compile_jit();
+    JITCallable callable = f.compile_to_callable();
+
+    // Changes to the Params after binding should still be seen.
+    offset.set(5);
+    callable(output);
+    for (int y = 0; y < 8; y++) {
+        for (int x = 0; x < 8; x++) {
+            int correct = (x + y * 8) * 2 + 5;
+            if (output(x, y) != correct) {
+                printf("output(%d, %d) = %d instead of %d\n", x, y, output(x, y), correct);
+                return -1;
+            }
+        }
+    }
+
+    // Time the per-call overhead of realizing a tiny output.
+    const int iters = 10000;
+    double t_realize = benchmark(10, iters, [&]() { f.realize(output); });
+    double t_callable = benchmark(10, iters, [&]() { callable(output); });
+
+    printf("Per-call latency of realize: %f us\n"
+           "Per-call latency of a JITCallable: %f us\n",
+           t_realize * 1e6, t_callable * 1e6);
+
+    if (t_callable > t_realize) {
+        printf("Calling a JITCallable was slower than calling realize\n");
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
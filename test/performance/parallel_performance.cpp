@@ -43,11 +43,45 @@ int main(int argc, char **argv) {
     double speedup = serialTime / parallelTime;
     printf("Speedup: %f\n", speedup);
 
+    // A parallel loop with many cheap iterations, which mostly
+    // measures the overhead of handing out tasks in the thread pool.
+    Func fine_parallel, fine_serial;
+    Expr cheap = cast<float>(x + y) * 0.5f;
+    fine_parallel(x, y) = cheap;
+    fine_serial(x, y) = cheap;
+    fine_parallel.parallel(y);
+
+    Buffer<float> fine_imf = fine_parallel.realize(16, 16*1024);
+    Buffer<float> fine_img = fine_serial.realize(16, 16*1024);
+    double fineParallelTime = benchmark(10, 1, [&]() { fine_parallel.realize(fine_imf); });
+    double fineSerialTime = benchmark(10, 1, [&]() { fine_serial.realize(fine_img); });
+
+    for (int y = 0; y < fine_imf.height(); y++) {
+        for (int x = 0; x < fine_imf.width(); x++) {
+            if (fine_imf(x, y) != fine_img(x, y)) {
+                printf("fine_imf(%d, %d) = %f\n", x, y, fine_imf(x, y));
+                printf("fine_img(%d, %d) = %f\n", x, y, fine_img(x, y));
+                return -1;
+            }
+        }
+    }
+
+    printf("Fine-grained times: %f %f\n", fineSerialTime, fineParallelTime);
+    double fineSpeedup = fineSerialTime / fineParallelTime;
+    printf("Fine-grained speedup: %f\n", fineSpeedup);
+
     if (speedup < 1.5) {
         fprintf(stderr, "WARNING: Parallel should be faster\n");
         return 0;
     }
 
+    // Handing out the tasks shouldn't cost more than the iterations
+    // themselves.
+    if (fineSpeedup < 1.0) {
+        fprintf(stderr, "WARNING: Fine-grained parallel loop is slower than the serial one\n");
+        return 0;
+    }
+
     printf("Success!\n");
     return 0;
 }
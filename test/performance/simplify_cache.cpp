@@ -0,0 +1,64 @@
+#include "Halide.h"
+#include "halide_benchmark.h"
+#include <stdio.h>
+
+using namespace Halide;
+using namespace Halide::Tools;
+
+// A chain of fully unrolled stencils, like those in the HLS apps, which
+// are full of structurally identical subexpressions.
+Func make_pipeline(ImageParam in) {
+    Var x("x"), y("y");
+    Func clamped = BoundaryConditions::repeat_edge(in);
+    Func prev = clamped;
+    for (int stage = 0; stage < 4; stage++) {
+        Func f("stage_" + std::to_string(stage)), normalized;
+        RDom r(-2, 5, -2, 5);
+        f(x, y) = 0;
+        f(x, y) += prev(x + r.x, y + r.y) * (r.x + r.y + stage + 3);
+        f.compute_root().vectorize(x, 8);
+        f.update().vectorize(x, 8).unroll(r.x).unroll(r.y);
+        normalized(x, y) = f(x, y) / 64;
+        prev = normalized;
+    }
+    return prev;
+}
+
+double time_compile(bool use_cache, Buffer<int> *output) {
+    Internal::set_simplify_cache_enabled(use_cache);
+    ImageParam in(Int(32), 2);
+    Buffer<int> input(64, 64);
+    input.for_each_element([&](int x, int y) { input(x, y) = (x * 17 + y * 31) % 256; });
+    in.set(input);
+
+    double t = benchmark(3, 1, [&]() {
+        make_pipeline(in).compile_to_module({in});
+    });
+
+    make_pipeline(in).realize(*output);
+    return t;
+}
+
+int main(int argc, char **argv) {
+    Buffer<int> without_cache(64, 64), with_cache(64, 64);
+    double t_without = time_compile(false, &without_cache);
+    double t_with = time_compile(true, &with_cache);
+    Internal::set_simplify_cache_enabled(false);
+
+    printf("Lowering without the simplify cache: %f ms\n"
+           "Lowering with the simplify cache: %f ms\n",
+           t_without * 1e3, t_with * 1e3);
+
+    for (int y = 0; y < 64; y++) {
+        for (int x = 0; x < 64; x++) {
+            if (with_cache(x, y) != without_cache(x, y)) {
+                printf("with_cache(%d, %d) = %d instead of %d\n",
+                       x, y, with_cache(x, y), without_cache(x, y));
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}